@@ -25,6 +25,7 @@
 #include <time.h>
 #include <stdbool.h>
 #include <future>
+#include <mutex>
 // #include "vp_bpu.h"
 
 #include "bpu_wrapper.h"
@@ -179,8 +180,361 @@ int hb_bpu_start_predict(bpu_module *bpu_handle, char *frame_buffer)
     return 0;
 }
 
+/*
+ * 用 frame 中的NV12数据构造输入tensor
+ * 帧宽度与stride相同且Y/UV平面连续(NV12_SEPARATE输入不要求连续)时，sysMem 直接指向帧的hb_mem缓存，
+ * BPU通过物理地址读取，不需要拷贝和刷cache；否则按行拷贝到 copy_tensor 的缓存中
+ * @return 0成功，帧与模型输入尺寸不一致返回-1
+ */
+static int32_t hb_bpu_frame_to_tensor(const hbDNNTensor *copy_tensor, ImageFrame *frame, hbDNNTensor *input)
+{
+    *input = *copy_tensor;
+    int32_t tensor_type = input->properties.tensorType;
+    int32_t height = input->properties.validShape.dimensionSize[2];
+    int32_t width = input->properties.validShape.dimensionSize[3];
+    if (frame->width != width || frame->height != height || frame->plane_count < 1)
+    {
+        printf("[BPU ERR] %s:frame %dx%d does not match model input %dx%d!\n",
+               __func__, frame->width, frame->height, width, height);
+        return -1;
+    }
+
+    uint32_t y_size = width * height;
+    uint32_t uv_size = y_size / 2;
+    bool packed = frame->stride == width;
+    if (packed && frame->plane_count == 2 && tensor_type == HB_DNN_IMG_TYPE_NV12_SEPARATE)
+    {
+        input->sysMem[0].phyAddr = frame->pdata[0];
+        input->sysMem[0].virAddr = frame->data[0];
+        input->sysMem[0].memSize = y_size;
+        input->sysMem[1].phyAddr = frame->pdata[1];
+        input->sysMem[1].virAddr = frame->data[1];
+        input->sysMem[1].memSize = uv_size;
+        return 0;
+    }
+    if (packed && tensor_type == HB_DNN_IMG_TYPE_NV12 &&
+        (frame->plane_count == 1 || frame->pdata[1] == frame->pdata[0] + y_size))
+    {
+        input->sysMem[0].phyAddr = frame->pdata[0];
+        input->sysMem[0].virAddr = frame->data[0];
+        input->sysMem[0].memSize = y_size + uv_size;
+        return 0;
+    }
+
+    // 不能零拷贝时按行拷贝到模块自带的输入缓存，仍然比先拷贝到用户数组再拷贝少一次
+    char *dst = static_cast<char *>(input->sysMem[0].virAddr);
+    const uint8_t *src_y = frame->data[0];
+    const uint8_t *src_uv = frame->plane_count > 1
+                                ? frame->data[1]
+                                : frame->data[0] + frame->stride * (frame->vstride > 0 ? frame->vstride : height);
+    for (int32_t h = 0; h < height; h++)
+    {
+        memcpy(dst + h * width, src_y + h * frame->stride, width);
+    }
+    for (int32_t h = 0; h < height / 2; h++)
+    {
+        memcpy(dst + y_size + h * width, src_uv + h * frame->stride, width);
+    }
+    hbSysFlushMem(input->sysMem, HB_SYS_MEM_CACHE_CLEAN);
+    if (tensor_type == HB_DNN_IMG_TYPE_NV12_SEPARATE)
+    {
+        input->sysMem[1].phyAddr = input->sysMem[0].phyAddr + y_size;
+        input->sysMem[1].virAddr = dst + y_size;
+        input->sysMem[1].memSize = uv_size;
+        input->sysMem[0].memSize = y_size;
+    }
+    return 0;
+}
+
+int hb_bpu_start_predict_frame(bpu_module *bpu_handle, ImageFrame *frame)
+{
+    hbDNNTensor input;
+    if (hb_bpu_frame_to_tensor(&(bpu_handle->input_tensor), frame, &input))
+    {
+        return -1;
+    }
+
+    hbDNNTaskHandle_t task_handle = nullptr;
+    hbDNNInferCtrlParam infer_ctrl_param;
+    HB_DNN_INITIALIZE_INFER_CTRL_PARAM(&infer_ctrl_param);
+    int32_t ret = hbDNNInfer(&task_handle,
+                             &(bpu_handle->output_tensor),
+                             &input,
+                             bpu_handle->m_dnn_handle,
+                             &infer_ctrl_param);
+    if (ret)
+    {
+        printf("[BPU ERR] %s:hbDNNInfer failed!Error code:%d\n", __func__, ret);
+        return ret;
+    }
+    // 帧在任务完成前不能归还，这里等待完成后再返回
+    hbDNNWaitTaskDone(task_handle, 0);
+    hbSysFlushMem(&(bpu_handle->output_tensor->sysMem[0]), HB_SYS_MEM_CACHE_INVALIDATE);
+    hbDNNReleaseTask(task_handle);
+    return 0;
+}
+
+// hb_bpu_submit 提交的一个任务
+typedef struct
+{
+    hbDNNTensor input_tensor;      // 每个任务独立的输入，不会被后面提交的帧覆盖
+    hbDNNTensor infer_input;       // 实际提交的输入，零拷贝时指向调用者的帧
+    hbDNNTensor *output_tensor;    // 模型输出个数个
+    hbDNNTaskHandle_t task_handle; // 任务完成并被取走之前非空
+    int32_t task_id;               // 最近一次使用该槽的任务编号，-1表示没有使用过
+    ImageFrame frame;              // hb_bpu_submit_frame 提交的帧，任务结束后归还
+    hb_bpu_frame_release frame_release;
+    void *frame_user_data;
+} bpu_async_slot;
+
+struct bpu_async_ring
+{
+    std::mutex mutex;
+    int32_t output_count;
+    int32_t next_task_id;
+    bpu_async_slot slots[HB_BPU_ASYNC_SLOT_NUM];
+};
+
+// 保护 bpu_module.m_async 的创建
+static std::mutex bpu_async_create_mutex;
+
+static void hb_bpu_destroy_async_ring(bpu_async_ring *ring)
+{
+    for (int i = 0; i < HB_BPU_ASYNC_SLOT_NUM; i++)
+    {
+        bpu_async_slot &slot = ring->slots[i];
+        if (slot.task_handle)
+        {
+            hbDNNWaitTaskDone(slot.task_handle, 0);
+            hbDNNReleaseTask(slot.task_handle);
+        }
+        if (slot.frame_release)
+        {
+            slot.frame_release(&(slot.frame), slot.frame_user_data);
+        }
+        if (slot.input_tensor.sysMem[0].virAddr)
+        {
+            hbSysFreeMem(&(slot.input_tensor.sysMem[0]));
+        }
+        if (slot.output_tensor)
+        {
+            hb_bpu_deinit_tensor(slot.output_tensor, ring->output_count);
+            delete[] slot.output_tensor;
+        }
+    }
+    delete ring;
+}
+
+static bpu_async_ring *hb_bpu_get_async_ring(bpu_module *bpu_handle)
+{
+    std::lock_guard<std::mutex> lock(bpu_async_create_mutex);
+    if (bpu_handle->m_async)
+    {
+        return bpu_handle->m_async;
+    }
+
+    bpu_async_ring *ring = new bpu_async_ring();
+    int32_t ret = hbDNNGetOutputCount(&ring->output_count, bpu_handle->m_dnn_handle);
+    if (ret)
+    {
+        printf("[BPU ERR] %s:hbDNNGetOutputCount failed!Error code:%d\n", __func__, ret);
+        delete ring;
+        return nullptr;
+    }
+
+    hbDNNTensorProperties &input_properties = bpu_handle->input_tensor.properties;
+    int32_t yuv_length = input_properties.validShape.dimensionSize[2] * input_properties.validShape.dimensionSize[3] * 3 / 2;
+    for (int i = 0; i < HB_BPU_ASYNC_SLOT_NUM; i++)
+    {
+        bpu_async_slot &slot = ring->slots[i];
+        slot.task_id = -1;
+        slot.input_tensor.properties = input_properties;
+        slot.output_tensor = new hbDNNTensor[ring->output_count]();
+        if (hbSysAllocCachedMem(slot.input_tensor.sysMem, yuv_length) ||
+            hb_bpu_init_tensors(bpu_handle, slot.output_tensor))
+        {
+            printf("[BPU ERR] %s:alloc tensors for async task failed!\n", __func__);
+            hb_bpu_destroy_async_ring(ring);
+            return nullptr;
+        }
+    }
+    bpu_handle->m_async = ring;
+    return ring;
+}
+
+/*
+ * 取环中的下一个槽，fill_input(slot) 准备好 slot.infer_input 后提交
+ * fill_input 返回非0时放弃提交
+ */
+template <typename FillInput>
+static int hb_bpu_submit_slot(bpu_module *bpu_handle, FillInput fill_input)
+{
+    bpu_async_ring *ring = hb_bpu_get_async_ring(bpu_handle);
+    if (ring == nullptr)
+    {
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> lock(ring->mutex);
+    int32_t task_id = ring->next_task_id;
+    bpu_async_slot &slot = ring->slots[task_id % HB_BPU_ASYNC_SLOT_NUM];
+    if (slot.task_handle)
+    {
+        printf("[BPU ERR] %s:%d tasks in flight, wait task %d first!\n",
+               __func__, HB_BPU_ASYNC_SLOT_NUM, slot.task_id);
+        return -1;
+    }
+    if (fill_input(slot))
+    {
+        return -1;
+    }
+
+    hbDNNInferCtrlParam infer_ctrl_param;
+    HB_DNN_INITIALIZE_INFER_CTRL_PARAM(&infer_ctrl_param);
+    hbDNNTaskHandle_t task_handle = nullptr;
+    int32_t ret = hbDNNInfer(&task_handle,
+                             &(slot.output_tensor),
+                             &(slot.infer_input),
+                             bpu_handle->m_dnn_handle,
+                             &infer_ctrl_param);
+    if (ret)
+    {
+        printf("[BPU ERR] %s:hbDNNInfer failed!Error code:%d\n", __func__, ret);
+        if (task_handle)
+        {
+            hbDNNReleaseTask(task_handle);
+        }
+        // 提交失败时帧仍归调用者
+        slot.frame_release = nullptr;
+        return -1;
+    }
+    slot.task_handle = task_handle;
+    slot.task_id = task_id;
+    // 2^31 是槽数的整数倍，编号回绕后槽的对应关系不变
+    ring->next_task_id = (task_id + 1) & 0x7FFFFFFF;
+    return task_id;
+}
+
+int hb_bpu_submit(bpu_module *bpu_handle, char *frame_buffer)
+{
+    return hb_bpu_submit_slot(bpu_handle, [frame_buffer](bpu_async_slot &slot) {
+        // copy NV12data from frame_buffer to this task's input tensor
+        int32_t height = slot.input_tensor.properties.validShape.dimensionSize[2];
+        int32_t width = slot.input_tensor.properties.validShape.dimensionSize[3];
+        int32_t yuv_length = height * width * 3 / 2;
+        memcpy(slot.input_tensor.sysMem[0].virAddr, frame_buffer, yuv_length);
+        hbSysFlushMem(slot.input_tensor.sysMem, HB_SYS_MEM_CACHE_CLEAN);
+        slot.infer_input = slot.input_tensor;
+        return 0;
+    });
+}
+
+int hb_bpu_submit_frame(bpu_module *bpu_handle, ImageFrame *frame,
+                        hb_bpu_frame_release release, void *user_data)
+{
+    return hb_bpu_submit_slot(bpu_handle, [frame, release, user_data](bpu_async_slot &slot) {
+        if (hb_bpu_frame_to_tensor(&(slot.input_tensor), frame, &(slot.infer_input)))
+        {
+            return -1;
+        }
+        slot.frame = *frame;
+        slot.frame_release = release;
+        slot.frame_user_data = user_data;
+        return 0;
+    });
+}
+
+int hb_bpu_wait(bpu_module *bpu_handle, int task_id, int timeout_ms, hbDNNTensor **output_tensors)
+{
+    bpu_async_ring *ring = bpu_handle->m_async;
+    if (ring == nullptr || task_id < 0)
+    {
+        printf("[BPU ERR] %s:invalid task id %d!\n", __func__, task_id);
+        return -1;
+    }
+
+    bpu_async_slot &slot = ring->slots[task_id % HB_BPU_ASYNC_SLOT_NUM];
+    hbDNNTaskHandle_t task_handle;
+    {
+        std::lock_guard<std::mutex> lock(ring->mutex);
+        if (slot.task_id != task_id)
+        {
+            printf("[BPU ERR] %s:task %d has been overwritten or not submitted!\n", __func__, task_id);
+            return -1;
+        }
+        task_handle = slot.task_handle;
+    }
+
+    // 不持有锁等待，等待期间其他线程可以继续提交任务
+    if (task_handle)
+    {
+        int32_t ret = hbDNNWaitTaskDone(task_handle, timeout_ms);
+        if (ret == HB_DNN_TIMEOUT)
+        {
+            return ret;
+        }
+        if (ret)
+        {
+            // 任务失败，释放句柄让出槽，否则之后每轮提交都会卡在这个槽上
+            printf("[BPU ERR] %s:task %d failed!Error code:%d\n", __func__, task_id, ret);
+        }
+        else
+        {
+            for (int i = 0; i < ring->output_count; i++)
+            {
+                hbSysFlushMem(&(slot.output_tensor[i].sysMem[0]), HB_SYS_MEM_CACHE_INVALIDATE);
+            }
+        }
+        hbDNNReleaseTask(task_handle);
+
+        // 清空 task_handle 后槽可能马上被其他线程复用，先取出帧，解锁后再归还
+        ImageFrame frame;
+        hb_bpu_frame_release frame_release;
+        void *frame_user_data;
+        {
+            std::lock_guard<std::mutex> lock(ring->mutex);
+            frame = slot.frame;
+            frame_release = slot.frame_release;
+            frame_user_data = slot.frame_user_data;
+            slot.frame_release = nullptr;
+            slot.task_handle = nullptr;
+            if (ret)
+            {
+                slot.task_id = -1;
+            }
+        }
+        if (frame_release)
+        {
+            frame_release(&frame, frame_user_data);
+        }
+        if (ret)
+        {
+            return HB_BPU_TASK_FAILED;
+        }
+    }
+    if (output_tensors)
+    {
+        *output_tensors = slot.output_tensor;
+    }
+    return 0;
+}
+
+int hb_bpu_try_poll(bpu_module *bpu_handle, int task_id, hbDNNTensor **output_tensors)
+{
+    int32_t ret = hb_bpu_wait(bpu_handle, task_id, 1, output_tensors);
+    if (ret == HB_DNN_TIMEOUT)
+    {
+        return 1;
+    }
+    return ret;
+}
+
 int hb_bpu_predict_unint(bpu_module *handle)
 {
+    if (handle->m_async)
+    {
+        hb_bpu_destroy_async_ring(handle->m_async);
+    }
     hbSysFreeMem(&(handle->input_tensor.sysMem[0]));
     hbDNNRelease(handle->m_packed_dnn_handle);
     free(handle);
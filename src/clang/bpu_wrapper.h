@@ -22,6 +22,7 @@
 
 #include "sp_bpu.h"
 #include "dnn/hb_dnn.h"
+#include "vp_common.h"
 
 #ifdef __cplusplus
 extern "C"
@@ -34,6 +35,55 @@ int hb_bpu_init_tensors(bpu_module *bpu_handle, hbDNNTensor *output_tensors);
 int hb_bpu_deinit_tensor(hbDNNTensor *tensor, int32_t len);
 int hb_bpu_start_predict(bpu_module *bpu_handle, char *frame_buffer);
 int hb_bpu_predict_unint(bpu_module *handle);
+
+/*
+ * 零拷贝推理：直接用VSE等模块输出的NV12帧(hb_mem物理地址)作为输入tensor，
+ * 省去拷贝到用户数组、再拷贝到输入tensor以及刷cache
+ * 帧的宽高需要与模型输入一致；stride与宽度不同或Y/UV平面不连续时回退为一次按行拷贝
+ * 等待推理完成后返回，调用者之后才能归还帧
+ */
+int hb_bpu_start_predict_frame(bpu_module *bpu_handle, ImageFrame *frame);
+
+// 每个 bpu_module 最多同时进行的异步任务数
+#define HB_BPU_ASYNC_SLOT_NUM 4
+// hb_bpu_wait/hb_bpu_try_poll：任务执行失败，任务已释放，不能再次等待
+#define HB_BPU_TASK_FAILED (-2)
+
+/*
+ * 异步推理：拷贝一帧NV12数据后提交给BPU，不等待完成
+ * 每个任务使用环中独立的输入/输出tensor，最多 HB_BPU_ASYNC_SLOT_NUM 个任务同时进行，
+ * 任务 k 的输出在提交任务 k + HB_BPU_ASYNC_SLOT_NUM 之前一直有效
+ * 返回任务编号(>=0)；下一个槽中的任务还没有被 hb_bpu_wait/hb_bpu_try_poll 取走时返回-1
+ */
+int hb_bpu_submit(bpu_module *bpu_handle, char *frame_buffer);
+
+// hb_bpu_submit_frame 提交的帧在任务结束后通过该回调归还
+typedef void (*hb_bpu_frame_release)(ImageFrame *frame, void *user_data);
+
+/*
+ * hb_bpu_submit 的零拷贝版本，输入规则同 hb_bpu_start_predict_frame
+ * 提交成功后帧由任务持有：hb_bpu_wait/hb_bpu_try_poll 得到任务完成或失败时调用 release(frame, user_data) 归还，
+ * release 为NULL时由调用者在任务结束后自行归还
+ * 提交失败时不会调用 release
+ */
+int hb_bpu_submit_frame(bpu_module *bpu_handle, ImageFrame *frame,
+                        hb_bpu_frame_release release, void *user_data);
+
+/*
+ * 等待任务完成，timeout_ms 为0时一直等待
+ * 完成后 output_tensors 指向该任务的输出tensor数组(已做cache invalidate)，个数与模型输出个数相同
+ * 返回0成功，超时返回 HB_DNN_TIMEOUT(任务仍在进行，可以再次等待)，任务编号无效返回-1，
+ * 任务执行失败返回 HB_BPU_TASK_FAILED，此时任务已释放，槽可以被新的任务使用
+ * 同一个任务只能在一个线程中等待
+ */
+int hb_bpu_wait(bpu_module *bpu_handle, int task_id, int timeout_ms, hbDNNTensor **output_tensors);
+
+/*
+ * 查询任务是否完成，完成时与 hb_bpu_wait 相同
+ * 返回0已完成，1仍在进行，任务编号无效返回-1，任务执行失败返回 HB_BPU_TASK_FAILED
+ * hbDNN没有非阻塞的状态查询接口，这里使用最短的1ms超时等待
+ */
+int hb_bpu_try_poll(bpu_module *bpu_handle, int task_id, hbDNNTensor **output_tensors);
 #ifdef __cplusplus
 }
 #endif
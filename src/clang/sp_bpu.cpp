@@ -17,6 +17,10 @@
 #include "dnn/hb_dnn.h"
 #include "sp_bpu.h"
 #include "bpu_wrapper.h"
+#include "vpp_camera.h"
+
+using namespace spdev;
+
 bpu_module *sp_init_bpu_module(const char *model_file_name)
 {
     auto bpu_handle = hb_bpu_predict_init(model_file_name);
@@ -32,6 +36,26 @@ int sp_bpu_start_predict(bpu_module *bpu_handle, char *addr)
     return -1;
 }
 
+int sp_bpu_start_predict_from_vio(bpu_module *bpu_handle, void *vio_obj,
+                                  int32_t width, int32_t height, const int32_t timeout)
+{
+    if (bpu_handle == NULL || vio_obj == NULL)
+    {
+        return -1;
+    }
+    auto sp = static_cast<VPPCamera *>(vio_obj);
+    auto module_enum = static_cast<DevModule>(SP_DEV_VPS);
+    ImageFrame frame = {0};
+    if (sp->GetImageFrame(&frame, module_enum, width, height, timeout))
+    {
+        return -1;
+    }
+    int ret = hb_bpu_start_predict_frame(bpu_handle, &frame);
+    // BPU直接读取VSE的缓存，任务完成后才能归还
+    sp->ReturnImageFrame(&frame, module_enum, width, height);
+    return ret;
+}
+
 int sp_release_bpu_module(bpu_module *bpu_handle)
 {
     if (bpu_handle)
@@ -56,4 +80,62 @@ int sp_deinit_bpu_tensor(hbDNNTensor *tensor, int32_t len)
         return hb_bpu_deinit_tensor(tensor, len);
     }
     return -1;
-}
\ No newline at end of file
+}
+
+int sp_bpu_submit(bpu_module *bpu_handle, char *addr)
+{
+    if (bpu_handle)
+    {
+        return hb_bpu_submit(bpu_handle, addr);
+    }
+    return -1;
+}
+
+// sp_bpu_submit_from_vio 提交的帧在任务结束后归还给 vio 模块
+static void sp_bpu_return_vio_frame(ImageFrame *frame, void *user_data)
+{
+    auto sp = static_cast<VPPCamera *>(user_data);
+    // VPS通道按宽高区分，取到的帧宽高就是取帧时的通道宽高
+    sp->ReturnImageFrame(frame, static_cast<DevModule>(SP_DEV_VPS), frame->width, frame->height);
+}
+
+int sp_bpu_submit_from_vio(bpu_module *bpu_handle, void *vio_obj,
+                           int32_t width, int32_t height, const int32_t timeout)
+{
+    if (bpu_handle == NULL || vio_obj == NULL)
+    {
+        return -1;
+    }
+    auto sp = static_cast<VPPCamera *>(vio_obj);
+    auto module_enum = static_cast<DevModule>(SP_DEV_VPS);
+    ImageFrame frame = {0};
+    if (sp->GetImageFrame(&frame, module_enum, width, height, timeout))
+    {
+        return -1;
+    }
+    int task_id = hb_bpu_submit_frame(bpu_handle, &frame, sp_bpu_return_vio_frame, sp);
+    if (task_id < 0)
+    {
+        // 提交失败时帧没有交给任务，在这里归还
+        sp->ReturnImageFrame(&frame, module_enum, width, height);
+    }
+    return task_id;
+}
+
+int sp_bpu_wait(bpu_module *bpu_handle, int32_t task_id, int32_t timeout_ms, hbDNNTensor **output_tensors)
+{
+    if (bpu_handle)
+    {
+        return hb_bpu_wait(bpu_handle, task_id, timeout_ms, output_tensors);
+    }
+    return -1;
+}
+
+int sp_bpu_try_poll(bpu_module *bpu_handle, int32_t task_id, hbDNNTensor **output_tensors)
+{
+    if (bpu_handle)
+    {
+        return hb_bpu_try_poll(bpu_handle, task_id, output_tensors);
+    }
+    return -1;
+}
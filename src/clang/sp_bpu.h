@@ -43,6 +43,9 @@ extern "C"
     //   const char* class_name;
   } classfiy_result;
 
+  // sp_bpu_submit 使用的异步任务环，定义在 bpu_wrapper.cpp 中
+  struct bpu_async_ring;
+
   typedef struct
   {
     int32_t m_alog_type; // 1:mobilenetV2 2: yolo5 3:personMultitask
@@ -50,16 +53,34 @@ extern "C"
     hbDNNHandle_t m_dnn_handle;
     hbDNNTensor input_tensor;
     hbDNNTensor *output_tensor;
+    struct bpu_async_ring *m_async; // 第一次调用 sp_bpu_submit 时创建
   } bpu_module;
 
   bpu_module *sp_init_bpu_module(const char *model_file_name);
 
   int32_t sp_bpu_start_predict(bpu_module *bpu_handle, char *addr);
+  /*
+   * 从 vio 模块(sp_init_vio_module)宽高为 width x height 的VPS通道取一帧直接推理，
+   * 不经过用户数组拷贝，推理完成后归还该帧；width/height 需要与模型输入一致
+   */
+  int32_t sp_bpu_start_predict_from_vio(bpu_module *bpu_handle, void *vio_obj,
+                                        int32_t width, int32_t height, const int32_t timeout);
 
   int32_t sp_release_bpu_module(bpu_module *bpu_handle);
   int32_t sp_init_bpu_tensors(bpu_module *bpu_handle, hbDNNTensor *output_tensors);
   int32_t sp_deinit_bpu_tensor(hbDNNTensor *tensor, int32_t len);
 
+  // 异步推理，说明见 bpu_wrapper.h 中的 hb_bpu_submit/hb_bpu_wait/hb_bpu_try_poll
+  int32_t sp_bpu_submit(bpu_module *bpu_handle, char *addr);
+  /*
+   * sp_bpu_start_predict_from_vio 的异步版本：取一帧零拷贝提交后立即返回任务编号，失败返回-1
+   * 帧由任务持有，sp_bpu_wait/sp_bpu_try_poll 得到任务完成或失败时自动归还
+   */
+  int32_t sp_bpu_submit_from_vio(bpu_module *bpu_handle, void *vio_obj,
+                                 int32_t width, int32_t height, const int32_t timeout);
+  int32_t sp_bpu_wait(bpu_module *bpu_handle, int32_t task_id, int32_t timeout_ms, hbDNNTensor **output_tensors);
+  int32_t sp_bpu_try_poll(bpu_module *bpu_handle, int32_t task_id, hbDNNTensor **output_tensors);
+
 #ifdef __cplusplus
 }
 #endif
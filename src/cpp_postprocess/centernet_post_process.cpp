@@ -29,11 +29,13 @@
 #include <iostream>
 #include <iomanip>
 #include <algorithm>
-#include <queue>
+#include <limits>
 #include <arm_neon.h>
 
 
 #include "centernet_post_process.h"
+#include "post_process_nms.h"
+#include "post_process_thread_pool.h"
 
 #define BSWAP_32(x) static_cast<int32_t>(__builtin_bswap32(x))
 
@@ -107,25 +109,17 @@ static float fastExp(float x) {
   return v.f;
 }
 
-// order topK data in node
-static void top_k_helper(DataNode *node, int topk, int len) {
-  std::priority_queue<int, std::vector<DataNode>, std::greater<DataNode>> heap;
-  int i = 0;
-  while (i < len) {
-    if (i < topk) {
-      heap.push(node[i]);
-    } else {
-      if (heap.top().value < node[i].value) {
-        heap.pop();
-        heap.push(node[i]);
-      }
-    }
-    i++;
-  }
-  for (int j = 0; j < topk; j++) {
-    node[j] = heap.top();
-    heap.pop();
+// 得分最高的 topk 个按得分从大到小移到 node 前部，得分相同时下标小的在前
+// 只对通过阈值的局部极大值做选择，候选数远小于热力图大小，nth_element 为线性复杂度
+static void SelectTopK(PostProcessArenaVector<DataNode> &node, int topk) {
+  auto greater = [](const DataNode &lhs, const DataNode &rhs) {
+    return lhs.value > rhs.value ||
+           (lhs.value == rhs.value && lhs.indx < rhs.indx);
+  };
+  if (topk < static_cast<int>(node.size())) {
+    std::nth_element(node.begin(), node.begin() + topk, node.end(), greater);
   }
+  std::sort(node.begin(), node.begin() + topk, greater);
 }
 
 #define BSWAP_32(x) static_cast<int32_t>(__builtin_bswap32(x))
@@ -140,7 +134,7 @@ float quanti_scale_function(DType data, float scale) {
 }
 
 int filter_func(hbDNNTensor *tensor,
-                std::vector<DataNode> &node,
+                PostProcessArenaVector<DataNode> &node,
                 float &t_value,
                 float *scale) {
   int h_index{2}, w_index{3}, c_index{1};
@@ -252,7 +246,11 @@ typedef struct Detection {
   ~Detection() {}
 } Detection;
 
-std::vector<Detection> centernet_dets;
+// 帧间复用的缓存，稳定运行后不再有堆分配
+static PostProcessDetectionArena<Detection> centernet_arena;
+// 通过阈值的热力图局部极大值，以及按通道并行时每个任务各自的结果
+static PostProcessArenaVector<DataNode> centernet_nodes;
+static PostProcessArenaVector<PostProcessArenaVector<DataNode>> centernet_task_nodes;
 
 
 void Centernet_resnet101_doProcess(hbDNNTensor *nms_tensor, hbDNNTensor *wh_tensor, hbDNNTensor *reg_tensor, CenternetPostProcessInfo_t *post_info, int layer){
@@ -281,7 +279,8 @@ void Centernet_resnet101_doProcess(hbDNNTensor *nms_tensor, hbDNNTensor *wh_tens
   // Determine whether the model contains a dequnatize node by the first tensor
   auto quanti_type = nms_tensor->properties.quantiType;
 
-  std::vector<DataNode> node;
+  PostProcessArenaVector<DataNode> &node = centernet_nodes;
+  node.clear();
 
   if (quanti_type == hbDNNQuantiType::SCALE) {
     auto &scales0 = nms_tensor->properties.scale.scaleData;
@@ -294,11 +293,9 @@ void Centernet_resnet101_doProcess(hbDNNTensor *nms_tensor, hbDNNTensor *wh_tens
 
   // topk sort
   int topk = node.size() > post_info->nms_top_k ? post_info->nms_top_k : node.size();
-  if (topk != 0) top_k_helper(node.data(), topk, node.size());
+  if (topk != 0) SelectTopK(node, topk);
 
-  std::vector<float> reg_x(topk);
-  std::vector<float> reg_y(topk);
-  std::vector<Detection> tmp_box(topk);
+  Detection tmp_box;
 
   if (wh_tensor->properties.quantiType == hbDNNQuantiType::SCALE) {
     int32_t *wh = reinterpret_cast<int32_t *>(wh_tensor->sysMem[0].virAddr);
@@ -325,23 +322,23 @@ void Centernet_resnet101_doProcess(hbDNNTensor *nms_tensor, hbDNNTensor *wh_tens
       float wh_0 = quanti_scale_function(wh[topk_inds], *wh_scale);
       float wh_1 = quanti_scale_function(wh[area + topk_inds], *(wh_scale + 1));
 
-      tmp_box[i].bbox.xmin = topk_xs - wh_0 / 2;
-      tmp_box[i].bbox.xmax = topk_xs + wh_0 / 2;
-      tmp_box[i].bbox.ymin = topk_ys - wh_1 / 2;
-      tmp_box[i].bbox.ymax = topk_ys + wh_1 / 2;
+      tmp_box.bbox.xmin = topk_xs - wh_0 / 2;
+      tmp_box.bbox.xmax = topk_xs + wh_0 / 2;
+      tmp_box.bbox.ymin = topk_ys - wh_1 / 2;
+      tmp_box.bbox.ymax = topk_ys + wh_1 / 2;
 
-      tmp_box[i].score = topk_score;
-      tmp_box[i].id = topk_clses;
-      tmp_box[i].class_name = default_ptq_centernet_config.class_names[topk_clses].c_str();
-      centernet_dets.push_back(tmp_box[i]);
+      tmp_box.score = topk_score;
+      tmp_box.id = topk_clses;
+      tmp_box.class_name = default_ptq_centernet_config.class_names[topk_clses].c_str();
+      centernet_arena.dets.push_back(tmp_box);
     }
   } else {
     printf("centernet unsupport now!\n");
     return;
   }
 
-  auto &detections = centernet_dets;
-  int det_num = centernet_dets.size();
+  auto &detections = centernet_arena.dets;
+  int det_num = centernet_arena.dets.size();
   printf("det.size(): %d", det_num);
   for (int i = 0; i < det_num; i++) {
     detections[i].bbox.xmin = detections[i].bbox.xmin * scale_x - offset_x;
@@ -355,399 +352,140 @@ void Centernet_resnet101_doProcess(hbDNNTensor *nms_tensor, hbDNNTensor *wh_tens
 }
 
 
-int NMSMaxPool2dDequanti(hbDNNTensor *tensor,
-                         std::vector<DataNode> &node,
-                         float &t_value,
-                         float *scale) {
-  int h_index{2}, w_index{3}, c_index{1};
-  int *shape = tensor->properties.validShape.dimensionSize;
-  int input_c = shape[c_index];
-  int input_h = shape[h_index];
-  int input_w = shape[w_index];
-
-  auto *raw_heat_map_data =
-      reinterpret_cast<int32_t *>(tensor->sysMem[0].virAddr);
-
-  std::vector<int> edge1 = {-1, +1, +input_w - 1, +input_w, +input_w + 1};
-
-  std::vector<int> edge2 = {
-      -1,
-      +1,
-      -input_w - 1,
-      -input_w,
-      -input_w + 1,
-  };
-
-  std::vector<int> edge3 = {
-      +1,
-      +input_w,
-      +input_w + 1,
-      -input_w,
-      -input_w + 1,
-  };
-
-  std::vector<int> edge4 = {
-      -1,
-      +input_w - 1,
-      +input_w,
-      -input_w - 1,
-      -input_w,
-  };
-
-  int pos[8] = {+1,
-                -1,
-                +input_w - 1,
-                +input_w,
-                +input_w + 1,
-                -input_w - 1,
-                -input_w,
-                -input_w + 1};
-
-  bool big_endian = false;
-
-  for (int c = 0; c < input_c; c++) {
-    int channel_offset = c * input_h * input_w;
-    int32_t *iptr = raw_heat_map_data + channel_offset;
-    float scale_value = scale[c];
-    // VLOG(EXAMPLE_REPORT) << "c: " << c << "; scale1:" << scale[c];
-    DataNode tmp_node;
-
-    std::vector<int32_t> point1(4, 0.f);
-    point1[0] = iptr[0];
-    point1[1] = iptr[1];
-    point1[2] = iptr[input_w + 0];
-    point1[3] = iptr[input_w + 1];
-    int i = 0;
-    for (; i < 4; ++i) {
-      if (point1[0] < point1[i]) break;
-    }
-    if (i == 4) {
-      tmp_node.value = DequantiScale(point1[0], big_endian, scale_value);
-      if (tmp_node.value > t_value) {
-        tmp_node.indx = channel_offset;
-        node.emplace_back(tmp_node);
-      }
-    }
-
-    std::vector<int32_t> point2(4, 0.f);
-    point2[0] = iptr[input_w - 2];
-    point2[1] = iptr[input_w - 1];  //
-    point2[2] = iptr[input_w + input_w - 2];
-    point2[3] = iptr[input_w + input_w - 1];
-    i = 0;
-    for (; i < 4; ++i) {
-      if (point2[1] < point2[i]) break;
-    }
-    if (i == 4) {
-      tmp_node.value = DequantiScale(point2[1], big_endian, scale_value);  //
-      if (tmp_node.value > t_value) {
-        tmp_node.indx = channel_offset + input_w - 1;
-        node.emplace_back(tmp_node);
-      }
-    }
-
-    std::vector<int32_t> point3(4, 0.f);
-    point3[0] = iptr[(input_h - 2) * input_w + 0];
-    point3[1] = iptr[(input_h - 2) * input_w + 1];
-    point3[2] = iptr[(input_h - 1) * input_w + 0];  //
-    point3[3] = iptr[(input_h - 1) * input_w + 1];
-    i = 0;
-    for (; i < 4; ++i) {
-      if (point3[2] < point3[i]) break;
-    }
-    if (i == 4) {
-      tmp_node.value = DequantiScale(point3[2], big_endian, scale_value);
-      if (tmp_node.value > t_value) {
-        tmp_node.indx = channel_offset + (input_h - 1) * input_w;
-        node.emplace_back(tmp_node);
-      }
-    }
-
-    std::vector<int32_t> point4(4, 0.f);
-    point4[0] = iptr[(input_h - 2) * input_w + (input_w - 2)];
-    point4[1] = iptr[(input_h - 2) * input_w + (input_w - 1)];
-    point4[2] = iptr[(input_h - 1) * input_w + (input_w - 2)];
-    point4[3] = iptr[(input_h - 1) * input_w + (input_w - 1)];  //
-    i = 0;
-    for (; i < 4; ++i) {
-      if (point4[3] < point4[i]) break;
-    }
-    if (i == 4) {
-      tmp_node.value = DequantiScale(point4[3], big_endian, scale_value);
-      if (tmp_node.value > t_value) {
-        tmp_node.indx = channel_offset + (input_h - 1) * input_w + input_w - 1;
-        node.emplace_back(tmp_node);
-      }
-    }
-
-    // top + bottom
-    for (int w = 1; w < input_w - 1; ++w) {
-      i = 0;
-      int32_t cur_value = iptr[w];
-      for (; i < 5; ++i) {
-        if (cur_value < iptr[w + edge1[i]]) break;
-      }
-      if (i == 5) {
-        tmp_node.value = DequantiScale(cur_value, big_endian, scale_value);
-        if (tmp_node.value > t_value) {
-          tmp_node.indx = channel_offset + w;
-          node.emplace_back(tmp_node);
-        }
-      }
+// row[0..3] 中是否有大于 thresh 的值，热力图绝大部分低于阈值，整块跳过
+static inline bool AnyAbove4(const float *row, float thresh) {
+#if defined(__ARM_NEON)
+  return vmaxvq_u32(vcgtq_f32(vld1q_f32(row), vdupq_n_f32(thresh))) != 0;
+#else
+  return row[0] > thresh || row[1] > thresh || row[2] > thresh || row[3] > thresh;
+#endif
+}
 
-      i = 0;
-      int cur_pos = (input_h - 1) * input_w + w;
-      cur_value = iptr[cur_pos];
-      for (; i < 5; ++i) {
-        if (cur_value < iptr[cur_pos + edge2[i]]) break;
-      }
-      if (i == 5) {
-        tmp_node.value = DequantiScale(cur_value, big_endian, scale_value);
-        if (tmp_node.value > t_value) {
-          tmp_node.indx = channel_offset + cur_pos;
-          node.emplace_back(tmp_node);
-        }
-      }
-    }
+static inline bool AnyAbove4(const int32_t *row, int32_t thresh) {
+#if defined(__ARM_NEON)
+  return vmaxvq_u32(vcgtq_s32(vld1q_s32(row), vdupq_n_s32(thresh))) != 0;
+#else
+  return row[0] > thresh || row[1] > thresh || row[2] > thresh || row[3] > thresh;
+#endif
+}
 
-    // left + right
-    for (int h = 1; h < input_h - 1; ++h) {
-      i = 0;
-      int cur_pos = h * input_w;
-      int32_t cur_value = iptr[cur_pos];
-      for (; i < 5; ++i) {
-        if (cur_value < iptr[cur_pos + edge3[i]]) break;
-      }
-      if (i == 5) {
-        tmp_node.value = DequantiScale(cur_value, big_endian, scale_value);
-        if (tmp_node.value > t_value) {
-          tmp_node.indx = channel_offset + cur_pos;
-          node.emplace_back(tmp_node);
-        }
-      }
+// row[left..right] 中没有大于 cur 的值
+template <typename T>
+static inline bool NotLessThanRow(const T *row, int left, int right, T cur) {
+  for (int x = left; x <= right; x++) {
+    if (cur < row[x]) return false;
+  }
+  return true;
+}
 
-      i = 0;
-      cur_pos = h * input_w + input_w - 1;
-      cur_value = iptr[cur_pos];
-      for (; i < 5; ++i) {
-        if (cur_value < iptr[cur_pos + edge3[i]]) break;
+/**
+ * 一个通道的 3x3 max pool NMS，保留不小于8邻域(边界处只比较图内的邻居)且得分大于 t_value 的位置
+ * 先在量化域和 raw_thresh 比较，低于阈值的位置不再比较邻居，也不做反量化
+ * @param[in] raw_thresh: 量化域的阈值，不大于 t_value 对应的量化值，最终结果由 score(cur) > t_value 决定
+ * @param[in] score: 原始数据转换成 logit 得分
+ */
+template <typename T, typename ScoreFunc>
+static void CenternetChannelLocalMax(const T *iptr,
+                                     int input_h,
+                                     int input_w,
+                                     T raw_thresh,
+                                     float t_value,
+                                     int channel_offset,
+                                     ScoreFunc score,
+                                     PostProcessArenaVector<DataNode> &node) {
+  DataNode tmp_node;
+  for (int h = 0; h < input_h; h++) {
+    const T *row = iptr + h * input_w;
+    const T *up = h > 0 ? row - input_w : nullptr;
+    const T *down = h < input_h - 1 ? row + input_w : nullptr;
+    int w = 0;
+    while (w < input_w) {
+      if (w + 4 <= input_w && !AnyAbove4(row + w, raw_thresh)) {
+        w += 4;
+        continue;
       }
-      if (i == 5) {
-        tmp_node.value = DequantiScale(cur_value, big_endian, scale_value);
-        if (tmp_node.value > t_value) {
-          tmp_node.indx = channel_offset + cur_pos;
+      T cur = row[w];
+      int left = w > 0 ? w - 1 : w;
+      int right = w < input_w - 1 ? w + 1 : w;
+      if (cur > raw_thresh && NotLessThanRow(row, left, right, cur) &&
+          (up == nullptr || NotLessThanRow(up, left, right, cur)) &&
+          (down == nullptr || NotLessThanRow(down, left, right, cur))) {
+        float value = score(cur);
+        if (value > t_value) {
+          tmp_node.indx = channel_offset + h * input_w + w;
+          tmp_node.value = value;
           node.emplace_back(tmp_node);
         }
       }
-    }
-
-    // center
-    for (int h = 1; h < input_h - 1; h++) {
-      int offset = h * input_w;
-      for (int w = 1; w < input_w - 1; w++) {
-        int cur_pos = offset + w;
-        int32_t cur_value = iptr[cur_pos];
-        i = 0;
-        for (; i < 8; ++i) {
-          if (cur_value < iptr[cur_pos + pos[i]]) break;
-        }
-        if (i == 8) {
-          tmp_node.value = DequantiScale(cur_value, big_endian, scale_value);
-          if (tmp_node.value > t_value) {
-            tmp_node.indx = channel_offset + cur_pos;
-            node.emplace_back(tmp_node);
-          }
-        }
-      }
+      w++;
     }
   }
-  return 0;
 }
 
-int NMSMaxPool2d(hbDNNTensor *tensor,
-                 std::vector<DataNode> &node,
-                 float &t_value) {
+/**
+ * 热力图 (1, C, H, W) 做 3x3 max pool NMS，结果按通道、行、列的顺序追加到 node
+ * 各通道互不相关，按通道分段在线程池中并行，结果与线程数无关
+ * @param[in] scale: NULL 时数据为float，否则为int32量化数据，按通道反量化
+ */
+static void CenternetLocalMax(hbDNNTensor *tensor,
+                              float t_value,
+                              const float *scale,
+                              PostProcessArenaVector<DataNode> &node) {
   int h_index{2}, w_index{3}, c_index{1};
   int *shape = tensor->properties.validShape.dimensionSize;
   int input_c = shape[c_index];
   int input_h = shape[h_index];
   int input_w = shape[w_index];
-
-  float *raw_heat_map_data =
-      reinterpret_cast<float *>(tensor->sysMem[0].virAddr);
-
-  std::vector<int> edge1 = {-1, +1, +input_w - 1, +input_w, +input_w + 1};
-
-  std::vector<int> edge2 = {
-      -1,
-      +1,
-      -input_w - 1,
-      -input_w,
-      -input_w + 1,
-  };
-
-  std::vector<int> edge3 = {
-      +1,
-      +input_w,
-      +input_w + 1,
-      -input_w,
-      -input_w + 1,
-  };
-
-  std::vector<int> edge4 = {
-      -1,
-      +input_w - 1,
-      +input_w,
-      -input_w - 1,
-      -input_w,
-  };
-
-  int pos[8] = {+1,
-                -1,
-                +input_w - 1,
-                +input_w,
-                +input_w + 1,
-                -input_w - 1,
-                -input_w,
-                -input_w + 1};
-
-  for (int c = 0; c < input_c; c++) {
-    int channel_offset = c * input_h * input_w;
-    float *iptr = raw_heat_map_data + channel_offset;
-    DataNode tmp_node;
-
-    std::vector<float> point1(4, 0.f);
-    point1[0] = iptr[0];  //
-    point1[1] = iptr[1];
-    point1[2] = iptr[input_w + 0];
-    point1[3] = iptr[input_w + 1];
-    int i = 0;
-    for (; i < 4; ++i) {
-      if (point1[0] < point1[i]) break;
-    }
-    if (i == 4 && point1[0] > t_value) {
-      tmp_node.indx = channel_offset;
-      tmp_node.value = point1[0];
-      node.emplace_back(tmp_node);
-    }
-
-    std::vector<float> point2(4, 0.f);
-    point2[0] = iptr[input_w - 2];
-    point2[1] = iptr[input_w - 1];  //
-    point2[2] = iptr[input_w + input_w - 2];
-    point2[3] = iptr[input_w + input_w - 1];
-    i = 0;
-    for (; i < 4; ++i) {
-      if (point2[1] < point2[i]) break;
-    }
-    if (i == 4 && point2[1] > t_value) {
-      tmp_node.indx = channel_offset + input_w - 1;
-      tmp_node.value = point2[1];  //
-      node.emplace_back(tmp_node);
-    }
-
-    std::vector<float> point3(4, 0.f);
-    point3[0] = iptr[(input_h - 2) * input_w + 0];
-    point3[1] = iptr[(input_h - 2) * input_w + 1];
-    point3[2] = iptr[(input_h - 1) * input_w + 0];  //
-    point3[3] = iptr[(input_h - 1) * input_w + 1];
-    i = 0;
-    for (; i < 4; ++i) {
-      if (point3[2] < point3[i]) break;
-    }
-    if (i == 4 && point3[2] > t_value) {
-      tmp_node.indx = channel_offset + (input_h - 1) * input_w;
-      tmp_node.value = point3[2];
-      node.emplace_back(tmp_node);
-    }
-
-    std::vector<float> point4(4, 0.f);
-    point4[0] = iptr[(input_h - 2) * input_w + (input_w - 2)];
-    point4[1] = iptr[(input_h - 2) * input_w + (input_w - 1)];
-    point4[2] = iptr[(input_h - 1) * input_w + (input_w - 2)];
-    point4[3] = iptr[(input_h - 1) * input_w + (input_w - 1)];  //
-    i = 0;
-    for (; i < 4; ++i) {
-      if (point4[3] < point4[i]) break;
-    }
-    if (i == 4 && point4[3] > t_value) {
-      tmp_node.indx = channel_offset + (input_h - 1) * input_w + input_w - 1;
-      tmp_node.value = point4[3];
-      node.emplace_back(tmp_node);
-    }
-
-    // top + bottom
-    for (int w = 1; w < input_w - 1; ++w) {
-      i = 0;
-      float cur_value = iptr[w];
-      for (; i < 5; ++i) {
-        if (cur_value < iptr[w + edge1[i]]) break;
-      }
-      if (i == 5 && cur_value > t_value) {
-        tmp_node.indx = channel_offset + w;
-        tmp_node.value = cur_value;
-        node.emplace_back(tmp_node);
-      }
-
-      i = 0;
-      int cur_pos = (input_h - 1) * input_w + w;
-      cur_value = iptr[cur_pos];
-      for (; i < 5; ++i) {
-        if (cur_value < iptr[cur_pos + edge2[i]]) break;
-      }
-      if (i == 5 && cur_value > t_value) {
-        tmp_node.indx = channel_offset + cur_pos;
-        tmp_node.value = cur_value;
-        node.emplace_back(tmp_node);
+  int area = input_h * input_w;
+
+  auto run_channel = [&](int c, PostProcessArenaVector<DataNode> &out) {
+    int channel_offset = c * area;
+    if (scale == nullptr) {
+      auto *iptr = reinterpret_cast<float *>(tensor->sysMem[0].virAddr) + channel_offset;
+      CenternetChannelLocalMax(iptr, input_h, input_w, t_value, t_value, channel_offset,
+                               [](float v) { return v; }, out);
+    } else {
+      auto *iptr = reinterpret_cast<int32_t *>(tensor->sysMem[0].virAddr) + channel_offset;
+      float channel_scale = scale[c];
+      // 量化阈值向下多取1，保证浮点比较为真的位置都能通过量化比较
+      int32_t raw_thresh = std::numeric_limits<int32_t>::min();
+      if (channel_scale > 0) {
+        double q = std::floor(t_value / channel_scale) - 1;
+        q = std::max(q, static_cast<double>(std::numeric_limits<int32_t>::min()));
+        q = std::min(q, static_cast<double>(std::numeric_limits<int32_t>::max()));
+        raw_thresh = static_cast<int32_t>(q);
       }
+      CenternetChannelLocalMax(iptr, input_h, input_w, raw_thresh, t_value, channel_offset,
+                               [channel_scale](int32_t v) {
+                                 return static_cast<float>(v) * channel_scale;
+                               }, out);
     }
+  };
 
-    // left + right
-    for (int h = 1; h < input_h - 1; ++h) {
-      i = 0;
-      int cur_pos = h * input_w;
-      float cur_value = iptr[cur_pos];
-      for (; i < 5; ++i) {
-        if (cur_value < iptr[cur_pos + edge3[i]]) break;
-      }
-      if (i == 5 && cur_value > t_value) {
-        tmp_node.indx = channel_offset + cur_pos;
-        tmp_node.value = cur_value;
-        node.emplace_back(tmp_node);
-      }
-
-      i = 0;
-      cur_pos = h * input_w + input_w - 1;
-      cur_value = iptr[cur_pos];
-      for (; i < 5; ++i) {
-        if (iptr[cur_pos] < iptr[cur_pos + edge4[i]]) break;
-      }
-      if (i == 5 && cur_value > t_value) {
-        tmp_node.indx = channel_offset + cur_pos;
-        tmp_node.value = cur_value;
-        node.emplace_back(tmp_node);
-      }
-    }
+  PostProcessThreadPool *pool = PostProcessThreadPool::Instance();
+  int task_num = pool->ThreadNum() > 1 ? pool->ThreadNum() * 2 : 1;
+  task_num = std::max(1, std::min(task_num, input_c));
+  if (task_num == 1) {
+    for (int c = 0; c < input_c; c++) run_channel(c, node);
+    return;
+  }
 
-    // center
-    for (int h = 1; h < input_h - 1; h++) {
-      int offset = h * input_w;
-      for (int w = 1; w < input_w - 1; w++) {
-        int cur_pos = offset + w;
-        float cur_value = iptr[cur_pos];
-        i = 0;
-        for (; i < 8; ++i) {
-          if (cur_value < iptr[cur_pos + pos[i]]) break;
-        }
-        if (i == 8 && cur_value > t_value) {
-          tmp_node.indx = channel_offset + cur_pos;
-          tmp_node.value = cur_value;
-          node.emplace_back(tmp_node);
-        }
-      }
-    }
+  if (static_cast<int>(centernet_task_nodes.size()) < task_num) {
+    centernet_task_nodes.resize(task_num);
+  }
+  int channels = (input_c + task_num - 1) / task_num;
+  pool->ParallelFor(task_num, [&](int t) {
+    PostProcessArenaVector<DataNode> &out = centernet_task_nodes[t];
+    out.clear();
+    int c_end = std::min(input_c, (t + 1) * channels);
+    for (int c = t * channels; c < c_end; c++) run_channel(c, out);
+  });
+
+  for (int t = 0; t < task_num; t++) {
+    PostProcessArenaVector<DataNode> &out = centernet_task_nodes[t];
+    node.insert(node.end(), out.begin(), out.end());
+    out.clear();
   }
-  return 0;
 }
 
 void CenternetdoProcess(hbDNNTensor *nms_tensor, hbDNNTensor *wh_tensor, hbDNNTensor *reg_tensor, CenternetPostProcessInfo_t *post_info, int layer) {
@@ -776,25 +514,23 @@ void CenternetdoProcess(hbDNNTensor *nms_tensor, hbDNNTensor *wh_tensor, hbDNNTe
   // Determine whether the model contains a dequnatize node by the first tensor
   auto quanti_type = nms_tensor->properties.quantiType;
 
-  std::vector<DataNode> node;
+  PostProcessArenaVector<DataNode> &node = centernet_nodes;
+  node.clear();
   float t_value =
       log(post_info->score_threshold / (1.f - post_info->score_threshold));  // ln (2.f/3.f)
   if (quanti_type == hbDNNQuantiType::NONE) {
-    NMSMaxPool2d(nms_tensor, node, t_value);
+    CenternetLocalMax(nms_tensor, t_value, nullptr, node);
   } else if (quanti_type == hbDNNQuantiType::SCALE) {
-    auto &scales0 = nms_tensor->properties.scale.scaleData;
-    NMSMaxPool2dDequanti(nms_tensor, node, t_value, scales0);
+    CenternetLocalMax(nms_tensor, t_value, nms_tensor->properties.scale.scaleData, node);
   } else {
     printf("centernet unsupport shift dequantzie now!\n");
     return;
   }
 
   int topk = node.size() > post_info->nms_top_k ? post_info->nms_top_k : node.size();
-  if (topk != 0) top_k_helper(node.data(), topk, node.size());
+  if (topk != 0) SelectTopK(node, topk);
 
-  std::vector<float> reg_x(topk);
-  std::vector<float> reg_y(topk);
-  std::vector<Detection> tmp_box(topk);
+  Detection tmp_box;
 
   if (quanti_type == hbDNNQuantiType::NONE) {
     float *wh = reinterpret_cast<float *>(wh_tensor->sysMem[0].virAddr);
@@ -815,15 +551,15 @@ void CenternetdoProcess(hbDNNTensor *nms_tensor, hbDNNTensor *wh_tensor, hbDNNTe
       topk_xs += reg[topk_inds];
       topk_ys += reg[area + topk_inds];
 
-      tmp_box[i].bbox.xmin = topk_xs - wh[topk_inds] / 2;
-      tmp_box[i].bbox.xmax = topk_xs + wh[topk_inds] / 2;
-      tmp_box[i].bbox.ymin = topk_ys - wh[area + topk_inds] / 2;
-      tmp_box[i].bbox.ymax = topk_ys + wh[area + topk_inds] / 2;
+      tmp_box.bbox.xmin = topk_xs - wh[topk_inds] / 2;
+      tmp_box.bbox.xmax = topk_xs + wh[topk_inds] / 2;
+      tmp_box.bbox.ymin = topk_ys - wh[area + topk_inds] / 2;
+      tmp_box.bbox.ymax = topk_ys + wh[area + topk_inds] / 2;
 
-      tmp_box[i].score = topk_score;
-      tmp_box[i].id = topk_clses;
-      tmp_box[i].class_name = default_ptq_centernet_config.class_names[topk_clses].c_str();
-      centernet_dets.push_back(tmp_box[i]);
+      tmp_box.score = topk_score;
+      tmp_box.id = topk_clses;
+      tmp_box.class_name = default_ptq_centernet_config.class_names[topk_clses].c_str();
+      centernet_arena.dets.push_back(tmp_box);
     }
 
   } else if (quanti_type == hbDNNQuantiType::SCALE) {
@@ -854,23 +590,23 @@ void CenternetdoProcess(hbDNNTensor *nms_tensor, hbDNNTensor *wh_tensor, hbDNNTe
       float wh_1 =
           DequantiScale(wh[area + topk_inds], big_endian, *(scales1 + 1));
 
-      tmp_box[i].bbox.xmin = topk_xs - wh_0 / 2;
-      tmp_box[i].bbox.xmax = topk_xs + wh_0 / 2;
-      tmp_box[i].bbox.ymin = topk_ys - wh_1 / 2;
-      tmp_box[i].bbox.ymax = topk_ys + wh_1 / 2;
+      tmp_box.bbox.xmin = topk_xs - wh_0 / 2;
+      tmp_box.bbox.xmax = topk_xs + wh_0 / 2;
+      tmp_box.bbox.ymin = topk_ys - wh_1 / 2;
+      tmp_box.bbox.ymax = topk_ys + wh_1 / 2;
 
-      tmp_box[i].score = topk_score;
-      tmp_box[i].id = topk_clses;
-      tmp_box[i].class_name = default_ptq_centernet_config.class_names[topk_clses].c_str();
-      centernet_dets.push_back(tmp_box[i]);
+      tmp_box.score = topk_score;
+      tmp_box.id = topk_clses;
+      tmp_box.class_name = default_ptq_centernet_config.class_names[topk_clses].c_str();
+      centernet_arena.dets.push_back(tmp_box);
     }
   } else {
     printf("centernet unsupport shift dequantzie now!\n");
     return;
   }
 
-  auto &detections = centernet_dets;
-  int det_num = centernet_dets.size();
+  auto &detections = centernet_arena.dets;
+  int det_num = centernet_arena.dets.size();
   printf("det.size(): %d\n", det_num);
   for (int i = 0; i < det_num; i++) {
     detections[i].bbox.xmin = detections[i].bbox.xmin * scale_x - offset_x;
@@ -885,30 +621,32 @@ void CenternetdoProcess(hbDNNTensor *nms_tensor, hbDNNTensor *wh_tensor, hbDNNTe
 
 char* CenternetPostProcess(CenternetPostProcessInfo_t *post_info) {
 
-  int i = 0;
-  char *str_dets;
+  // 算法结果转换成json格式
+  PostProcessArenaVector<PostProcessDetection_t> &dets = centernet_arena.out;
+  dets.resize(centernet_arena.dets.size());
+  int num = CopyDetectionResult(centernet_arena.dets, dets.data(), dets.size());
+  centernet_arena.Clear();
+  return DetectionResultToJson("centernet_result", dets.data(), num, CenternetGetClassName);
+}
 
-  std::stringstream out_string;
-  std::vector<Detection> centernet_det_restuls;
+int CenternetPostProcessToArray(CenternetPostProcessInfo_t *post_info,
+                                PostProcessDetection_t *dets,
+                                int capacity) {
+  if (dets == nullptr || capacity < 0) {
+    printf("centernet post process invalid output array!\n");
+    centernet_arena.Clear();
+    return -1;
+  }
 
-  centernet_det_restuls = centernet_dets;
-  // 算法结果转换成json格式
-  int centernet_det_restuls_size = centernet_det_restuls.size();
-  out_string << "\"centernet_result\": [";
-  for (i = 0; i < centernet_det_restuls_size; i++) {
-  	auto det_ret = centernet_det_restuls[i];
-  	out_string << det_ret;
-  	if (i < centernet_det_restuls_size - 1)
-		out_string << ",";
+  int num = CopyDetectionResult(centernet_arena.dets, dets, capacity);
+  centernet_arena.Clear();
+  return num;
+}
+
+const char *CenternetGetClassName(int id) {
+  if (id < 0 || id >= static_cast<int>(default_ptq_centernet_config.class_names.size())) {
+    return nullptr;
   }
-  out_string << "]" << std::endl;
-
-  str_dets = (char *)malloc(out_string.str().length() + 1);
-  str_dets[out_string.str().length()] = '\0';
-  snprintf(str_dets, out_string.str().length(), "%s", out_string.str().c_str());
-  // printf("str_dets: %s\n", str_dets);
-  centernet_dets.clear();
-  centernet_det_restuls.clear();
-  return str_dets;
+  return default_ptq_centernet_config.class_names[id].c_str();
 }
 
@@ -24,6 +24,7 @@
 #define _POST_PROCESS_CENTERNET_POST_PROCESS_H_
 
 #include "dnn/hb_dnn.h"
+#include "post_process_common.h"
 
 #ifdef __cplusplus
   extern "C"{
@@ -53,6 +54,21 @@ void CenternetdoProcess(hbDNNTensor *nms_tensor, hbDNNTensor *wh_tensor, hbDNNTe
 
 void Centernet_resnet101_doProcess(hbDNNTensor *nms_tensor, hbDNNTensor *wh_tensor, hbDNNTensor *reg_tensor, CenternetPostProcessInfo_t *post_info, int layer);
 
+/**
+ * 与 CenternetPostProcess 相同，但结果直接写入 dets 数组，不生成json字符串
+ * @param[out] dets: 调用者分配的结果数组，按score从大到小排列
+ * @param[in] capacity: dets 数组的长度，结果超过 capacity 时只保留前 capacity 个
+ * @return 写入的结果个数，参数错误返回-1
+ */
+int CenternetPostProcessToArray(CenternetPostProcessInfo_t *post_info,
+                         PostProcessDetection_t *dets,
+                         int capacity);
+
+/**
+ * 根据 PostProcessDetection_t.id 获取类别名，越界返回NULL
+ */
+const char *CenternetGetClassName(int id);
+
 
 #ifdef __cplusplus
 }
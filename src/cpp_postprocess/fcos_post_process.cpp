@@ -30,9 +30,15 @@
 #include <iomanip>
 #include <algorithm>
 #include <arm_neon.h>
+#include <memory>
+#include <new>
 #include <queue>
 
 #include "fcos_post_process.h"
+#include "post_process_batch.h"
+#include "post_process_math.h"
+#include "post_process_nms.h"
+#include "post_process_thread_pool.h"
 
 static inline uint32x4x4_t CalculateIndex(uint32_t idx,
                                           float32x4_t a,
@@ -237,7 +243,58 @@ typedef struct Detection {
   ~Detection() {}
 } Detection;
 
-std::vector<Detection> fcos_dets;
+// 候选框、NMS结果等帧间复用的缓存，稳定运行后不再有堆分配
+static PostProcessDetectionArena<Detection> fcos_arena;
+
+// 解码任务：一层输出中连续的若干行
+struct FcosDecodeTask {
+  int layer;
+  int h_begin;
+  int h_end;
+};
+
+// 各层并行解码时的任务及每个任务的候选框，帧间复用
+struct FcosDecodeContext {
+  PostProcessArenaVector<FcosDecodeTask> tasks;
+  PostProcessArenaVector<PostProcessArenaVector<Detection>> task_dets;
+};
+static FcosDecodeContext fcos_decode_context;
+
+// 批量后处理中每张图片一份，帧间复用
+struct FcosBatchItem {
+  PostProcessDetectionArena<Detection> arena;
+  FcosDecodeContext decode;
+  // 本张图片各层的 cls/bbox/ce tensor
+  PostProcessArenaVector<hbDNNTensor> tensors;
+};
+
+struct FcosPostProcessContext {
+  explicit FcosPostProcessContext(int mode = NMS_MODE_HARD) : nms_mode(mode) {}
+
+  std::vector<std::unique_ptr<FcosBatchItem>> batch_items;
+  // FcosSetNmsMode 设置，默认上下文为 NMS_MODE_PROCESS_DEFAULT
+  int nms_mode;
+};
+
+// FcosPostProcessBatchToArray 使用的默认上下文，NMS方式跟随 PostProcessSetNmsMode
+static FcosPostProcessContext default_fcos_context(NMS_MODE_PROCESS_DEFAULT);
+
+FcosPostProcessContext_t *FcosCreateContext(void) {
+  return new (std::nothrow) FcosPostProcessContext();
+}
+
+void FcosDestroyContext(FcosPostProcessContext_t *ctx) {
+  delete ctx;
+}
+
+int FcosSetNmsMode(FcosPostProcessContext_t *ctx, int nms_mode) {
+  if (ctx == nullptr || !IsValidNmsMode(nms_mode)) {
+    printf("fcos invalid context or nms mode %d!\n", nms_mode);
+    return -1;
+  }
+  ctx->nms_mode = nms_mode;
+  return 0;
+}
 
 static int get_tensor_hwc_index(hbDNNTensor *tensor,
                          int *h_index,
@@ -257,80 +314,64 @@ static int get_tensor_hwc_index(hbDNNTensor *tensor,
   return 0;
 }
 
-static void fcos_nms(std::vector<Detection> &input,
-               float iou_threshold,
-               int top_k,
-               std::vector<Detection> &result,
-               bool suppress) {
-  // sort order by score desc
-  std::stable_sort(input.begin(), input.end(), std::greater<Detection>());
-
-  std::vector<bool> skip(input.size(), false);
-
-  // pre-calculate boxes area
-  std::vector<float> areas;
-  areas.reserve(input.size());
-  for (size_t i = 0; i < input.size(); i++) {
-    float width = input[i].bbox.xmax - input[i].bbox.xmin;
-    float height = input[i].bbox.ymax - input[i].bbox.ymin;
-    areas.push_back(width * height);
-  }
 
-  int count = 0;
-  for (size_t i = 0; count < top_k && i < skip.size(); i++) {
-    if (skip[i]) {
-      continue;
-    }
-    skip[i] = true;
-    ++count;
+// 原图与模型输入之间的缩放比例
+static void FcosGetScale(FcosPostProcessInfo_t *post_info, float *w_scale, float *h_scale) {
+  int ori_h = post_info->ori_height;
+  int ori_w = post_info->ori_width;
+  int input_h = post_info->height;
+  int input_w = post_info->width;
+  // preprocess action is pad and resize
+  if (post_info->is_pad_resize) {
+    float scale = ori_h > ori_w ? ori_h : ori_w;
+    *w_scale = scale / input_w;
+    *h_scale = scale / input_h;
+  } else {
+    *w_scale = static_cast<float>(ori_w) / input_w;
+    *h_scale = static_cast<float>(ori_h) / input_h;
+  }
+}
 
-    for (size_t j = i + 1; j < skip.size(); ++j) {
-      if (skip[j]) {
-        continue;
-      }
-      if (suppress == false) {
-        if (input[i].id != input[j].id) {
-          continue;
-        }
+// NCHW布局下行尾不足4个位置时逐个求通道最大值，结果与 ArgMaxChannelX4 相同
+static void ArgMaxChannelTail(const float *input, int length, int channel_stride,
+                              int lanes, float *max_value, int32_t *max_idx) {
+  for (int j = 0; j < lanes; j++) {
+    max_value[j] = input[j];
+    max_idx[j] = 0;
+    for (int c = 1; c < length; c++) {
+      if (input[c * channel_stride + j] > max_value[j]) {
+        max_value[j] = input[c * channel_stride + j];
+        max_idx[j] = c;
       }
+    }
+  }
+}
 
-      // intersection area
-      float xx1 = std::max(input[i].bbox.xmin, input[j].bbox.xmin);
-      float yy1 = std::max(input[i].bbox.ymin, input[j].bbox.ymin);
-      float xx2 = std::min(input[i].bbox.xmax, input[j].bbox.xmax);
-      float yy2 = std::min(input[i].bbox.ymax, input[j].bbox.ymax);
-
-      if (xx2 > xx1 && yy2 > yy1) {
-        float area_intersection = (xx2 - xx1) * (yy2 - yy1);
-        float iou_ratio =
-            area_intersection / (areas[j] + areas[i] - area_intersection);
-        if (iou_ratio > iou_threshold) {
-          skip[j] = true;
-        }
+static void ArgMaxChannelTail(const int32_t *input, const float *scale, int length,
+                              int channel_stride, int lanes, float *max_value,
+                              int32_t *max_idx) {
+  for (int j = 0; j < lanes; j++) {
+    max_value[j] = input[j] * scale[0];
+    max_idx[j] = 0;
+    for (int c = 1; c < length; c++) {
+      float score = input[c * channel_stride + j] * scale[c];
+      if (score > max_value[j]) {
+        max_value[j] = score;
+        max_idx[j] = c;
       }
     }
-    result.push_back(input[i]);
   }
 }
 
+// 以下解码函数只处理 [h_begin, h_end) 行，每个位置在一次遍历中完成
+// centerness过滤、类别argmax、得分计算和框解码，三个输出tensor各读一遍
 static void GetBboxAndScoresNHWC(
     hbDNNTensor *cls_tensors, hbDNNTensor *bbox_tensors, hbDNNTensor *ce_tensors,
-    FcosPostProcessInfo_t *post_info, int layer) {
-  int ori_h = post_info->ori_height;
-  int ori_w = post_info->ori_width;
-  int input_h = post_info->height;
-  int input_w = post_info->width;
+    FcosPostProcessInfo_t *post_info, int layer, int h_begin, int h_end,
+    PostProcessArenaVector<Detection> *dets) {
   float w_scale;
   float h_scale;
-  // preprocess action is pad and resize
-  if (post_info->is_pad_resize) {
-    float scale = ori_h > ori_w ? ori_h : ori_w;
-    w_scale = scale / input_w;
-    h_scale = scale / input_h;
-  } else {
-    w_scale = static_cast<float>(ori_w) / input_w;
-    h_scale = static_cast<float>(ori_h) / input_h;
-  }
+  FcosGetScale(post_info, &w_scale, &h_scale);
 
   auto *cls_data = reinterpret_cast<float *>(cls_tensors->sysMem[0].virAddr);
   auto *bbox_data =
@@ -340,71 +381,46 @@ static void GetBboxAndScoresNHWC(
 
   // 同一个尺度下，tensor[i],tensor[i+5],tensor[i+10]出来的hw都一致，64*64/32*32/...
   int *shape = cls_tensors->properties.alignedShape.dimensionSize;
-  int tensor_h = shape[1];
   int tensor_w = shape[2];
   int tensor_c = shape[3];
-  // printf("tensor_h:%d, tensor_w:%d, tensor_c:%d, \n", tensor_h, tensor_w, tensor_c);
+  float stride = fcos_config_.strides[layer];
 
-  for (int h = 0; h < tensor_h; h++) {
-    int offset = h * tensor_w;
+  // sqrt(sigmoid(cls) * sigmoid(ce)) <= score_threshold 在 sigmoid(ce) <= score_threshold^2 时一定成立，
+  // 先用centerness的logit阈值过滤，跳过类别argmax
+  float ce_thresh =
+      LogitThreshold(post_info->score_threshold * post_info->score_threshold);
+
+  for (int h = h_begin; h < h_end; h++) {
     for (int w = 0; w < tensor_w; w++) {
-      // get score
-      int ce_offset = offset + w;
-      ce_data[ce_offset] = 1.0 / (1.0 + exp(-ce_data[ce_offset]));
+      int offset = h * tensor_w + w;
+      if (ce_data[offset] <= ce_thresh) continue;
 
-      int cls_offset = ce_offset * tensor_c;
-      ScoreId tmp_score = {cls_data[cls_offset], 0};
-      for (int cls_c = 1; cls_c < tensor_c; cls_c++) {
-        int cls_index = cls_offset + cls_c;
-        if (cls_data[cls_index] > tmp_score.score) {
-          tmp_score.id = cls_c;
-          tmp_score.score = cls_data[cls_index];
-        }
-      }
-      tmp_score.score = 1.0 / (1.0 + exp(-tmp_score.score));
-      tmp_score.score = std::sqrt(tmp_score.score * ce_data[ce_offset]);
-      if (tmp_score.score <= post_info->score_threshold) continue;
+      float max_cls;
+      int id = ArgMaxFloat(cls_data + offset * tensor_c, tensor_c, &max_cls);
+      float score = std::sqrt(FastSigmoid(max_cls) * FastSigmoid(ce_data[offset]));
+      if (score <= post_info->score_threshold) continue;
 
-      // get detection box
+      const float *box = bbox_data + 4 * offset;
       Detection detection;
-      int index = 4 * (h * tensor_w + w);
-      auto &strides = fcos_config_.strides;
-
-      detection.bbox.xmin =
-          ((w + 0.5) * strides[layer] - bbox_data[index]) * w_scale;
-      detection.bbox.ymin =
-          ((h + 0.5) * strides[layer] - bbox_data[index + 1]) * h_scale;
-      detection.bbox.xmax =
-          ((w + 0.5) * strides[layer] + bbox_data[index + 2]) * w_scale;
-      detection.bbox.ymax =
-          ((h + 0.5) * strides[layer] + bbox_data[index + 3]) * h_scale;
-
-      detection.score = tmp_score.score;
-      detection.id = tmp_score.id;
-      detection.class_name = fcos_config_.class_names[detection.id].c_str();
-      fcos_dets.push_back(detection);
+      detection.bbox.xmin = ((w + 0.5) * stride - box[0]) * w_scale;
+      detection.bbox.ymin = ((h + 0.5) * stride - box[1]) * h_scale;
+      detection.bbox.xmax = ((w + 0.5) * stride + box[2]) * w_scale;
+      detection.bbox.ymax = ((h + 0.5) * stride + box[3]) * h_scale;
+      detection.score = score;
+      detection.id = id;
+      detection.class_name = fcos_config_.class_names[id].c_str();
+      dets->push_back(detection);
     }
   }
 }
 
 static void GetBboxAndScoresNCHW(
     hbDNNTensor *cls_tensors, hbDNNTensor *bbox_tensors, hbDNNTensor *ce_tensors,
-    FcosPostProcessInfo_t *post_info, int layer) {
-  int ori_h = post_info->ori_height;
-  int ori_w = post_info->ori_width;
-  int input_h = post_info->height;
-  int input_w = post_info->width;
+    FcosPostProcessInfo_t *post_info, int layer, int h_begin, int h_end,
+    PostProcessArenaVector<Detection> *dets) {
   float w_scale;
   float h_scale;
-  // preprocess action is pad and resize
-  if (post_info->is_pad_resize) {
-    float scale = ori_h > ori_w ? ori_h : ori_w;
-    w_scale = scale / input_w;
-    h_scale = scale / input_h;
-  } else {
-    w_scale = static_cast<float>(ori_w) / input_w;
-    h_scale = static_cast<float>(ori_h) / input_h;
-  }
+  FcosGetScale(post_info, &w_scale, &h_scale);
 
   auto *cls_data = reinterpret_cast<float *>(cls_tensors->sysMem[0].virAddr);
   auto *bbox_data =
@@ -418,65 +434,59 @@ static void GetBboxAndScoresNCHW(
   int tensor_h = shape[2];
   int tensor_w = shape[3];
   int aligned_hw = tensor_h * tensor_w;
+  float stride = fcos_config_.strides[layer];
 
-  for (int h = 0; h < tensor_h; h++) {
-    int offset = h * tensor_w;
-    for (int w = 0; w < tensor_w; w++) {
-      // get score
-      int ce_offset = offset + w;
-      ce_data[ce_offset] = 1.0 / (1.0 + exp(-ce_data[ce_offset]));
+  // sigmoid(ce) <= score_threshold^2 时得分一定不满足阈值，先用centerness过滤
+  float ce_thresh =
+      LogitThreshold(post_info->score_threshold * post_info->score_threshold);
 
-      ScoreId tmp_score = {cls_data[offset + w], 0};
-      for (int cls_c = 1; cls_c < tensor_c; cls_c++) {
-        int cls_index = cls_c * aligned_hw + offset + w;
-        if (cls_data[cls_index] > tmp_score.score) {
-          tmp_score.id = cls_c;
-          tmp_score.score = cls_data[cls_index];
-        }
+  // 相邻4个位置为一组，组内有位置通过centerness过滤时，4个位置一起在各通道上求最大值
+  float max_cls[4];
+  int32_t max_id[4];
+  for (int h = h_begin; h < h_end; h++) {
+    int offset = h * tensor_w;
+    for (int w = 0; w < tensor_w; w += 4) {
+      int lanes = std::min(4, tensor_w - w);
+      bool any_pass = false;
+      for (int j = 0; j < lanes; j++) {
+        any_pass |= ce_data[offset + w + j] > ce_thresh;
+      }
+      if (!any_pass) continue;
+      if (lanes == 4) {
+        ArgMaxChannelX4(cls_data + offset + w, tensor_c, aligned_hw, max_cls, max_id);
+      } else {
+        ArgMaxChannelTail(cls_data + offset + w, tensor_c, aligned_hw, lanes, max_cls, max_id);
       }
-      tmp_score.score = 1.0 / (1.0 + exp(-tmp_score.score));
-      tmp_score.score = std::sqrt(tmp_score.score * ce_data[ce_offset]);
-      if (tmp_score.score <= post_info->score_threshold) continue;
-
-      // get detection box
-      auto &strides = fcos_config_.strides;
-      Detection detection;
-      detection.bbox.xmin =
-          ((w + 0.5) * strides[layer] - bbox_data[offset + w]) * w_scale;
-      detection.bbox.ymin =
-          ((h + 0.5) * strides[layer] - bbox_data[1 * aligned_hw + offset + w]) *
-          h_scale;
-      detection.bbox.xmax =
-          ((w + 0.5) * strides[layer] + bbox_data[2 * aligned_hw + offset + w]) *
-          w_scale;
-      detection.bbox.ymax =
-          ((h + 0.5) * strides[layer] + bbox_data[3 * aligned_hw + offset + w]) *
-          h_scale;
 
-      detection.score = tmp_score.score;
-      detection.id = tmp_score.id;
-      detection.class_name = fcos_config_.class_names[detection.id].c_str();
-      fcos_dets.push_back(detection);
+      for (int j = 0; j < lanes; j++) {
+        int pos = offset + w + j;
+        if (ce_data[pos] <= ce_thresh) continue;
+        float score = std::sqrt(FastSigmoid(max_cls[j]) * FastSigmoid(ce_data[pos]));
+        if (score <= post_info->score_threshold) continue;
+
+        float cx = (w + j + 0.5) * stride;
+        float cy = (h + 0.5) * stride;
+        Detection detection;
+        detection.bbox.xmin = (cx - bbox_data[pos]) * w_scale;
+        detection.bbox.ymin = (cy - bbox_data[aligned_hw + pos]) * h_scale;
+        detection.bbox.xmax = (cx + bbox_data[2 * aligned_hw + pos]) * w_scale;
+        detection.bbox.ymax = (cy + bbox_data[3 * aligned_hw + pos]) * h_scale;
+        detection.score = score;
+        detection.id = max_id[j];
+        detection.class_name = fcos_config_.class_names[detection.id].c_str();
+        dets->push_back(detection);
+      }
     }
   }
 }
 
-void GetBboxAndScoresScaleNCHW(hbDNNTensor *cls_tensors, hbDNNTensor *bbox_tensors, hbDNNTensor *ce_tensors, FcosPostProcessInfo_t *post_info, int layer) {
-  int ori_h = post_info->ori_height;
-  int ori_w = post_info->ori_width;
-  int input_h = post_info->height;
-  int input_w = post_info->width;
+static void GetBboxAndScoresScaleNCHW(
+    hbDNNTensor *cls_tensors, hbDNNTensor *bbox_tensors, hbDNNTensor *ce_tensors,
+    FcosPostProcessInfo_t *post_info, int layer, int h_begin, int h_end,
+    PostProcessArenaVector<Detection> *dets) {
   float w_scale;
   float h_scale;
-  // preprocess action is pad and resize
-  if (post_info->is_pad_resize) {
-    float scale = ori_h > ori_w ? ori_h : ori_w;
-    w_scale = scale / input_w;
-    h_scale = scale / input_h;
-  } else {
-    w_scale = static_cast<float>(ori_w) / input_w;
-    h_scale = static_cast<float>(ori_h) / input_h;
-  }
+  FcosGetScale(post_info, &w_scale, &h_scale);
 
   /* sqrt(sigmoid(cls) * sigmoid(ce)) <= score_threshold_  equals to
    ** sigmoid(cls) * sigmoid(ce) <= score_threshold_^2
@@ -508,70 +518,62 @@ void GetBboxAndScoresScaleNCHW(hbDNNTensor *cls_tensors, hbDNNTensor *bbox_tenso
   int tensor_w = shape[3];
   int tensor_vw = cls_tensors->properties.validShape.dimensionSize[3];
   int aligned_hw = tensor_h * tensor_w;
+  float stride = fcos_config_.strides[layer];
 
-  ScoreId tmp;
-
-  tmp.score = pre_thresh;
-  tmp.id = -1;
-  // mask score stored the max score and id in 80 classes for every pixels
-  std::vector<std::vector<ScoreId>> mask_score(
-      tensor_h, std::vector<ScoreId>(tensor_w, tmp));
-
-  for (int c = 0; c < tensor_c; c++) {
-    int offset_c = c * aligned_hw;
-    for (int h = 0; h < tensor_h; h++) {
-      int ce_offset_h = h * tensor_w;
-      int offset_h = offset_c + ce_offset_h;
-      for (int w = 0; w < tensor_vw; w++) {
-        int score_offset = offset_h + w;
-        float tmp_score = cls_data[score_offset] * de_cls[c];
-        if (tmp_score <= mask_score[h][w].score) continue;
-        mask_score[h][w].score = tmp_score;
-        mask_score[h][w].id = c;
-      }
-    }
-  }
+  // centerness 阈值换算到量化域，先用int32比较筛掉绝大部分位置，
+  // 只对剩下的位置在各个类别通道上求最大值
+  int32_t ce_raw_thresh = QuantiLogitThreshold(score_thresh, de_ce[0]);
 
-  auto &strides = fcos_config_.strides;
-
-  for (int h = 0; h < tensor_h; h++) {
-    int ce_offset_h = h * tensor_w;
-    for (int w = 0; w < tensor_w; w++) {
-      // if cls <= -ln( 1 / score_threshold_^2 -1)
-      if (mask_score[h][w].score <= pre_thresh) continue;
-      int offset = ce_offset_h + w;
-      float tmp_ce = ce_data[offset] * de_ce[0];
-      if (tmp_ce <= pre_thresh) continue;
-      float ce = 1.0 / (1.0 + exp(-tmp_ce));
-      float tmp_score = 1.0 / (1.0 + exp(-mask_score[h][w].score));
-      // sigmoid(ce) * sigmoid(cls)
-      tmp_score = tmp_score * ce;
-      if (tmp_score <= score_thresh) {
-        continue;
+  float max_cls[4];
+  int32_t max_id[4];
+  for (int h = h_begin; h < h_end; h++) {
+    int offset = h * tensor_w;
+    for (int w = 0; w < tensor_vw; w += 4) {
+      int lanes = std::min(4, tensor_vw - w);
+      bool any_pass = false;
+      for (int j = 0; j < lanes; j++) {
+        any_pass |= ce_data[offset + w + j] > ce_raw_thresh;
+      }
+      if (!any_pass) continue;
+      if (lanes == 4) {
+        ArgMaxChannelDequantiX4(cls_data + offset + w, de_cls, tensor_c, aligned_hw,
+                                max_cls, max_id);
+      } else {
+        ArgMaxChannelTail(cls_data + offset + w, de_cls, tensor_c, aligned_hw, lanes,
+                          max_cls, max_id);
       }
 
-      float xmin = std::max(0.f, bbox_data[offset] * de_bbox[0]);
-      float ymin = std::max(0.f, bbox_data[offset + aligned_hw] * de_bbox[1]);
-      float xmax =
-          std::max(0.f, bbox_data[offset + 2 * aligned_hw] * de_bbox[2]);
-      float ymax =
-          std::max(0.f, bbox_data[offset + 3 * aligned_hw] * de_bbox[3]);
-
-      Detection detection;
-      detection.bbox.xmin = (w + 0.5 - xmin) * strides[layer] * w_scale;
-      detection.bbox.ymin = (h + 0.5 - ymin) * strides[layer] * h_scale;
-      detection.bbox.xmax = (w + 0.5 + xmax) * strides[layer] * w_scale;
-      detection.bbox.ymax = (h + 0.5 + ymax) * strides[layer] * h_scale;
-
-      detection.score = std::sqrt(tmp_score);
-      detection.id = mask_score[h][w].id;
-      detection.class_name = fcos_config_.class_names[detection.id].c_str();
-      fcos_dets.push_back(detection);
+      for (int j = 0; j < lanes; j++) {
+        int pos = offset + w + j;
+        if (ce_data[pos] <= ce_raw_thresh) continue;
+        float tmp_ce = ce_data[pos] * de_ce[0];
+        // if cls <= -ln( 1 / score_threshold_^2 -1)
+        if (tmp_ce <= pre_thresh || max_cls[j] <= pre_thresh) continue;
+
+        // sigmoid(ce) * sigmoid(cls)
+        float tmp_score = FastSigmoid(max_cls[j]) * FastSigmoid(tmp_ce);
+        if (tmp_score <= score_thresh) continue;
+
+        float xmin = std::max(0.f, bbox_data[pos] * de_bbox[0]);
+        float ymin = std::max(0.f, bbox_data[pos + aligned_hw] * de_bbox[1]);
+        float xmax = std::max(0.f, bbox_data[pos + 2 * aligned_hw] * de_bbox[2]);
+        float ymax = std::max(0.f, bbox_data[pos + 3 * aligned_hw] * de_bbox[3]);
+
+        Detection detection;
+        detection.bbox.xmin = (w + j + 0.5 - xmin) * stride * w_scale;
+        detection.bbox.ymin = (h + 0.5 - ymin) * stride * h_scale;
+        detection.bbox.xmax = (w + j + 0.5 + xmax) * stride * w_scale;
+        detection.bbox.ymax = (h + 0.5 + ymax) * stride * h_scale;
+        detection.score = std::sqrt(tmp_score);
+        detection.id = max_id[j];
+        detection.class_name = fcos_config_.class_names[detection.id].c_str();
+        dets->push_back(detection);
+      }
     }
   }
 }
 
-void GetBboxAndScoresScaleNHWC(hbDNNTensor *cls_tensors, hbDNNTensor *bbox_tensors, hbDNNTensor *ce_tensors, FcosPostProcessInfo_t *post_info, int layer) {
+void GetBboxAndScoresScaleNHWC(hbDNNTensor *cls_tensors, hbDNNTensor *bbox_tensors, hbDNNTensor *ce_tensors, FcosPostProcessInfo_t *post_info, int layer, PostProcessArenaVector<Detection> *dets) {
   int ori_h = post_info->ori_height;
   int ori_w = post_info->ori_width;
   int input_h = post_info->height;
@@ -647,15 +649,16 @@ void GetBboxAndScoresScaleNHWC(hbDNNTensor *cls_tensors, hbDNNTensor *bbox_tenso
       detection.score = tmp_score.score;
       detection.id = tmp_score.id;
       detection.class_name = fcos_config_.class_names[detection.id].c_str();
-      fcos_dets.push_back(detection);
+      dets->push_back(detection);
     }
   }
 }
 
 //for community_qat_ support
-void GetBboxAndScoresScaleNHWC_V2(hbDNNTensor *cls_tensors, hbDNNTensor *bbox_tensors, hbDNNTensor *ce_tensors, FcosPostProcessInfo_t *post_info, int layer) {
-
-  // preprocess action is pad and resize
+static void GetBboxAndScoresScaleNHWC_V2(
+    hbDNNTensor *cls_tensors, hbDNNTensor *bbox_tensors, hbDNNTensor *ce_tensors,
+    FcosPostProcessInfo_t *post_info, int layer, int h_begin, int h_end,
+    PostProcessArenaVector<Detection> *dets) {
   auto *cls_data = reinterpret_cast<int32_t *>(cls_tensors->sysMem[0].virAddr);
   auto *bbox_data =
       reinterpret_cast<int32_t *>(bbox_tensors->sysMem[0].virAddr);
@@ -667,75 +670,77 @@ void GetBboxAndScoresScaleNHWC_V2(hbDNNTensor *cls_tensors, hbDNNTensor *bbox_te
 
   // 同一个尺度下，tensor[i],tensor[i+5],tensor[i+10]出来的hw都一致，64*64/32*32/...
   int *shape = cls_tensors->properties.alignedShape.dimensionSize;
-  int tensor_h = shape[1];
   int tensor_w = shape[2];
   int tensor_c = shape[3];
-  // int32_t bbox_c_stride=4;//{bbox_tensors->properties.alignedShape.dimensionSize[3]};
-  // int32_t ce_c_stride=4;//{ce_tensors->properties.alignedShape.dimensionSize[3]};
   int32_t bbox_c_stride=bbox_tensors->properties.alignedShape.dimensionSize[3];
   int32_t ce_c_stride=ce_tensors->properties.alignedShape.dimensionSize[3];
+  float stride = fcos_config_.strides[layer];
 
+  // sigmoid(ce) <= score_threshold^2 时得分一定不满足阈值，
+  // 阈值换算到量化域后直接和int32原始数据比较，跳过反量化、exp和类别argmax
+  int32_t ce_raw_thresh = QuantiLogitThreshold(
+      post_info->score_threshold * post_info->score_threshold, ce_scale[0]);
 
-  for (int h = 0; h < tensor_h; h++) {
+  for (int h = h_begin; h < h_end; h++) {
     for (int w = 0; w < tensor_w; w++) {
-      // get score
-      int ce_offset = (h * tensor_w + w) * ce_c_stride;
-      float ce_data_offset =
-          1.0 / (1.0 + exp(-ce_data[ce_offset] * ce_scale[0]));
-      int cls_offset = (h * tensor_w + w) * tensor_c;
+      int offset = h * tensor_w + w;
+      int32_t ce_raw = ce_data[offset * ce_c_stride];
+      if (ce_raw <= ce_raw_thresh) continue;
       auto max_score_id =
-          MaxScoreID(cls_data + cls_offset, cls_scale, tensor_c);
-      // filter
-      float cls_data_offset = 1.0 / (1.0 + exp(-max_score_id.first));
-      float score = std::sqrt(cls_data_offset * ce_data_offset);
-
-
-      // if (tmp_score.score <= post_info->score_threshold) continue;
+          MaxScoreID(cls_data + offset * tensor_c, cls_scale, tensor_c);
+      float score = std::sqrt(FastSigmoid(max_score_id.first) *
+                              FastSigmoid(ce_raw * ce_scale[0]));
       if (score <= post_info->score_threshold) continue;
 
-      // get detection box
-      Detection detection;
-      int index = bbox_c_stride * (h * tensor_w + w);
-      auto &strides = fcos_config_.strides;
-
-
-      float xmin = std::max(0.f, bbox_data[index] * bbox_scale[0]);
-      float ymin = std::max(0.f, bbox_data[index + 1] * bbox_scale[1]);
-      float xmax = std::max(0.f, bbox_data[index + 2] * bbox_scale[2]);
-      float ymax = std::max(0.f, bbox_data[index + 3] * bbox_scale[3]);
-
-      detection.bbox.xmin = ((w + 0.5) - xmin) * strides[layer];
-      detection.bbox.ymin = ((h + 0.5) - ymin) * strides[layer];
-      detection.bbox.xmax = ((w + 0.5) + xmax) * strides[layer];
-      detection.bbox.ymax = ((h + 0.5) + ymax) * strides[layer];
+      const int32_t *box = bbox_data + offset * bbox_c_stride;
+      float xmin = std::max(0.f, box[0] * bbox_scale[0]);
+      float ymin = std::max(0.f, box[1] * bbox_scale[1]);
+      float xmax = std::max(0.f, box[2] * bbox_scale[2]);
+      float ymax = std::max(0.f, box[3] * bbox_scale[3]);
 
+      Detection detection;
+      detection.bbox.xmin = ((w + 0.5) - xmin) * stride;
+      detection.bbox.ymin = ((h + 0.5) - ymin) * stride;
+      detection.bbox.xmax = ((w + 0.5) + xmax) * stride;
+      detection.bbox.ymax = ((h + 0.5) + ymax) * stride;
       detection.score = score;
       detection.id = max_score_id.second;
       detection.class_name = fcos_config_.class_names[detection.id].c_str();
-      fcos_dets.push_back(detection);
+      dets->push_back(detection);
     }
   }
+}
 
+// 输出层的行数
+static int FcosLayerHeight(hbDNNTensor *cls_tensors) {
+  int h_index, w_index, c_index;
+  if (get_tensor_hwc_index(cls_tensors, &h_index, &w_index, &c_index) != 0) {
+    return 0;
+  }
+  return cls_tensors->properties.alignedShape.dimensionSize[h_index];
 }
 
-void FcosdoProcess(hbDNNTensor *cls_tensors, hbDNNTensor *bbox_tensors, hbDNNTensor *ce_tensors, FcosPostProcessInfo_t *post_info, int layer) {
+// 解码一层输出的 [h_begin, h_end) 行，候选框追加到 dets
+static void FcosDecodeLayer(hbDNNTensor *cls_tensors, hbDNNTensor *bbox_tensors, hbDNNTensor *ce_tensors,
+                            FcosPostProcessInfo_t *post_info, int layer, int h_begin, int h_end,
+                            PostProcessArenaVector<Detection> *dets) {
 
   auto quanti_type = cls_tensors->properties.quantiType;
 
   if (quanti_type == hbDNNQuantiType::SCALE) {
       if (cls_tensors->properties.tensorLayout == HB_DNN_LAYOUT_NHWC) {
-        // GetBboxAndScoresScaleNHWC(cls_tensors, bbox_tensors, ce_tensors, post_info, layer);
-        GetBboxAndScoresScaleNHWC_V2(cls_tensors, bbox_tensors, ce_tensors, post_info, layer);
+        // GetBboxAndScoresScaleNHWC(cls_tensors, bbox_tensors, ce_tensors, post_info, layer, dets);
+        GetBboxAndScoresScaleNHWC_V2(cls_tensors, bbox_tensors, ce_tensors, post_info, layer, h_begin, h_end, dets);
       } else if (cls_tensors->properties.tensorLayout == HB_DNN_LAYOUT_NCHW) {
-        GetBboxAndScoresScaleNCHW(cls_tensors, bbox_tensors, ce_tensors, post_info, layer);
+        GetBboxAndScoresScaleNCHW(cls_tensors, bbox_tensors, ce_tensors, post_info, layer, h_begin, h_end, dets);
       } else {
         printf("tensor layout error.\n");
       }
     } else if (quanti_type == hbDNNQuantiType::NONE) {
       if (cls_tensors->properties.tensorLayout == HB_DNN_LAYOUT_NHWC) {
-        GetBboxAndScoresNHWC(cls_tensors, bbox_tensors, ce_tensors, post_info, layer);
+        GetBboxAndScoresNHWC(cls_tensors, bbox_tensors, ce_tensors, post_info, layer, h_begin, h_end, dets);
       } else if (cls_tensors->properties.tensorLayout == HB_DNN_LAYOUT_NCHW) {
-        GetBboxAndScoresNCHW(cls_tensors, bbox_tensors, ce_tensors, post_info, layer);
+        GetBboxAndScoresNCHW(cls_tensors, bbox_tensors, ce_tensors, post_info, layer, h_begin, h_end, dets);
       } else {
         printf("tensor layout error.\n");
       }
@@ -745,34 +750,183 @@ void FcosdoProcess(hbDNNTensor *cls_tensors, hbDNNTensor *bbox_tensors, hbDNNTen
 
 }
 
-char* FcosPostProcess(FcosPostProcessInfo_t *post_info) {
+/**
+ * 一次解码全部输出层，各层按行数切分成若干段后在后处理线程池中并行解码，
+ * 结果按层、行的顺序合并到 dets，与逐层调用 FcosDecodeLayer 的顺序一致
+ */
+static void FcosDecodeAll(FcosDecodeContext *ctx,
+                          hbDNNTensor *cls_tensors,
+                          hbDNNTensor *bbox_tensors,
+                          hbDNNTensor *ce_tensors,
+                          int layer_num,
+                          FcosPostProcessInfo_t *post_info,
+                          PostProcessArenaVector<Detection> *dets) {
+  if (layer_num <= 0 || layer_num > static_cast<int>(fcos_config_.strides.size())) {
+    printf("fcos post process invalid output layer num %d!\n", layer_num);
+    return;
+  }
 
-  int i = 0;
-  char *str_dets;
+  // stride 8 的层行数最多，切得最细；任务数取线程数的2倍，减少各线程之间的等待
+  PostProcessThreadPool *pool = PostProcessThreadPool::Instance();
+  int target_tasks = pool->ThreadNum() > 1 ? pool->ThreadNum() * 2 : 1;
+  int total_rows = 0;
+  for (int i = 0; i < layer_num; i++) {
+    total_rows += FcosLayerHeight(&cls_tensors[i]);
+  }
+  PostProcessArenaVector<FcosDecodeTask> &tasks = ctx->tasks;
+  tasks.clear();
+  for (int i = 0; i < layer_num; i++) {
+    int height = FcosLayerHeight(&cls_tensors[i]);
+    if (height <= 0) continue;
+    int chunks = static_cast<int>(
+        (static_cast<int64_t>(height) * target_tasks + total_rows / 2) / total_rows);
+    chunks = std::max(1, std::min(chunks, height));
+    int rows = (height + chunks - 1) / chunks;
+    for (int h = 0; h < height; h += rows) {
+      tasks.push_back({i, h, std::min(h + rows, height)});
+    }
+  }
 
-  std::vector<Detection> fcos_det_restuls;
-  // 计算交并比来合并检测框，传入交并比阈值和返回box数量
-  fcos_nms(fcos_dets, post_info->nms_threshold, post_info->nms_top_k, fcos_det_restuls, false);
+  int task_num = tasks.size();
+  if (static_cast<int>(ctx->task_dets.size()) < task_num) {
+    ctx->task_dets.resize(task_num);
+  }
+  pool->ParallelFor(task_num, [&](int t) {
+    const FcosDecodeTask &task = tasks[t];
+    PostProcessArenaVector<Detection> &task_dets = ctx->task_dets[t];
+    task_dets.clear();
+    FcosDecodeLayer(&cls_tensors[task.layer], &bbox_tensors[task.layer], &ce_tensors[task.layer],
+                    post_info, task.layer, task.h_begin, task.h_end, &task_dets);
+  });
+
+  for (int t = 0; t < task_num; t++) {
+    PostProcessArenaVector<Detection> &task_dets = ctx->task_dets[t];
+    dets->insert(dets->end(), task_dets.begin(), task_dets.end());
+    task_dets.clear();
+  }
+}
 
-  std::stringstream out_string;
+void FcosdoProcess(hbDNNTensor *cls_tensors, hbDNNTensor *bbox_tensors, hbDNNTensor *ce_tensors, FcosPostProcessInfo_t *post_info, int layer) {
+  FcosDecodeLayer(cls_tensors, bbox_tensors, ce_tensors, post_info, layer,
+                  0, FcosLayerHeight(cls_tensors), &fcos_arena.dets);
+}
+
+void FcosdoProcessAll(hbDNNTensor *cls_tensors, hbDNNTensor *bbox_tensors, hbDNNTensor *ce_tensors,
+                      int layer_num, FcosPostProcessInfo_t *post_info) {
+  FcosDecodeAll(&fcos_decode_context, cls_tensors, bbox_tensors, ce_tensors, layer_num,
+                post_info, &fcos_arena.dets);
+}
+
+// 对 arena 中的候选框做NMS，结果写入 dets 后清空 arena
+static int FcosArenaToArray(PostProcessDetectionArena<Detection> *arena,
+                            FcosPostProcessInfo_t *post_info,
+                            int nms_mode,
+                            PostProcessDetection_t *dets,
+                            int capacity) {
+  PostProcessNms(arena->dets, GetNmsParam(post_info, nms_mode), arena->results, &arena->nms_ws);
+  int num = CopyDetectionResult(arena->results, dets, capacity);
+  arena->Clear();
+  return num;
+}
+
+char* FcosPostProcess(FcosPostProcessInfo_t *post_info) {
+
+  // 计算交并比来合并检测框，传入交并比阈值和返回box数量
+  PostProcessNms(fcos_arena.dets, GetNmsParam(post_info, PostProcessGetNmsMode()), fcos_arena.results,
+                 &fcos_arena.nms_ws);
 
   // 算法结果转换成json格式
-  out_string << "\"fcos_result\": [";
-  for (i = 0; i < fcos_det_restuls.size(); i++) {
-  	auto det_ret = fcos_det_restuls[i];
-  	out_string << det_ret;
-  	if (i < fcos_det_restuls.size() - 1)
-		out_string << ",";
+  PostProcessArenaVector<PostProcessDetection_t> &dets = fcos_arena.out;
+  dets.resize(fcos_arena.results.size());
+  int num = CopyDetectionResult(fcos_arena.results, dets.data(), dets.size());
+  fcos_arena.Clear();
+  return DetectionResultToJson("fcos_result", dets.data(), num, FcosGetClassName);
+}
+
+int FcosPostProcessToArray(FcosPostProcessInfo_t *post_info,
+                           PostProcessDetection_t *dets,
+                           int capacity) {
+  if (dets == nullptr || capacity < 0) {
+    printf("fcos post process invalid output array!\n");
+    fcos_arena.Clear();
+    return -1;
   }
-  out_string << "]" << std::endl;
 
-  str_dets = (char *)malloc(out_string.str().length() + 1);
-  str_dets[out_string.str().length()] = '\0';
-  snprintf(str_dets, out_string.str().length(), "%s", out_string.str().c_str());
-  /*printf("str_dets: %s\n", str_dets);*/
+  return FcosArenaToArray(&fcos_arena, post_info, PostProcessGetNmsMode(), dets, capacity);
+}
 
-  fcos_dets.clear();
-  fcos_det_restuls.clear();
-  return str_dets;
+int FcosPostProcessBatchToArray(hbDNNTensor *cls_tensors,
+                                hbDNNTensor *bbox_tensors,
+                                hbDNNTensor *ce_tensors,
+                                int layer_num,
+                                FcosPostProcessInfo_t *post_info,
+                                PostProcessDetection_t *dets,
+                                int capacity,
+                                int *counts,
+                                int max_batch) {
+  return FcosPostProcessBatchWithContextToArray(&default_fcos_context, cls_tensors, bbox_tensors,
+                                                ce_tensors, layer_num, post_info, dets, capacity,
+                                                counts, max_batch);
 }
 
+int FcosPostProcessBatchWithContextToArray(FcosPostProcessContext_t *ctx,
+                                           hbDNNTensor *cls_tensors,
+                                           hbDNNTensor *bbox_tensors,
+                                           hbDNNTensor *ce_tensors,
+                                           int layer_num,
+                                           FcosPostProcessInfo_t *post_info,
+                                           PostProcessDetection_t *dets,
+                                           int capacity,
+                                           int *counts,
+                                           int max_batch) {
+  if (ctx == nullptr || cls_tensors == nullptr || bbox_tensors == nullptr || ce_tensors == nullptr ||
+      layer_num <= 0 || dets == nullptr || capacity < 0 || counts == nullptr) {
+    printf("fcos post process invalid batch input or output array!\n");
+    return -1;
+  }
+
+  int batch_num = PostProcessGetBatchNum(&cls_tensors[0]);
+  for (int i = 0; i < layer_num; i++) {
+    if (PostProcessGetBatchNum(&cls_tensors[i]) != batch_num ||
+        PostProcessGetBatchNum(&bbox_tensors[i]) != batch_num ||
+        PostProcessGetBatchNum(&ce_tensors[i]) != batch_num) {
+      printf("fcos post process output layers have different batch size!\n");
+      return -1;
+    }
+  }
+  if (batch_num > max_batch) {
+    printf("fcos post process batch %d exceeds output array size %d!\n", batch_num, max_batch);
+    return -1;
+  }
+
+  // 只在调用线程中增加，并行任务开始后不再改变
+  while (static_cast<int>(ctx->batch_items.size()) < batch_num) {
+    ctx->batch_items.emplace_back(new FcosBatchItem());
+  }
+  // 开始前确定NMS方式，同一批图片使用同一方式
+  int nms_mode = ResolveNmsMode(ctx->nms_mode);
+
+  PostProcessThreadPool::Instance()->ParallelFor(batch_num, [&](int n) {
+    FcosBatchItem *item = ctx->batch_items[n].get();
+    item->tensors.resize(layer_num * 3);
+    hbDNNTensor *cls = item->tensors.data();
+    hbDNNTensor *bbox = cls + layer_num;
+    hbDNNTensor *ce = bbox + layer_num;
+    for (int i = 0; i < layer_num; i++) {
+      PostProcessGetBatchTensor(&cls_tensors[i], batch_num, n, &cls[i]);
+      PostProcessGetBatchTensor(&bbox_tensors[i], batch_num, n, &bbox[i]);
+      PostProcessGetBatchTensor(&ce_tensors[i], batch_num, n, &ce[i]);
+    }
+    FcosDecodeAll(&item->decode, cls, bbox, ce, layer_num, post_info, &item->arena.dets);
+    counts[n] = FcosArenaToArray(&item->arena, post_info, nms_mode,
+                                 dets + static_cast<size_t>(n) * capacity, capacity);
+  });
+  return batch_num;
+}
+
+const char *FcosGetClassName(int id) {
+  if (id < 0 || id >= static_cast<int>(fcos_config_.class_names.size())) {
+    return nullptr;
+  }
+  return fcos_config_.class_names[id].c_str();
+}
@@ -24,6 +24,7 @@
 #define _POST_PROCESS_FCOS_POST_PROCESS_H_
 
 #include "dnn/hb_dnn.h"
+#include "post_process_common.h"
 
 #ifdef __cplusplus
   extern "C"{
@@ -41,6 +42,26 @@ typedef struct {
 	// hbDNNTensor *output_tensor;
 } FcosPostProcessInfo_t;
 
+  /**
+   * 批量后处理的上下文，保存单路视频流每张图片的中间结果，不同上下文可以在不同线程中并行使用
+   * 同一个上下文同一时刻只能被一个线程使用
+   */
+  typedef struct FcosPostProcessContext FcosPostProcessContext_t;
+
+  /**
+   * 创建上下文，失败返回NULL
+   */
+  FcosPostProcessContext_t *FcosCreateContext(void);
+
+  void FcosDestroyContext(FcosPostProcessContext_t *ctx);
+
+  /**
+   * 设置 ctx 使用的NMS方式，新建的上下文默认 NMS_MODE_HARD，不受 PostProcessSetNmsMode 影响
+   * @param[in] nms_mode: PostProcessNmsMode_t
+   * @return 0 成功，ctx 为NULL或 nms_mode 不是 PostProcessNmsMode_t 中的值返回-1
+   */
+  int FcosSetNmsMode(FcosPostProcessContext_t *ctx, int nms_mode);
+
   /**
    * Post process
    * @param[in] tensor: Model output tensors
@@ -52,6 +73,70 @@ typedef struct {
 
   void FcosdoProcess(hbDNNTensor *cls_tensors, hbDNNTensor *bbox_tensors, hbDNNTensor *ce_tensors, FcosPostProcessInfo_t *post_info, int layer) ;
 
+  /**
+   * 一次解码全部输出层，等价于依次调用 FcosdoProcess(&cls_tensors[i], &bbox_tensors[i], &ce_tensors[i], post_info, i)
+   * 各层按行切分后在后处理线程池中并行解码，线程数见 PostProcessSetThreadNum
+   * @param[in] cls_tensors/bbox_tensors/ce_tensors: 各层的输出tensor数组，按 stride 8/16/32/64/128 的顺序
+   * @param[in] layer_num: 输出层数
+   */
+  void FcosdoProcessAll(hbDNNTensor *cls_tensors,
+                        hbDNNTensor *bbox_tensors,
+                        hbDNNTensor *ce_tensors,
+                        int layer_num,
+                        FcosPostProcessInfo_t *post_info);
+
+  /**
+   * 与 FcosPostProcess 相同，但结果直接写入 dets 数组，不生成json字符串
+   * @param[out] dets: 调用者分配的结果数组
+   * @param[in] capacity: dets 数组的长度，结果超过 capacity 时只保留前 capacity 个
+   * @return 写入的结果个数，参数错误返回-1
+   */
+  int FcosPostProcessToArray(FcosPostProcessInfo_t *post_info,
+                           PostProcessDetection_t *dets,
+                           int capacity);
+
+  /**
+   * 批量(N>1)输出的后处理，每张图片单独解码和NMS，图片之间在后处理线程池中并行
+   * 内部使用全局默认上下文，不能在多个线程中同时调用；多路并行时使用 FcosPostProcessBatchWithContextToArray
+   * @param[in] cls_tensors/bbox_tensors/ce_tensors: 各层的输出tensor数组，第 i 个对应 FcosdoProcess 的 layer i
+   * @param[in] layer_num: 输出层数
+   * @param[out] dets: 调用者分配的结果数组，长度 max_batch * capacity，
+   *                   第 n 张图片的结果从 dets + n * capacity 开始
+   * @param[in] capacity: 每张图片最多保留的结果个数
+   * @param[out] counts: 每张图片实际写入的结果个数，长度 max_batch
+   * @param[in] max_batch: dets/counts 能容纳的图片数，小于输出的batch数时返回-1
+   * @return 输出的batch数，参数错误返回-1
+   */
+  int FcosPostProcessBatchToArray(hbDNNTensor *cls_tensors,
+                                  hbDNNTensor *bbox_tensors,
+                                  hbDNNTensor *ce_tensors,
+                                  int layer_num,
+                                  FcosPostProcessInfo_t *post_info,
+                                  PostProcessDetection_t *dets,
+                                  int capacity,
+                                  int *counts,
+                                  int max_batch);
+
+  /**
+   * 与 FcosPostProcessBatchToArray 相同，每张图片的中间结果保存在 ctx 中
+   * 不同的 ctx 可以在不同线程中同时调用
+   */
+  int FcosPostProcessBatchWithContextToArray(FcosPostProcessContext_t *ctx,
+                                             hbDNNTensor *cls_tensors,
+                                             hbDNNTensor *bbox_tensors,
+                                             hbDNNTensor *ce_tensors,
+                                             int layer_num,
+                                             FcosPostProcessInfo_t *post_info,
+                                             PostProcessDetection_t *dets,
+                                             int capacity,
+                                             int *counts,
+                                             int max_batch);
+
+  /**
+   * 根据 PostProcessDetection_t.id 获取类别名，越界返回NULL
+   */
+  const char *FcosGetClassName(int id);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,27 @@
+// Copyright (c) 2024，D-Robotics.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <atomic>
+
+#include "post_process_arena.h"
+
+static std::atomic<uint64_t> arena_alloc_count(0);
+
+void PostProcessArenaCountAlloc() {
+  arena_alloc_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t PostProcessArenaAllocCount() {
+  return arena_alloc_count.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,89 @@
+// Copyright (c) 2024，D-Robotics.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// 后处理帧间复用的内存
+// 各模型的候选框、NMS用到的面积/下标、结果等缓存都使用 PostProcessArenaVector，
+// clear 只清空内容不释放内存，容量保持历史最大值(high-water mark)，
+// 稳定运行后每帧不再有堆分配。每次真正向系统申请内存都会计数，用 PostProcessArenaAllocCount 检查
+
+#ifndef _POST_PROCESS_POST_PROCESS_ARENA_H_
+#define _POST_PROCESS_POST_PROCESS_ARENA_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+  extern "C"{
+#endif
+
+  /**
+   * 获取后处理缓存累计向系统申请内存的次数
+   * 输入尺寸和候选框个数不超过之前的最大值时该值保持不变，可以在测试中检查稳定运行后是否还有堆分配
+   * 注意 XxxPostProcess 返回的json字符串本身是malloc分配的，不计入；XxxPostProcessToArray 没有这部分分配
+   * @return 累计申请次数
+   */
+  uint64_t PostProcessArenaAllocCount();
+
+#ifdef __cplusplus
+}
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// 记录一次内存申请
+void PostProcessArenaCountAlloc();
+
+/**
+ * 申请内存时计数的分配器，其余行为与 std::allocator 相同
+ */
+template <typename T>
+struct PostProcessArenaAllocator {
+  typedef T value_type;
+
+  PostProcessArenaAllocator() {}
+  template <typename U>
+  PostProcessArenaAllocator(const PostProcessArenaAllocator<U> &) {}
+
+  T *allocate(size_t num) {
+    PostProcessArenaCountAlloc();
+    return std::allocator<T>().allocate(num);
+  }
+
+  void deallocate(T *ptr, size_t num) {
+    std::allocator<T>().deallocate(ptr, num);
+  }
+};
+
+template <typename T, typename U>
+static inline bool operator==(const PostProcessArenaAllocator<T> &,
+                              const PostProcessArenaAllocator<U> &) {
+  return true;
+}
+
+template <typename T, typename U>
+static inline bool operator!=(const PostProcessArenaAllocator<T> &,
+                              const PostProcessArenaAllocator<U> &) {
+  return false;
+}
+
+/**
+ * 帧间复用的缓存，用法与 std::vector 相同
+ * 只有 resize/push_back 超过历史最大容量时才会重新申请内存
+ */
+template <typename T>
+using PostProcessArenaVector = std::vector<T, PostProcessArenaAllocator<T>>;
+
+#endif
+
+#endif  // _POST_PROCESS_POST_PROCESS_ARENA_H_
@@ -0,0 +1,44 @@
+// Copyright (c) 2024，D-Robotics.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdint>
+
+#include "post_process_batch.h"
+
+int PostProcessGetBatchNum(hbDNNTensor *tensor) {
+  if (tensor == nullptr || tensor->properties.alignedShape.numDimensions < 1) {
+    return -1;
+  }
+  int batch_num = tensor->properties.alignedShape.dimensionSize[0];
+  return batch_num > 0 ? batch_num : 1;
+}
+
+void PostProcessGetBatchTensor(const hbDNNTensor *tensor,
+                               int batch_num,
+                               int index,
+                               hbDNNTensor *view) {
+  *view = *tensor;
+  if (batch_num <= 1) {
+    return;
+  }
+
+  int32_t batch_size = tensor->properties.alignedByteSize / batch_num;
+  int32_t offset = batch_size * index;
+  view->properties.alignedShape.dimensionSize[0] = 1;
+  view->properties.validShape.dimensionSize[0] = 1;
+  view->properties.alignedByteSize = batch_size;
+  view->sysMem[0].virAddr = reinterpret_cast<uint8_t *>(tensor->sysMem[0].virAddr) + offset;
+  view->sysMem[0].phyAddr = tensor->sysMem[0].phyAddr + offset;
+  view->sysMem[0].memSize = batch_size;
+}
@@ -0,0 +1,48 @@
+// Copyright (c) 2024，D-Robotics.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// 批量(N>1)输出tensor的拆分
+// 与 dnn_python.cpp 分配输入内存的方式一致，每张图片占 alignedByteSize / N 字节，
+// 拆成 N 个 batch 为1的tensor后可以直接交给原来的单张图片解码函数
+
+#ifndef _POST_PROCESS_POST_PROCESS_BATCH_H_
+#define _POST_PROCESS_POST_PROCESS_BATCH_H_
+
+#include "dnn/hb_dnn.h"
+
+#ifdef __cplusplus
+  extern "C"{
+#endif
+
+  /**
+   * 获取输出tensor的batch数，即 alignedShape 的第0维
+   * XxxPostProcessBatchToArray 的结果数组按这个值分配
+   * @return batch数，tensor为空返回-1
+   */
+  int PostProcessGetBatchNum(hbDNNTensor *tensor);
+
+#ifdef __cplusplus
+}
+
+/**
+ * 取出第 index 张图片对应的tensor，属性与原tensor相同，只是batch为1、内存地址指向该图片的数据
+ * 不拷贝数据，view 只在原tensor的内存有效期间可用
+ */
+void PostProcessGetBatchTensor(const hbDNNTensor *tensor,
+                               int batch_num,
+                               int index,
+                               hbDNNTensor *view);
+#endif
+
+#endif  // _POST_PROCESS_POST_PROCESS_BATCH_H_
@@ -0,0 +1,107 @@
+// Copyright (c) 2024，D-Robotics.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "post_process_common.h"
+
+static char *StringToMalloc(const std::string &str) {
+  char *out = (char *)malloc(str.length() + 1);
+  if (out == nullptr) {
+    printf("malloc json string failed!\n");
+    return nullptr;
+  }
+  memcpy(out, str.c_str(), str.length() + 1);
+  return out;
+}
+
+static const char *SafeClassName(PostProcessGetClassName get_class_name, int id) {
+  const char *name = get_class_name ? get_class_name(id) : nullptr;
+  return name ? name : "";
+}
+
+// 输出格式与各模型中 Detection 的 operator<< 一致
+char* DetectionResultToJson(const char *result_name,
+                            const PostProcessDetection_t *dets,
+                            int num,
+                            PostProcessGetClassName get_class_name) {
+  std::string out;
+  char buf[256];
+
+  out.reserve(32 + num * 128);
+  out += "\"";
+  out += result_name;
+  out += "\": [";
+  for (int i = 0; i < num; i++) {
+    const PostProcessDetection_t &det = dets[i];
+    snprintf(buf, sizeof(buf),
+             "{\"bbox\":[%f,%f,%f,%f],\"score\":%f,\"id\":%d,\"name\":\"",
+             det.bbox.xmin, det.bbox.ymin, det.bbox.xmax, det.bbox.ymax,
+             det.score, det.id);
+    out += buf;
+    out += SafeClassName(get_class_name, det.id);
+    out += "\"}";
+    if (i < num - 1)
+      out += ",";
+  }
+  out += "]";
+  return StringToMalloc(out);
+}
+
+char* ClassificationResultToJson(const char *result_name,
+                                 const PostProcessClassification_t *cls,
+                                 int num,
+                                 PostProcessGetClassName get_class_name) {
+  std::string out;
+  char buf[64];
+
+  out.reserve(32 + num * 128);
+  out += "\"";
+  out += result_name;
+  out += "\": [";
+  for (int i = 0; i < num; i++) {
+    snprintf(buf, sizeof(buf), "{\"prob\":%.5f,\"label\":%d,\"class_name\":\"",
+             cls[i].prob, cls[i].id);
+    out += buf;
+    out += SafeClassName(get_class_name, cls[i].id);
+    out += "\"}";
+    if (i < num - 1)
+      out += ",";
+  }
+  out += "]";
+  return StringToMalloc(out);
+}
+
+char* SegmentationResultToJson(const char *result_name,
+                               const uint8_t *mask,
+                               int num) {
+  std::string out;
+  char buf[8];
+
+  out.reserve(32 + num * 3);
+  out += "\"";
+  out += result_name;
+  out += "\": [";
+  for (int i = 0; i < num; i++) {
+    int len = snprintf(buf, sizeof(buf), "%d", mask[i]);
+    out.append(buf, len);
+    if (i < num - 1)
+      out += ",";
+  }
+  out += "]";
+  return StringToMalloc(out);
+}
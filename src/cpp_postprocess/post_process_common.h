@@ -0,0 +1,157 @@
+// Copyright (c) 2024，D-Robotics.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// 各个模型后处理共用的二进制结果格式
+// XxxPostProcessToArray 接口把结果直接写到调用者提供的数组中，不再生成json字符串，
+// 需要json时再用本文件中的 XxxResultToJson 格式化，输出与 XxxPostProcess 完全一致
+
+#ifndef _POST_PROCESS_POST_PROCESS_COMMON_H_
+#define _POST_PROCESS_POST_PROCESS_COMMON_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+  extern "C"{
+#endif
+
+typedef struct {
+	float xmin;
+	float ymin;
+	float xmax;
+	float ymax;
+} PostProcessBbox_t;
+
+typedef struct {
+	PostProcessBbox_t bbox;
+	float score;
+	int32_t id; // 类别编号，同时也是 XxxGetClassName 的下标
+} PostProcessDetection_t;
+
+typedef struct {
+	float prob;
+	int32_t id; // 类别编号，同时也是 ClassificationGetClassName 的下标
+} PostProcessClassification_t;
+
+/**
+ * 根据类别编号获取类别名，编号越界时返回NULL
+ */
+typedef const char *(*PostProcessGetClassName)(int id);
+
+/**
+ * 检测后处理的NMS方式，见 PostProcessSetNmsMode
+ */
+typedef enum {
+	NMS_MODE_HARD = 0,          // 贪心NMS，IoU大于 nms_threshold 的框直接去掉
+	NMS_MODE_SOFT_GAUSSIAN = 1, // Soft-NMS，按 exp(-iou^2 / sigma) 衰减重叠框的得分
+	NMS_MODE_MATRIX = 2,        // Matrix-NMS，所有框的衰减系数由IoU矩阵一次并行算出
+	NMS_MODE_HARD_INT16 = 3,    // 与 NMS_MODE_HARD 相同，坐标取整为int16像素，一次比较8个框
+} PostProcessNmsMode_t;
+
+  /**
+   * 设置检测模型后处理使用的进程默认NMS方式，默认 NMS_MODE_HARD
+   * 只对不带上下文的旧接口(XxxPostProcess/XxxPostProcessToArray/XxxPostProcessBatchToArray 等)生效；
+   * XxxCreateContext 创建的上下文使用各自的 XxxSetNmsMode 设置，不受该设置影响，
+   * 多路视频流可以使用不同的方式，修改一路的设置不会影响其他路正在进行的后处理
+   * PostProcessNmsDetections 也不受该设置影响，使用参数指定的方式
+   * @param[in] nms_mode: PostProcessNmsMode_t
+   * @return 0 成功，nms_mode 不是 PostProcessNmsMode_t 中的值返回-1
+   */
+  int PostProcessSetNmsMode(int nms_mode);
+
+  /**
+   * 获取 PostProcessSetNmsMode 设置的NMS方式
+   */
+  int PostProcessGetNmsMode(void);
+
+  /**
+   * 把检测结果格式化成json字符串
+   * @param[in] result_name: 结果名，如 "yolov5_result"
+   * @param[in] dets: 检测结果
+   * @param[in] num: 检测结果个数
+   * @param[in] get_class_name: 类别名查询函数
+   * @return malloc分配的字符串，需要调用者free
+   */
+  char* DetectionResultToJson(const char *result_name,
+                              const PostProcessDetection_t *dets,
+                              int num,
+                              PostProcessGetClassName get_class_name);
+
+  char* ClassificationResultToJson(const char *result_name,
+                                   const PostProcessClassification_t *cls,
+                                   int num,
+                                   PostProcessGetClassName get_class_name);
+
+  /**
+   * 把分割结果格式化成json整数列表
+   * @param[in] mask: 每个像素的类别编号
+   * @param[in] num: 像素个数
+   */
+  char* SegmentationResultToJson(const char *result_name,
+                                 const uint8_t *mask,
+                                 int num);
+
+  /**
+   * 对调用者提供的检测框做NMS，同类别之间互相抑制
+   * 与模型后处理使用同一份实现，可用于python端自己解码的模型或者比较几种NMS方式
+   * 每个线程使用各自的临时内存，可以在多个线程中同时调用；id 可以是任意 int32 值
+   * @param[in] dets: 输入检测框
+   * @param[in] num: 输入检测框个数
+   * @param[in] nms_mode: PostProcessNmsMode_t
+   * @param[in] iou_threshold: NMS_MODE_HARD 时IoU大于该值的框被去掉
+   * @param[in] score_threshold: soft/matrix 方式下得分衰减到该值以下的框被去掉
+   * @param[in] top_k: 最多保留的框个数
+   * @param[out] out: 保留的框，按得分从大到小，score 为衰减后的得分
+   * @param[in] capacity: out 数组的长度
+   * @return 写入 out 的框个数，参数错误返回-1
+   */
+  int PostProcessNmsDetections(const PostProcessDetection_t *dets,
+                               int num,
+                               int nms_mode,
+                               float iou_threshold,
+                               float score_threshold,
+                               int top_k,
+                               PostProcessDetection_t *out,
+                               int capacity);
+
+#ifdef __cplusplus
+}
+
+#include <vector>
+
+/**
+ * 把各模型内部的 Detection 转换成 PostProcessDetection_t
+ * DetectionVector 为 std::vector 或 PostProcessArenaVector
+ * @return 实际写入的个数，最多 capacity 个
+ */
+template <typename DetectionVector>
+static inline int CopyDetectionResult(const DetectionVector &src,
+                                      PostProcessDetection_t *dst,
+                                      int capacity) {
+  int num = static_cast<int>(src.size());
+  if (num > capacity) {
+    num = capacity;
+  }
+  for (int i = 0; i < num; i++) {
+    dst[i].bbox.xmin = src[i].bbox.xmin;
+    dst[i].bbox.ymin = src[i].bbox.ymin;
+    dst[i].bbox.xmax = src[i].bbox.xmax;
+    dst[i].bbox.ymax = src[i].bbox.ymax;
+    dst[i].score = src[i].score;
+    dst[i].id = src[i].id;
+  }
+  return num;
+}
+#endif
+
+#endif  // _POST_PROCESS_POST_PROCESS_COMMON_H_
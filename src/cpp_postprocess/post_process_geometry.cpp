@@ -0,0 +1,134 @@
+// Copyright (c) 2024，D-Robotics.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "post_process_geometry.h"
+
+// 每个线程缓存最近使用的几组变换，一般一个线程只处理一两种分辨率
+#define GEOMETRY_CACHE_SIZE 4
+
+static PostProcessGeometry ComputeGeometry(int width,
+                                           int height,
+                                           int ori_width,
+                                           int ori_height,
+                                           int is_pad_resize) {
+  PostProcessGeometry geometry;
+  geometry.width = width;
+  geometry.height = height;
+  geometry.ori_width = ori_width;
+  geometry.ori_height = ori_height;
+  geometry.is_pad_resize = is_pad_resize;
+
+  // 计算原始图像与算法推理实际使用图像的缩放比
+  double h_ratio = height * 1.0 / ori_height;
+  double w_ratio = width * 1.0 / ori_width;
+  double resize_ratio = std::min(w_ratio, h_ratio);
+  if (is_pad_resize) {
+    w_ratio = resize_ratio;
+    h_ratio = resize_ratio;
+  }
+  geometry.w_padding = (width - w_ratio * ori_width) / 2.0;
+  geometry.h_padding = (height - h_ratio * ori_height) / 2.0;
+  geometry.w_ratio_inv = 1.0 / w_ratio;
+  geometry.h_ratio_inv = 1.0 / h_ratio;
+  geometry.max_x = ori_width - 1.0f;
+  geometry.max_y = ori_height - 1.0f;
+  return geometry;
+}
+
+PostProcessGeometry PostProcessGetGeometry(int width,
+                                           int height,
+                                           int ori_width,
+                                           int ori_height,
+                                           int is_pad_resize) {
+  static thread_local PostProcessGeometry cache[GEOMETRY_CACHE_SIZE];
+  static thread_local int cache_num = 0;
+  static thread_local int cache_next = 0;
+
+  is_pad_resize = is_pad_resize ? 1 : 0;
+  for (int i = 0; i < cache_num; i++) {
+    const PostProcessGeometry &geometry = cache[i];
+    if (geometry.width == width && geometry.height == height &&
+        geometry.ori_width == ori_width && geometry.ori_height == ori_height &&
+        geometry.is_pad_resize == is_pad_resize) {
+      return geometry;
+    }
+  }
+
+  PostProcessGeometry geometry =
+      ComputeGeometry(width, height, ori_width, ori_height, is_pad_resize);
+  cache[cache_next] = geometry;
+  cache_next = (cache_next + 1) % GEOMETRY_CACHE_SIZE;
+  cache_num = std::min(cache_num + 1, GEOMETRY_CACHE_SIZE);
+  return geometry;
+}
+
+void PostProcessProjectBoxes(const PostProcessGeometry &geometry,
+                             float *xmin,
+                             float *ymin,
+                             float *xmax,
+                             float *ymax,
+                             int num,
+                             uint8_t *valid) {
+  int i = 0;
+#if defined(__ARM_NEON)
+  const float32x4_t w_padding = vdupq_n_f32(geometry.w_padding);
+  const float32x4_t h_padding = vdupq_n_f32(geometry.h_padding);
+  const float32x4_t w_ratio_inv = vdupq_n_f32(geometry.w_ratio_inv);
+  const float32x4_t h_ratio_inv = vdupq_n_f32(geometry.h_ratio_inv);
+  const float32x4_t max_x = vdupq_n_f32(geometry.max_x);
+  const float32x4_t max_y = vdupq_n_f32(geometry.max_y);
+  const float32x4_t zero = vdupq_n_f32(0.0f);
+  for (; i <= num - 4; i += 4) {
+    float32x4_t x1 = vmulq_f32(vsubq_f32(vld1q_f32(xmin + i), w_padding), w_ratio_inv);
+    float32x4_t y1 = vmulq_f32(vsubq_f32(vld1q_f32(ymin + i), h_padding), h_ratio_inv);
+    float32x4_t x2 = vmulq_f32(vsubq_f32(vld1q_f32(xmax + i), w_padding), w_ratio_inv);
+    float32x4_t y2 = vmulq_f32(vsubq_f32(vld1q_f32(ymax + i), h_padding), h_ratio_inv);
+
+    // 先裁剪再判断，完全在图像范围之外的框裁剪后坐标颠倒
+    x1 = vmaxq_f32(x1, zero);
+    y1 = vmaxq_f32(y1, zero);
+    x2 = vminq_f32(x2, max_x);
+    y2 = vminq_f32(y2, max_y);
+    uint32x4_t ok = vandq_u32(vcgtq_f32(x2, zero), vcgtq_f32(y2, zero));
+    ok = vandq_u32(ok, vandq_u32(vcleq_f32(x1, x2), vcleq_f32(y1, y2)));
+    uint16x4_t ok16 = vmovn_u32(ok);
+    uint8x8_t ok8 = vmovn_u16(vcombine_u16(ok16, ok16));
+    uint32_t ok_bits = vget_lane_u32(vreinterpret_u32_u8(vand_u8(ok8, vdup_n_u8(1))), 0);
+    memcpy(valid + i, &ok_bits, 4);
+
+    vst1q_f32(xmin + i, x1);
+    vst1q_f32(ymin + i, y1);
+    vst1q_f32(xmax + i, x2);
+    vst1q_f32(ymax + i, y2);
+  }
+#endif
+  for (; i < num; i++) {
+    float x1 = std::max((xmin[i] - geometry.w_padding) * geometry.w_ratio_inv, 0.0f);
+    float y1 = std::max((ymin[i] - geometry.h_padding) * geometry.h_ratio_inv, 0.0f);
+    float x2 = std::min((xmax[i] - geometry.w_padding) * geometry.w_ratio_inv, geometry.max_x);
+    float y2 = std::min((ymax[i] - geometry.h_padding) * geometry.h_ratio_inv, geometry.max_y);
+    valid[i] = x2 > 0 && y2 > 0 && x1 <= x2 && y1 <= y2;
+    xmin[i] = x1;
+    ymin[i] = y1;
+    xmax[i] = x2;
+    ymax[i] = y2;
+  }
+}
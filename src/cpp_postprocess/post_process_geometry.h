@@ -0,0 +1,72 @@
+// Copyright (c) 2024，D-Robotics.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// 模型输入坐标到原图坐标的变换
+// 同一个模型输入尺寸、原图尺寸、是否pad resize 的组合只计算一次，帧间复用；
+// 解码得到的候选框在模型输入坐标系下，最后用 PostProcessProjectBoxes 一次性还原并裁剪
+
+#ifndef _POST_PROCESS_POST_PROCESS_GEOMETRY_H_
+#define _POST_PROCESS_POST_PROCESS_GEOMETRY_H_
+
+#include <cstdint>
+
+struct PostProcessGeometry {
+  int width;
+  int height;
+  int ori_width;
+  int ori_height;
+  int is_pad_resize;
+  // x_ori = (x - w_padding) * w_ratio_inv, y_ori = (y - h_padding) * h_ratio_inv
+  float w_padding;
+  float h_padding;
+  float w_ratio_inv;
+  float h_ratio_inv;
+  // 裁剪范围 [0, max_x], [0, max_y]
+  float max_x;
+  float max_y;
+};
+
+/**
+ * 获取 letterbox(居中pad)或直接resize 的坐标变换，结果按参数缓存
+ * @param[in] width/height: 模型输入尺寸
+ * @param[in] ori_width/ori_height: 原图尺寸
+ * @param[in] is_pad_resize: 非0表示保持宽高比缩放后在两边补边
+ */
+PostProcessGeometry PostProcessGetGeometry(int width,
+                                           int height,
+                                           int ori_width,
+                                           int ori_height,
+                                           int is_pad_resize);
+
+template <typename PostProcessInfoT>
+static inline PostProcessGeometry GetGeometry(const PostProcessInfoT *post_info) {
+  return PostProcessGetGeometry(post_info->width, post_info->height,
+                                post_info->ori_width, post_info->ori_height,
+                                post_info->is_pad_resize);
+}
+
+/**
+ * 把模型输入坐标系下的 num 个框原地变换到原图坐标并裁剪到图像范围内
+ * 裁剪后 xmax <= 0、ymax <= 0 或者坐标颠倒的框(完全在图像之外)valid 置0
+ * @param[out] valid: 每个框是否有效
+ */
+void PostProcessProjectBoxes(const PostProcessGeometry &geometry,
+                             float *xmin,
+                             float *ymin,
+                             float *xmax,
+                             float *ymax,
+                             int num,
+                             uint8_t *valid);
+
+#endif  // _POST_PROCESS_POST_PROCESS_GEOMETRY_H_
@@ -0,0 +1,527 @@
+// Copyright (c) 2024，D-Robotics.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// 后处理公用的单精度数学函数
+// 板端(aarch64)使用NEON一次处理4个float，其他平台编译时使用等价的标量实现，
+// 两种实现使用相同的多项式，计算结果一致
+
+#ifndef _POST_PROCESS_POST_PROCESS_MATH_H_
+#define _POST_PROCESS_POST_PROCESS_MATH_H_
+
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// exp多项式近似(cephes expf)，相对误差约1e-7
+#define PP_EXP_HI (88.3762626647949f)
+#define PP_EXP_LO (-87.3365478515625f)
+#define PP_LOG2EF (1.44269504088896341f)
+#define PP_EXP_C1 (0.693359375f)
+#define PP_EXP_C2 (-2.12194440e-4f)
+#define PP_EXP_P0 (1.9875691500E-4f)
+#define PP_EXP_P1 (1.3981999507E-3f)
+#define PP_EXP_P2 (8.3334519073E-3f)
+#define PP_EXP_P3 (4.1665795894E-2f)
+#define PP_EXP_P4 (1.6666665459E-1f)
+#define PP_EXP_P5 (5.0000001201E-1f)
+
+static inline float FastExp(float x) {
+  x = std::fmin(std::fmax(x, PP_EXP_LO), PP_EXP_HI);
+  float fx = std::floor(x * PP_LOG2EF + 0.5f);
+  x = x - fx * PP_EXP_C1 - fx * PP_EXP_C2;
+  float y = PP_EXP_P0;
+  y = y * x + PP_EXP_P1;
+  y = y * x + PP_EXP_P2;
+  y = y * x + PP_EXP_P3;
+  y = y * x + PP_EXP_P4;
+  y = y * x + PP_EXP_P5;
+  y = y * x * x + x + 1.0f;
+  int32_t bits = (static_cast<int32_t>(fx) + 127) << 23;
+  float pow2n;
+  memcpy(&pow2n, &bits, sizeof(pow2n));
+  return y * pow2n;
+}
+
+static inline float FastSigmoid(float x) {
+  return 1.0f / (1.0f + FastExp(-x));
+}
+
+#if defined(__ARM_NEON)
+static inline float32x4_t FastExpX4(float32x4_t x) {
+  x = vminq_f32(vmaxq_f32(x, vdupq_n_f32(PP_EXP_LO)), vdupq_n_f32(PP_EXP_HI));
+  float32x4_t fx = vrndmq_f32(
+      vmlaq_f32(vdupq_n_f32(0.5f), x, vdupq_n_f32(PP_LOG2EF)));
+  x = vmlsq_f32(x, fx, vdupq_n_f32(PP_EXP_C1));
+  x = vmlsq_f32(x, fx, vdupq_n_f32(PP_EXP_C2));
+  float32x4_t y = vdupq_n_f32(PP_EXP_P0);
+  y = vmlaq_f32(vdupq_n_f32(PP_EXP_P1), y, x);
+  y = vmlaq_f32(vdupq_n_f32(PP_EXP_P2), y, x);
+  y = vmlaq_f32(vdupq_n_f32(PP_EXP_P3), y, x);
+  y = vmlaq_f32(vdupq_n_f32(PP_EXP_P4), y, x);
+  y = vmlaq_f32(vdupq_n_f32(PP_EXP_P5), y, x);
+  y = vmlaq_f32(vaddq_f32(x, vdupq_n_f32(1.0f)), y, vmulq_f32(x, x));
+  int32x4_t bits = vshlq_n_s32(
+      vaddq_s32(vcvtq_s32_f32(fx), vdupq_n_s32(127)), 23);
+  return vmulq_f32(y, vreinterpretq_f32_s32(bits));
+}
+
+// 1/x，倒数估计加两次牛顿迭代，精度与除法相当
+static inline float32x4_t FastReciprocalX4(float32x4_t x) {
+  float32x4_t r = vrecpeq_f32(x);
+  r = vmulq_f32(vrecpsq_f32(x, r), r);
+  r = vmulq_f32(vrecpsq_f32(x, r), r);
+  return r;
+}
+
+static inline float32x4_t FastSigmoidX4(float32x4_t x) {
+  return FastReciprocalX4(
+      vaddq_f32(vdupq_n_f32(1.0f), FastExpX4(vnegq_f32(x))));
+}
+#endif
+
+/**
+ * 概率阈值对应的logit，sigmoid(x) < prob 等价于 x < LogitThreshold(prob)
+ * prob 不在 (0, 1) 内时返回 -FLT_MAX，即不做过滤
+ */
+static inline float LogitThreshold(float prob) {
+  if (prob <= 0.0f || prob >= 1.0f) {
+    return -FLT_MAX;
+  }
+  return -std::log(1.0f / prob - 1.0f);
+}
+
+/**
+ * 把概率阈值转换到int32量化域，用于反量化和sigmoid之前的快速过滤
+ * sigmoid(q * scale) < prob 等价于 q * scale < logit(prob)，返回 floor(logit(prob) / scale)，
+ * 因此 q < 返回值 的数据一定不满足阈值，可以直接丢弃
+ * scale 非正或者 prob 不在 (0, 1) 内时返回 INT32_MIN，即不做过滤
+ */
+static inline int32_t QuantiLogitThreshold(float prob, float scale) {
+  if (prob <= 0.0f || prob >= 1.0f || !(scale > 0.0f)) {
+    return INT32_MIN;
+  }
+  double thresh = std::floor(-std::log(1.0 / prob - 1.0) / scale);
+  if (thresh <= INT32_MIN) {
+    return INT32_MIN;
+  }
+  if (thresh >= INT32_MAX) {
+    return INT32_MAX;
+  }
+  return static_cast<int32_t>(thresh);
+}
+
+/**
+ * out[i] = sigmoid(a[i]) * sigmoid(b[i])，用于计算 objness * class 置信度
+ * @param[in] length: 元素个数，NEON路径下不足4个的尾部用标量计算
+ */
+static inline void SigmoidProduct(const float *a,
+                                  const float *b,
+                                  float *out,
+                                  int length) {
+  int i = 0;
+#if defined(__ARM_NEON)
+  for (; i <= length - 4; i += 4) {
+    float32x4_t va = FastSigmoidX4(vld1q_f32(a + i));
+    float32x4_t vb = FastSigmoidX4(vld1q_f32(b + i));
+    vst1q_f32(out + i, vmulq_f32(va, vb));
+  }
+#endif
+  for (; i < length; i++) {
+    out[i] = FastSigmoid(a[i]) * FastSigmoid(b[i]);
+  }
+}
+
+/**
+ * int32量化数据反量化，out[i] = input[i] * scale
+ * @param[in] scale_len: scale 的长度，不小于 length 时按元素(通道)取 scale[i]，否则都使用 scale[0]
+ */
+static inline void DequantiArray(const int32_t *input,
+                                 const float *scale,
+                                 int scale_len,
+                                 float *out,
+                                 int length) {
+  bool per_channel = scale_len >= length;
+  int i = 0;
+#if defined(__ARM_NEON)
+  float32x4_t vec_scale = vdupq_n_f32(scale[0]);
+  for (; i <= length - 4; i += 4) {
+    if (per_channel) {
+      vec_scale = vld1q_f32(scale + i);
+    }
+    vst1q_f32(out + i, vmulq_f32(vcvtq_f32_s32(vld1q_s32(input + i)), vec_scale));
+  }
+#endif
+  for (; i < length; i++) {
+    out[i] = input[i] * (per_channel ? scale[i] : scale[0]);
+  }
+}
+
+/**
+ * softmax的分子部分，out[i] = exp(input[i] - max(input))
+ * @return sum(out)，out[i] / sum 即为softmax结果；只需要少数几个概率时可以只对它们做除法
+ */
+static inline float SoftmaxExp(const float *input, float *out, int length) {
+  float max_value = input[0];
+  int i = 0;
+#if defined(__ARM_NEON)
+  if (length >= 4) {
+    float32x4_t vec_max = vld1q_f32(input);
+    for (i = 4; i <= length - 4; i += 4) {
+      vec_max = vmaxq_f32(vec_max, vld1q_f32(input + i));
+    }
+    max_value = vmaxvq_f32(vec_max);
+  }
+#endif
+  for (; i < length; i++) {
+    max_value = std::fmax(max_value, input[i]);
+  }
+
+  float sum = 0.0f;
+  i = 0;
+#if defined(__ARM_NEON)
+  float32x4_t vec_shift = vdupq_n_f32(max_value);
+  float32x4_t vec_sum = vdupq_n_f32(0.0f);
+  for (; i <= length - 4; i += 4) {
+    float32x4_t e = FastExpX4(vsubq_f32(vld1q_f32(input + i), vec_shift));
+    vst1q_f32(out + i, e);
+    vec_sum = vaddq_f32(vec_sum, e);
+  }
+  sum = vaddvq_f32(vec_sum);
+#endif
+  for (; i < length; i++) {
+    out[i] = FastExp(input[i] - max_value);
+    sum += out[i];
+  }
+  return sum;
+}
+
+/**
+ * 求 input[0, length) 中最大值的下标，相同最大值取下标最小的
+ * @param[out] max_value: 最大值
+ */
+static inline int ArgMaxFloat(const float *input, int length, float *max_value) {
+  int idx = 0;
+  float res = input[0];
+  int i = 1;
+#if defined(__ARM_NEON)
+  if (length >= 8) {
+    float32x4_t vec_max = vld1q_f32(input);
+    uint32x4_t vec_idx = {0, 1, 2, 3};
+    uint32x4_t vec_cur = vec_idx;
+    const uint32x4_t vec_four = vdupq_n_u32(4);
+    for (i = 4; i <= length - 4; i += 4) {
+      vec_cur = vaddq_u32(vec_cur, vec_four);
+      float32x4_t vec_in = vld1q_f32(input + i);
+      uint32x4_t mask = vcgtq_f32(vec_in, vec_max);
+      vec_max = vbslq_f32(mask, vec_in, vec_max);
+      vec_idx = vbslq_u32(mask, vec_cur, vec_idx);
+    }
+    res = vmaxvq_f32(vec_max);
+    uint32x4_t is_max = vceqq_f32(vec_max, vdupq_n_f32(res));
+    idx = vminvq_u32(vbslq_u32(is_max, vec_idx, vdupq_n_u32(0xFFFFFFFF)));
+  }
+#endif
+  for (; i < length; i++) {
+    if (input[i] > res) {
+      res = input[i];
+      idx = i;
+    }
+  }
+  *max_value = res;
+  return idx;
+}
+
+/**
+ * 与 ArgMaxFloat 相同，输入为int32量化数据，按通道乘scale反量化后比较
+ */
+static inline int ArgMaxDequanti(const int32_t *input,
+                                 const float *scale,
+                                 int length,
+                                 float *max_value) {
+  int idx = 0;
+  float res = input[0] * scale[0];
+  int i = 1;
+#if defined(__ARM_NEON)
+  if (length >= 8) {
+    float32x4_t vec_max =
+        vmulq_f32(vcvtq_f32_s32(vld1q_s32(input)), vld1q_f32(scale));
+    uint32x4_t vec_idx = {0, 1, 2, 3};
+    uint32x4_t vec_cur = vec_idx;
+    const uint32x4_t vec_four = vdupq_n_u32(4);
+    for (i = 4; i <= length - 4; i += 4) {
+      vec_cur = vaddq_u32(vec_cur, vec_four);
+      float32x4_t vec_in =
+          vmulq_f32(vcvtq_f32_s32(vld1q_s32(input + i)), vld1q_f32(scale + i));
+      uint32x4_t mask = vcgtq_f32(vec_in, vec_max);
+      vec_max = vbslq_f32(mask, vec_in, vec_max);
+      vec_idx = vbslq_u32(mask, vec_cur, vec_idx);
+    }
+    res = vmaxvq_f32(vec_max);
+    uint32x4_t is_max = vceqq_f32(vec_max, vdupq_n_f32(res));
+    idx = vminvq_u32(vbslq_u32(is_max, vec_idx, vdupq_n_u32(0xFFFFFFFF)));
+  }
+#endif
+  for (; i < length; i++) {
+    float score = input[i] * scale[i];
+    if (score > res) {
+      res = score;
+      idx = i;
+    }
+  }
+  *max_value = res;
+  return idx;
+}
+
+/**
+ * NCHW布局下同时求相邻4个位置在 length 个通道上的最大值及下标
+ * @param[in] input: 第0个通道上第一个位置的地址
+ * @param[in] channel_stride: 相邻通道之间的元素个数(h * w)
+ * @param[out] max_value: 4个位置的最大值
+ * @param[out] max_idx: 4个位置的最大值所在通道
+ */
+static inline void ArgMaxChannelX4(const float *input,
+                                   int length,
+                                   int channel_stride,
+                                   float *max_value,
+                                   int32_t *max_idx) {
+#if defined(__ARM_NEON)
+  float32x4_t vec_max = vld1q_f32(input);
+  int32x4_t vec_idx = vdupq_n_s32(0);
+  for (int c = 1; c < length; c++) {
+    float32x4_t vec_in = vld1q_f32(input + c * channel_stride);
+    uint32x4_t mask = vcgtq_f32(vec_in, vec_max);
+    vec_max = vbslq_f32(mask, vec_in, vec_max);
+    vec_idx = vbslq_s32(mask, vdupq_n_s32(c), vec_idx);
+  }
+  vst1q_f32(max_value, vec_max);
+  vst1q_s32(max_idx, vec_idx);
+#else
+  for (int j = 0; j < 4; j++) {
+    max_value[j] = input[j];
+    max_idx[j] = 0;
+  }
+  for (int c = 1; c < length; c++) {
+    const float *cur = input + c * channel_stride;
+    for (int j = 0; j < 4; j++) {
+      if (cur[j] > max_value[j]) {
+        max_value[j] = cur[j];
+        max_idx[j] = c;
+      }
+    }
+  }
+#endif
+}
+
+/**
+ * 与 ArgMaxChannelX4 相同，输入为int32量化数据，按通道乘scale反量化后比较
+ * @param[in] scale: 每个通道的scale，长度为 length
+ */
+static inline void ArgMaxChannelDequantiX4(const int32_t *input,
+                                           const float *scale,
+                                           int length,
+                                           int channel_stride,
+                                           float *max_value,
+                                           int32_t *max_idx) {
+#if defined(__ARM_NEON)
+  float32x4_t vec_max = vmulq_n_f32(vcvtq_f32_s32(vld1q_s32(input)), scale[0]);
+  int32x4_t vec_idx = vdupq_n_s32(0);
+  for (int c = 1; c < length; c++) {
+    float32x4_t vec_in =
+        vmulq_n_f32(vcvtq_f32_s32(vld1q_s32(input + c * channel_stride)), scale[c]);
+    uint32x4_t mask = vcgtq_f32(vec_in, vec_max);
+    vec_max = vbslq_f32(mask, vec_in, vec_max);
+    vec_idx = vbslq_s32(mask, vdupq_n_s32(c), vec_idx);
+  }
+  vst1q_f32(max_value, vec_max);
+  vst1q_s32(max_idx, vec_idx);
+#else
+  for (int j = 0; j < 4; j++) {
+    max_value[j] = input[j] * scale[0];
+    max_idx[j] = 0;
+  }
+  for (int c = 1; c < length; c++) {
+    const int32_t *cur = input + c * channel_stride;
+    for (int j = 0; j < 4; j++) {
+      float score = cur[j] * scale[c];
+      if (score > max_value[j]) {
+        max_value[j] = score;
+        max_idx[j] = c;
+      }
+    }
+  }
+#endif
+}
+
+/**
+ * NCHW布局下按通道流式求一行的argmax：用第 channel_id 个通道的一行数据
+ * 更新 max_value/max_idx 中保存的当前最大值及所在通道，严格大于才更新
+ * @param[in] input: 第 channel_id 个通道中这一行的起始地址
+ * @param[in] length: 行的长度
+ */
+static inline void UpdateArgMaxRow(const float *input,
+                                   int channel_id,
+                                   int length,
+                                   float *max_value,
+                                   int32_t *max_idx) {
+  int i = 0;
+#if defined(__ARM_NEON)
+  const int32x4_t vec_id = vdupq_n_s32(channel_id);
+  for (; i <= length - 4; i += 4) {
+    float32x4_t vec_in = vld1q_f32(input + i);
+    float32x4_t vec_max = vld1q_f32(max_value + i);
+    uint32x4_t mask = vcgtq_f32(vec_in, vec_max);
+    vst1q_f32(max_value + i, vbslq_f32(mask, vec_in, vec_max));
+    vst1q_s32(max_idx + i, vbslq_s32(mask, vec_id, vld1q_s32(max_idx + i)));
+  }
+#endif
+  for (; i < length; i++) {
+    if (input[i] > max_value[i]) {
+      max_value[i] = input[i];
+      max_idx[i] = channel_id;
+    }
+  }
+}
+
+/**
+ * 与 UpdateArgMaxRow 相同，输入为int32量化数据，整行使用同一个通道的scale
+ */
+static inline void UpdateArgMaxRowDequanti(const int32_t *input,
+                                           float scale,
+                                           int channel_id,
+                                           int length,
+                                           float *max_value,
+                                           int32_t *max_idx) {
+  int i = 0;
+#if defined(__ARM_NEON)
+  const int32x4_t vec_id = vdupq_n_s32(channel_id);
+  const float32x4_t vec_scale = vdupq_n_f32(scale);
+  for (; i <= length - 4; i += 4) {
+    float32x4_t vec_in = vmulq_f32(vcvtq_f32_s32(vld1q_s32(input + i)), vec_scale);
+    float32x4_t vec_max = vld1q_f32(max_value + i);
+    uint32x4_t mask = vcgtq_f32(vec_in, vec_max);
+    vst1q_f32(max_value + i, vbslq_f32(mask, vec_in, vec_max));
+    vst1q_s32(max_idx + i, vbslq_s32(mask, vec_id, vld1q_s32(max_idx + i)));
+  }
+#endif
+  for (; i < length; i++) {
+    float score = input[i] * scale;
+    if (score > max_value[i]) {
+      max_value[i] = score;
+      max_idx[i] = channel_id;
+    }
+  }
+}
+
+/**
+ * 一个框与 num 个框(SoA)的IoU，不相交时为0
+ * @param[in] bx1/by1/bx2/by2/barea: 该框的坐标和面积
+ * @param[out] iou: 长度为 num
+ */
+static inline void IouRow(float bx1,
+                          float by1,
+                          float bx2,
+                          float by2,
+                          float barea,
+                          const float *x1,
+                          const float *y1,
+                          const float *x2,
+                          const float *y2,
+                          const float *area,
+                          int num,
+                          float *iou) {
+  int j = 0;
+#if defined(__ARM_NEON)
+  float32x4_t ix1 = vdupq_n_f32(bx1);
+  float32x4_t iy1 = vdupq_n_f32(by1);
+  float32x4_t ix2 = vdupq_n_f32(bx2);
+  float32x4_t iy2 = vdupq_n_f32(by2);
+  float32x4_t iarea = vdupq_n_f32(barea);
+  float32x4_t zero = vdupq_n_f32(0.0f);
+  for (; j <= num - 4; j += 4) {
+    float32x4_t w = vsubq_f32(vminq_f32(ix2, vld1q_f32(x2 + j)),
+                              vmaxq_f32(ix1, vld1q_f32(x1 + j)));
+    float32x4_t h = vsubq_f32(vminq_f32(iy2, vld1q_f32(y2 + j)),
+                              vmaxq_f32(iy1, vld1q_f32(y1 + j)));
+    uint32x4_t overlap = vandq_u32(vcgtq_f32(w, zero), vcgtq_f32(h, zero));
+    float32x4_t inter = vmulq_f32(w, h);
+    float32x4_t uni = vsubq_f32(vaddq_f32(vld1q_f32(area + j), iarea), inter);
+    float32x4_t val = vmulq_f32(inter, FastReciprocalX4(uni));
+    vst1q_f32(iou + j,
+              vreinterpretq_f32_u32(vandq_u32(overlap, vreinterpretq_u32_f32(val))));
+  }
+#endif
+  for (; j < num; j++) {
+    float w = std::fmin(bx2, x2[j]) - std::fmax(bx1, x1[j]);
+    float h = std::fmin(by2, y2[j]) - std::fmax(by1, y1[j]);
+    if (w > 0.0f && h > 0.0f) {
+      float inter = w * h;
+      iou[j] = inter / (area[j] + barea - inter);
+    } else {
+      iou[j] = 0.0f;
+    }
+  }
+}
+
+/**
+ * DFL(distribution focal loss)边框解码，每条边 reg_max 个分箱做softmax后求期望
+ * out[k] = sum_i(i * softmax(input[k * reg_max : (k + 1) * reg_max])[i])，k = 0..3 依次为 left/top/right/bottom
+ * NEON路径一次处理4个分箱，要求 reg_max 是4的倍数，否则使用标量实现
+ * @param[in] input: 4 * reg_max 个反量化后的logit
+ * @param[out] out: 4条边到网格中心的距离，单位为网格
+ */
+static inline void DflDecode(const float *input, int reg_max, float *out) {
+  for (int k = 0; k < 4; k++) {
+    const float *bins = input + k * reg_max;
+#if defined(__ARM_NEON)
+    if (reg_max >= 4 && reg_max % 4 == 0) {
+      float32x4_t vec_max = vld1q_f32(bins);
+      for (int i = 4; i < reg_max; i += 4) {
+        vec_max = vmaxq_f32(vec_max, vld1q_f32(bins + i));
+      }
+      float32x4_t vec_shift = vdupq_n_f32(vmaxvq_f32(vec_max));
+      float32x4_t vec_sum = vdupq_n_f32(0.0f);
+      float32x4_t vec_dot = vdupq_n_f32(0.0f);
+      float32x4_t vec_bin = {0.0f, 1.0f, 2.0f, 3.0f};
+      const float32x4_t vec_four = vdupq_n_f32(4.0f);
+      for (int i = 0; i < reg_max; i += 4) {
+        float32x4_t e = FastExpX4(vsubq_f32(vld1q_f32(bins + i), vec_shift));
+        vec_sum = vaddq_f32(vec_sum, e);
+        vec_dot = vmlaq_f32(vec_dot, e, vec_bin);
+        vec_bin = vaddq_f32(vec_bin, vec_four);
+      }
+      out[k] = vaddvq_f32(vec_dot) / vaddvq_f32(vec_sum);
+      continue;
+    }
+#endif
+    float max_value = bins[0];
+    for (int i = 1; i < reg_max; i++) {
+      max_value = std::fmax(max_value, bins[i]);
+    }
+    float sum = 0.0f;
+    float dot = 0.0f;
+    for (int i = 0; i < reg_max; i++) {
+      float e = FastExp(bins[i] - max_value);
+      sum += e;
+      dot += e * i;
+    }
+    out[k] = dot / sum;
+  }
+}
+
+#endif  // _POST_PROCESS_POST_PROCESS_MATH_H_
@@ -0,0 +1,634 @@
+// Copyright (c) 2024，D-Robotics.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+
+#include "post_process_math.h"
+#include "post_process_nms.h"
+#include "post_process_thread_pool.h"
+
+/**
+ * 第 i 个框与 [begin, end) 内的框计算IoU，大于阈值的标记为抑制
+ * IoU的计算顺序与原来的逐对实现相同，保证结果一致
+ */
+static void SuppressOverlap(PostProcessNmsWorkspace *ws,
+                            int i,
+                            int begin,
+                            int end,
+                            float iou_threshold) {
+  const float *x1 = ws->box_x1.data();
+  const float *y1 = ws->box_y1.data();
+  const float *x2 = ws->box_x2.data();
+  const float *y2 = ws->box_y2.data();
+  const float *area = ws->box_area.data();
+  uint8_t *skip = ws->skip.data();
+
+  int j = begin;
+#if defined(__ARM_NEON)
+  float32x4_t ix1 = vdupq_n_f32(x1[i]);
+  float32x4_t iy1 = vdupq_n_f32(y1[i]);
+  float32x4_t ix2 = vdupq_n_f32(x2[i]);
+  float32x4_t iy2 = vdupq_n_f32(y2[i]);
+  float32x4_t iarea = vdupq_n_f32(area[i]);
+  float32x4_t thresh = vdupq_n_f32(iou_threshold);
+  float32x4_t zero = vdupq_n_f32(0.0f);
+  for (; j <= end - 4; j += 4) {
+    float32x4_t xx1 = vmaxq_f32(ix1, vld1q_f32(x1 + j));
+    float32x4_t yy1 = vmaxq_f32(iy1, vld1q_f32(y1 + j));
+    float32x4_t xx2 = vminq_f32(ix2, vld1q_f32(x2 + j));
+    float32x4_t yy2 = vminq_f32(iy2, vld1q_f32(y2 + j));
+    float32x4_t w = vsubq_f32(xx2, xx1);
+    float32x4_t h = vsubq_f32(yy2, yy1);
+    uint32x4_t overlap = vandq_u32(vcgtq_f32(w, zero), vcgtq_f32(h, zero));
+    if (vmaxvq_u32(overlap) == 0) {
+      continue;
+    }
+    float32x4_t inter = vmulq_f32(w, h);
+    float32x4_t uni = vsubq_f32(vaddq_f32(vld1q_f32(area + j), iarea), inter);
+    float32x4_t iou = vdivq_f32(inter, uni);
+    uint32x4_t hit = vandq_u32(overlap, vcgtq_f32(iou, thresh));
+    uint32_t mask[4];
+    vst1q_u32(mask, hit);
+    for (int k = 0; k < 4; k++) {
+      skip[j + k] |= static_cast<uint8_t>(mask[k] & 1);
+    }
+  }
+#endif
+  for (; j < end; j++) {
+    if (skip[j]) {
+      continue;
+    }
+    float xx1 = std::max(x1[i], x1[j]);
+    float yy1 = std::max(y1[i], y1[j]);
+    float xx2 = std::min(x2[i], x2[j]);
+    float yy2 = std::min(y2[i], y2[j]);
+    if (xx2 > xx1 && yy2 > yy1) {
+      float inter = (xx2 - xx1) * (yy2 - yy1);
+      float iou = inter / (area[j] + area[i] - inter);
+      if (iou > iou_threshold) {
+        skip[j] = 1;
+      }
+    }
+  }
+}
+
+/**
+ * 与 SuppressOverlap 相同，使用取整后的int16坐标
+ * iou > t 等价于 inter > t * union，面积为整数，不需要除法；int16 一次处理8个框
+ */
+static void SuppressOverlapInt16(PostProcessNmsWorkspace *ws,
+                                 int i,
+                                 int begin,
+                                 int end,
+                                 float iou_threshold) {
+  const int16_t *x1 = ws->box_ix1.data();
+  const int16_t *y1 = ws->box_iy1.data();
+  const int16_t *x2 = ws->box_ix2.data();
+  const int16_t *y2 = ws->box_iy2.data();
+  const int32_t *area = ws->box_iarea.data();
+  uint8_t *skip = ws->skip.data();
+
+  int j = begin;
+#if defined(__ARM_NEON)
+  int16x8_t ix1 = vdupq_n_s16(x1[i]);
+  int16x8_t iy1 = vdupq_n_s16(y1[i]);
+  int16x8_t ix2 = vdupq_n_s16(x2[i]);
+  int16x8_t iy2 = vdupq_n_s16(y2[i]);
+  int32x4_t iarea = vdupq_n_s32(area[i]);
+  float32x4_t thresh = vdupq_n_f32(iou_threshold);
+  int16x8_t zero = vdupq_n_s16(0);
+  for (; j <= end - 8; j += 8) {
+    // 不相交时宽或高为0，交集面积为0，一定不会超过阈值
+    int16x8_t w = vmaxq_s16(vsubq_s16(vminq_s16(ix2, vld1q_s16(x2 + j)),
+                                      vmaxq_s16(ix1, vld1q_s16(x1 + j))), zero);
+    int16x8_t h = vmaxq_s16(vsubq_s16(vminq_s16(iy2, vld1q_s16(y2 + j)),
+                                      vmaxq_s16(iy1, vld1q_s16(y1 + j))), zero);
+    if (vmaxvq_s16(vminq_s16(w, h)) == 0) {
+      continue;
+    }
+    int32x4_t inter_lo = vmull_s16(vget_low_s16(w), vget_low_s16(h));
+    int32x4_t inter_hi = vmull_s16(vget_high_s16(w), vget_high_s16(h));
+    int32x4_t uni_lo = vsubq_s32(vaddq_s32(vld1q_s32(area + j), iarea), inter_lo);
+    int32x4_t uni_hi = vsubq_s32(vaddq_s32(vld1q_s32(area + j + 4), iarea), inter_hi);
+    uint32x4_t hit_lo = vcgtq_f32(vcvtq_f32_s32(inter_lo),
+                                  vmulq_f32(vcvtq_f32_s32(uni_lo), thresh));
+    uint32x4_t hit_hi = vcgtq_f32(vcvtq_f32_s32(inter_hi),
+                                  vmulq_f32(vcvtq_f32_s32(uni_hi), thresh));
+    uint8x8_t hit = vmovn_u16(vcombine_u16(vmovn_u32(hit_lo), vmovn_u32(hit_hi)));
+    uint8x8_t old = vld1_u8(skip + j);
+    vst1_u8(skip + j, vorr_u8(old, vand_u8(hit, vdup_n_u8(1))));
+  }
+#endif
+  for (; j < end; j++) {
+    if (skip[j]) {
+      continue;
+    }
+    int32_t w = std::min(x2[i], x2[j]) - std::max(x1[i], x1[j]);
+    int32_t h = std::min(y2[i], y2[j]) - std::max(y1[i], y1[j]);
+    if (w > 0 && h > 0) {
+      int32_t inter = w * h;
+      int32_t uni = area[i] + area[j] - inter;
+      if (inter > iou_threshold * uni) {
+        skip[j] = 1;
+      }
+    }
+  }
+}
+
+static inline int16_t RoundCoordInt16(float v) {
+  v = std::min(std::max(v, static_cast<float>(NMS_INT16_COORD_MIN)),
+               static_cast<float>(NMS_INT16_COORD_MAX));
+  return static_cast<int16_t>(std::lround(v));
+}
+
+/**
+ * 第 i 个框与 [begin, end) 内每个框的IoU，不相交时为0
+ * @param[out] iou: 长度为 end - begin
+ */
+static void ComputeIouRow(PostProcessNmsWorkspace *ws,
+                          int i,
+                          int begin,
+                          int end,
+                          float *iou) {
+  IouRow(ws->box_x1[i], ws->box_y1[i], ws->box_x2[i], ws->box_y2[i], ws->box_area[i],
+         ws->box_x1.data() + begin, ws->box_y1.data() + begin, ws->box_x2.data() + begin,
+         ws->box_y2.data() + begin, ws->box_area.data() + begin, end - begin, iou);
+}
+
+// 贪心NMS，被保留的框记录在 kept 中
+static void HardNmsBucket(PostProcessNmsWorkspace *ws,
+                          int begin,
+                          int end,
+                          const PostProcessNmsParam &param) {
+  int count = 0;
+  for (int p = begin; p < end && count < param.top_k; p++) {
+    if (ws->skip[p]) {
+      continue;
+    }
+    ws->kept[ws->rank[p]] = 1;
+    ++count;
+    if (count < param.top_k) {
+      if (param.mode == NMS_MODE_HARD_INT16) {
+        SuppressOverlapInt16(ws, p, p + 1, end, param.iou_threshold);
+      } else {
+        SuppressOverlap(ws, p, p + 1, end, param.iou_threshold);
+      }
+    }
+  }
+}
+
+/**
+ * Soft-NMS：每次取剩余框中得分最高的保留，其余框得分乘以 exp(-iou^2 / sigma)
+ * 得分只会减小，低于 score_threshold 的框直接去掉
+ */
+static void SoftNmsBucket(PostProcessNmsWorkspace *ws,
+                          int begin,
+                          int end,
+                          const PostProcessNmsParam &param) {
+  float *score = ws->box_score.data();
+  float *kept_score = ws->box_comp.data();
+  float *iou = ws->iou_row.data();
+  uint8_t *skip = ws->skip.data();
+  const float neg_inv_sigma = -1.0f / NMS_GAUSSIAN_SIGMA;
+  size_t first = ws->soft_keep.size();
+
+  for (int count = 0; count < param.top_k; count++) {
+    int best = -1;
+    float best_score = param.score_threshold;
+    for (int p = begin; p < end; p++) {
+      if (skip[p]) {
+        continue;
+      }
+      if (score[p] < param.score_threshold) {
+        skip[p] = 1;
+      } else if (best < 0 || score[p] > best_score) {
+        best = p;
+        best_score = score[p];
+      }
+    }
+    if (best < 0) {
+      break;
+    }
+    skip[best] = 1;
+    kept_score[best] = best_score;
+    ws->soft_keep.push_back(best);
+
+    ComputeIouRow(ws, best, begin, end, iou);
+    int p = begin;
+#if defined(__ARM_NEON)
+    float32x4_t coef = vdupq_n_f32(neg_inv_sigma);
+    for (; p <= end - 4; p += 4) {
+      float32x4_t v = vld1q_f32(iou + p - begin);
+      float32x4_t decay = FastExpX4(vmulq_f32(vmulq_f32(v, v), coef));
+      vst1q_f32(score + p, vmulq_f32(vld1q_f32(score + p), decay));
+    }
+#endif
+    for (; p < end; p++) {
+      float v = iou[p - begin];
+      score[p] *= FastExp(v * v * neg_inv_sigma);
+    }
+  }
+
+  // 衰减时没有跳过已经保留的框，恢复它们保留时的得分
+  for (size_t k = first; k < ws->soft_keep.size(); k++) {
+    int32_t p = ws->soft_keep[k];
+    score[p] = kept_score[p];
+  }
+}
+
+// iou[0, n) 中的最大值，n 为0时返回0
+static inline float MaxIou(const float *iou, int n) {
+  float max_iou = 0.0f;
+  int i = 0;
+#if defined(__ARM_NEON)
+  float32x4_t vec_iou = vdupq_n_f32(0.0f);
+  for (; i <= n - 4; i += 4) {
+    vec_iou = vmaxq_f32(vec_iou, vld1q_f32(iou + i));
+  }
+  max_iou = vmaxvq_f32(vec_iou);
+#endif
+  for (; i < n; i++) {
+    max_iou = std::max(max_iou, iou[i]);
+  }
+  return max_iou;
+}
+
+// max(0, max_i (iou[i]^2 - comp[i]^2))，i 在 [0, n) 内
+static inline float MaxDecay(const float *iou, const float *comp, int n) {
+  float max_decay = 0.0f;
+  int i = 0;
+#if defined(__ARM_NEON)
+  float32x4_t vec_decay = vdupq_n_f32(-FLT_MAX);
+  for (; i <= n - 4; i += 4) {
+    float32x4_t v = vld1q_f32(iou + i);
+    float32x4_t c = vld1q_f32(comp + i);
+    vec_decay = vmaxq_f32(vec_decay, vmlsq_f32(vmulq_f32(v, v), c, c));
+  }
+  max_decay = std::max(max_decay, vmaxvq_f32(vec_decay));
+#endif
+  for (; i < n; i++) {
+    max_decay = std::max(max_decay, iou[i] * iou[i] - comp[i] * comp[i]);
+  }
+  return max_decay;
+}
+
+/**
+ * Matrix-NMS：按得分顺序，第 j 个框的衰减系数为
+ *   min_{i<j} exp(-(iou(i,j)^2 - comp(i)^2) / sigma), comp(i) = max_{k<i} iou(k,i)
+ * 衰减系数只依赖IoU，不依赖其他框是否被保留，没有贪心NMS的串行依赖；
+ * 按 j 递增计算时 comp(i) 已经求出，不需要保存整个IoU矩阵
+ */
+static void MatrixNmsBucket(PostProcessNmsWorkspace *ws,
+                            int begin,
+                            int end,
+                            const PostProcessNmsParam &param) {
+  float *score = ws->box_score.data();
+  float *comp = ws->box_comp.data();
+  float *iou = ws->iou_row.data();
+  const float neg_inv_sigma = -1.0f / NMS_GAUSSIAN_SIGMA;
+
+  for (int j = begin; j < end; j++) {
+    ComputeIouRow(ws, j, begin, j, iou);
+    comp[j] = MaxIou(iou, j - begin);
+    score[j] *= FastExp(MaxDecay(iou, comp + begin, j - begin) * neg_inv_sigma);
+    if (score[j] >= param.score_threshold) {
+      ws->soft_keep.push_back(j);
+    }
+  }
+}
+
+/**
+ * 多线程的 Matrix-NMS，结果与逐个桶调用 MatrixNmsBucket 相同
+ * 先并行求出所有框的 comp，再并行计算每个框的衰减；两遍都按行切分，
+ * 第 j 行的计算量与它在桶内的位置成正比，按累计计算量把所有桶的行均分给各个任务
+ */
+static void MatrixNmsParallel(PostProcessNmsWorkspace *ws,
+                              int num,
+                              int bucket_num,
+                              const PostProcessNmsParam &param,
+                              int task_num,
+                              int max_bucket) {
+  // 每一行所在桶的起始位置
+  ws->row_bucket.resize(num);
+  for (int b = 0; b < bucket_num; b++) {
+    for (int j = ws->bucket_start[b]; j < ws->bucket_start[b + 1]; j++) {
+      ws->row_bucket[j] = ws->bucket_start[b];
+    }
+  }
+
+  int64_t total = 0;
+  for (int j = 0; j < num; j++) {
+    total += j - ws->row_bucket[j];
+  }
+  ws->row_task_start.assign(task_num + 1, num);
+  ws->row_task_start[0] = 0;
+  int64_t cost = 0;
+  int t = 1;
+  for (int j = 0; j < num && t < task_num; j++) {
+    cost += j - ws->row_bucket[j];
+    while (t < task_num && cost * task_num >= total * t) {
+      ws->row_task_start[t++] = j + 1;
+    }
+  }
+
+  // 每个任务使用自己的一段IoU行缓存
+  ws->iou_row.resize(static_cast<size_t>(task_num) * max_bucket);
+  float *score = ws->box_score.data();
+  float *comp = ws->box_comp.data();
+  const int32_t *row_bucket = ws->row_bucket.data();
+  const int32_t *row_task_start = ws->row_task_start.data();
+  PostProcessThreadPool *pool = PostProcessThreadPool::Instance();
+
+  pool->ParallelFor(task_num, [&](int task) {
+    float *iou = ws->iou_row.data() + static_cast<size_t>(task) * max_bucket;
+    for (int j = row_task_start[task]; j < row_task_start[task + 1]; j++) {
+      int begin = row_bucket[j];
+      ComputeIouRow(ws, j, begin, j, iou);
+      comp[j] = MaxIou(iou, j - begin);
+    }
+  });
+
+  const float neg_inv_sigma = -1.0f / NMS_GAUSSIAN_SIGMA;
+  pool->ParallelFor(task_num, [&](int task) {
+    float *iou = ws->iou_row.data() + static_cast<size_t>(task) * max_bucket;
+    for (int j = row_task_start[task]; j < row_task_start[task + 1]; j++) {
+      int begin = row_bucket[j];
+      ComputeIouRow(ws, j, begin, j, iou);
+      score[j] *= FastExp(MaxDecay(iou, comp + begin, j - begin) * neg_inv_sigma);
+    }
+  });
+
+  for (int j = 0; j < num; j++) {
+    if (score[j] >= param.score_threshold) {
+      ws->soft_keep.push_back(j);
+    }
+  }
+}
+
+// IoU计算量(框对数)少于该值时 Matrix-NMS 在调用线程中完成，多线程的调度开销比计算还大
+#define NMS_MATRIX_PARALLEL_MIN_PAIRS (64 * 1024)
+
+static void MatrixNms(PostProcessNmsWorkspace *ws,
+                      int num,
+                      int bucket_num,
+                      const PostProcessNmsParam &param) {
+  int64_t pairs = 0;
+  int max_bucket = 0;
+  for (int b = 0; b < bucket_num; b++) {
+    int64_t n = ws->bucket_start[b + 1] - ws->bucket_start[b];
+    pairs += n * (n - 1) / 2;
+    max_bucket = std::max(max_bucket, static_cast<int>(n));
+  }
+
+  // 两遍都要计算IoU，计算量是单线程的2倍，至少有3个线程时才划算
+  int thread_num = PostProcessThreadPool::Instance()->ThreadNum();
+  if (thread_num < 3 || pairs < NMS_MATRIX_PARALLEL_MIN_PAIRS) {
+    for (int b = 0; b < bucket_num; b++) {
+      MatrixNmsBucket(ws, ws->bucket_start[b], ws->bucket_start[b + 1], param);
+    }
+    return;
+  }
+  MatrixNmsParallel(ws, num, bucket_num, param, thread_num * 2, max_bucket);
+}
+
+int PostProcessNmsRun(PostProcessNmsWorkspace *ws,
+                      int num,
+                      const PostProcessNmsParam &param) {
+  ws->keep.clear();
+  ws->keep_score.clear();
+  if (num <= 0 || param.top_k <= 0) {
+    return 0;
+  }
+
+  // 按得分从大到小排序，得分相同时保持输入顺序，与 std::stable_sort 结果相同
+  const float *score = ws->score.data();
+  ws->order.resize(num);
+  for (int i = 0; i < num; i++) {
+    ws->order[i] = i;
+  }
+  auto greater = [score](int32_t a, int32_t b) {
+    return score[a] > score[b] || (!(score[b] > score[a]) && a < b);
+  };
+  if (param.max_input > 0 && num > param.max_input) {
+    std::partial_sort(ws->order.begin(), ws->order.begin() + param.max_input,
+                      ws->order.end(), greater);
+    num = param.max_input;
+  } else {
+    std::sort(ws->order.begin(), ws->order.end(), greater);
+  }
+
+  // 按类别分桶(计数排序)，桶内保持得分顺序；suppress 时所有框放在一个桶里
+  ws->rank.resize(num);
+  if (param.suppress) {
+    ws->bucket_start.assign(2, 0);
+    ws->bucket_start[1] = num;
+    for (int r = 0; r < num; r++) {
+      ws->rank[r] = r;
+    }
+  } else {
+    int32_t id_min = ws->id[ws->order[0]];
+    int32_t id_max = id_min;
+    for (int r = 1; r < num; r++) {
+      int32_t id = ws->id[ws->order[r]];
+      id_min = std::min(id_min, id);
+      id_max = std::max(id_max, id);
+    }
+    // 用int64计算范围，id 为 INT_MIN/INT_MAX 附近的值时不会溢出
+    int64_t id_range = static_cast<int64_t>(id_max) - id_min;
+    if (id_range < num) {
+      int bucket_num = static_cast<int>(id_range) + 1;
+      ws->bucket_start.assign(bucket_num + 1, 0);
+      for (int r = 0; r < num; r++) {
+        ws->bucket_start[ws->id[ws->order[r]] - id_min + 1]++;
+      }
+      for (int b = 0; b < bucket_num; b++) {
+        ws->bucket_start[b + 1] += ws->bucket_start[b];
+      }
+      // 借用 keep 作为每个桶的写入位置
+      ws->keep.assign(ws->bucket_start.begin(), ws->bucket_start.end() - 1);
+      for (int r = 0; r < num; r++) {
+        ws->rank[ws->keep[ws->id[ws->order[r]] - id_min]++] = r;
+      }
+      ws->keep.clear();
+    } else {
+      // 类别编号范围比框数大(如外部传入的任意 id)时计数排序的桶数不可控，
+      // 改为按(类别, 得分名次)排序，只为出现过的类别建桶
+      const int32_t *id = ws->id.data();
+      const int32_t *order = ws->order.data();
+      for (int r = 0; r < num; r++) {
+        ws->rank[r] = r;
+      }
+      std::sort(ws->rank.begin(), ws->rank.end(), [id, order](int32_t a, int32_t b) {
+        int32_t id_a = id[order[a]];
+        int32_t id_b = id[order[b]];
+        return id_a < id_b || (id_a == id_b && a < b);
+      });
+      ws->bucket_start.clear();
+      ws->bucket_start.push_back(0);
+      for (int p = 1; p < num; p++) {
+        if (id[order[ws->rank[p]]] != id[order[ws->rank[p - 1]]]) {
+          ws->bucket_start.push_back(p);
+        }
+      }
+      ws->bucket_start.push_back(num);
+    }
+  }
+
+  // 整理成SoA
+  if (param.mode == NMS_MODE_HARD_INT16) {
+    ws->box_ix1.resize(num);
+    ws->box_iy1.resize(num);
+    ws->box_ix2.resize(num);
+    ws->box_iy2.resize(num);
+    ws->box_iarea.resize(num);
+    for (int p = 0; p < num; p++) {
+      int32_t i = ws->order[ws->rank[p]];
+      int16_t x1 = RoundCoordInt16(ws->xmin[i]);
+      int16_t y1 = RoundCoordInt16(ws->ymin[i]);
+      int16_t x2 = RoundCoordInt16(ws->xmax[i]);
+      int16_t y2 = RoundCoordInt16(ws->ymax[i]);
+      ws->box_ix1[p] = x1;
+      ws->box_iy1[p] = y1;
+      ws->box_ix2[p] = x2;
+      ws->box_iy2[p] = y2;
+      ws->box_iarea[p] = (x2 - x1) * (y2 - y1);
+    }
+  } else {
+    ws->box_x1.resize(num);
+    ws->box_y1.resize(num);
+    ws->box_x2.resize(num);
+    ws->box_y2.resize(num);
+    ws->box_area.resize(num);
+    for (int p = 0; p < num; p++) {
+      int32_t i = ws->order[ws->rank[p]];
+      ws->box_x1[p] = ws->xmin[i];
+      ws->box_y1[p] = ws->ymin[i];
+      ws->box_x2[p] = ws->xmax[i];
+      ws->box_y2[p] = ws->ymax[i];
+      ws->box_area[p] = (ws->xmax[i] - ws->xmin[i]) * (ws->ymax[i] - ws->ymin[i]);
+    }
+  }
+  ws->skip.assign(num, 0);
+
+  int bucket_num = static_cast<int>(ws->bucket_start.size()) - 1;
+  if (param.mode != NMS_MODE_SOFT_GAUSSIAN && param.mode != NMS_MODE_MATRIX) {
+    // 每个桶内贪心NMS，一个桶保留 top_k 个后就不需要再看剩下的框
+    ws->kept.assign(num, 0);
+    for (int b = 0; b < bucket_num; b++) {
+      HardNmsBucket(ws, ws->bucket_start[b], ws->bucket_start[b + 1], param);
+    }
+
+    // 按得分顺序合并各个桶的结果
+    for (int r = 0; r < num && static_cast<int>(ws->keep.size()) < param.top_k; r++) {
+      if (ws->kept[r]) {
+        ws->keep.push_back(ws->order[r]);
+        ws->keep_score.push_back(score[ws->order[r]]);
+      }
+    }
+    return static_cast<int>(ws->keep.size());
+  }
+
+  ws->box_score.resize(num);
+  ws->box_comp.resize(num);
+  ws->iou_row.resize(num);
+  ws->soft_keep.clear();
+  for (int p = 0; p < num; p++) {
+    ws->box_score[p] = score[ws->order[ws->rank[p]]];
+  }
+  if (param.mode == NMS_MODE_SOFT_GAUSSIAN) {
+    for (int b = 0; b < bucket_num; b++) {
+      SoftNmsBucket(ws, ws->bucket_start[b], ws->bucket_start[b + 1], param);
+    }
+  } else {
+    MatrixNms(ws, num, bucket_num, param);
+  }
+
+  // 衰减后的得分从大到小排序，得分相同时按原来的名次
+  const float *box_score = ws->box_score.data();
+  const int32_t *rank = ws->rank.data();
+  auto soft_greater = [box_score, rank](int32_t a, int32_t b) {
+    return box_score[a] > box_score[b] ||
+           (!(box_score[b] > box_score[a]) && rank[a] < rank[b]);
+  };
+  int count = std::min(static_cast<int>(ws->soft_keep.size()), param.top_k);
+  std::partial_sort(ws->soft_keep.begin(), ws->soft_keep.begin() + count,
+                    ws->soft_keep.end(), soft_greater);
+  for (int k = 0; k < count; k++) {
+    int32_t p = ws->soft_keep[k];
+    ws->keep.push_back(ws->order[rank[p]]);
+    ws->keep_score.push_back(box_score[p]);
+  }
+  return count;
+}
+
+// 默认上下文及没有上下文的检测模型使用的NMS方式，PostProcessSetNmsMode 设置
+static std::atomic<int> nms_default_mode(NMS_MODE_HARD);
+
+int PostProcessSetNmsMode(int nms_mode) {
+  if (!IsValidNmsMode(nms_mode)) {
+    printf("invalid nms mode %d!\n", nms_mode);
+    return -1;
+  }
+  nms_default_mode.store(nms_mode, std::memory_order_relaxed);
+  return 0;
+}
+
+int PostProcessGetNmsMode(void) {
+  return nms_default_mode.load(std::memory_order_relaxed);
+}
+
+// 每个线程使用自己的临时内存，PostProcessNmsDetections 可以在多个线程中同时调用
+static thread_local PostProcessNmsWorkspace nms_detections_ws;
+
+int PostProcessNmsDetections(const PostProcessDetection_t *dets,
+                             int num,
+                             int nms_mode,
+                             float iou_threshold,
+                             float score_threshold,
+                             int top_k,
+                             PostProcessDetection_t *out,
+                             int capacity) {
+  if (dets == nullptr || num < 0 || out == nullptr || capacity < 0) {
+    printf("nms invalid input or output array!\n");
+    return -1;
+  }
+
+  PostProcessNmsWorkspace *ws = &nms_detections_ws;
+  ws->Resize(num);
+  for (int i = 0; i < num; i++) {
+    ws->xmin[i] = dets[i].bbox.xmin;
+    ws->ymin[i] = dets[i].bbox.ymin;
+    ws->xmax[i] = dets[i].bbox.xmax;
+    ws->ymax[i] = dets[i].bbox.ymax;
+    ws->score[i] = dets[i].score;
+    ws->id[i] = dets[i].id;
+  }
+
+  PostProcessNmsParam param;
+  param.mode = nms_mode;
+  param.iou_threshold = iou_threshold;
+  param.score_threshold = score_threshold;
+  param.top_k = std::min(top_k, capacity);
+  param.suppress = false;
+  param.max_input = 0;
+  int count = PostProcessNmsRun(ws, num, param);
+  for (int k = 0; k < count; k++) {
+    out[k] = dets[ws->keep[k]];
+    out[k].score = ws->keep_score[k];
+  }
+  return count;
+}
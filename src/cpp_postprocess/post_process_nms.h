@@ -0,0 +1,189 @@
+// Copyright (c) 2024，D-Robotics.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// 各个检测模型后处理共用的NMS
+// 候选框按得分排序后按类别分桶，每个桶内的框以SoA(xmin[], ymin[], ...)形式连续存放，
+// 一个框同时与另外4个框计算IoU；每个类别保留 top_k 个后提前结束。
+// NMS_MODE_HARD 的结果与原来逐对比较的实现完全一致，
+// NMS_MODE_SOFT_GAUSSIAN/NMS_MODE_MATRIX 会修改保留框的得分
+// NMS_MODE_HARD_INT16 把坐标四舍五入到整数像素并限制在 [NMS_INT16_COORD_MIN, NMS_INT16_COORD_MAX]，
+// IoU用整数面积交叉相乘比较，不做除法；适合像素坐标的检测结果，和 NMS_MODE_HARD 只有取整带来的差别
+
+#ifndef _POST_PROCESS_POST_PROCESS_NMS_H_
+#define _POST_PROCESS_POST_PROCESS_NMS_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "post_process_arena.h"
+#include "post_process_common.h"
+
+// Soft-NMS 和 Matrix-NMS 高斯衰减的 sigma
+#define NMS_GAUSSIAN_SIGMA (0.5f)
+
+// NMS_MODE_HARD_INT16 的坐标范围，保证面积及面积之和不会超出int32
+#define NMS_INT16_COORD_MIN (-8192)
+#define NMS_INT16_COORD_MAX (8191)
+
+struct PostProcessNmsParam {
+  int mode;               // PostProcessNmsMode_t
+  float iou_threshold;    // NMS_MODE_HARD/NMS_MODE_HARD_INT16 使用
+  float score_threshold;  // 衰减后得分低于该值的框被去掉，soft/matrix 使用
+  int top_k;              // 最多保留的框个数
+  bool suppress;          // true 时不同类别之间也互相抑制
+  int max_input;          // 排序后最多参与NMS的框个数，<= 0 表示不限制
+};
+
+/**
+ * NMS用到的临时内存(面积、下标等)，多次调用之间复用，避免每帧重新分配
+ * 不同线程同时做NMS时需要使用不同的 PostProcessNmsWorkspace
+ */
+struct PostProcessNmsWorkspace {
+  // 输入，按输入顺序存放
+  PostProcessArenaVector<float> xmin;
+  PostProcessArenaVector<float> ymin;
+  PostProcessArenaVector<float> xmax;
+  PostProcessArenaVector<float> ymax;
+  PostProcessArenaVector<float> score;
+  PostProcessArenaVector<int32_t> id;
+
+  // 按得分排序、按类别分桶后的数据
+  PostProcessArenaVector<int32_t> order;        // 第 r 名对应的输入下标
+  PostProcessArenaVector<int32_t> rank;         // 桶内第 p 个框的得分名次
+  PostProcessArenaVector<int32_t> bucket_start;
+  PostProcessArenaVector<float> box_x1;
+  PostProcessArenaVector<float> box_y1;
+  PostProcessArenaVector<float> box_x2;
+  PostProcessArenaVector<float> box_y2;
+  PostProcessArenaVector<float> box_area;
+  PostProcessArenaVector<uint8_t> skip;
+  PostProcessArenaVector<uint8_t> kept;         // 按得分名次记录是否保留
+
+  // NMS_MODE_HARD_INT16 使用，取整后的坐标
+  PostProcessArenaVector<int16_t> box_ix1;
+  PostProcessArenaVector<int16_t> box_iy1;
+  PostProcessArenaVector<int16_t> box_ix2;
+  PostProcessArenaVector<int16_t> box_iy2;
+  PostProcessArenaVector<int32_t> box_iarea;
+
+  // soft/matrix 方式使用
+  PostProcessArenaVector<float> box_score;      // 桶内每个框当前(衰减后)的得分
+  PostProcessArenaVector<float> box_comp;       // Matrix-NMS 中每个框与更高分框的最大IoU，Soft-NMS 中为保留时的得分
+  PostProcessArenaVector<float> iou_row;        // 一个框与桶内其他框的IoU，多线程 Matrix-NMS 中每个任务一段
+  PostProcessArenaVector<int32_t> soft_keep;    // 保留框在桶内的位置
+  PostProcessArenaVector<int32_t> row_bucket;   // 多线程 Matrix-NMS 中每个框所在桶的起始位置
+  PostProcessArenaVector<int32_t> row_task_start;  // 多线程 Matrix-NMS 中每个任务的起始行
+
+  // 输出，保留框的输入下标及得分，按得分从大到小
+  PostProcessArenaVector<int32_t> keep;
+  PostProcessArenaVector<float> keep_score;
+
+  void Resize(int num) {
+    xmin.resize(num);
+    ymin.resize(num);
+    xmax.resize(num);
+    ymax.resize(num);
+    score.resize(num);
+    id.resize(num);
+  }
+};
+
+/**
+ * 对 ws 中的 num 个输入框做NMS，结果保存在 ws->keep 和 ws->keep_score
+ * mode 不是 PostProcessNmsMode_t 中的值时按 NMS_MODE_HARD 处理
+ * @return 保留的框个数
+ */
+int PostProcessNmsRun(PostProcessNmsWorkspace *ws,
+                      int num,
+                      const PostProcessNmsParam &param);
+
+/**
+ * 各模型 Detection 结构的NMS入口，DetectionT 需要有 id, score, bbox.{xmin,ymin,xmax,ymax}
+ * DetectionVector 为 std::vector<DetectionT> 或 PostProcessArenaVector<DetectionT>
+ * 结果按得分从大到小追加到 result，input 保持不变
+ */
+template <typename DetectionVector>
+void PostProcessNms(const DetectionVector &input,
+                    const PostProcessNmsParam &param,
+                    DetectionVector &result,
+                    PostProcessNmsWorkspace *ws) {
+  int num = static_cast<int>(input.size());
+  ws->Resize(num);
+  for (int i = 0; i < num; i++) {
+    const auto &det = input[i];
+    ws->xmin[i] = det.bbox.xmin;
+    ws->ymin[i] = det.bbox.ymin;
+    ws->xmax[i] = det.bbox.xmax;
+    ws->ymax[i] = det.bbox.ymax;
+    ws->score[i] = det.score;
+    ws->id[i] = det.id;
+  }
+
+  int count = PostProcessNmsRun(ws, num, param);
+  result.reserve(result.size() + count);
+  for (int k = 0; k < count; k++) {
+    result.push_back(input[ws->keep[k]]);
+    result.back().score = ws->keep_score[k];
+  }
+}
+
+/**
+ * 检测模型一路输入的帧间缓存：候选框、NMS结果、NMS临时内存和转换成json前的结果
+ * 每帧结束时调用 Clear，只清空内容不释放内存
+ */
+template <typename DetectionT>
+struct PostProcessDetectionArena {
+  PostProcessArenaVector<DetectionT> dets;             // 解码得到的候选框
+  PostProcessArenaVector<DetectionT> results;          // NMS保留的框
+  PostProcessArenaVector<PostProcessDetection_t> out;  // 转换成json前的结果
+  PostProcessNmsWorkspace nms_ws;
+
+  void Clear() {
+    dets.clear();
+    results.clear();
+  }
+};
+
+// 上下文的NMS方式为该值时使用 PostProcessSetNmsMode 设置的进程默认值，只用于兼容旧接口的默认上下文
+#define NMS_MODE_PROCESS_DEFAULT (-1)
+
+static inline bool IsValidNmsMode(int nms_mode) {
+  return nms_mode >= NMS_MODE_HARD && nms_mode <= NMS_MODE_HARD_INT16;
+}
+
+// 上下文实际使用的NMS方式
+static inline int ResolveNmsMode(int nms_mode) {
+  return nms_mode == NMS_MODE_PROCESS_DEFAULT ? PostProcessGetNmsMode() : nms_mode;
+}
+
+/**
+ * 模型后处理中常用的参数组合，同类别之间互相抑制
+ * @param[in] nms_mode: PostProcessNmsMode_t，有上下文的模型用 ResolveNmsMode(上下文的方式)，
+ *                      没有上下文的模型用 PostProcessGetNmsMode()
+ */
+template <typename PostProcessInfoT>
+static inline PostProcessNmsParam GetNmsParam(const PostProcessInfoT *post_info,
+                                              int nms_mode,
+                                              int max_input = 0) {
+  PostProcessNmsParam param;
+  param.mode = nms_mode;
+  param.iou_threshold = post_info->nms_threshold;
+  param.score_threshold = post_info->score_threshold;
+  param.top_k = post_info->nms_top_k;
+  param.suppress = false;
+  param.max_input = max_input;
+  return param;
+}
+
+#endif  // _POST_PROCESS_POST_PROCESS_NMS_H_
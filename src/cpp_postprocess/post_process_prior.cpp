@@ -0,0 +1,86 @@
+// Copyright (c) 2024，D-Robotics.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cmath>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "post_process_prior.h"
+
+void PostProcessDecodePriorBoxes(const PostProcessPriorTable &table,
+                                 const float *variance,
+                                 float size_offset,
+                                 PostProcessPriorCandidates *candidates) {
+  int num = candidates->Size();
+  candidates->xmin.resize(num);
+  candidates->ymin.resize(num);
+  candidates->xmax.resize(num);
+  candidates->ymax.resize(num);
+
+  const int32_t *prior = candidates->prior.data();
+  const float *dx = candidates->dx.data();
+  const float *dy = candidates->dy.data();
+  const float *dw = candidates->dw.data();
+  const float *dh = candidates->dh.data();
+  float *xmin = candidates->xmin.data();
+  float *ymin = candidates->ymin.data();
+  float *xmax = candidates->xmax.data();
+  float *ymax = candidates->ymax.data();
+
+  int i = 0;
+#if defined(__ARM_NEON)
+  const float32x4_t var_x = vdupq_n_f32(variance[0]);
+  const float32x4_t var_y = vdupq_n_f32(variance[1]);
+  const float32x4_t offset = vdupq_n_f32(size_offset);
+  const float32x4_t half = vdupq_n_f32(0.5f);
+  for (; i <= num - 4; i += 4) {
+    // 候选框对应的先验框不连续，先取到连续内存中；exp 需要和标量版本结果一致，逐个计算
+    float prior_cx[4], prior_cy[4], prior_w[4], prior_h[4], exp_w[4], exp_h[4];
+    for (int j = 0; j < 4; j++) {
+      int p = prior[i + j];
+      prior_cx[j] = table.cx[p];
+      prior_cy[j] = table.cy[p];
+      prior_w[j] = table.w[p];
+      prior_h[j] = table.h[p];
+      exp_w[j] = std::exp(variance[2] * dw[i + j]);
+      exp_h[j] = std::exp(variance[3] * dh[i + j]);
+    }
+    float32x4_t pw = vld1q_f32(prior_w);
+    float32x4_t ph = vld1q_f32(prior_h);
+    float32x4_t center_x =
+        vaddq_f32(vmulq_f32(vmulq_f32(var_x, vld1q_f32(dx + i)), pw), vld1q_f32(prior_cx));
+    float32x4_t center_y =
+        vaddq_f32(vmulq_f32(vmulq_f32(var_y, vld1q_f32(dy + i)), ph), vld1q_f32(prior_cy));
+    float32x4_t half_w = vmulq_f32(half, vsubq_f32(vmulq_f32(vld1q_f32(exp_w), pw), offset));
+    float32x4_t half_h = vmulq_f32(half, vsubq_f32(vmulq_f32(vld1q_f32(exp_h), ph), offset));
+    vst1q_f32(xmin + i, vsubq_f32(center_x, half_w));
+    vst1q_f32(ymin + i, vsubq_f32(center_y, half_h));
+    vst1q_f32(xmax + i, vaddq_f32(center_x, half_w));
+    vst1q_f32(ymax + i, vaddq_f32(center_y, half_h));
+  }
+#endif
+  for (; i < num; i++) {
+    int p = prior[i];
+    float center_x = variance[0] * dx[i] * table.w[p] + table.cx[p];
+    float center_y = variance[1] * dy[i] * table.h[p] + table.cy[p];
+    float half_w = 0.5f * (std::exp(variance[2] * dw[i]) * table.w[p] - size_offset);
+    float half_h = 0.5f * (std::exp(variance[3] * dh[i]) * table.h[p] - size_offset);
+    xmin[i] = center_x - half_w;
+    ymin[i] = center_y - half_h;
+    xmax[i] = center_x + half_w;
+    ymax[i] = center_y + half_h;
+  }
+}
@@ -0,0 +1,147 @@
+// Copyright (c) 2024，D-Robotics.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// SSD/EfficientDet 等基于先验框(anchor)解码的模型共用的先验框表
+// 先验框只和模型输入尺寸、输出层及其特征图尺寸有关，第一次遇到时生成，之后每帧直接使用
+
+#ifndef _POST_PROCESS_POST_PROCESS_PRIOR_H_
+#define _POST_PROCESS_POST_PROCESS_PRIOR_H_
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "post_process_arena.h"
+
+/**
+ * 一层输出的全部先验框，按输出顺序以SoA形式连续存放
+ */
+struct PostProcessPriorTable {
+  std::vector<float> cx;
+  std::vector<float> cy;
+  std::vector<float> w;
+  std::vector<float> h;
+
+  void Add(float center_x, float center_y, float width, float height) {
+    cx.push_back(center_x);
+    cy.push_back(center_y);
+    w.push_back(width);
+    h.push_back(height);
+  }
+
+  int Size() const { return static_cast<int>(cx.size()); }
+};
+
+struct PostProcessPriorKey {
+  int input_height;
+  int input_width;
+  int layer;
+  int feature_height;
+  int feature_width;
+
+  bool operator==(const PostProcessPriorKey &other) const {
+    return input_height == other.input_height && input_width == other.input_width &&
+           layer == other.layer && feature_height == other.feature_height &&
+           feature_width == other.feature_width;
+  }
+};
+
+/**
+ * 先验框表缓存，可以在多个线程中同时使用，返回的表在缓存的生命周期内一直有效
+ */
+class PostProcessPriorCache {
+ public:
+  /**
+   * 获取 key 对应的先验框表，第一次出现时调用 build(PostProcessPriorTable *) 生成
+   * build 按模板参数传入，命中缓存时不会为捕获列表分配内存
+   */
+  template <typename BuildFunc>
+  const PostProcessPriorTable &Get(const PostProcessPriorKey &key, const BuildFunc &build) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto &table : tables_) {
+      if (table.first == key) {
+        return *table.second;
+      }
+    }
+    std::unique_ptr<PostProcessPriorTable> table(new PostProcessPriorTable());
+    build(table.get());
+    tables_.emplace_back(key, std::move(table));
+    return *tables_.back().second;
+  }
+
+ private:
+  std::mutex mutex_;
+  std::vector<std::pair<PostProcessPriorKey, std::unique_ptr<PostProcessPriorTable>>> tables_;
+};
+
+/**
+ * 通过分类阈值、等待解码的候选框，多帧之间复用
+ * prior 为对应先验框在表中的下标，dx/dy/dw/dh 为反量化后的回归值
+ */
+struct PostProcessPriorCandidates {
+  PostProcessArenaVector<int32_t> prior;
+  PostProcessArenaVector<float> dx;
+  PostProcessArenaVector<float> dy;
+  PostProcessArenaVector<float> dw;
+  PostProcessArenaVector<float> dh;
+  PostProcessArenaVector<float> score;
+  PostProcessArenaVector<int32_t> id;
+
+  // PostProcessDecodePriorBoxes 的结果
+  PostProcessArenaVector<float> xmin;
+  PostProcessArenaVector<float> ymin;
+  PostProcessArenaVector<float> xmax;
+  PostProcessArenaVector<float> ymax;
+  PostProcessArenaVector<uint8_t> valid;
+
+  void Add(int32_t prior_index, float delta_x, float delta_y, float delta_w, float delta_h,
+           float cls_score, int32_t cls_id) {
+    prior.push_back(prior_index);
+    dx.push_back(delta_x);
+    dy.push_back(delta_y);
+    dw.push_back(delta_w);
+    dh.push_back(delta_h);
+    score.push_back(cls_score);
+    id.push_back(cls_id);
+  }
+
+  int Size() const { return static_cast<int>(prior.size()); }
+
+  void Clear() {
+    prior.clear();
+    dx.clear();
+    dy.clear();
+    dw.clear();
+    dh.clear();
+    score.clear();
+    id.clear();
+  }
+};
+
+/**
+ * 按先验框解码全部候选框，结果写入 candidates 的 xmin/ymin/xmax/ymax
+ * center_x = variance[0] * dx * prior_w + prior_cx
+ * width = exp(variance[2] * dw) * prior_w
+ * xmin = center_x - 0.5 * (width - size_offset)，xmax = center_x + 0.5 * (width - size_offset)
+ * @param[in] variance: 回归值的系数 x, y, w, h
+ * @param[in] size_offset: 宽高是否按像素个数(+1)计算，EfficientDet 为1，SSD 为0
+ */
+void PostProcessDecodePriorBoxes(const PostProcessPriorTable &table,
+                                 const float *variance,
+                                 float size_offset,
+                                 PostProcessPriorCandidates *candidates);
+
+#endif  // _POST_PROCESS_POST_PROCESS_PRIOR_H_
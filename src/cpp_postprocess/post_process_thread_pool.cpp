@@ -0,0 +1,166 @@
+// Copyright (c) 2024，D-Robotics.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <cstdio>
+
+#include "post_process_thread_pool.h"
+
+static std::mutex thread_pool_mutex;
+static std::unique_ptr<PostProcessThreadPool> thread_pool;
+static int thread_pool_size = 0;
+
+int PostProcessSetThreadNum(int thread_num) {
+  std::lock_guard<std::mutex> lock(thread_pool_mutex);
+  if (thread_num < 1) {
+    printf("post process thread num %d invalid!\n", thread_num);
+    return -1;
+  }
+  if (thread_pool != nullptr) {
+    printf("post process thread pool already created with %d threads!\n",
+           thread_pool->ThreadNum());
+    return -1;
+  }
+  thread_pool_size = thread_num;
+  return 0;
+}
+
+PostProcessThreadPool *PostProcessThreadPool::Instance() {
+  std::lock_guard<std::mutex> lock(thread_pool_mutex);
+  if (thread_pool == nullptr) {
+    int thread_num = thread_pool_size;
+    if (thread_num < 1) {
+      thread_num = std::max(1u, std::thread::hardware_concurrency());
+    }
+    thread_pool.reset(new PostProcessThreadPool(thread_num));
+  }
+  return thread_pool.get();
+}
+
+PostProcessThreadPool::PostProcessThreadPool(int thread_num)
+    : job_head_(0), job_count_(0), stop_(false) {
+  for (int i = 1; i < thread_num; i++) {
+    workers_.emplace_back(&PostProcessThreadPool::WorkerLoop, this);
+  }
+}
+
+PostProcessThreadPool::~PostProcessThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cond_.notify_all();
+  for (auto &worker : workers_) {
+    worker.join();
+  }
+}
+
+void PostProcessThreadPool::RunJob(Job *job) {
+  for (;;) {
+    int task = job->next.fetch_add(1);
+    if (task >= job->task_num) {
+      break;
+    }
+    job->func(job->ctx, task);
+    if (job->done.fetch_add(1) + 1 == job->task_num) {
+      std::lock_guard<std::mutex> lock(job->mutex);
+      job->cond.notify_all();
+    }
+  }
+}
+
+void PostProcessThreadPool::RemoveJob(Job *job) {
+  for (int i = 0; i < job_count_; i++) {
+    int index = (job_head_ + i) % kMaxJobs;
+    if (jobs_[index] != job) {
+      continue;
+    }
+    // 后面的元素前移一位，保持先进先出
+    for (int j = i; j + 1 < job_count_; j++) {
+      jobs_[(job_head_ + j) % kMaxJobs] = jobs_[(job_head_ + j + 1) % kMaxJobs];
+    }
+    job_count_--;
+    return;
+  }
+}
+
+void PostProcessThreadPool::WorkerLoop() {
+  for (;;) {
+    Job *job = nullptr;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cond_.wait(lock, [this] { return stop_ || job_count_ > 0; });
+      if (stop_) {
+        return;
+      }
+      job = jobs_[job_head_];
+      // 任务已经全部被领取，从队列中移除
+      if (job->next.load() >= job->task_num) {
+        job_head_ = (job_head_ + 1) % kMaxJobs;
+        job_count_--;
+        continue;
+      }
+      // 在 mutex_ 内登记，调用者把 job 移出队列后不会再有新的工作线程领取它
+      std::lock_guard<std::mutex> job_lock(job->mutex);
+      job->active++;
+    }
+    RunJob(job);
+    // job 在调用者的栈上，调用者要等 active 归零后才返回
+    std::lock_guard<std::mutex> job_lock(job->mutex);
+    if (--job->active == 0) {
+      job->cond.notify_all();
+    }
+  }
+}
+
+void PostProcessThreadPool::ParallelFor(int task_num, TaskFunc func, void *ctx) {
+  if (task_num <= 0) {
+    return;
+  }
+
+  Job job;
+  job.func = func;
+  job.ctx = ctx;
+  job.task_num = task_num;
+  job.next = 0;
+  job.done = 0;
+  job.active = 0;
+
+  bool queued = false;
+  if (!workers_.empty() && task_num > 1) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (job_count_ < kMaxJobs) {
+      jobs_[(job_head_ + job_count_) % kMaxJobs] = &job;
+      job_count_++;
+      queued = true;
+    }
+  }
+  if (!queued) {
+    RunJob(&job);
+    return;
+  }
+  cond_.notify_all();
+
+  RunJob(&job);
+
+  // 工作线程可能还没来得及移除，这里确保 job 不再留在队列中
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    RemoveJob(&job);
+  }
+  std::unique_lock<std::mutex> job_lock(job.mutex);
+  job.cond.wait(job_lock, [&job] {
+    return job.done.load() >= job.task_num && job.active == 0;
+  });
+}
@@ -0,0 +1,108 @@
+// Copyright (c) 2024，D-Robotics.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// 后处理共用的常驻线程池
+// 线程在第一次并行后处理时创建，之后一直复用，避免每帧创建/销毁线程
+
+#ifndef _POST_PROCESS_POST_PROCESS_THREAD_POOL_H_
+#define _POST_PROCESS_POST_PROCESS_THREAD_POOL_H_
+
+#ifdef __cplusplus
+  extern "C"{
+#endif
+
+  /**
+   * 设置后处理线程池的线程数(包括调用线程)，必须在第一次并行后处理之前调用
+   * @param[in] thread_num: 线程数，1 表示不使用工作线程，全部在调用线程中完成
+   * @return 0 成功，线程池已经创建或者参数错误返回-1
+   */
+  int PostProcessSetThreadNum(int thread_num);
+
+#ifdef __cplusplus
+}
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class PostProcessThreadPool {
+ public:
+  // 任务函数，ctx 为 ParallelFor 传入的上下文
+  typedef void (*TaskFunc)(void *ctx, int task);
+
+  /**
+   * 获取全局线程池，第一次调用时按 PostProcessSetThreadNum 的设置创建，
+   * 默认线程数为CPU核数
+   */
+  static PostProcessThreadPool *Instance();
+
+  explicit PostProcessThreadPool(int thread_num);
+  ~PostProcessThreadPool();
+
+  // 包括调用线程在内的线程数
+  int ThreadNum() const { return static_cast<int>(workers_.size()) + 1; }
+
+  /**
+   * 并行执行 func(ctx, 0) ... func(ctx, task_num - 1)，全部完成后返回
+   * 调用线程也参与执行，可以在多个线程中同时调用，任务中也可以再次调用
+   * 不分配堆内存：任务描述放在调用者的栈上，队列容量固定为 kMaxJobs，
+   * 队列满时全部任务在调用线程中顺序执行
+   */
+  void ParallelFor(int task_num, TaskFunc func, void *ctx);
+
+  /**
+   * 同上，func 为 lambda 等可调用对象，按引用传递，不会包装成 std::function
+   */
+  template <typename Func>
+  void ParallelFor(int task_num, const Func &func) {
+    ParallelFor(task_num,
+                [](void *ctx, int task) { (*static_cast<const Func *>(ctx))(task); },
+                const_cast<void *>(static_cast<const void *>(&func)));
+  }
+
+ private:
+  static const int kMaxJobs = 32;
+
+  struct Job {
+    TaskFunc func;
+    void *ctx;
+    int task_num;
+    std::atomic<int> next;
+    std::atomic<int> done;
+    int active;  // 正在执行该 Job 的工作线程数，受 mutex 保护
+    std::mutex mutex;
+    std::condition_variable cond;
+  };
+
+  // 执行 job 中还没有被领取的任务，直到全部领取完
+  static void RunJob(Job *job);
+  void WorkerLoop();
+  // 调用者持有 mutex_
+  void RemoveJob(Job *job);
+
+  std::vector<std::thread> workers_;
+  // 固定容量的环形队列，Job 由 ParallelFor 的调用者持有
+  Job *jobs_[kMaxJobs];
+  int job_head_;
+  int job_count_;
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  bool stop_;
+};
+#endif
+
+#endif  // _POST_PROCESS_POST_PROCESS_THREAD_POOL_H_
@@ -0,0 +1,346 @@
+// Copyright (c) 2024，D-Robotics.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <cstdio>
+#include <new>
+
+#include "post_process_arena.h"
+#include "post_process_math.h"
+#include "post_process_tracker.h"
+
+// 卡尔曼滤波的噪声与框的高度成正比，系数与ByteTrack相同
+#define TRACKER_STD_WEIGHT_POSITION (1.0f / 20)
+#define TRACKER_STD_WEIGHT_VELOCITY (1.0f / 160)
+// 框的宽高下限，避免预测出负的宽高
+#define TRACKER_MIN_SIZE (1.0f)
+
+/**
+ * 一条轨迹，中心x/中心y/宽/高 各用一个匀速模型 [位置, 速度] 的卡尔曼滤波，
+ * 4个维度相互独立，协方差为 [[p00, p01], [p01, p11]]
+ */
+struct TrackerTrack {
+  float pos[4];
+  float vel[4];
+  float p00[4];
+  float p01[4];
+  float p11[4];
+
+  float score;
+  int32_t id;
+  int32_t track_id;
+  int hits;  // 关联上的次数
+  int lost;  // 连续没有关联上的检测次数
+  bool confirmed;
+};
+
+// 关联时轨迹与检测框的一个候选配对
+struct TrackerMatch {
+  float iou;
+  int32_t track;  // cand_tracks 中的位置
+  int32_t det;    // 本次关联的检测框中的位置
+};
+
+struct PostProcessTracker {
+  PostProcessTrackerInfo_t info;
+  int32_t next_track_id;
+  PostProcessArenaVector<TrackerTrack> tracks;
+
+  // 关联用的临时内存，帧间复用
+  PostProcessArenaVector<int32_t> high_dets;    // 高分检测框在输入中的下标
+  PostProcessArenaVector<int32_t> low_dets;     // 低分检测框在输入中的下标
+  PostProcessArenaVector<int32_t> cand_tracks;  // 参与本次关联的轨迹下标
+  PostProcessArenaVector<float> det_x1;
+  PostProcessArenaVector<float> det_y1;
+  PostProcessArenaVector<float> det_x2;
+  PostProcessArenaVector<float> det_y2;
+  PostProcessArenaVector<float> det_area;
+  PostProcessArenaVector<float> cost;           // IoU矩阵，cand_tracks.size() 行
+  PostProcessArenaVector<TrackerMatch> pairs;
+  PostProcessArenaVector<int32_t> track_det;    // 每条轨迹关联上的检测框下标，-1 表示没有
+  PostProcessArenaVector<uint8_t> det_used;
+};
+
+static inline float TrackerHeight(const TrackerTrack &track) {
+  return std::max(track.pos[3], TRACKER_MIN_SIZE);
+}
+
+static void TrackerInit(TrackerTrack *track, const PostProcessDetection_t &det) {
+  float z[4] = {(det.bbox.xmin + det.bbox.xmax) * 0.5f, (det.bbox.ymin + det.bbox.ymax) * 0.5f,
+                det.bbox.xmax - det.bbox.xmin, det.bbox.ymax - det.bbox.ymin};
+  float h = std::max(z[3], TRACKER_MIN_SIZE);
+  float std_pos = 2 * TRACKER_STD_WEIGHT_POSITION * h;
+  float std_vel = 10 * TRACKER_STD_WEIGHT_VELOCITY * h;
+  for (int k = 0; k < 4; k++) {
+    track->pos[k] = z[k];
+    track->vel[k] = 0.0f;
+    track->p00[k] = std_pos * std_pos;
+    track->p01[k] = 0.0f;
+    track->p11[k] = std_vel * std_vel;
+  }
+  track->score = det.score;
+  track->id = det.id;
+  track->hits = 1;
+  track->lost = 0;
+}
+
+// 预测到下一帧，dt = 1
+static void TrackerPredict(TrackerTrack *track) {
+  float h = TrackerHeight(*track);
+  float q_pos = TRACKER_STD_WEIGHT_POSITION * h;
+  float q_vel = TRACKER_STD_WEIGHT_VELOCITY * h;
+  q_pos *= q_pos;
+  q_vel *= q_vel;
+  for (int k = 0; k < 4; k++) {
+    track->pos[k] += track->vel[k];
+    track->p00[k] += 2 * track->p01[k] + track->p11[k] + q_pos;
+    track->p01[k] += track->p11[k];
+    track->p11[k] += q_vel;
+  }
+}
+
+static void TrackerCorrect(TrackerTrack *track, const PostProcessDetection_t &det) {
+  float z[4] = {(det.bbox.xmin + det.bbox.xmax) * 0.5f, (det.bbox.ymin + det.bbox.ymax) * 0.5f,
+                det.bbox.xmax - det.bbox.xmin, det.bbox.ymax - det.bbox.ymin};
+  float r = TRACKER_STD_WEIGHT_POSITION * TrackerHeight(*track);
+  r *= r;
+  for (int k = 0; k < 4; k++) {
+    float s = track->p00[k] + r;
+    float k0 = track->p00[k] / s;
+    float k1 = track->p01[k] / s;
+    float y = z[k] - track->pos[k];
+    track->pos[k] += k0 * y;
+    track->vel[k] += k1 * y;
+    track->p11[k] -= k1 * track->p01[k];
+    track->p01[k] -= k0 * track->p01[k];
+    track->p00[k] -= k0 * track->p00[k];
+  }
+  track->score = det.score;
+}
+
+static void TrackerBox(const TrackerTrack &track, PostProcessBbox_t *bbox) {
+  float half_w = std::max(track.pos[2], TRACKER_MIN_SIZE) * 0.5f;
+  float half_h = std::max(track.pos[3], TRACKER_MIN_SIZE) * 0.5f;
+  bbox->xmin = track.pos[0] - half_w;
+  bbox->ymin = track.pos[1] - half_h;
+  bbox->xmax = track.pos[0] + half_w;
+  bbox->ymax = track.pos[1] + half_h;
+}
+
+/**
+ * cand_tracks 中的轨迹与 det_index 中的检测框按IoU贪心关联，只有同类别的才能关联
+ * IoU矩阵每行用 IouRow 一次算出一条轨迹与全部检测框的IoU
+ * 结果写入 track_det/det_used
+ */
+static void TrackerAssociate(PostProcessTracker *tracker,
+                             const PostProcessDetection_t *dets,
+                             const PostProcessArenaVector<int32_t> &det_index) {
+  int num_tracks = tracker->cand_tracks.size();
+  int num_dets = det_index.size();
+  if (num_tracks == 0 || num_dets == 0) {
+    return;
+  }
+
+  tracker->det_x1.resize(num_dets);
+  tracker->det_y1.resize(num_dets);
+  tracker->det_x2.resize(num_dets);
+  tracker->det_y2.resize(num_dets);
+  tracker->det_area.resize(num_dets);
+  for (int j = 0; j < num_dets; j++) {
+    const PostProcessBbox_t &bbox = dets[det_index[j]].bbox;
+    tracker->det_x1[j] = bbox.xmin;
+    tracker->det_y1[j] = bbox.ymin;
+    tracker->det_x2[j] = bbox.xmax;
+    tracker->det_y2[j] = bbox.ymax;
+    tracker->det_area[j] = (bbox.xmax - bbox.xmin) * (bbox.ymax - bbox.ymin);
+  }
+
+  float match_iou = tracker->info.match_iou;
+  tracker->cost.resize(static_cast<size_t>(num_tracks) * num_dets);
+  tracker->pairs.clear();
+  for (int i = 0; i < num_tracks; i++) {
+    const TrackerTrack &track = tracker->tracks[tracker->cand_tracks[i]];
+    PostProcessBbox_t box;
+    TrackerBox(track, &box);
+    float *row = tracker->cost.data() + static_cast<size_t>(i) * num_dets;
+    IouRow(box.xmin, box.ymin, box.xmax, box.ymax,
+           (box.xmax - box.xmin) * (box.ymax - box.ymin),
+           tracker->det_x1.data(), tracker->det_y1.data(), tracker->det_x2.data(),
+           tracker->det_y2.data(), tracker->det_area.data(), num_dets, row);
+    for (int j = 0; j < num_dets; j++) {
+      if (row[j] >= match_iou && dets[det_index[j]].id == track.id) {
+        tracker->pairs.push_back({row[j], i, j});
+      }
+    }
+  }
+
+  // IoU从大到小贪心配对，IoU相同时按下标排序，保证结果确定
+  std::sort(tracker->pairs.begin(), tracker->pairs.end(),
+            [](const TrackerMatch &lhs, const TrackerMatch &rhs) {
+              if (lhs.iou != rhs.iou) return lhs.iou > rhs.iou;
+              if (lhs.track != rhs.track) return lhs.track < rhs.track;
+              return lhs.det < rhs.det;
+            });
+  for (const TrackerMatch &match : tracker->pairs) {
+    int t = tracker->cand_tracks[match.track];
+    int d = det_index[match.det];
+    if (tracker->track_det[t] >= 0 || tracker->det_used[d]) {
+      continue;
+    }
+    tracker->track_det[t] = d;
+    tracker->det_used[d] = 1;
+  }
+}
+
+// 输出上一次检测时关联上的已确认轨迹
+static int TrackerOutput(PostProcessTracker *tracker, PostProcessTrack_t *tracks, int capacity) {
+  int count = 0;
+  for (const TrackerTrack &track : tracker->tracks) {
+    if (count >= capacity) {
+      break;
+    }
+    if (!track.confirmed || track.lost > 0) {
+      continue;
+    }
+    PostProcessTrack_t &out = tracks[count++];
+    TrackerBox(track, &out.bbox);
+    out.score = track.score;
+    out.id = track.id;
+    out.track_id = track.track_id;
+  }
+  return count;
+}
+
+PostProcessTracker_t *PostProcessCreateTracker(const PostProcessTrackerInfo_t *info) {
+  if (info == nullptr || info->max_lost < 0 || info->min_hits < 1 ||
+      info->low_threshold > info->high_threshold) {
+    printf("tracker invalid param!\n");
+    return nullptr;
+  }
+  PostProcessTracker *tracker = new (std::nothrow) PostProcessTracker();
+  if (tracker == nullptr) {
+    return nullptr;
+  }
+  tracker->info = *info;
+  tracker->next_track_id = 1;
+  return tracker;
+}
+
+void PostProcessDestroyTracker(PostProcessTracker_t *tracker) {
+  delete tracker;
+}
+
+void PostProcessTrackerReset(PostProcessTracker_t *tracker) {
+  if (tracker == nullptr) {
+    return;
+  }
+  tracker->tracks.clear();
+  tracker->next_track_id = 1;
+}
+
+int PostProcessTrackerUpdate(PostProcessTracker_t *tracker,
+                             const PostProcessDetection_t *dets,
+                             int num,
+                             PostProcessTrack_t *tracks,
+                             int capacity) {
+  if (tracker == nullptr || (dets == nullptr && num > 0) || num < 0 ||
+      tracks == nullptr || capacity < 0) {
+    printf("tracker invalid input or output array!\n");
+    return -1;
+  }
+  const PostProcessTrackerInfo_t &info = tracker->info;
+
+  for (TrackerTrack &track : tracker->tracks) {
+    TrackerPredict(&track);
+  }
+
+  tracker->high_dets.clear();
+  tracker->low_dets.clear();
+  for (int i = 0; i < num; i++) {
+    if (dets[i].score >= info.high_threshold) {
+      tracker->high_dets.push_back(i);
+    } else if (dets[i].score >= info.low_threshold) {
+      tracker->low_dets.push_back(i);
+    }
+  }
+
+  int num_tracks = tracker->tracks.size();
+  tracker->track_det.assign(num_tracks, -1);
+  tracker->det_used.assign(num, 0);
+
+  // 第一轮：全部轨迹与高分检测框关联
+  tracker->cand_tracks.clear();
+  for (int t = 0; t < num_tracks; t++) {
+    tracker->cand_tracks.push_back(t);
+  }
+  TrackerAssociate(tracker, dets, tracker->high_dets);
+
+  // 第二轮：上一次检测还在跟踪、本轮没有关联上的轨迹与低分检测框关联，找回被遮挡的目标
+  tracker->cand_tracks.clear();
+  for (int t = 0; t < num_tracks; t++) {
+    if (tracker->track_det[t] < 0 && tracker->tracks[t].lost == 0) {
+      tracker->cand_tracks.push_back(t);
+    }
+  }
+  TrackerAssociate(tracker, dets, tracker->low_dets);
+
+  for (int t = 0; t < num_tracks; t++) {
+    TrackerTrack &track = tracker->tracks[t];
+    int d = tracker->track_det[t];
+    if (d >= 0) {
+      TrackerCorrect(&track, dets[d]);
+      track.hits++;
+      track.lost = 0;
+      track.confirmed = track.confirmed || track.hits >= info.min_hits;
+    } else {
+      track.lost++;
+    }
+  }
+
+  // 删除丢失太久的轨迹，还没确认的轨迹丢失一次就删除
+  auto end = std::remove_if(tracker->tracks.begin(), tracker->tracks.end(),
+                            [&info](const TrackerTrack &track) {
+                              return track.lost > info.max_lost ||
+                                     (!track.confirmed && track.lost > 0);
+                            });
+  tracker->tracks.erase(end, tracker->tracks.end());
+
+  // 没有关联上的高分检测框新建轨迹
+  for (int32_t d : tracker->high_dets) {
+    if (tracker->det_used[d]) {
+      continue;
+    }
+    TrackerTrack track;
+    TrackerInit(&track, dets[d]);
+    track.track_id = tracker->next_track_id++;
+    track.confirmed = info.min_hits <= 1;
+    tracker->tracks.push_back(track);
+  }
+
+  return TrackerOutput(tracker, tracks, capacity);
+}
+
+int PostProcessTrackerPredict(PostProcessTracker_t *tracker,
+                              PostProcessTrack_t *tracks,
+                              int capacity) {
+  if (tracker == nullptr || tracks == nullptr || capacity < 0) {
+    printf("tracker invalid output array!\n");
+    return -1;
+  }
+
+  for (TrackerTrack &track : tracker->tracks) {
+    TrackerPredict(&track);
+  }
+  return TrackerOutput(tracker, tracks, capacity);
+}
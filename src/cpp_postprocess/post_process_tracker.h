@@ -0,0 +1,94 @@
+// Copyright (c) 2024，D-Robotics.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// 检测结果的多目标跟踪(SORT/ByteTrack方式)
+// 输入为 XxxPostProcessToArray 得到的检测框，按IoU和类别关联到已有轨迹，给每个目标分配固定的 track_id；
+// 每个框的中心和宽高各用一个匀速卡尔曼滤波预测，检测模型隔帧运行时，
+// 没有检测的帧调用 PostProcessTrackerPredict 外推出当前帧的框
+
+#ifndef _POST_PROCESS_POST_PROCESS_TRACKER_H_
+#define _POST_PROCESS_POST_PROCESS_TRACKER_H_
+
+#include <stdint.h>
+
+#include "post_process_common.h"
+
+#ifdef __cplusplus
+  extern "C"{
+#endif
+
+typedef struct {
+	float high_threshold; // 0.5, 得分不低于该值的检测框先参与关联，没有关联上的新建轨迹
+	float low_threshold; // 0.1, [low, high) 之间的检测框只用来延续已有轨迹，低于该值的丢弃
+	float match_iou; // 0.3, 轨迹与检测框的IoU不低于该值才能关联
+	int max_lost; // 30, 连续多少次检测没有关联上后删除轨迹
+	int min_hits; // 3, 关联上多少次后才输出
+} PostProcessTrackerInfo_t;
+
+typedef struct {
+	PostProcessBbox_t bbox;
+	float score; // 最近一次关联上的检测框得分
+	int32_t id; // 类别编号
+	int32_t track_id; // 从1开始递增，同一个目标在整个跟踪过程中不变
+} PostProcessTrack_t;
+
+  /**
+   * 跟踪器，保存单路视频流的轨迹，不同跟踪器可以在不同线程中并行使用
+   * 同一个跟踪器同一时刻只能被一个线程使用
+   */
+  typedef struct PostProcessTracker PostProcessTracker_t;
+
+  /**
+   * 创建跟踪器
+   * @param[in] info: 跟踪参数，内容会被复制
+   * @return 跟踪器，参数错误或者失败返回NULL
+   */
+  PostProcessTracker_t *PostProcessCreateTracker(const PostProcessTrackerInfo_t *info);
+
+  void PostProcessDestroyTracker(PostProcessTracker_t *tracker);
+
+  /**
+   * 有检测结果的帧：所有轨迹预测到当前帧后与检测框关联，更新/新建/删除轨迹
+   * @param[in] dets: 检测框，如 Yolov5PostProcessToArray/FcosPostProcessToArray 的输出
+   * @param[in] num: 检测框个数
+   * @param[out] tracks: 当前帧关联上的已确认轨迹，框为滤波后的结果
+   * @param[in] capacity: tracks 数组的长度
+   * @return 写入 tracks 的个数，参数错误返回-1
+   */
+  int PostProcessTrackerUpdate(PostProcessTracker_t *tracker,
+                               const PostProcessDetection_t *dets,
+                               int num,
+                               PostProcessTrack_t *tracks,
+                               int capacity);
+
+  /**
+   * 跳过检测的帧：所有轨迹预测到当前帧，不做关联，也不计入 max_lost
+   * @param[out] tracks: 上一次检测时关联上的已确认轨迹，框为预测结果
+   * @param[in] capacity: tracks 数组的长度
+   * @return 写入 tracks 的个数，参数错误返回-1
+   */
+  int PostProcessTrackerPredict(PostProcessTracker_t *tracker,
+                                PostProcessTrack_t *tracks,
+                                int capacity);
+
+  /**
+   * 删除所有轨迹，track_id 重新从1开始，用于切换视频源
+   */
+  void PostProcessTrackerReset(PostProcessTracker_t *tracker);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // _POST_PROCESS_POST_PROCESS_TRACKER_H_
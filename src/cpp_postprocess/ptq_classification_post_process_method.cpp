@@ -29,9 +29,15 @@
 #include <iostream>
 #include <iomanip>
 #include <algorithm>
+#include <memory>
+#include <new>
 
 // #include "utils/utils_log.h"
 
+#include "post_process_arena.h"
+#include "post_process_batch.h"
+#include "post_process_math.h"
+#include "post_process_thread_pool.h"
 #include "ptq_classification_post_process_method.h"
 
 /**
@@ -1084,76 +1090,203 @@ typedef struct Classification {
   ~Classification() {}
 } Classification;
 
-bool compareObjects(const Classification &lhs, const Classification &rhs) {
-  return (lhs.score > rhs.score);
+/**
+ * 一张图片的分类结果及 GetTopkResult 的临时内存
+ * 帧间复用的缓存，稳定运行后不再有堆分配
+ */
+struct ClassificationState {
+  PostProcessArenaVector<Classification> dets;
+  PostProcessArenaVector<float> scores;
+  PostProcessArenaVector<int32_t> index;
+};
+
+// 兼容旧接口使用的默认状态
+static ClassificationState classification_state;
+static PostProcessArenaVector<PostProcessClassification_t> classification_results;
+
+struct ClassificationPostProcessContext {
+  // 批量后处理中每张图片一份
+  std::vector<std::unique_ptr<ClassificationState>> batch_states;
+  // 模型输出为logits时先做softmax，见 ClassificationSetApplySoftmax
+  bool apply_softmax = false;
+};
+
+// ClassificationDoProcess/ClassificationPostProcessBatchToArray 使用的默认上下文
+static ClassificationPostProcessContext default_classification_context;
+
+ClassificationPostProcessContext_t *ClassificationCreateContext(void) {
+  return new (std::nothrow) ClassificationPostProcessContext();
 }
 
-std::vector<Classification> classification_dets;
+void ClassificationDestroyContext(ClassificationPostProcessContext_t *ctx) {
+  delete ctx;
+}
 
-void GetTopkResult(hbDNNTensor *tensor, ClassificationPostProcessInfo_t *post_info) {
+int ClassificationSetApplySoftmax(ClassificationPostProcessContext_t *ctx, int apply_softmax) {
+  if (ctx == nullptr) {
+    ctx = &default_classification_context;
+  }
+  ctx->apply_softmax = apply_softmax != 0;
+  return 0;
+}
 
-  Classification classification;
+static void GetTopkResult(hbDNNTensor *tensor,
+                          ClassificationPostProcessInfo_t *post_info,
+                          bool apply_softmax,
+                          ClassificationState *state) {
   int n_dim = tensor->properties.validShape.numDimensions;
   int *shape = tensor->properties.validShape.dimensionSize;
   int tensor_len{1};
   for (int i = 1; i < n_dim; i++) {
     tensor_len *= shape[i];
   }
+  if (tensor_len <= 0) {
+    return;
+  }
 
-  for (auto i = 0; i < tensor_len; i++) {
-    float score = reinterpret_cast<float *>(tensor->sysMem[0].virAddr)[i];
-    classification.score = score;
-    classification.id = i;
-    classification.class_name = classification_config_.class_names[classification.id].c_str();
-    if (classification.score > post_info->score_threshold){
-          classification_dets.push_back(classification);
+  // 反量化，浮点输出且不需要softmax时直接使用tensor中的数据
+  const float *scores = reinterpret_cast<float *>(tensor->sysMem[0].virAddr);
+  if (tensor->properties.quantiType == hbDNNQuantiType::SCALE || apply_softmax) {
+    state->scores.resize(tensor_len);
+    if (tensor->properties.quantiType == hbDNNQuantiType::SCALE) {
+      DequantiArray(reinterpret_cast<int32_t *>(tensor->sysMem[0].virAddr),
+                    tensor->properties.scale.scaleData,
+                    tensor->properties.scale.scaleLen,
+                    state->scores.data(),
+                    tensor_len);
+      scores = state->scores.data();
     }
   }
 
-  // 排序，根据对象的score从大到小排序  
-  std::sort(classification_dets.begin(), classification_dets.end(), compareObjects);  
+  // softmax只求分子，prob = exp / sum，阈值比较换成 exp > score_threshold * sum，
+  // 最后只对top_k个结果做除法
+  float score_threshold = post_info->score_threshold;
+  float norm = 1.0f;
+  if (apply_softmax) {
+    float sum = SoftmaxExp(scores, state->scores.data(), tensor_len);
+    scores = state->scores.data();
+    score_threshold *= sum;
+    norm = 1.0f / sum;
+  }
 
-  // 如果对象数量超过top_k个，删除多余的对象，只保留前top_k个  
-  int classification_dets_size = classification_dets.size();
-  if (classification_dets_size > post_info->nms_top_k) {  
-      classification_dets.resize(post_info->nms_top_k);  
-  }  
+  state->index.clear();
+  for (int i = 0; i < tensor_len; i++) {
+    if (scores[i] > score_threshold) {
+      state->index.push_back(i);
+    }
+  }
+
+  // 只对下标做部分选择，得分相同时编号小的在前
+  auto greater = [scores](int32_t lhs, int32_t rhs) {
+    return scores[lhs] > scores[rhs] || (scores[lhs] == scores[rhs] && lhs < rhs);
+  };
+  int top_k = std::max(0, std::min(static_cast<int>(state->index.size()),
+                                   post_info->nms_top_k));
+  if (top_k < static_cast<int>(state->index.size())) {
+    std::nth_element(state->index.begin(), state->index.begin() + top_k,
+                     state->index.end(), greater);
+  }
+  std::sort(state->index.begin(), state->index.begin() + top_k, greater);
 
+  // 只有最终的top_k个结果需要查找类别名
+  for (int k = 0; k < top_k; k++) {
+    int id = state->index[k];
+    state->dets.emplace_back(id, scores[id] * norm,
+                             classification_config_.class_names[id].c_str());
+  }
 }
 
 void ClassificationDoProcess(hbDNNTensor *tensors, ClassificationPostProcessInfo_t *post_info) {
 
-  GetTopkResult(tensors, post_info);
+  GetTopkResult(tensors, post_info, default_classification_context.apply_softmax,
+                &classification_state);
 
 }
 
+// 把 state 中的结果写入 results 后清空
+static int ClassificationStateToArray(ClassificationState *state,
+                                      PostProcessClassification_t *results,
+                                      int capacity) {
+  int num = std::min(static_cast<int>(state->dets.size()), capacity);
+  for (int i = 0; i < num; i++) {
+    results[i].prob = state->dets[i].score;
+    results[i].id = state->dets[i].id;
+  }
+  state->dets.clear();
+  return num;
+}
+
 char* ClassificationPostProcess(ClassificationPostProcessInfo_t *post_info) {
 
-  int i = 0;
-  char *str_dets;
+  // 算法结果转换成json格式
+  PostProcessArenaVector<PostProcessClassification_t> &results = classification_results;
+  results.resize(classification_state.dets.size());
+  int num = ClassificationPostProcessToArray(post_info, results.data(), results.size());
+  return ClassificationResultToJson("classification_result", results.data(), num, ClassificationGetClassName);
+}
 
-  std::vector<Classification> classification_restuls;
-  classification_restuls = classification_dets;
+int ClassificationPostProcessToArray(ClassificationPostProcessInfo_t *post_info,
+                                     PostProcessClassification_t *results,
+                                     int capacity) {
+  if (results == nullptr || capacity < 0) {
+    printf("classification post process invalid output array!\n");
+    classification_state.dets.clear();
+    return -1;
+  }
 
-  std::stringstream out_string;
+  return ClassificationStateToArray(&classification_state, results, capacity);
+}
 
-  // 算法结果转换成json格式
-  int classification_restuls_size = classification_restuls.size();
-  out_string << "\"classification_result\": [";
-  for (i = 0; i < classification_restuls_size; i++) {
-  	auto det_ret = classification_restuls[i];
-  	out_string << det_ret;
-  	if (i < classification_restuls_size - 1)
-		out_string << ",";
+int ClassificationPostProcessBatchToArray(hbDNNTensor *tensor,
+                                          ClassificationPostProcessInfo_t *post_info,
+                                          PostProcessClassification_t *results,
+                                          int capacity,
+                                          int *counts,
+                                          int max_batch) {
+  return ClassificationPostProcessBatchWithContextToArray(&default_classification_context, tensor,
+                                                          post_info, results, capacity, counts,
+                                                          max_batch);
+}
+
+int ClassificationPostProcessBatchWithContextToArray(ClassificationPostProcessContext_t *ctx,
+                                                     hbDNNTensor *tensor,
+                                                     ClassificationPostProcessInfo_t *post_info,
+                                                     PostProcessClassification_t *results,
+                                                     int capacity,
+                                                     int *counts,
+                                                     int max_batch) {
+  if (ctx == nullptr || tensor == nullptr || results == nullptr || capacity < 0 || counts == nullptr) {
+    printf("classification post process invalid batch input or output array!\n");
+    return -1;
+  }
+
+  int batch_num = PostProcessGetBatchNum(tensor);
+  if (batch_num > max_batch) {
+    printf("classification post process batch %d exceeds output array size %d!\n",
+           batch_num, max_batch);
+    return -1;
+  }
+
+  // 只在调用线程中增加，并行任务开始后不再改变
+  while (static_cast<int>(ctx->batch_states.size()) < batch_num) {
+    ctx->batch_states.emplace_back(new ClassificationState());
   }
-  out_string << "]" << std::endl;
 
-  str_dets = (char *)malloc(out_string.str().length() + 1);
-  str_dets[out_string.str().length()] = '\0';
-  snprintf(str_dets, out_string.str().length(), "%s", out_string.str().c_str());
-  // printf("str_dets: %s\n", str_dets);
-  classification_dets.clear();
-  classification_restuls.clear();
-  return str_dets;
+  PostProcessThreadPool::Instance()->ParallelFor(batch_num, [&](int n) {
+    ClassificationState *state = ctx->batch_states[n].get();
+    hbDNNTensor view;
+    PostProcessGetBatchTensor(tensor, batch_num, n, &view);
+    GetTopkResult(&view, post_info, ctx->apply_softmax, state);
+    counts[n] = ClassificationStateToArray(state, results + static_cast<size_t>(n) * capacity,
+                                           capacity);
+  });
+  return batch_num;
+}
+
+const char *ClassificationGetClassName(int id) {
+  if (id < 0 || id >= static_cast<int>(classification_config_.class_names.size())) {
+    return nullptr;
+  }
+  return classification_config_.class_names[id].c_str();
 }
 
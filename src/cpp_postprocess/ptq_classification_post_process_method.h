@@ -24,6 +24,7 @@
 #define _POST_PROCESS_CLASSIFICATION_POST_PROCESS_H_
 
 #include "dnn/hb_dnn.h"
+#include "post_process_common.h"
 
 #ifdef __cplusplus
   extern "C"{
@@ -40,6 +41,27 @@ typedef struct {
 	int is_pad_resize;
 } ClassificationPostProcessInfo_t;
 
+/**
+ * 批量后处理的上下文，保存单路视频流每张图片的中间结果，不同上下文可以在不同线程中并行使用
+ * 同一个上下文同一时刻只能被一个线程使用
+ */
+typedef struct ClassificationPostProcessContext ClassificationPostProcessContext_t;
+
+/**
+ * 创建上下文，失败返回NULL
+ */
+ClassificationPostProcessContext_t *ClassificationCreateContext(void);
+
+void ClassificationDestroyContext(ClassificationPostProcessContext_t *ctx);
+
+/**
+ * 设置模型输出的类型，新建的上下文默认为0
+ * @param[in] ctx: 上下文，为NULL时设置 ClassificationDoProcess/ClassificationPostProcessBatchToArray 使用的默认上下文
+ * @param[in] apply_softmax: 0: 模型输出已经是概率, 1: 模型输出为logits, 先做softmax
+ * @return 0 成功
+ */
+int ClassificationSetApplySoftmax(ClassificationPostProcessContext_t *ctx, int apply_softmax);
+
   /**
    * Post process
    * @param[in] tensor: Model output tensors
@@ -51,6 +73,51 @@ char* ClassificationPostProcess(ClassificationPostProcessInfo_t *post_info);
 
 void ClassificationDoProcess(hbDNNTensor *tensors, ClassificationPostProcessInfo_t *post_info);
 
+/**
+ * 与 ClassificationPostProcess 相同，但结果直接写入 results 数组，不生成json字符串
+ * @param[out] results: 调用者分配的结果数组，按prob从大到小排列
+ * @param[in] capacity: results 数组的长度，结果超过 capacity 时只保留前 capacity 个
+ * @return 写入的结果个数，参数错误返回-1
+ */
+int ClassificationPostProcessToArray(ClassificationPostProcessInfo_t *post_info,
+                                     PostProcessClassification_t *results,
+                                     int capacity);
+
+/**
+ * 批量(N>1)输出的后处理，每张图片单独求top_k，图片之间在后处理线程池中并行
+ * 内部使用全局默认上下文，不能在多个线程中同时调用；多路并行时使用 ClassificationPostProcessBatchWithContextToArray
+ * @param[in] tensor: 模型输出tensor
+ * @param[out] results: 调用者分配的结果数组，长度 max_batch * capacity，
+ *                      第 n 张图片的结果从 results + n * capacity 开始，按prob从大到小排列
+ * @param[in] capacity: 每张图片最多保留的结果个数
+ * @param[out] counts: 每张图片实际写入的结果个数，长度 max_batch
+ * @param[in] max_batch: results/counts 能容纳的图片数，小于输出的batch数时返回-1
+ * @return 输出的batch数，参数错误返回-1
+ */
+int ClassificationPostProcessBatchToArray(hbDNNTensor *tensor,
+                                          ClassificationPostProcessInfo_t *post_info,
+                                          PostProcessClassification_t *results,
+                                          int capacity,
+                                          int *counts,
+                                          int max_batch);
+
+/**
+ * 与 ClassificationPostProcessBatchToArray 相同，每张图片的中间结果保存在 ctx 中
+ * 不同的 ctx 可以在不同线程中同时调用
+ */
+int ClassificationPostProcessBatchWithContextToArray(ClassificationPostProcessContext_t *ctx,
+                                                     hbDNNTensor *tensor,
+                                                     ClassificationPostProcessInfo_t *post_info,
+                                                     PostProcessClassification_t *results,
+                                                     int capacity,
+                                                     int *counts,
+                                                     int max_batch);
+
+/**
+ * 根据 PostProcessClassification_t.id 获取类别名，越界返回NULL
+ */
+const char *ClassificationGetClassName(int id);
+
 #ifdef __cplusplus
 }
 #endif
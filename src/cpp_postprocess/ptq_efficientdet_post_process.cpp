@@ -34,6 +34,8 @@
 #include <cassert>
 
 #include "ptq_efficientdet_post_process.h"
+#include "post_process_nms.h"
+#include "post_process_prior.h"
 
 /**
  * Config definition for EfficientDet
@@ -55,15 +57,6 @@ struct EDBaseAnchor {
   float y2_;
 };
 
-struct EDAnchor {
-  EDAnchor(float c_x, float c_y, float w, float h)
-      : c_x_(c_x), c_y_(c_y), w_(w), h_(h) {}
-  float c_x_;
-  float c_y_;
-  float w_;
-  float h_;
-};
-
 
 const int kEfficientDetClassNum = 80;
 
@@ -104,8 +97,6 @@ EfficientDetConfig default_efficient_det_config = {
      "vase",          "scissors",     "teddy bear",
      "hair drier",    "toothbrush"}};
 
-
-
 /**
  * Finds the smallest element in the range [first, last).
  * @tparam[in] ForwardIterator
@@ -186,65 +177,13 @@ typedef struct Detection {
   ~Detection() {}
 } Detection;
 
-std::vector<Detection> efficient_det_dets;
-std::vector<Detection> efficient_det_restuls;
-static std::vector<std::vector<EDAnchor>> anchors_table;
-
-static void efficient_det_nms(std::vector<Detection> &input,
-               float iou_threshold,
-               int top_k,
-               std::vector<Detection> &result,
-               bool suppress) {
-  // sort order by score desc
-  std::stable_sort(input.begin(), input.end(), std::greater<Detection>());
-
-  std::vector<bool> skip(input.size(), false);
-
-  // pre-calculate boxes area
-  std::vector<float> areas;
-  areas.reserve(input.size());
-  for (size_t i = 0; i < input.size(); i++) {
-    float width = input[i].bbox.xmax - input[i].bbox.xmin;
-    float height = input[i].bbox.ymax - input[i].bbox.ymin;
-    areas.push_back(width * height);
-  }
+// 候选框、NMS结果等帧间复用的缓存，稳定运行后不再有堆分配
+static PostProcessDetectionArena<Detection> efficient_det_arena;
+// 先验框表，按模型输入尺寸和特征图尺寸缓存
+static PostProcessPriorCache efficient_det_prior_cache;
+// 当前层通过分类阈值的候选框
+static PostProcessPriorCandidates efficient_det_candidates;
 
-  int count = 0;
-  for (size_t i = 0; count < top_k && i < skip.size(); i++) {
-    if (skip[i]) {
-      continue;
-    }
-    skip[i] = true;
-    ++count;
-
-    for (size_t j = i + 1; j < skip.size(); ++j) {
-      if (skip[j]) {
-        continue;
-      }
-      if (suppress == false) {
-        if (input[i].id != input[j].id) {
-          continue;
-        }
-      }
-
-      // intersection area
-      float xx1 = std::max(input[i].bbox.xmin, input[j].bbox.xmin);
-      float yy1 = std::max(input[i].bbox.ymin, input[j].bbox.ymin);
-      float xx2 = std::min(input[i].bbox.xmax, input[j].bbox.xmax);
-      float yy2 = std::min(input[i].bbox.ymax, input[j].bbox.ymax);
-
-      if (xx2 > xx1 && yy2 > yy1) {
-        float area_intersection = (xx2 - xx1) * (yy2 - yy1);
-        float iou_ratio =
-            area_intersection / (areas[j] + areas[i] - area_intersection);
-        if (iou_ratio > iou_threshold) {
-          skip[j] = true;
-        }
-      }
-    }
-    result.push_back(input[i]);
-  }
-}
 
 static inline uint32x4x4_t CalculateIndex(uint32_t idx,
                                           float32x4_t a,
@@ -311,7 +250,7 @@ static std::pair<float, int> MaxScoreID(int32_t *input,
   return result_id_score;
 }
 
-int GetAnchors(std::vector<EDAnchor> &anchors,
+int GetAnchors(PostProcessPriorTable *anchors,
                                                  int layer,
                                                  int feat_height,
                                                  int feat_width) {
@@ -350,7 +289,7 @@ int GetAnchors(std::vector<EDAnchor> &anchors,
         float ctr_x = x1 + 0.5f * (width - 1.f);
         float ctr_y = y1 + 0.5f * (height - 1.f);
 
-        anchors.push_back(EDAnchor(ctr_x, ctr_y, width, height));
+        anchors->Add(ctr_x, ctr_y, width, height);
       }
     }
   }
@@ -360,7 +299,7 @@ int GetAnchors(std::vector<EDAnchor> &anchors,
 int GetBboxAndScores(
     hbDNNTensor *c_tensor,
     hbDNNTensor *bbox_tensor,
-    std::vector<EDAnchor> &anchors,
+    const PostProcessPriorTable &anchors,
     int class_num,
     float img_h,
     float img_w,
@@ -461,36 +400,9 @@ int GetBboxAndScores(
 
       // aligned index
       int start = i * 4;
-      float dx = raw_box_data[start];
-      float dy = raw_box_data[start + 1];
-      float dw = raw_box_data[start + 2];
-      float dh = raw_box_data[start + 3];
-      float width = anchors[i].w_;
-      float height = anchors[i].h_;
-      float ctr_x = anchors[i].c_x_;
-      float ctr_y = anchors[i].c_y_;
-
-      float pred_ctr_x = dx * width + ctr_x;
-      float pred_ctr_y = dy * height + ctr_y;
-      float pred_w = std::exp(dw) * width;
-      float pred_h = std::exp(dh) * height;
-
-      // python在这里需要对框做clip,  x >= 0 && x <= input_width...
-      float xmin = (pred_ctr_x - 0.5f * (pred_w - 1.f));
-      float ymin = (pred_ctr_y - 0.5f * (pred_h - 1.f));
-      float xmax = (pred_ctr_x + 0.5f * (pred_w - 1.f));
-      float ymax = (pred_ctr_y + 0.5f * (pred_h - 1.f));
-
-      Bbox bbox;
-      bbox.xmin = std::max(xmin, 0.f);
-      bbox.ymin = std::max(ymin, 0.f);
-      bbox.xmax = std::min(xmax, img_w);
-      bbox.ymax = std::min(ymax, img_h);
-
-      efficient_det_dets.push_back(Detection(max_id,
-                                              max_score,
-                                              bbox,
-                                              default_efficient_det_config.class_names[max_id].c_str()));
+      efficient_det_candidates.Add(i, raw_box_data[start], raw_box_data[start + 1],
+                                   raw_box_data[start + 2], raw_box_data[start + 3],
+                                   max_score, max_id);
     }
   } else {
     auto *raw_cls_data =
@@ -523,34 +435,29 @@ int GetBboxAndScores(
       float dy = raw_box_data[start + 1] * box_scales[1];
       float dw = raw_box_data[start + 2] * box_scales[2];
       float dh = raw_box_data[start + 3] * box_scales[3];
-      float width = anchors[i].w_;
-      float height = anchors[i].h_;
-      float ctr_x = anchors[i].c_x_;
-      float ctr_y = anchors[i].c_y_;
-
-      float pred_ctr_x = dx * width + ctr_x;
-      float pred_ctr_y = dy * height + ctr_y;
-      float pred_w = std::exp(dw) * width;
-      float pred_h = std::exp(dh) * height;
-
-      // python在这里需要对框做clip,  x >= 0 && x <= input_width...
-      float xmin = (pred_ctr_x - 0.5f * (pred_w - 1.f));
-      float ymin = (pred_ctr_y - 0.5f * (pred_h - 1.f));
-      float xmax = (pred_ctr_x + 0.5f * (pred_w - 1.f));
-      float ymax = (pred_ctr_y + 0.5f * (pred_h - 1.f));
-
-      Bbox bbox;
-      bbox.xmin = std::max(xmin, 0.f);
-      bbox.ymin = std::max(ymin, 0.f);
-      bbox.xmax = std::min(xmax, img_w);
-      bbox.ymax = std::min(ymax, img_h);
-
-      efficient_det_dets.push_back(Detection(max_id,
-                                    max_score,
-                                    bbox,
-                                    default_efficient_det_config.class_names[max_id].c_str()));
+      efficient_det_candidates.Add(i, dx, dy, dw, dh, max_score, max_id);
     }
   }
+
+  // 用先验框表一次性解码全部候选框
+  PostProcessPriorCandidates &cand = efficient_det_candidates;
+  const float variance[4] = {1.f, 1.f, 1.f, 1.f};
+  PostProcessDecodePriorBoxes(anchors, variance, 1.f, &cand);
+  for (int i = 0; i < cand.Size(); i++) {
+    // python在这里需要对框做clip,  x >= 0 && x <= input_width...
+    Bbox bbox;
+    bbox.xmin = std::max(cand.xmin[i], 0.f);
+    bbox.ymin = std::max(cand.ymin[i], 0.f);
+    bbox.xmax = std::min(cand.xmax[i], img_w);
+    bbox.ymax = std::min(cand.ymax[i], img_h);
+
+    int max_id = cand.id[i];
+    efficient_det_arena.dets.push_back(Detection(max_id,
+                                            cand.score[i],
+                                            bbox,
+                                            default_efficient_det_config.class_names[max_id].c_str()));
+  }
+  cand.Clear();
   return 0;
 }
 
@@ -579,26 +486,19 @@ void EfficientdetdoProcess(hbDNNTensor *cls_tensor, hbDNNTensor *bbox_tensor, Ef
 
   int height = bbox_tensor->properties.alignedShape.dimensionSize[1];
   int width = bbox_tensor->properties.alignedShape.dimensionSize[2];
-  int layer_num = default_efficient_det_config.feature_strides.size();
-  if (anchors_table.empty()) {
-    // Note: note thread safe
-    anchors_table.resize(layer_num);
-    printf("init anchors_table.\n");
-  }
-  GetAnchors(anchors_table[layer], layer, height, width);
+  PostProcessPriorKey key = {input_height, input_width, layer, height, width};
+  const PostProcessPriorTable &anchors =
+      efficient_det_prior_cache.Get(key, [&](PostProcessPriorTable *table) {
+        GetAnchors(table, layer, height, width);
+      });
 
-  std::vector<EDAnchor> &anchors = anchors_table[layer];
   GetBboxAndScores(cls_tensor, bbox_tensor, anchors, kEfficientDetClassNum, new_h, new_w, post_info);
 
 }
 
 
-char* EfficientdetPostProcess(EfficientdetPostProcessInfo_t *post_info) {
-
-  int i = 0;
-  char *str_dets;
-  std::stringstream out_string;
-
+// NMS 后把检测框从模型输入尺寸还原到原图尺寸，结果保存在 efficient_det_arena.results
+static void EfficientdetGetResults(EfficientdetPostProcessInfo_t *post_info) {
   float origin_height = post_info->ori_height;
   float origin_width = post_info->ori_width;
 
@@ -619,13 +519,13 @@ char* EfficientdetPostProcess(EfficientdetPostProcessInfo_t *post_info) {
     h_ratio = scale;
   }
 
-  efficient_det_nms(efficient_det_dets, post_info->nms_threshold, post_info->nms_top_k, efficient_det_restuls, false);
+  PostProcessNms(efficient_det_arena.dets, GetNmsParam(post_info, PostProcessGetNmsMode()), efficient_det_arena.results, &efficient_det_arena.nms_ws);
 
-  if (efficient_det_restuls.size() > post_info->nms_top_k) {
-    efficient_det_restuls.resize(post_info->nms_top_k);
+  if (efficient_det_arena.results.size() > post_info->nms_top_k) {
+    efficient_det_arena.results.resize(post_info->nms_top_k);
   }
 
-  for (auto &box : efficient_det_restuls) {
+  for (auto &box : efficient_det_arena.results) {
     box.bbox.xmax /= w_ratio;
     box.bbox.xmin /= w_ratio;
     box.bbox.ymax /= h_ratio;
@@ -636,23 +536,39 @@ char* EfficientdetPostProcess(EfficientdetPostProcessInfo_t *post_info) {
     box.bbox.xmax = std::min(static_cast<float>(box.bbox.xmax), static_cast<float>(post_info->ori_width - 1)) + 1;
     box.bbox.ymax = std::min(static_cast<float>(box.bbox.ymax), static_cast<float>(post_info->ori_height - 1)) + 1;
   }
+}
+
+char* EfficientdetPostProcess(EfficientdetPostProcessInfo_t *post_info) {
+
+  EfficientdetGetResults(post_info);
 
   // 算法结果转换成json格式
-  out_string << "\"efficient_det_result\": [";
-  for (i = 0; i < efficient_det_restuls.size(); i++) {
-  	auto det_ret = efficient_det_restuls[i];
-  	out_string << det_ret;
-  	if (i < efficient_det_restuls.size() - 1)
-		out_string << ",";
+  PostProcessArenaVector<PostProcessDetection_t> &dets = efficient_det_arena.out;
+  dets.resize(efficient_det_arena.results.size());
+  int num = CopyDetectionResult(efficient_det_arena.results, dets.data(), dets.size());
+  efficient_det_arena.Clear();
+  return DetectionResultToJson("efficient_det_result", dets.data(), num, EfficientdetGetClassName);
+}
+
+int EfficientdetPostProcessToArray(EfficientdetPostProcessInfo_t *post_info,
+                                   PostProcessDetection_t *dets,
+                                   int capacity) {
+  if (dets == nullptr || capacity < 0) {
+    printf("efficientdet post process invalid output array!\n");
+    efficient_det_arena.Clear();
+    return -1;
+  }
+
+  EfficientdetGetResults(post_info);
+  int num = CopyDetectionResult(efficient_det_arena.results, dets, capacity);
+  efficient_det_arena.Clear();
+  return num;
+}
+
+const char *EfficientdetGetClassName(int id) {
+  if (id < 0 || id >= static_cast<int>(default_efficient_det_config.class_names.size())) {
+    return nullptr;
   }
-  out_string << "]" << std::endl;
-
-  str_dets = (char *)malloc(out_string.str().length() + 1);
-  str_dets[out_string.str().length()] = '\0';
-  snprintf(str_dets, out_string.str().length(), "%s", out_string.str().c_str());
-  // printf("str_dets: %s\n", str_dets);
-  efficient_det_dets.clear();
-  efficient_det_restuls.clear();
-  return str_dets;
+  return default_efficient_det_config.class_names[id].c_str();
 }
 
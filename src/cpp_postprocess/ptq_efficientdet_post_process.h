@@ -24,6 +24,7 @@
 #define _POST_PROCESS_EFFICIENTDET_POST_PROCESS_H_
 
 #include "dnn/hb_dnn.h"
+#include "post_process_common.h"
 
 #ifdef __cplusplus
   extern "C"{
@@ -51,6 +52,21 @@ char* EfficientdetPostProcess(EfficientdetPostProcessInfo_t *post_info);
 
 void EfficientdetdoProcess(hbDNNTensor *cls_tensor, hbDNNTensor *bbox_tensor, EfficientdetPostProcessInfo_t *post_info, int layer);
 
+/**
+ * 与 EfficientdetPostProcess 相同，但结果直接写入 dets 数组，不生成json字符串
+ * @param[out] dets: 调用者分配的结果数组
+ * @param[in] capacity: dets 数组的长度，结果超过 capacity 时只保留前 capacity 个
+ * @return 写入的结果个数，参数错误返回-1
+ */
+int EfficientdetPostProcessToArray(EfficientdetPostProcessInfo_t *post_info,
+                         PostProcessDetection_t *dets,
+                         int capacity);
+
+/**
+ * 根据 PostProcessDetection_t.id 获取类别名，越界返回NULL
+ */
+const char *EfficientdetGetClassName(int id);
+
 #ifdef __cplusplus
 }
 #endif
@@ -34,6 +34,9 @@
 #include <cassert>
 
 #include "ptq_ssd_post_process.h"
+#include "post_process_geometry.h"
+#include "post_process_nms.h"
+#include "post_process_prior.h"
 
 inline float fastExp(float x) {
   union {
@@ -126,20 +129,6 @@ inline size_t argmax(ForwardIterator first, ForwardIterator last) {
 }
 
 
-typedef struct Anchor {
-  float cx{0.0};
-  float cy{0.0};
-  float w{0.0};
-  float h{0.0};
-  Anchor(float cx, float cy, float w, float h) : cx(cx), cy(cy), w(w), h(h) {}
-
-  friend std::ostream &operator<<(std::ostream &os, const Anchor &anchor) {
-    os << "[" << anchor.cx << "," << anchor.cy << "," << anchor.w << ","
-       << anchor.h << "]";
-    return os;
-  }
-} Anchor;
-
 /**
  * Bounding box definition
  */
@@ -202,102 +191,91 @@ static float DequantiScale(int32_t data,
   return static_cast<float>(r_int32(data, big_endian)) * scale_value;
 }
 
-std::vector<Detection> ssd_dets;
-std::vector<Detection> ssd_det_restuls;
-std::vector<std::vector<Anchor>> anchors_table;
+// 候选框、NMS结果等帧间复用的缓存，稳定运行后不再有堆分配
+static PostProcessDetectionArena<Detection> ssd_arena;
+// 先验框表，按模型输入尺寸和特征图尺寸缓存
+static PostProcessPriorCache ssd_prior_cache;
+// 当前层通过分类阈值的候选框
+static PostProcessPriorCandidates ssd_candidates;
 
 #define NMS_MAX_INPUT (400)
-void ssd_nms(std::vector<Detection> &input,
-         float iou_threshold,
-         int top_k,
-         std::vector<Detection> &result,
-         bool suppress) {
-  // sort order by score desc
-  std::stable_sort(input.begin(), input.end(), std::greater<Detection>());
-  if (input.size() > NMS_MAX_INPUT) {
-    input.resize(NMS_MAX_INPUT);
-  }
-
-  std::vector<bool> skip(input.size(), false);
-
-  // pre-calculate boxes area
-  std::vector<float> areas;
-  areas.reserve(input.size());
-  for (size_t i = 0; i < input.size(); i++) {
-    float width = input[i].bbox.xmax - input[i].bbox.xmin;
-    float height = input[i].bbox.ymax - input[i].bbox.ymin;
-    areas.push_back(width * height);
-  }
-
-  int count = 0;
-  for (size_t i = 0; count < top_k && i < skip.size(); i++) {
-    if (skip[i]) {
-      continue;
-    }
-    skip[i] = true;
-    ++count;
 
-    for (size_t j = i + 1; j < skip.size(); ++j) {
-      if (skip[j]) {
-        continue;
-      }
-      if (suppress == false) {
-        if (input[i].id != input[j].id) {
-          continue;
-        }
-      }
-
-      // intersection area
-      float xx1 = std::max(input[i].bbox.xmin, input[j].bbox.xmin);
-      float yy1 = std::max(input[i].bbox.ymin, input[j].bbox.ymin);
-      float xx2 = std::min(input[i].bbox.xmax, input[j].bbox.xmax);
-      float yy2 = std::min(input[i].bbox.ymax, input[j].bbox.ymax);
-
-      if (xx2 > xx1 && yy2 > yy1) {
-        float area_intersection = (xx2 - xx1) * (yy2 - yy1);
-        float iou_ratio =
-            area_intersection / (areas[j] + areas[i] - area_intersection);
-        if (iou_ratio > iou_threshold) {
-          skip[j] = true;
-        }
-      }
-    }
-    result.push_back(input[i]);
-  }
-}
-
-int SsdAnchors(std::vector<Anchor> &anchors, int layer, int layer_height, int layer_width) {
+/**
+ * 生成一层的先验框，中心和宽高按模型输入尺寸归一化
+ */
+int SsdAnchors(PostProcessPriorTable *table,
+               int layer,
+               int layer_height,
+               int layer_width,
+               int input_height,
+               int input_width) {
   int step = default_ssd_config.step[layer];
   float min_size = default_ssd_config.anchor_size[layer].first;
   float max_size = default_ssd_config.anchor_size[layer].second;
   auto &anchor_ratio = default_ssd_config.anchor_ratio[layer];
+  auto add_anchor = [&](float cx, float cy, float w, float h) {
+    float x_min = (cx - w / 2) / input_width;
+    float y_min = (cy - h / 2) / input_height;
+    float x_max = (cx + w / 2) / input_width;
+    float y_max = (cy + h / 2) / input_height;
+    table->Add((x_max + x_min) / 2, (y_max + y_min) / 2, x_max - x_min, y_max - y_min);
+  };
   for (int i = 0; i < layer_height; i++) {
     for (int j = 0; j < layer_width; j++) {
       float cy = (i + default_ssd_config.offset[0]) * step;
       float cx = (j + default_ssd_config.offset[1]) * step;
-      anchors.emplace_back(Anchor(cx, cy, min_size, min_size));
+      add_anchor(cx, cy, min_size, min_size);
       if (max_size > 0) {
-        anchors.emplace_back(Anchor(cx,
-                                    cy,
-                                    std::sqrt(max_size * min_size),
-                                    std::sqrt(max_size * min_size)));
+        add_anchor(cx, cy, std::sqrt(max_size * min_size), std::sqrt(max_size * min_size));
       }
       for (int k = 0; k < 4; k++) {
         if (anchor_ratio[k] == 0) continue;
         float sr = std::sqrt(anchor_ratio[k]);
         float w = min_size * sr;
         float h = min_size / sr;
-        anchors.emplace_back(Anchor(cx, cy, w, h));
+        add_anchor(cx, cy, w, h);
       }
     }
   }
   return 0;
 }
 
+/**
+ * 用先验框表一次性解码 ssd_candidates 中的候选框，还原到原图并裁剪后追加到 ssd_arena.dets
+ */
+static void SsdEmitDetections(const PostProcessPriorTable &priors,
+                              SsdPostProcessInfo_t *post_info) {
+  PostProcessPriorCandidates &cand = ssd_candidates;
+  int num = cand.Size();
+  if (num == 0) {
+    return;
+  }
+  PostProcessDecodePriorBoxes(priors, default_ssd_config.std.data(), 0.0f, &cand);
+
+  // 解码结果是按模型输入归一化的坐标，直接乘原图宽高
+  PostProcessGeometry geometry = {};
+  geometry.w_ratio_inv = post_info->ori_width;
+  geometry.h_ratio_inv = post_info->ori_height;
+  geometry.max_x = post_info->ori_width - 1.0f;
+  geometry.max_y = post_info->ori_height - 1.0f;
+  cand.valid.resize(num);
+  PostProcessProjectBoxes(geometry, cand.xmin.data(), cand.ymin.data(), cand.xmax.data(),
+                          cand.ymax.data(), num, cand.valid.data());
+
+  for (int i = 0; i < num; i++) {
+    if (!cand.valid[i]) continue;
+    int max_id = cand.id[i];
+    Bbox bbox(cand.xmin[i], cand.ymin[i], cand.xmax[i], cand.ymax[i]);
+    ssd_arena.dets.emplace_back(Detection(
+        max_id, cand.score[i], bbox, default_ssd_config.class_names[max_id].c_str()));
+  }
+  cand.Clear();
+}
+
 int GetBboxAndScoresQuantiNONE(
     hbDNNTensor *bbox_tensor,
     hbDNNTensor *cls_tensor,
-    std::vector<Anchor> &anchors,
+    const PostProcessPriorTable &priors,
     int class_num, SsdPostProcessInfo_t *post_info) {
   int *shape = cls_tensor->properties.validShape.dimensionSize;
   //uint32_t c_batch_size = shape[0];
@@ -369,49 +347,17 @@ int GetBboxAndScoresQuantiNONE(
     }
 
     int start = i * 4;
-    float dx = raw_box_data[start];
-    float dy = raw_box_data[start + 1];
-    float dw = raw_box_data[start + 2];
-    float dh = raw_box_data[start + 3];
-
-    auto x_min = (anchors[i].cx - anchors[i].w / 2) / post_info->width;
-    auto y_min = (anchors[i].cy - anchors[i].h / 2) / post_info->height;
-    auto x_max = (anchors[i].cx + anchors[i].w / 2) / post_info->width;
-    auto y_max = (anchors[i].cy + anchors[i].h / 2) / post_info->height;
-
-    auto prior_w = x_max - x_min;
-    auto prior_h = y_max - y_min;
-    auto prior_center_x = (x_max + x_min) / 2;
-    auto prior_center_y = (y_max + y_min) / 2;
-    auto decode_x = default_ssd_config.std[0] * dx * prior_w + prior_center_x;
-    auto decode_y = default_ssd_config.std[1] * dy * prior_h + prior_center_y;
-    auto decode_w = std::exp(default_ssd_config.std[2] * dw) * prior_w;
-    auto decode_h = std::exp(default_ssd_config.std[3] * dh) * prior_h;
-
-    auto xmin_org = (decode_x - decode_w * 0.5) * post_info->ori_width;
-    auto ymin_org = (decode_y - decode_h * 0.5) * post_info->ori_height;
-    auto xmax_org = (decode_x + decode_w * 0.5) * post_info->ori_width;
-    auto ymax_org = (decode_y + decode_h * 0.5) * post_info->ori_height;
-
-    xmin_org = std::max(xmin_org, 0.0);
-    xmax_org = std::min(xmax_org, post_info->ori_width - 1.0);
-    ymin_org = std::max(ymin_org, 0.0);
-    ymax_org = std::min(ymax_org, post_info->ori_height - 1.0);
-
-    if (xmax_org <= 0 || ymax_org <= 0) continue;
-    if (xmin_org > xmax_org || ymin_org > ymax_org) continue;
-
-    Bbox bbox(xmin_org, ymin_org, xmax_org, ymax_org);
-    ssd_dets.emplace_back(Detection(
-        (int)max_id, max_score, bbox, default_ssd_config.class_names[max_id].c_str()));
+    ssd_candidates.Add(i, raw_box_data[start], raw_box_data[start + 1],
+                       raw_box_data[start + 2], raw_box_data[start + 3], max_score, max_id);
   }
+  SsdEmitDetections(priors, post_info);
   return 0;
 }
 
 int GetBboxAndScoresQuantiSCALE(
     hbDNNTensor *bbox_tensor,
     hbDNNTensor *cls_tensor,
-    std::vector<Anchor> &anchors,
+    const PostProcessPriorTable &priors,
     int class_num, SsdPostProcessInfo_t *post_info) {
   int h_idx{1}, w_idx{2}, c_idx{3};
 
@@ -483,43 +429,13 @@ int GetBboxAndScoresQuantiSCALE(
         float dh = DequantiScale(cur_bbox_data[3], false, cur_bbox_scale[3]);
 
         int i = h * bbox_w * stride + w * stride + k;
-        auto x_min = (anchors[i].cx - anchors[i].w / 2) / post_info->width;
-        auto y_min = (anchors[i].cy - anchors[i].h / 2) / post_info->height;
-        auto x_max = (anchors[i].cx + anchors[i].w / 2) / post_info->width;
-        auto y_max = (anchors[i].cy + anchors[i].h / 2) / post_info->height;
-
-        auto prior_w = x_max - x_min;
-        auto prior_h = y_max - y_min;
-        auto prior_center_x = (x_max + x_min) / 2;
-        auto prior_center_y = (y_max + y_min) / 2;
-        auto decode_x = default_ssd_config.std[0] * dx * prior_w + prior_center_x;
-        auto decode_y = default_ssd_config.std[1] * dy * prior_h + prior_center_y;
-        auto decode_w = std::exp(default_ssd_config.std[2] * dw) * prior_w;
-        auto decode_h = std::exp(default_ssd_config.std[3] * dh) * prior_h;
-
-        auto xmin_org = (decode_x - decode_w * 0.5) * post_info->ori_width;
-        auto ymin_org = (decode_y - decode_h * 0.5) * post_info->ori_height;
-        auto xmax_org = (decode_x + decode_w * 0.5) * post_info->ori_width;
-        auto ymax_org = (decode_y + decode_h * 0.5) * post_info->ori_height;
-
-        xmin_org = std::max(xmin_org, 0.0);
-        xmax_org = std::min(xmax_org, post_info->ori_width - 1.0);
-        ymin_org = std::max(ymin_org, 0.0);
-        ymax_org = std::min(ymax_org, post_info->ori_height - 1.0);
-
-        if (xmax_org <= 0 || ymax_org <= 0) continue;
-        if (xmin_org > xmax_org || ymin_org > ymax_org) continue;
-
-        Bbox bbox(xmin_org, ymin_org, xmax_org, ymax_org);
-        ssd_dets.emplace_back(Detection((int)max_id,
-                                    max_score,
-                                    bbox,
-                                    default_ssd_config.class_names[max_id].c_str()));
+        ssd_candidates.Add(i, dx, dy, dw, dh, max_score, max_id);
       }
       bbox_data = bbox_data + bbox_c_aligned;
       cls_data = cls_data + cls_c_aligned;
     }
   }
+  SsdEmitDetections(priors, post_info);
   return 0;
 }
 
@@ -528,19 +444,17 @@ void SsddoProcess(hbDNNTensor *bbox_tensor, hbDNNTensor *cls_tensor, SsdPostProc
 
   int height = bbox_tensor->properties.alignedShape.dimensionSize[1];
   int width = bbox_tensor->properties.alignedShape.dimensionSize[2];
-  int layer_num = default_ssd_config.step.size();
-  if (anchors_table.empty()) {
-    // Note: note thread safe
-    anchors_table.resize(layer_num);
-    printf("init anchors_table.\n");
-  }
-  SsdAnchors(anchors_table[layer], layer, height, width);
+  PostProcessPriorKey key = {post_info->height, post_info->width, layer, height, width};
+  const PostProcessPriorTable &priors =
+      ssd_prior_cache.Get(key, [&](PostProcessPriorTable *table) {
+        SsdAnchors(table, layer, height, width, post_info->height, post_info->width);
+      });
 
   auto quanti_type = bbox_tensor->properties.quantiType;
   if (quanti_type == hbDNNQuantiType::SCALE) {
-    GetBboxAndScoresQuantiSCALE(bbox_tensor, cls_tensor, anchors_table[layer], default_ssd_config.class_num + 1, post_info);
+    GetBboxAndScoresQuantiSCALE(bbox_tensor, cls_tensor, priors, default_ssd_config.class_num + 1, post_info);
   } else if (quanti_type == hbDNNQuantiType::NONE) {
-    GetBboxAndScoresQuantiNONE(bbox_tensor, cls_tensor, anchors_table[layer], default_ssd_config.class_num + 1, post_info);
+    GetBboxAndScoresQuantiNONE(bbox_tensor, cls_tensor, priors, default_ssd_config.class_num + 1, post_info);
   } else {
     printf("error quanti_type: %d\n", quanti_type);
   }
@@ -549,30 +463,36 @@ void SsddoProcess(hbDNNTensor *bbox_tensor, hbDNNTensor *cls_tensor, SsdPostProc
 
 char* SsdPostProcess(SsdPostProcessInfo_t *post_info) {
 
-  int i = 0;
-  char *str_dets;
-
   // 计算交并比来合并检测框，传入交并比阈值(0.65)和返回box数量(5000)
-  ssd_nms(ssd_dets, post_info->nms_threshold, post_info->nms_top_k, ssd_det_restuls, false);
-  std::stringstream out_string;
+  PostProcessNms(ssd_arena.dets, GetNmsParam(post_info, PostProcessGetNmsMode(), NMS_MAX_INPUT), ssd_arena.results, &ssd_arena.nms_ws);
 
   // 算法结果转换成json格式
-  int ssd_det_restuls_size = ssd_det_restuls.size();
-  out_string << "\"ssd_result\": [";
-  for (i = 0; i < ssd_det_restuls_size; i++) {
-  	auto det_ret = ssd_det_restuls[i];
-  	out_string << det_ret;
-  	if (i < ssd_det_restuls_size - 1)
-		out_string << ",";
+  PostProcessArenaVector<PostProcessDetection_t> &dets = ssd_arena.out;
+  dets.resize(ssd_arena.results.size());
+  int num = CopyDetectionResult(ssd_arena.results, dets.data(), dets.size());
+  ssd_arena.Clear();
+  return DetectionResultToJson("ssd_result", dets.data(), num, SsdGetClassName);
+}
+
+int SsdPostProcessToArray(SsdPostProcessInfo_t *post_info,
+                          PostProcessDetection_t *dets,
+                          int capacity) {
+  if (dets == nullptr || capacity < 0) {
+    printf("ssd post process invalid output array!\n");
+    ssd_arena.Clear();
+    return -1;
+  }
+
+  PostProcessNms(ssd_arena.dets, GetNmsParam(post_info, PostProcessGetNmsMode(), NMS_MAX_INPUT), ssd_arena.results, &ssd_arena.nms_ws);
+  int num = CopyDetectionResult(ssd_arena.results, dets, capacity);
+  ssd_arena.Clear();
+  return num;
+}
+
+const char *SsdGetClassName(int id) {
+  if (id < 0 || id >= static_cast<int>(default_ssd_config.class_names.size())) {
+    return nullptr;
   }
-  out_string << "]" << std::endl;
-
-  str_dets = (char *)malloc(out_string.str().length() + 1);
-  str_dets[out_string.str().length()] = '\0';
-  snprintf(str_dets, out_string.str().length(), "%s", out_string.str().c_str());
-  // printf("str_dets: %s\n", str_dets);
-  ssd_dets.clear();
-  ssd_det_restuls.clear();
-  return str_dets;
+  return default_ssd_config.class_names[id].c_str();
 }
 
@@ -29,13 +29,16 @@
 #include <iostream>
 #include <iomanip>
 #include <algorithm>
-#include <arm_neon.h>
 #include <queue>
+#include <cstring>
 
 #include "unet_post_process.h"
+#include "post_process_arena.h"
+#include "post_process_math.h"
+#include "post_process_thread_pool.h"
 
 typedef struct Segmentation {
-  std::vector<int8_t> seg;
+  PostProcessArenaVector<uint8_t> seg;
   int32_t num_classes;
   int32_t width;
   int32_t height;
@@ -44,131 +47,159 @@ typedef struct Segmentation {
 
 Segmentation Segmentation_dets;
 
-static inline uint32x4x4_t CalculateIndex(uint32_t idx,
-                                          float32x4_t a,
-                                          float32x4_t b,
-                                          uint32x4x4_t c) {
-  uint32x4_t mask{0};
-  mask = vcltq_f32(b, a);
-  uint32x4_t vec_idx = {idx, idx + 1, idx + 2, idx + 3};
-  uint32x4x4_t res = {{vbslq_u32(mask, vec_idx, c.val[0]), 0, 0, 0}};
-  return res;
-}
-
-static inline float32x2_t CalculateMax(float32x4_t in) {
-  auto pmax = vpmax_f32(vget_high_f32(in), vget_low_f32(in));
-  return vpmax_f32(pmax, pmax);
-}
-
-static inline uint32_t CalculateVectorIndex(uint32x4x4_t vec_res_idx,
-                                            float32x4_t vec_res_value) {
-  uint32x4_t res_idx_mask{0};
-  uint32x4_t mask_ones = vdupq_n_u32(0xFFFFFFFF);
-
-  auto pmax = CalculateMax(vec_res_value);
-  auto mask = vceqq_f32(vec_res_value, vcombine_f32(pmax, pmax));
-  res_idx_mask = vandq_u32(vec_res_idx.val[0], mask);
-  res_idx_mask = vaddq_u32(res_idx_mask, mask_ones);
-  auto pmin =
-      vpmin_u32(vget_high_u32(res_idx_mask), vget_low_u32(res_idx_mask));
-  pmin = vpmin_u32(pmin, pmin);
-  uint32_t res = vget_lane_u32(pmin, 0);
-  return (res - 0xFFFFFFFF);
-}
-
-static std::pair<float, int> MaxScoreID(int32_t *input,
-                                        float *scale,
-                                        int length) {
-  float init_res_value = input[0] * scale[0];
-  float32x4_t vec_res_value = vdupq_n_f32(init_res_value);
-  uint32x4x4_t vec_res_idx{{0}};
-  int i = 0;
-  for (; i <= (length - 4); i += 4) {
-    int32x4_t vec_input = vld1q_s32(input + i);
-    float32x4_t vec_scale = vld1q_f32(scale + i);
-
-    float32x4_t vec_elements = vmulq_f32(vcvtq_f32_s32(vec_input), vec_scale);
-    float32x4_t temp_vec_res_value = vmaxq_f32(vec_elements, vec_res_value);
-    vec_res_idx =
-        CalculateIndex(i, temp_vec_res_value, vec_res_value, vec_res_idx);
-    vec_res_value = temp_vec_res_value;
+// 小于这个元素个数(h * w * c)时不值得分到线程池
+#define UNET_PARALLEL_MIN_ELEMENTS (64 * 1024)
+
+// NCHW 每个任务保存一行的当前最大值和所在通道
+static PostProcessArenaVector<float> unet_row_max;
+static PostProcessArenaVector<int32_t> unet_row_idx;
+// UnetPostProcess 转换成json前的结果，UnetPostProcessToMask 缩放时每列对应的源列
+static PostProcessArenaVector<uint8_t> unet_json_mask;
+static PostProcessArenaVector<int32_t> unet_src_x;
+
+struct UnetTensorInfo {
+  int height;
+  int width;
+  int channel;
+  bool nchw;
+  // 以元素为单位的步长
+  int row_stride;
+  int w_stride;
+  int c_stride;
+};
+
+static int UnetGetTensorInfo(hbDNNTensor *tensor, UnetTensorInfo *info) {
+  auto &valid = tensor->properties.validShape;
+  auto &aligned = tensor->properties.alignedShape;
+  if (tensor->properties.tensorLayout == HB_DNN_LAYOUT_NCHW) {
+    info->nchw = true;
+    info->channel = valid.dimensionSize[1];
+    info->height = valid.dimensionSize[2];
+    info->width = valid.dimensionSize[3];
+    info->w_stride = 1;
+    info->row_stride = aligned.dimensionSize[3];
+    info->c_stride = aligned.dimensionSize[2] * aligned.dimensionSize[3];
+  } else if (tensor->properties.tensorLayout == HB_DNN_LAYOUT_NHWC) {
+    info->nchw = false;
+    info->height = valid.dimensionSize[1];
+    info->width = valid.dimensionSize[2];
+    info->channel = valid.dimensionSize[3];
+    info->c_stride = 1;
+    info->w_stride = aligned.dimensionSize[3];
+    info->row_stride = aligned.dimensionSize[2] * aligned.dimensionSize[3];
+  } else {
+    printf("unet post process unsupported layout: %d\n",
+           tensor->properties.tensorLayout);
+    return -1;
   }
-
-  uint32_t idx = CalculateVectorIndex(vec_res_idx, vec_res_value);
-  float res = vget_lane_f32(CalculateMax(vec_res_value), 0);
-
-  // Compute left elements
-  for (; i < length; ++i) {
-    float score = input[i] * scale[i];
-    if (score > res) {
-      idx = i;
-      res = score;
-    }
+  if (info->channel <= 0 || info->height <= 0 || info->width <= 0) {
+    printf("unet post process invalid shape: %dx%dx%d\n",
+           info->height, info->width, info->channel);
+    return -1;
   }
-  std::pair<float, int> result_id_score = {res, idx};
-  return result_id_score;
+  return 0;
 }
 
-int PostProcessNone(hbDNNTensor *tensors, UnetPostProcessInfo_t *post_info, int layer) {
-
-  int height = tensors->properties.validShape.dimensionSize[1];
-  int width = tensors->properties.validShape.dimensionSize[2];
-  int channel = tensors->properties.validShape.dimensionSize[3];
-
-  float *data = reinterpret_cast<float *>(tensors->sysMem[0].virAddr);
-  Segmentation_dets.seg.resize(height * width);
-  Segmentation_dets.width = width;
-  Segmentation_dets.height = height;
-  Segmentation_dets.num_classes = layer;
+/**
+ * 对 [h_begin, h_end) 行求每个像素的类别，结果写入 seg
+ * NHWC 下每个像素的通道连续，直接按像素求argmax；NCHW 下逐通道扫描同一行，
+ * 用 row_max/row_idx 保存整行的当前最大值，每次只读连续的一行数据
+ * @param[in] scale: 为 nullptr 时输入为float，否则为int32按通道反量化
+ */
+template <typename T>
+static void UnetArgMaxRows(const T *data,
+                           const float *scale,
+                           const UnetTensorInfo &info,
+                           int h_begin,
+                           int h_end,
+                           float *row_max,
+                           int32_t *row_idx,
+                           uint8_t *seg) {
+  for (int h = h_begin; h < h_end; h++) {
+    const T *row = data + h * info.row_stride;
+    uint8_t *seg_row = seg + h * info.width;
+    if (!info.nchw) {
+      for (int w = 0; w < info.width; w++) {
+        const T *c_data = row + w * info.w_stride;
+        float max_value;
+        seg_row[w] = scale == nullptr
+            ? ArgMaxFloat(reinterpret_cast<const float *>(c_data), info.channel, &max_value)
+            : ArgMaxDequanti(reinterpret_cast<const int32_t *>(c_data), scale,
+                             info.channel, &max_value);
+      }
+      continue;
+    }
 
-  // argmax, operate in NHWC format
-  for (int h = 0; h < height; ++h) {
-    for (int w = 0; w < width; ++w) {
-      float top_score = -1000000.0f;
-      int top_index = 0;
-      float *c_data = data + (width * h + w) * channel;
-      for (int c = 0; c < channel; c++) {
-        if (c_data[c] > top_score) {
-          top_score = c_data[c];
-          top_index = c;
-        }
+    for (int w = 0; w < info.width; w++) {
+      row_max[w] = scale == nullptr ? row[w] : row[w] * scale[0];
+      row_idx[w] = 0;
+    }
+    for (int c = 1; c < info.channel; c++) {
+      const T *c_row = row + c * info.c_stride;
+      if (scale == nullptr) {
+        UpdateArgMaxRow(reinterpret_cast<const float *>(c_row), c, info.width,
+                        row_max, row_idx);
+      } else {
+        UpdateArgMaxRowDequanti(reinterpret_cast<const int32_t *>(c_row), scale[c], c,
+                                info.width, row_max, row_idx);
       }
-      Segmentation_dets.seg[h * width + w] = top_index;
+    }
+    for (int w = 0; w < info.width; w++) {
+      seg_row[w] = row_idx[w];
     }
   }
-  return 0;
 }
 
-int PostProcessScale(hbDNNTensor *tensors, UnetPostProcessInfo_t *post_info, int layer) {
+/**
+ * 按行切分到线程池中并行求argmax
+ */
+template <typename T>
+static int UnetArgMax(hbDNNTensor *tensors, const float *scale, int layer) {
+  UnetTensorInfo info;
+  if (UnetGetTensorInfo(tensors, &info) != 0) {
+    return -1;
+  }
+  if (info.channel > 256) {
+    printf("unet post process class num %d exceeds 256!\n", info.channel);
+    return -1;
+  }
 
-  // get shape
-  int height = tensors->properties.validShape.dimensionSize[1];
-  int width = tensors->properties.validShape.dimensionSize[2];
-  int channel = tensors->properties.validShape.dimensionSize[3];
-  float *scale = tensors->properties.scale.scaleData;
-  int c_stride = tensors->properties.alignedShape.dimensionSize[3];
-
-  int32_t *data = reinterpret_cast<int32_t *>(tensors->sysMem[0].virAddr);
-  Segmentation_dets.seg.resize(height * width);
-  Segmentation_dets.width = width;
-  Segmentation_dets.height = height;
+  const T *data = reinterpret_cast<const T *>(tensors->sysMem[0].virAddr);
+  Segmentation_dets.seg.resize(info.height * info.width);
+  Segmentation_dets.width = info.width;
+  Segmentation_dets.height = info.height;
   Segmentation_dets.num_classes = layer;
 
-  // argmax, operate in NHWC format
-  for (int h = 0; h < height; ++h) {
-    for (int w = 0; w < width; ++w) {
-      float top_score = -1000000.0f;
-      int top_index = 0;
-      int32_t *c_data = data + (width * h + w) * c_stride;
-      auto max_score_id = MaxScoreID(c_data, scale, channel);
-      top_score = max_score_id.first;
-      top_index = max_score_id.second;
-      Segmentation_dets.seg[h * width + w] = top_index;
-    }
+  PostProcessThreadPool *pool = PostProcessThreadPool::Instance();
+  int task_num = 1;
+  if (pool->ThreadNum() > 1 &&
+      info.height * info.width * info.channel >= UNET_PARALLEL_MIN_ELEMENTS) {
+    task_num = std::min(info.height, pool->ThreadNum() * 2);
+  }
+  if (info.nchw) {
+    unet_row_max.resize(task_num * info.width);
+    unet_row_idx.resize(task_num * info.width);
   }
+
+  uint8_t *seg = Segmentation_dets.seg.data();
+  pool->ParallelFor(task_num, [&](int t) {
+    int h_begin = info.height * t / task_num;
+    int h_end = info.height * (t + 1) / task_num;
+    UnetArgMaxRows(data, scale, info, h_begin, h_end,
+                   unet_row_max.data() + t * info.width,
+                   unet_row_idx.data() + t * info.width, seg);
+  });
   return 0;
 }
 
+int PostProcessNone(hbDNNTensor *tensors, UnetPostProcessInfo_t *post_info, int layer) {
+  return UnetArgMax<float>(tensors, nullptr, layer);
+}
+
+int PostProcessScale(hbDNNTensor *tensors, UnetPostProcessInfo_t *post_info, int layer) {
+  return UnetArgMax<int32_t>(tensors, tensors->properties.scale.scaleData, layer);
+}
+
 void UnetdoProcess(hbDNNTensor *tensors, UnetPostProcessInfo_t *post_info, int layer) {
 
   if (tensors->properties.quantiType == hbDNNQuantiType::SCALE) {
@@ -183,27 +214,117 @@ void UnetdoProcess(hbDNNTensor *tensors, UnetPostProcessInfo_t *post_info, int l
 
 char* UnetPostProcess(UnetPostProcessInfo_t *post_info) {
 
-  int i = 0;
-  char *str_dets;
+  // 算法结果转换成json格式
+  PostProcessArenaVector<uint8_t> &mask = unet_json_mask;
+  mask.resize(Segmentation_dets.seg.size());
+  int num = UnetPostProcessToArray(post_info, mask.data(), mask.size());
+  return SegmentationResultToJson("unet_result", mask.data(), num > 0 ? num : 0);
+}
 
-  std::stringstream out_string;
+int UnetPostProcessToArray(UnetPostProcessInfo_t *post_info,
+                           uint8_t *mask,
+                           int capacity) {
+  int num = Segmentation_dets.seg.size();
+  if (mask == nullptr || capacity < num) {
+    printf("unet post process output array too small, need %d\n", num);
+    Segmentation_dets.seg.clear();
+    return -1;
+  }
 
-  // 算法结果转换成json格式
-  out_string << "\"unet_result\": [";
-  for (i = 0; i < Segmentation_dets.seg.size(); i++) {
-  	auto det_ret = Segmentation_dets.seg[i];
-  	out_string << std::to_string(det_ret);
-  	if (i < Segmentation_dets.seg.size() - 1)
-		out_string << ",";
+  memcpy(mask, Segmentation_dets.seg.data(), num);
+  Segmentation_dets.seg.clear();
+  return num;
+}
+
+int UnetGetMaskShape(int *height, int *width) {
+  if (height == nullptr || width == nullptr) {
+    return -1;
+  }
+  if (Segmentation_dets.seg.empty()) {
+    *height = 0;
+    *width = 0;
+    return -1;
+  }
+  *height = Segmentation_dets.height;
+  *width = Segmentation_dets.width;
+  return 0;
+}
+
+int UnetPostProcessToMask(UnetPostProcessInfo_t *post_info,
+                          uint8_t *mask,
+                          int out_height,
+                          int out_width) {
+  int height = Segmentation_dets.height;
+  int width = Segmentation_dets.width;
+  if (mask == nullptr || out_height <= 0 || out_width <= 0 || Segmentation_dets.seg.empty()) {
+    printf("unet post process invalid mask %dx%d\n", out_width, out_height);
+    Segmentation_dets.seg.clear();
+    return -1;
   }
-  out_string << "]" << std::endl;
 
-  str_dets = (char *)malloc(out_string.str().length() + 1);
-  str_dets[out_string.str().length()] = '\0';
-  snprintf(str_dets, out_string.str().length(), "%s", out_string.str().c_str());
-  /*printf("str_dets: %s\n", str_dets);*/
+  const uint8_t *seg = Segmentation_dets.seg.data();
+  if (out_height == height && out_width == width) {
+    memcpy(mask, seg, height * width);
+  } else {
+    // 最近邻缩放，每列对应的源列只算一次
+    PostProcessArenaVector<int32_t> &src_x = unet_src_x;
+    src_x.resize(out_width);
+    for (int x = 0; x < out_width; x++) {
+      src_x[x] = std::min(static_cast<int>((x + 0.5f) * width / out_width), width - 1);
+    }
+    for (int y = 0; y < out_height; y++) {
+      int sy = std::min(static_cast<int>((y + 0.5f) * height / out_height), height - 1);
+      const uint8_t *src_row = seg + sy * width;
+      uint8_t *dst_row = mask + y * out_width;
+      for (int x = 0; x < out_width; x++) {
+        dst_row[x] = src_row[src_x[x]];
+      }
+    }
+  }
+  Segmentation_dets.seg.clear();
+  return out_height * out_width;
+}
 
+int UnetPostProcessToRle(UnetPostProcessInfo_t *post_info,
+                         uint8_t *values,
+                         int32_t *lengths,
+                         int capacity) {
+  int num = Segmentation_dets.seg.size();
+  if (values == nullptr || lengths == nullptr || capacity <= 0) {
+    printf("unet post process invalid rle array!\n");
+    Segmentation_dets.seg.clear();
+    return -1;
+  }
+
+  const uint8_t *seg = Segmentation_dets.seg.data();
+  int runs = 0;
+  int i = 0;
+  while (i < num) {
+    if (runs >= capacity) {
+      printf("unet post process rle array too small, capacity %d\n", capacity);
+      Segmentation_dets.seg.clear();
+      return -1;
+    }
+    uint8_t value = seg[i];
+    int begin = i;
+    // 先按8字节比较，跳过大片相同类别的区域
+    uint64_t pattern = 0x0101010101010101ULL * value;
+    while (i + 8 <= num) {
+      uint64_t block;
+      memcpy(&block, seg + i, sizeof(block));
+      if (block != pattern) {
+        break;
+      }
+      i += 8;
+    }
+    while (i < num && seg[i] == value) {
+      i++;
+    }
+    values[runs] = value;
+    lengths[runs] = i - begin;
+    runs++;
+  }
   Segmentation_dets.seg.clear();
-  return str_dets;
+  return runs;
 }
 
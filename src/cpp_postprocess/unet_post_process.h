@@ -24,6 +24,7 @@
 #define _POST_PROCESS_UNET_POST_PROCESS_H_
 
 #include "dnn/hb_dnn.h"
+#include "post_process_common.h"
 
 #ifdef __cplusplus
   extern "C"{
@@ -51,6 +52,45 @@ typedef struct {
 
   void UnetdoProcess(hbDNNTensor *tensors, UnetPostProcessInfo_t *post_info, int layer);
 
+  /**
+   * 与 UnetPostProcess 相同，但每个像素的类别编号直接写入 mask，不生成json字符串
+   * @param[out] mask: 调用者分配的 height * width 字节的数组，按行存放
+   * @param[in] capacity: mask 数组的长度，小于 height * width 时返回-1
+   * @return 写入的像素个数
+   */
+  int UnetPostProcessToArray(UnetPostProcessInfo_t *post_info,
+                             uint8_t *mask,
+                             int capacity);
+
+  /**
+   * 获取 UnetdoProcess 得到的mask尺寸，用于调用者分配输出内存
+   * @return 0 成功，还没有结果时返回-1
+   */
+  int UnetGetMaskShape(int *height, int *width);
+
+  /**
+   * 把mask写入调用者分配的 out_height * out_width 字节数组，尺寸不同时做最近邻缩放
+   * python中可以直接传入numpy数组的内存，不需要拷贝和解析：
+   *   mask = np.empty((out_height, out_width), dtype=np.uint8)
+   *   lib.UnetPostProcessToMask(ctypes.byref(info), mask.ctypes.data_as(ctypes.c_void_p),
+   *                             out_height, out_width)
+   * @return 写入的像素个数，参数错误返回-1
+   */
+  int UnetPostProcessToMask(UnetPostProcessInfo_t *post_info,
+                            uint8_t *mask,
+                            int out_height,
+                            int out_width);
+
+  /**
+   * 把mask按行优先顺序做游程编码，第 i 段为 lengths[i] 个连续的类别 values[i]
+   * @param[in] capacity: values/lengths 数组的长度
+   * @return 段数，数组不够长时返回-1
+   */
+  int UnetPostProcessToRle(UnetPostProcessInfo_t *post_info,
+                           uint8_t *values,
+                           int32_t *lengths,
+                           int capacity);
+
 #ifdef __cplusplus
 }
 #endif
@@ -29,7 +29,12 @@
 #include <iostream>
 #include <iomanip>
 #include <algorithm>
+#include <cstring>
 
+#include "post_process_common.h"
+#include "post_process_geometry.h"
+#include "post_process_math.h"
+#include "post_process_nms.h"
 #include "yolov3_post_process.h"
 
 /**
@@ -77,8 +82,6 @@ Yolov3Config default_yolov3_config = {
      "vase",          "scissors",     "teddy bear",
      "hair drier",    "toothbrush"}};
 
-
-
 /**
  * Finds the smallest element in the range [first, last).
  * @tparam[in] ForwardIterator
@@ -159,73 +162,200 @@ typedef struct Detection {
   ~Detection() {}
 } Detection;
 
-std::vector<Detection> yolov3_dets;
+// 候选框、NMS结果等帧间复用的缓存，稳定运行后不再有堆分配
+static PostProcessDetectionArena<Detection> yolov3_arena;
 
 #define NMS_MAX_INPUT (400)
 
-static void yolov3_nms(std::vector<Detection> &input,
-               float iou_threshold,
-               int top_k,
-               std::vector<Detection> &result,
-               bool suppress) {
- // sort order by score desc
-  std::stable_sort(input.begin(), input.end(), std::greater<Detection>());
-  if (input.size() > NMS_MAX_INPUT) {
-    input.resize(NMS_MAX_INPUT);
+float DequantiScale(int32_t data,
+                                                      bool big_endian,
+                                                      float &scale_value) {
+  return static_cast<float>(r_int32(data, big_endian)) * scale_value;
+}
+
+/**
+ * 4个候选框一起解码时用到的参数，每层计算一次
+ */
+struct Yolov3DecodeParam {
+  float stride;
+};
+
+/**
+ * 按行解码时的中间结果，大小为一行的候选框个数
+ */
+struct Yolov3RowBuffer {
+  // 通过objness预过滤的候选框在行内的位置
+  PostProcessArenaVector<int32_t> pos;
+  PostProcessArenaVector<float> obj;
+  PostProcessArenaVector<float> cls;
+  PostProcessArenaVector<float> conf;
+  PostProcessArenaVector<int32_t> id;
+  PostProcessArenaVector<float> box;
+
+  // 一层中通过置信度阈值的候选框，坐标还在模型输入坐标系下，整层解码结束后统一还原到原图
+  PostProcessArenaVector<float> cand_xmin;
+  PostProcessArenaVector<float> cand_ymin;
+  PostProcessArenaVector<float> cand_xmax;
+  PostProcessArenaVector<float> cand_ymax;
+  PostProcessArenaVector<float> cand_score;
+  PostProcessArenaVector<int32_t> cand_id;
+  PostProcessArenaVector<uint8_t> cand_valid;
+
+  // 量化输出每个anchor的objness预过滤阈值
+  PostProcessArenaVector<int32_t> obj_thresh;
+
+  void Reserve(size_t size) {
+    if (obj.size() < size) {
+      pos.resize(size);
+      obj.resize(size);
+      cls.resize(size);
+      conf.resize(size);
+      id.resize(size);
+      box.resize(size * 4);
+    }
   }
+};
 
-  std::vector<bool> skip(input.size(), false);
+static Yolov3RowBuffer yolov3_row_buf;
 
-  // pre-calculate boxes area
-  std::vector<float> areas;
-  areas.reserve(input.size());
-  for (size_t i = 0; i < input.size(); i++) {
-    float width = input[i].bbox.xmax - input[i].bbox.xmin;
-    float height = input[i].bbox.ymax - input[i].bbox.ymin;
-    areas.push_back(width * height);
+/**
+ * 4个候选框一起解码，得到模型输入坐标系下的坐标
+ * @param[in] raw: 网络输出的 x[4], y[4], w[4], h[4]
+ * @param[in] grid: 所在网格 grid_x[4], grid_y[4]
+ * @param[in] anchor: 对应anchor的 anchor_w[4], anchor_h[4]
+ * @param[out] box: xmin[4], ymin[4], xmax[4], ymax[4]
+ */
+static inline void Yolov3DecodeBoxX4(const float *raw,
+                                     const float *grid,
+                                     const float *anchor,
+                                     const Yolov3DecodeParam &param,
+                                     float *box) {
+#if defined(__ARM_NEON)
+  float32x4_t stride = vdupq_n_f32(param.stride);
+  float32x4_t half_stride = vdupq_n_f32(param.stride * 0.5f);
+  float32x4_t center_x = vmulq_f32(
+      vaddq_f32(FastSigmoidX4(vld1q_f32(raw)), vld1q_f32(grid)), stride);
+  float32x4_t center_y = vmulq_f32(
+      vaddq_f32(FastSigmoidX4(vld1q_f32(raw + 4)), vld1q_f32(grid + 4)), stride);
+  // 半宽、半高
+  float32x4_t scale_x = vmulq_f32(
+      vmulq_f32(FastExpX4(vld1q_f32(raw + 8)), vld1q_f32(anchor)), half_stride);
+  float32x4_t scale_y = vmulq_f32(
+      vmulq_f32(FastExpX4(vld1q_f32(raw + 12)), vld1q_f32(anchor + 4)), half_stride);
+  vst1q_f32(box, vsubq_f32(center_x, scale_x));
+  vst1q_f32(box + 4, vsubq_f32(center_y, scale_y));
+  vst1q_f32(box + 8, vaddq_f32(center_x, scale_x));
+  vst1q_f32(box + 12, vaddq_f32(center_y, scale_y));
+#else
+  for (int j = 0; j < 4; j++) {
+    float center_x = (FastSigmoid(raw[j]) + grid[j]) * param.stride;
+    float center_y = (FastSigmoid(raw[4 + j]) + grid[4 + j]) * param.stride;
+    float scale_x = FastExp(raw[8 + j]) * anchor[j] * param.stride * 0.5f;
+    float scale_y = FastExp(raw[12 + j]) * anchor[4 + j] * param.stride * 0.5f;
+    box[j] = center_x - scale_x;
+    box[4 + j] = center_y - scale_y;
+    box[8 + j] = center_x + scale_x;
+    box[12 + j] = center_y + scale_y;
   }
+#endif
+}
 
-  int count = 0;
-  for (size_t i = 0; count < top_k && i < skip.size(); i++) {
-    if (skip[i]) {
+static void GetDecodeParam(Yolov3PostProcessInfo_t *post_info,
+                           int layer,
+                           Yolov3DecodeParam &param) {
+  param.stride = default_yolov3_config.strides[layer];
+}
+
+/**
+ * 解码一行的候选框，yolov3_row_buf 已经由调用者填好，通过阈值的追加到 cand_xxx 中
+ * 第 i 个候选框对应网格 w = pos / anchor_per_cell，anchor k = anchor_base + pos % anchor_per_cell
+ * NHWC 一行包含 width * anchor_num 个候选框，NCHW 一行只包含同一个anchor的 width 个候选框
+ */
+static void Yolov3DecodeRow(int num,
+                            int h,
+                            int anchor_per_cell,
+                            int anchor_base,
+                            const std::vector<std::pair<double, double>> &anchors,
+                            const Yolov3DecodeParam &param,
+                            Yolov3PostProcessInfo_t *post_info) {
+  float score_threshold = post_info->score_threshold;
+  float *conf = yolov3_row_buf.conf.data();
+  const float *box_raw = yolov3_row_buf.box.data();
+  const int32_t *ids = yolov3_row_buf.id.data();
+  const int32_t *pos = yolov3_row_buf.pos.data();
+
+  SigmoidProduct(yolov3_row_buf.obj.data(), yolov3_row_buf.cls.data(), conf, num);
+
+  for (int i = 0; i < num; i += 4) {
+    int lanes = std::min(4, num - i);
+    bool hit = false;
+    for (int j = 0; j < lanes; j++) {
+      hit |= (conf[i + j] >= score_threshold);
+    }
+    if (!hit) {
       continue;
     }
-    skip[i] = true;
-    ++count;
 
-    for (size_t j = i + 1; j < skip.size(); ++j) {
-      if (skip[j]) {
-        continue;
-      }
-      if (suppress == false) {
-        if (input[i].id != input[j].id) {
-          continue;
-        }
-      }
+    float raw[16];
+    float grid[8];
+    float anchor[8];
+    float box[16];
+    for (int j = 0; j < 4; j++) {
+      // 行尾不足4个时重复最后一个，只是为了凑满4路，结果不使用
+      int index = i + std::min(j, lanes - 1);
+      int k = anchor_base + pos[index] % anchor_per_cell;
+      raw[j] = box_raw[index * 4];
+      raw[4 + j] = box_raw[index * 4 + 1];
+      raw[8 + j] = box_raw[index * 4 + 2];
+      raw[12 + j] = box_raw[index * 4 + 3];
+      grid[j] = pos[index] / anchor_per_cell;
+      grid[4 + j] = h;
+      anchor[j] = anchors[k].first;
+      anchor[4 + j] = anchors[k].second;
+    }
+    Yolov3DecodeBoxX4(raw, grid, anchor, param, box);
 
-      // intersection area
-      float xx1 = std::max(input[i].bbox.xmin, input[j].bbox.xmin);
-      float yy1 = std::max(input[i].bbox.ymin, input[j].bbox.ymin);
-      float xx2 = std::min(input[i].bbox.xmax, input[j].bbox.xmax);
-      float yy2 = std::min(input[i].bbox.ymax, input[j].bbox.ymax);
-
-      if (xx2 > xx1 && yy2 > yy1) {
-        float area_intersection = (xx2 - xx1) * (yy2 - yy1);
-        float iou_ratio =
-            area_intersection / (areas[j] + areas[i] - area_intersection);
-        if (iou_ratio > iou_threshold) {
-          skip[j] = true;
-        }
+    for (int j = 0; j < lanes; j++) {
+      if (conf[i + j] < score_threshold) {
+        continue;
       }
+      yolov3_row_buf.cand_xmin.push_back(box[j]);
+      yolov3_row_buf.cand_ymin.push_back(box[4 + j]);
+      yolov3_row_buf.cand_xmax.push_back(box[8 + j]);
+      yolov3_row_buf.cand_ymax.push_back(box[12 + j]);
+      yolov3_row_buf.cand_score.push_back(conf[i + j]);
+      yolov3_row_buf.cand_id.push_back(ids[i + j]);
     }
-    result.push_back(input[i]);
   }
 }
 
-float DequantiScale(int32_t data,
-                                                      bool big_endian,
-                                                      float &scale_value) {
-  return static_cast<float>(r_int32(data, big_endian)) * scale_value;
+/**
+ * 把一层的候选框一次性还原到原图坐标、裁剪到图像范围内，有效的追加到 yolov3_arena.dets
+ */
+static void Yolov3EmitDetections(Yolov3PostProcessInfo_t *post_info) {
+  Yolov3RowBuffer &buf = yolov3_row_buf;
+  int num = buf.cand_score.size();
+  buf.cand_valid.resize(num);
+  PostProcessProjectBoxes(GetGeometry(post_info), buf.cand_xmin.data(), buf.cand_ymin.data(),
+                          buf.cand_xmax.data(), buf.cand_ymax.data(), num,
+                          buf.cand_valid.data());
+  for (int i = 0; i < num; i++) {
+    if (!buf.cand_valid[i]) {
+      continue;
+    }
+    int id = buf.cand_id[i];
+    Bbox bbox(buf.cand_xmin[i], buf.cand_ymin[i], buf.cand_xmax[i], buf.cand_ymax[i]);
+    yolov3_arena.dets.push_back(Detection(id,
+                             buf.cand_score[i],
+                             bbox,
+                             default_yolov3_config.class_names[id].c_str()));
+  }
+  buf.cand_xmin.clear();
+  buf.cand_ymin.clear();
+  buf.cand_xmax.clear();
+  buf.cand_ymax.clear();
+  buf.cand_score.clear();
+  buf.cand_id.clear();
 }
 
 void PostProcessQuantiScaleNHWC(
@@ -235,20 +365,13 @@ void PostProcessQuantiScaleNHWC(
   auto *data = reinterpret_cast<int32_t *>(tensor->sysMem[0].virAddr);
   float *scale = tensor->properties.scale.scaleData;
   int num_classes = default_yolov3_config.class_num;
-  int stride = default_yolov3_config.strides[layer];
   int num_pred = default_yolov3_config.class_num + 4 + 1;
 
-  std::vector<float> class_pred(default_yolov3_config.class_num, 0.0);
   std::vector<std::pair<double, double>> &anchors =
       default_yolov3_config.anchors_table[layer];
 
-  double h_ratio = post_info->height * 1.0 / post_info->ori_height;
-  double w_ratio = post_info->width * 1.0 / post_info->ori_width;
-  double resize_ratio = std::min(w_ratio, h_ratio);
-  if (post_info->is_pad_resize) {
-    w_ratio = resize_ratio;
-    h_ratio = resize_ratio;
-  }
+  Yolov3DecodeParam param;
+  GetDecodeParam(post_info, layer, param);
 
   int height = tensor->properties.validShape.dimensionSize[1];
   int width = tensor->properties.validShape.dimensionSize[2];
@@ -259,76 +382,44 @@ void PostProcessQuantiScaleNHWC(
   printf("channel_aligned: %d\n", channel_aligned);
 
   int anchors_size = anchors.size();
+  yolov3_row_buf.Reserve(width * anchors_size);
+  int32_t *pos = yolov3_row_buf.pos.data();
+  float *obj = yolov3_row_buf.obj.data();
+  float *cls = yolov3_row_buf.cls.data();
+  int32_t *ids = yolov3_row_buf.id.data();
+  float *box_raw = yolov3_row_buf.box.data();
+
+  // confidence <= sigmoid(objness)，objness 换算到量化域后直接用int32比较做预过滤
+  PostProcessArenaVector<int32_t> &obj_thresh = yolov3_row_buf.obj_thresh;
+  obj_thresh.resize(anchors_size);
+  for (int k = 0; k < anchors_size; k++) {
+    obj_thresh[k] =
+        QuantiLogitThreshold(post_info->score_threshold, scale[k * num_pred + 4]);
+  }
+
   for (int32_t h = 0; h < height; h++) {
+    int index = 0;
     for (int32_t w = 0; w < width; w++) {
       for (int k = 0; k < anchors_size; k++) {
-        double anchor_x = anchors[k].first;
-        double anchor_y = anchors[k].second;
-
         int32_t *cur_data = data + k * num_pred;
-        float *cur_scale = scale + k * num_pred;
-        float objness = DequantiScale(cur_data[4], false, cur_scale[4]);
-
-        for (int index = 0; index < num_classes; ++index) {
-          class_pred[index] =
-              DequantiScale(cur_data[5 + index], false, cur_scale[5 + index]);
-        }
-
-        float id = argmax(class_pred.begin(), class_pred.end());
-        double x1 = 1 / (1 + std::exp(-objness)) * 1;
-        double x2 = 1 / (1 + std::exp(-class_pred[id]));
-        double confidence = x1 * x2;
-
-        if (confidence < post_info->score_threshold) {
+        if (cur_data[4] < obj_thresh[k]) {
           continue;
         }
+        float *cur_scale = scale + k * num_pred;
 
-        float center_x = DequantiScale(cur_data[0], false, cur_scale[0]);
-        float center_y = DequantiScale(cur_data[1], false, cur_scale[1]);
-        float scale_x = DequantiScale(cur_data[2], false, cur_scale[2]);
-        float scale_y = DequantiScale(cur_data[3], false, cur_scale[3]);
-
-        double box_center_x =
-            ((1.0 / (1.0 + std::exp(-center_x))) + w) * stride;
-        double box_center_y =
-            ((1.0 / (1.0 + std::exp(-center_y))) + h) * stride;
-
-        double box_scale_x = std::exp(scale_x) * anchor_x * stride;
-        double box_scale_y = std::exp(scale_y) * anchor_y * stride;
-
-        double xmin = (box_center_x - box_scale_x / 2.0);
-        double ymin = (box_center_y - box_scale_y / 2.0);
-        double xmax = (box_center_x + box_scale_x / 2.0);
-        double ymax = (box_center_y + box_scale_y / 2.0);
-
-        double w_padding =
-            (post_info->width - w_ratio * post_info->ori_width) / 2.0;
-        double h_padding =
-            (post_info->height - h_ratio * post_info->ori_height) / 2.0;
-
-        double xmin_org = (xmin - w_padding) / w_ratio;
-        double xmax_org = (xmax - w_padding) / w_ratio;
-        double ymin_org = (ymin - h_padding) / h_ratio;
-        double ymax_org = (ymax - h_padding) / h_ratio;
-
-        if (xmin_org > xmax_org || ymin_org > ymax_org) {
-          continue;
+        pos[index] = w * anchors_size + k;
+        obj[index] = DequantiScale(cur_data[4], false, cur_scale[4]);
+        ids[index] = ArgMaxDequanti(cur_data + 5, cur_scale + 5, num_classes, &cls[index]);
+        for (int j = 0; j < 4; j++) {
+          box_raw[index * 4 + j] = DequantiScale(cur_data[j], false, cur_scale[j]);
         }
-
-        xmin_org = std::max(xmin_org, 0.0);
-        xmax_org = std::min(xmax_org, post_info->ori_width - 1.0);
-        ymin_org = std::max(ymin_org, 0.0);
-        ymax_org = std::min(ymax_org, post_info->ori_height - 1.0);
-
-        Bbox bbox(xmin_org, ymin_org, xmax_org, ymax_org);
-        yolov3_dets.push_back(Detection((int)id,
-                                 confidence,
-                                 bbox,
-                                 default_yolov3_config.class_names[(int)id].c_str()));
+        index++;
       }
       data = data + channel_aligned;
     }
+    Yolov3DecodeRow(index, h, anchors_size, 0, anchors, param, post_info);
   }
+  Yolov3EmitDetections(post_info);
 }
 
 void PostProcessQuantiNoneNHWC(
@@ -337,91 +428,47 @@ void PostProcessQuantiNoneNHWC(
     int layer) {
   auto *data = reinterpret_cast<float *>(tensor->sysMem[0].virAddr);
   int num_classes = default_yolov3_config.class_num;
-  int stride = default_yolov3_config.strides[layer];
   int num_pred = default_yolov3_config.class_num + 4 + 1;
 
-  std::vector<float> class_pred(default_yolov3_config.class_num, 0.0);
   std::vector<std::pair<double, double>> &anchors =
       default_yolov3_config.anchors_table[layer];
 
-  double h_ratio = post_info->height * 1.0 / post_info->ori_height;
-  double w_ratio = post_info->width * 1.0 / post_info->ori_width;
-  double resize_ratio = std::min(w_ratio, h_ratio);
-  if (post_info->is_pad_resize) {
-    w_ratio = resize_ratio;
-    h_ratio = resize_ratio;
-  }
+  Yolov3DecodeParam param;
+  GetDecodeParam(post_info, layer, param);
 
   int height = tensor->properties.validShape.dimensionSize[1];
   int width = tensor->properties.validShape.dimensionSize[2];
 
   int anchors_size = anchors.size();
+  yolov3_row_buf.Reserve(width * anchors_size);
+  int32_t *pos = yolov3_row_buf.pos.data();
+  float *obj = yolov3_row_buf.obj.data();
+  float *cls = yolov3_row_buf.cls.data();
+  int32_t *ids = yolov3_row_buf.id.data();
+  float *box_raw = yolov3_row_buf.box.data();
+
+  // confidence <= sigmoid(objness)，objness 小于 logit(score_threshold) 的直接跳过
+  float obj_thresh = LogitThreshold(post_info->score_threshold);
+
   for (int32_t h = 0; h < height; h++) {
+    int index = 0;
     for (int32_t w = 0; w < width; w++) {
       for (int k = 0; k < anchors_size; k++) {
-        double anchor_x = anchors[k].first;
-        double anchor_y = anchors[k].second;
         float *cur_data = data + k * num_pred;
-        float objness = cur_data[4];
-        for (int index = 0; index < num_classes; ++index) {
-          class_pred[index] = cur_data[5 + index];
-        }
-
-        float id = argmax(class_pred.begin(), class_pred.end());
-        double x1 = 1 / (1 + std::exp(-objness)) * 1;
-        double x2 = 1 / (1 + std::exp(-class_pred[id]));
-        double confidence = x1 * x2;
-
-        if (confidence < post_info->score_threshold) {
+        if (cur_data[4] < obj_thresh) {
           continue;
         }
-
-        float center_x = cur_data[0];
-        float center_y = cur_data[1];
-        float scale_x = cur_data[2];
-        float scale_y = cur_data[3];
-
-        double box_center_x =
-            ((1.0 / (1.0 + std::exp(-center_x))) + w) * stride;
-        double box_center_y =
-            ((1.0 / (1.0 + std::exp(-center_y))) + h) * stride;
-
-        double box_scale_x = std::exp(scale_x) * anchor_x * stride;
-        double box_scale_y = std::exp(scale_y) * anchor_y * stride;
-
-        double xmin = (box_center_x - box_scale_x / 2.0);
-        double ymin = (box_center_y - box_scale_y / 2.0);
-        double xmax = (box_center_x + box_scale_x / 2.0);
-        double ymax = (box_center_y + box_scale_y / 2.0);
-
-        double w_padding =
-            (post_info->width - w_ratio * post_info->ori_width) / 2.0;
-        double h_padding =
-            (post_info->height - h_ratio * post_info->ori_height) / 2.0;
-
-        double xmin_org = (xmin - w_padding) / w_ratio;
-        double xmax_org = (xmax - w_padding) / w_ratio;
-        double ymin_org = (ymin - h_padding) / h_ratio;
-        double ymax_org = (ymax - h_padding) / h_ratio;
-
-        if (xmin_org > xmax_org || ymin_org > ymax_org) {
-          continue;
-        }
-
-        xmin_org = std::max(xmin_org, 0.0);
-        xmax_org = std::min(xmax_org, post_info->ori_width - 1.0);
-        ymin_org = std::max(ymin_org, 0.0);
-        ymax_org = std::min(ymax_org, post_info->ori_height - 1.0);
-
-        Bbox bbox(xmin_org, ymin_org, xmax_org, ymax_org);
-        yolov3_dets.push_back(Detection((int)id,
-                                 confidence,
-                                 bbox,
-                                 default_yolov3_config.class_names[(int)id].c_str()));
+        pos[index] = w * anchors_size + k;
+        obj[index] = cur_data[4];
+        ids[index] = ArgMaxFloat(cur_data + 5, num_classes, &cls[index]);
+        memcpy(box_raw + index * 4, cur_data, 4 * sizeof(float));
+        index++;
       }
       data = data + num_pred * anchors.size();
     }
+    Yolov3DecodeRow(index, h, anchors_size, 0, anchors, param, post_info);
   }
+  Yolov3EmitDetections(post_info);
 }
 
 void PostProcessNCHW(
@@ -430,20 +477,13 @@ void PostProcessNCHW(
     int layer) {
   auto *data = reinterpret_cast<float *>(tensor->sysMem[0].virAddr);
   int num_classes = default_yolov3_config.class_num;
-  int stride = default_yolov3_config.strides[layer];
   int num_pred = default_yolov3_config.class_num + 4 + 1;
 
-  std::vector<float> class_pred(default_yolov3_config.class_num, 0.0);
   std::vector<std::pair<double, double>> &anchors =
       default_yolov3_config.anchors_table[layer];
 
-  double h_ratio = post_info->height * 1.0 / post_info->ori_height;
-  double w_ratio = post_info->width * 1.0 / post_info->ori_width;
-  double resize_ratio = std::min(w_ratio, h_ratio);
-  if (post_info->is_pad_resize) {
-    w_ratio = resize_ratio;
-    h_ratio = resize_ratio;
-  }
+  Yolov3DecodeParam param;
+  GetDecodeParam(post_info, layer, param);
 
   int height = tensor->properties.validShape.dimensionSize[2];
   int width = tensor->properties.validShape.dimensionSize[3];
@@ -452,74 +492,71 @@ void PostProcessNCHW(
   int aligned_w = tensor->properties.validShape.dimensionSize[3];
   int aligned_hw = aligned_h * aligned_w;
 
+  yolov3_row_buf.Reserve(width);
+  int32_t *pos = yolov3_row_buf.pos.data();
+  float *obj = yolov3_row_buf.obj.data();
+  float *cls = yolov3_row_buf.cls.data();
+  int32_t *ids = yolov3_row_buf.id.data();
+  float *box_raw = yolov3_row_buf.box.data();
+
+  // confidence <= sigmoid(objness)，objness 小于 logit(score_threshold) 的直接跳过
+  float obj_thresh = LogitThreshold(post_info->score_threshold);
+
   int anchors_size = anchors.size();
   for (int k = 0; k < anchors_size; k++) {
+    float *anchor_data = data + k * num_pred * aligned_hw;
     for (int32_t h = 0; h < height; h++) {
-      for (int32_t w = 0; w < width; w++) {
-        double anchor_x = anchors[k].first;
-        double anchor_y = anchors[k].second;
-        int stride_hw = h * aligned_w + w;
-
-        float objness = data[(k * num_pred + 4) * aligned_hw + stride_hw];
-        for (int index = 0; index < num_classes; ++index) {
-          class_pred[index] =
-              data[(k * num_pred + index + 5) * aligned_hw + stride_hw];
-        }
-
-        float id = argmax(class_pred.begin(), class_pred.end());
-        double x1 = 1 / (1 + std::exp(-objness)) * 1;
-        double x2 = 1 / (1 + std::exp(-class_pred[id]));
-        double confidence = x1 * x2;
-
-        if (confidence < post_info->score_threshold) {
+      int stride_h = h * aligned_w;
+      float *obj_data = anchor_data + 4 * aligned_hw + stride_h;
+      int index = 0;
+      int32_t w = 0;
+      // 同一行相邻4个位置在各个类别通道上一起求最大值
+      for (; w + 4 <= width; w += 4) {
+        if (obj_data[w] < obj_thresh && obj_data[w + 1] < obj_thresh &&
+            obj_data[w + 2] < obj_thresh && obj_data[w + 3] < obj_thresh) {
           continue;
         }
-
-        float center_x = data[(k * num_pred) * aligned_hw + stride_hw];
-        float center_y = data[(k * num_pred + 1) * aligned_hw + stride_hw];
-        float scale_x = data[(k * num_pred + 2) * aligned_hw + stride_hw];
-        float scale_y = data[(k * num_pred + 3) * aligned_hw + stride_hw];
-
-        double box_center_x =
-            ((1.0 / (1.0 + std::exp(-center_x))) + w) * stride;
-        double box_center_y =
-            ((1.0 / (1.0 + std::exp(-center_y))) + h) * stride;
-
-	double box_scale_x = std::exp(scale_x) * anchor_x * stride;
-        double box_scale_y = std::exp(scale_y) * anchor_y * stride;
-
-        double xmin = (box_center_x - box_scale_x / 2.0);
-        double ymin = (box_center_y - box_scale_y / 2.0);
-        double xmax = (box_center_x + box_scale_x / 2.0);
-        double ymax = (box_center_y + box_scale_y / 2.0);
-
-        double w_padding =
-            (post_info->width - w_ratio * post_info->ori_width) / 2.0;
-        double h_padding =
-            (post_info->height - h_ratio * post_info->ori_height) / 2.0;
-
-        double xmin_org = (xmin - w_padding) / w_ratio;
-        double xmax_org = (xmax - w_padding) / w_ratio;
-        double ymin_org = (ymin - h_padding) / h_ratio;
-        double ymax_org = (ymax - h_padding) / h_ratio;
-
-        if (xmin_org > xmax_org || ymin_org > ymax_org) {
+        float max_value[4];
+        int32_t max_idx[4];
+        ArgMaxChannelX4(anchor_data + 5 * aligned_hw + stride_h + w,
+                        num_classes, aligned_hw, max_value, max_idx);
+        for (int j = 0; j < 4; j++) {
+          if (obj_data[w + j] < obj_thresh) {
+            continue;
+          }
+          pos[index] = w + j;
+          cls[index] = max_value[j];
+          ids[index] = max_idx[j];
+          index++;
+        }
+      }
+      for (; w < width; w++) {
+        if (obj_data[w] < obj_thresh) {
           continue;
         }
-
-        xmin_org = std::max(xmin_org, 0.0);
-        xmax_org = std::min(xmax_org, post_info->ori_width - 1.0);
-        ymin_org = std::max(ymin_org, 0.0);
-        ymax_org = std::min(ymax_org, post_info->ori_height - 1.0);
-
-        Bbox bbox(xmin_org, ymin_org, xmax_org, ymax_org);
-        yolov3_dets.push_back(Detection((int)id,
-                                 confidence,
-                                 bbox,
-                                 default_yolov3_config.class_names[(int)id].c_str()));
+        float *cur_cls = anchor_data + 5 * aligned_hw + stride_h + w;
+        pos[index] = w;
+        cls[index] = cur_cls[0];
+        ids[index] = 0;
+        for (int c = 1; c < num_classes; ++c) {
+          if (cur_cls[c * aligned_hw] > cls[index]) {
+            cls[index] = cur_cls[c * aligned_hw];
+            ids[index] = c;
+          }
+        }
+        index++;
+      }
+      for (int i = 0; i < index; i++) {
+        int stride_hw = stride_h + pos[i];
+        obj[i] = obj_data[pos[i]];
+        for (int j = 0; j < 4; j++) {
+          box_raw[i * 4 + j] = anchor_data[j * aligned_hw + stride_hw];
+        }
       }
+      Yolov3DecodeRow(index, h, 1, k, anchors, param, post_info);
     }
   }
+  Yolov3EmitDetections(post_info);
 }
 
 
@@ -554,31 +591,38 @@ void Yolov3doProcess(hbDNNTensor *tensor, Yolov3PostProcessInfo_t *post_info, in
 // 3次下采样得到三组缩小后的gred，然后对每个gred进行三次预测，最后输出结果
 char* Yolov3PostProcess(Yolov3PostProcessInfo_t *post_info) {
 
-  int i = 0;
-  char *str_yolov3_dets;
-  std::vector<Detection> det_restuls;
+  PostProcessDetectionArena<Detection> &arena = yolov3_arena;
 
   // 计算交并比来合并检测框，传入交并比阈值(0.65)和返回box数量(5000)
-  yolov3_nms(yolov3_dets, post_info->nms_threshold, post_info->nms_top_k, det_restuls, false);
-  std::stringstream out_string;
+  PostProcessNms(arena.dets, GetNmsParam(post_info, PostProcessGetNmsMode(), NMS_MAX_INPUT), arena.results, &arena.nms_ws);
 
   // 算法结果转换成json格式
-  int det_restuls_size = det_restuls.size();
-  out_string << "\"yolov3_result\": [";
-  for (i = 0; i < det_restuls_size; i++) {
-  	auto det_ret = det_restuls[i];
-  	out_string << det_ret;
-  	if (i < det_restuls_size - 1)
-		out_string << ",";
+  PostProcessArenaVector<PostProcessDetection_t> &dets = arena.out;
+  dets.resize(arena.results.size());
+  int num = CopyDetectionResult(arena.results, dets.data(), dets.size());
+  arena.Clear();
+  return DetectionResultToJson("yolov3_result", dets.data(), num, Yolov3GetClassName);
+}
+
+int Yolov3PostProcessToArray(Yolov3PostProcessInfo_t *post_info,
+                             PostProcessDetection_t *dets,
+                             int capacity) {
+  if (dets == nullptr || capacity < 0) {
+    printf("yolov3 post process invalid output array!\n");
+    yolov3_arena.Clear();
+    return -1;
   }
-  out_string << "]" << std::endl;
-
-  str_yolov3_dets = (char *)malloc(out_string.str().length() + 1);
-  str_yolov3_dets[out_string.str().length()] = '\0';
-  snprintf(str_yolov3_dets, out_string.str().length(), "%s", out_string.str().c_str());
-  // printf("str_yolov3_dets: %s\n", str_yolov3_dets);
-  yolov3_dets.clear();
-  det_restuls.clear();
-  return str_yolov3_dets;
+
+  PostProcessDetectionArena<Detection> &arena = yolov3_arena;
+  PostProcessNms(arena.dets, GetNmsParam(post_info, PostProcessGetNmsMode(), NMS_MAX_INPUT), arena.results, &arena.nms_ws);
+  int num = CopyDetectionResult(arena.results, dets, capacity);
+  arena.Clear();
+  return num;
 }
 
+const char *Yolov3GetClassName(int id) {
+  if (id < 0 || id >= static_cast<int>(default_yolov3_config.class_names.size())) {
+    return nullptr;
+  }
+  return default_yolov3_config.class_names[id].c_str();
+}
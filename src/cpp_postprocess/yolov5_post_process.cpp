@@ -30,11 +30,19 @@
 #include <iomanip>
 #include <algorithm>
 #include <queue>
-#include <arm_neon.h>
 #include <limits>
+#include <memory>
+#include <new>
+#include <type_traits>
 
 // #include "utils/utils_log.h"
 
+#include "post_process_batch.h"
+#include "post_process_common.h"
+#include "post_process_geometry.h"
+#include "post_process_math.h"
+#include "post_process_nms.h"
+#include "post_process_thread_pool.h"
 #include "yolov5_post_process.h"
 
 #define BSWAP_32(x) static_cast<int32_t>(__builtin_bswap32(x))
@@ -123,8 +131,6 @@ Yolov5Config default_yolov5_config = {
      "vase",          "scissors",     "teddy bear",
      "hair drier",    "toothbrush"}};
 
-
-
 /**
  * Finds the smallest element in the range [first, last).
  * @tparam[in] ForwardIterator
@@ -205,14 +211,50 @@ typedef struct Detection {
   ~Detection() {}
 } Detection;
 
-std::vector<Detection> dets;
-std::vector<Detection> det_restuls;
-
+/**
+ * 按行解码时的中间结果，大小为 width * anchor_num
+ * 只保存通过objness预过滤的候选框，pos_buf 为其在行内的位置 w * anchor_num + k
+ */
+struct Yolov5DecodeBuffer {
+  PostProcessArenaVector<int32_t> pos_buf;
+  PostProcessArenaVector<float> obj_buf;
+  PostProcessArenaVector<float> cls_buf;
+  PostProcessArenaVector<float> conf_buf;
+  PostProcessArenaVector<int32_t> id_buf;
+  PostProcessArenaVector<float> box_buf;
+
+  // 通过置信度阈值的候选框，坐标还在模型输入坐标系下，解码结束后统一还原到原图
+  PostProcessArenaVector<float> cand_xmin;
+  PostProcessArenaVector<float> cand_ymin;
+  PostProcessArenaVector<float> cand_xmax;
+  PostProcessArenaVector<float> cand_ymax;
+  PostProcessArenaVector<float> cand_score;
+  PostProcessArenaVector<int32_t> cand_id;
+  PostProcessArenaVector<uint8_t> cand_valid;
+
+  // 并行解码时每个任务自己的候选框，合并后清空
+  PostProcessArenaVector<Detection> dets;
+
+  void Reserve(size_t row_size) {
+    if (obj_buf.size() < row_size) {
+      pos_buf.resize(row_size);
+      obj_buf.resize(row_size);
+      cls_buf.resize(row_size);
+      conf_buf.resize(row_size);
+      id_buf.resize(row_size);
+      box_buf.resize(row_size * 4);
+    }
+  }
+};
 
-static float DequantiScale(int32_t data, bool big_endian, float &scale_value) {
-  return static_cast<float>(r_int32(data, big_endian)) * scale_value;
+const char *Yolov5GetClassName(int id) {
+  if (id < 0 || id >= static_cast<int>(default_yolov5_config.class_names.size())) {
+    return nullptr;
+  }
+  return default_yolov5_config.class_names[id].c_str();
 }
 
+
 static int get_tensor_hw(hbDNNTensor &tensor, int *height, int *width) {
   int h_index = 0;
   int w_index = 0;
@@ -231,68 +273,164 @@ static int get_tensor_hw(hbDNNTensor &tensor, int *height, int *width) {
   return 0;
 }
 
-static void yolov5_nms(std::vector<Detection> &input,
-               float iou_threshold,
-               int top_k,
-               std::vector<Detection> &result,
-               bool suppress) {
-  // sort order by score desc
-  std::stable_sort(input.begin(), input.end(), std::greater<Detection>());
 
-  std::vector<bool> skip(input.size(), false);
+/**
+ * 4个候选框一起解码时用到的参数，每层计算一次
+ */
+struct Yolov5DecodeParam {
+  float stride;
+};
 
-  // pre-calculate boxes area
-  std::vector<float> areas;
-  areas.reserve(input.size());
-  for (size_t i = 0; i < input.size(); i++) {
-    float width = input[i].bbox.xmax - input[i].bbox.xmin;
-    float height = input[i].bbox.ymax - input[i].bbox.ymin;
-    areas.push_back(width * height);
+/**
+ * 4个候选框一起解码，得到模型输入坐标系下的坐标
+ * @param[in] raw: 网络输出的 x[4], y[4], w[4], h[4]
+ * @param[in] grid: 所在网格 grid_x[4], grid_y[4]
+ * @param[in] anchor: 对应anchor的 anchor_w[4], anchor_h[4]
+ * @param[out] box: xmin[4], ymin[4], xmax[4], ymax[4]
+ */
+static inline void Yolov5DecodeBoxX4(const float *raw,
+                                     const float *grid,
+                                     const float *anchor,
+                                     const Yolov5DecodeParam &param,
+                                     float *box) {
+#if defined(__ARM_NEON)
+  float32x4_t two = vdupq_n_f32(2.0f);
+  float32x4_t half = vdupq_n_f32(0.5f);
+  float32x4_t stride = vdupq_n_f32(param.stride);
+  float32x4_t center_x = vmulq_f32(
+      vaddq_f32(vmlaq_f32(vnegq_f32(half), FastSigmoidX4(vld1q_f32(raw)), two),
+                vld1q_f32(grid)),
+      stride);
+  float32x4_t center_y = vmulq_f32(
+      vaddq_f32(vmlaq_f32(vnegq_f32(half), FastSigmoidX4(vld1q_f32(raw + 4)), two),
+                vld1q_f32(grid + 4)),
+      stride);
+  float32x4_t scale_x = vmulq_f32(FastSigmoidX4(vld1q_f32(raw + 8)), two);
+  float32x4_t scale_y = vmulq_f32(FastSigmoidX4(vld1q_f32(raw + 12)), two);
+  // 半宽、半高
+  scale_x = vmulq_f32(vmulq_f32(vmulq_f32(scale_x, scale_x), vld1q_f32(anchor)), half);
+  scale_y = vmulq_f32(vmulq_f32(vmulq_f32(scale_y, scale_y), vld1q_f32(anchor + 4)), half);
+  vst1q_f32(box, vsubq_f32(center_x, scale_x));
+  vst1q_f32(box + 4, vsubq_f32(center_y, scale_y));
+  vst1q_f32(box + 8, vaddq_f32(center_x, scale_x));
+  vst1q_f32(box + 12, vaddq_f32(center_y, scale_y));
+#else
+  for (int j = 0; j < 4; j++) {
+    float center_x = (FastSigmoid(raw[j]) * 2 - 0.5f + grid[j]) * param.stride;
+    float center_y = (FastSigmoid(raw[4 + j]) * 2 - 0.5f + grid[4 + j]) * param.stride;
+    float scale_x = FastSigmoid(raw[8 + j]) * 2;
+    float scale_y = FastSigmoid(raw[12 + j]) * 2;
+    scale_x = scale_x * scale_x * anchor[j] * 0.5f;
+    scale_y = scale_y * scale_y * anchor[4 + j] * 0.5f;
+    box[j] = center_x - scale_x;
+    box[4 + j] = center_y - scale_y;
+    box[8 + j] = center_x + scale_x;
+    box[12 + j] = center_y + scale_y;
   }
+#endif
+}
 
-  int count = 0;
-  for (size_t i = 0; count < top_k && i < skip.size(); i++) {
-    if (skip[i]) {
-      continue;
-    }
-    skip[i] = true;
-    ++count;
+struct Yolov5LayerInfo;
 
-    for (size_t j = i + 1; j < skip.size(); ++j) {
-      if (skip[j]) {
-        continue;
-      }
-      if (suppress == false) {
-        if (input[i].id != input[j].id) {
-          continue;
-        }
-      }
+typedef void (*Yolov5DecodeFunc)(const Yolov5LayerInfo &layer,
+                                 int h_begin,
+                                 int h_end,
+                                 Yolov5PostProcessInfo_t *post_info,
+                                 Yolov5DecodeBuffer *buf,
+                                 PostProcessArenaVector<Detection> *dets);
 
-      // intersection area
-      float xx1 = std::max(input[i].bbox.xmin, input[j].bbox.xmin);
-      float yy1 = std::max(input[i].bbox.ymin, input[j].bbox.ymin);
-      float xx2 = std::min(input[i].bbox.xmax, input[j].bbox.xmax);
-      float yy2 = std::min(input[i].bbox.ymax, input[j].bbox.ymax);
-
-      if (xx2 > xx1 && yy2 > yy1) {
-        float area_intersection = (xx2 - xx1) * (yy2 - yy1);
-        float iou_ratio =
-            area_intersection / (areas[j] + areas[i] - area_intersection);
-        if (iou_ratio > iou_threshold) {
-          skip[j] = true;
-        }
-      }
-    }
-    result.push_back(input[i]);
+static Yolov5DecodeFunc Yolov5SelectDecoder(bool quanti, bool nchw, int num_classes, int anchor_num);
+
+/**
+ * 一层输出解码时用到的参数，每帧每层计算一次
+ */
+struct Yolov5LayerInfo {
+  hbDNNTensor *tensor;
+  const std::vector<std::pair<double, double>> *anchors;
+  Yolov5DecodeParam param;
+  // 模型输入坐标到原图坐标的变换
+  PostProcessGeometry geometry;
+  int height;
+  int width;
+  // 相邻两行、相邻两个通道之间的元素个数
+  int row_stride;
+  int c_stride;
+  int num_classes;
+  int num_pred;
+  // 按布局、量化方式选好的解码函数
+  Yolov5DecodeFunc decode;
+  // objness预过滤阈值，NONE 为logit，SCALE 为每个anchor换算到量化域的值
+  float obj_thresh;
+  PostProcessArenaVector<int32_t> quanti_obj_thresh;
+};
+
+// Yolov5doProcessAll 中的一个并行任务，解码一层输出的 [h_begin, h_end) 行
+struct Yolov5DecodeTask {
+  int layer;
+  int h_begin;
+  int h_end;
+};
+
+/**
+ * 每路视频流独立的后处理上下文，保存该路的候选框和NMS结果，
+ * 不同上下文之间互不共享数据，可以在多个线程中并行调用
+ * 所有缓存帧间复用，容量保持历史最大值，稳定运行后不再有堆分配
+ */
+struct Yolov5PostProcessContext {
+  explicit Yolov5PostProcessContext(int mode = NMS_MODE_HARD) : nms_mode(mode) {}
+
+  // 候选框、NMS结果及NMS临时内存
+  PostProcessDetectionArena<Detection> arena;
+  // Yolov5SetNmsMode 设置，默认上下文为 NMS_MODE_PROCESS_DEFAULT
+  int nms_mode;
+
+  // 每层的解码参数
+  PostProcessArenaVector<Yolov5LayerInfo> layers;
+  // 串行解码使用
+  Yolov5DecodeBuffer decode_buf;
+  // Yolov5doProcessAll 中每个并行任务一个
+  PostProcessArenaVector<Yolov5DecodeTask> tasks;
+  PostProcessArenaVector<Yolov5DecodeBuffer> task_bufs;
+
+  // 作为批量后处理中的一张图片时，本张图片各层输出的tensor
+  PostProcessArenaVector<hbDNNTensor> batch_tensors;
+  // Yolov5PostProcessBatchWithContextToArray 中每张图片一个子上下文，帧间复用
+  std::vector<std::unique_ptr<Yolov5PostProcessContext>> batch_contexts;
+};
+
+// 兼容旧接口使用的默认上下文，NMS方式跟随 PostProcessSetNmsMode
+static Yolov5PostProcessContext default_yolov5_context(NMS_MODE_PROCESS_DEFAULT);
+
+Yolov5PostProcessContext_t *Yolov5CreateContext(void) {
+  return new (std::nothrow) Yolov5PostProcessContext();
+}
+
+void Yolov5DestroyContext(Yolov5PostProcessContext_t *ctx) {
+  delete ctx;
+}
+
+int Yolov5SetNmsMode(Yolov5PostProcessContext_t *ctx, int nms_mode) {
+  if (ctx == nullptr || !IsValidNmsMode(nms_mode)) {
+    printf("yolov5 invalid context or nms mode %d!\n", nms_mode);
+    return -1;
   }
+  ctx->nms_mode = nms_mode;
+  return 0;
 }
 
-void Yolov5doProcess(hbDNNTensor *tensor, Yolov5PostProcessInfo_t *post_info, int layer) {
+static int Yolov5GetLayerInfo(hbDNNTensor *tensor,
+                              Yolov5PostProcessInfo_t *post_info,
+                              int layer,
+                              Yolov5LayerInfo *info) {
+  auto quanti_type = tensor->properties.quantiType;
+  if (quanti_type != hbDNNQuantiType::NONE && quanti_type != hbDNNQuantiType::SCALE) {
+    printf("yolov5x unsupport shift dequantzie now!\n");
+    return -1;
+  }
 
+  info->tensor = tensor;
   // 80个分类
-  int num_classes = default_yolov5_config.class_num;
-  // 下采样值 8 16 32
-  int stride = default_yolov5_config.strides[layer];
+  info->num_classes = default_yolov5_config.class_num;
   // 每个预测值占用多少空间
   // 一组条件类别概率，都是区间在[0,1]之间的值，代表概率。
   // box参数即box的中心点坐标（x,y）和box的宽和高（w,h）
@@ -301,20 +439,14 @@ void Yolov5doProcess(hbDNNTensor *tensor, Yolov5PostProcessInfo_t *post_info, in
    * 也就是说每个grid cell有B个bounding box, 每个bounding box内有4个位置参数，
    * 1个置信度，classes个类别概率，那么最终的输出维数是：width * height * [B*(4 + 1 + classes)]
    */
-  int num_pred = default_yolov5_config.class_num + 4 + 1;
+  info->num_pred = default_yolov5_config.class_num + 4 + 1;
 
-  std::vector<float> class_pred(default_yolov5_config.class_num, 0.0);
   // 3组 预设检测框类型
-  std::vector<std::pair<double, double>> &anchors = default_yolov5_config.anchors_table[layer];
+  info->anchors = &default_yolov5_config.anchors_table[layer];
 
-  // 计算原始图像与算法推理实际使用图像的缩放比
-  double h_ratio = post_info->height * 1.0 / post_info->ori_height;
-  double w_ratio = post_info->width * 1.0 / post_info->ori_width;
-  double resize_ratio = std::min(w_ratio, h_ratio);
-  if (post_info->is_pad_resize) {
-    w_ratio = resize_ratio;
-    h_ratio = resize_ratio;
-  }
+  // 下采样值 8 16 32
+  info->param.stride = default_yolov5_config.strides[layer];
+  info->geometry = GetGeometry(post_info);
 
   // int height, width;
   // auto ret = get_tensor_hw(*tensor, &height, &width);
@@ -322,241 +454,465 @@ void Yolov5doProcess(hbDNNTensor *tensor, Yolov5PostProcessInfo_t *post_info, in
   //   printf("get_tensor_hw failed\n");
   // }
 
-  int height = tensor->properties.validShape.dimensionSize[1];
-  int width = tensor->properties.validShape.dimensionSize[2];
-
-  int anchor_num = anchors.size();
-  auto quanti_type = tensor->properties.quantiType;
+  bool nchw = tensor->properties.tensorLayout == HB_DNN_LAYOUT_NCHW;
+  int anchor_num = info->anchors->size();
+  if (nchw) {
+    get_tensor_hw(*tensor, &info->height, &info->width);
+    info->row_stride = tensor->properties.alignedShape.dimensionSize[3];
+    info->c_stride = tensor->properties.alignedShape.dimensionSize[2] * info->row_stride;
+  } else {
+    info->height = tensor->properties.validShape.dimensionSize[1];
+    info->width = tensor->properties.validShape.dimensionSize[2];
+    // SCALE 输出每个网格的通道数对齐后多一个
+    info->row_stride = info->width * (info->num_pred * anchor_num +
+                                      (quanti_type == hbDNNQuantiType::SCALE ? 1 : 0));
+    info->c_stride = 1;
+  }
+  info->decode = Yolov5SelectDecoder(quanti_type == hbDNNQuantiType::SCALE, nchw,
+                                     info->num_classes, anchor_num);
 
+  // confidence = sigmoid(objness) * sigmoid(class) <= sigmoid(objness)，
+  // 所以 objness < logit(score_threshold) 的候选框一定会被过滤，不需要再求类别和解码
   if (quanti_type == hbDNNQuantiType::NONE) {
-    auto *data = reinterpret_cast<float *>(tensor->sysMem[0].virAddr);
-    for (int32_t h = 0; h < height; h++) {
-      for (int32_t w = 0; w < width; w++) {
-        for (int k = 0; k < anchor_num; k++) {
-          double anchor_x = anchors[k].first;
-          double anchor_y = anchors[k].second;
-          // 取出一个预测结果
-          float *cur_data = data + k * num_pred;
-          // 置信度
-          float objness = cur_data[4];
-
-          // 获得概率值最大的分类对应的编号，作为id
-          int id = argmax(cur_data + 5, cur_data + 5 + num_classes);
-          // 计算置信度
-          double x1 = 1 / (1 + std::exp(-objness)) * 1;
-          double x2 = 1 / (1 + std::exp(-cur_data[id + 5]));
-          double confidence = x1 * x2;
-
-          // 过滤执行度不足的检测框
-          if (confidence < post_info->score_threshold) {
-            continue;
-          }
+    info->obj_thresh = LogitThreshold(post_info->score_threshold);
+  } else {
+    auto dequantize_scale_ptr = reinterpret_cast<float *>(tensor->properties.scale.scaleData);
+    // 每个anchor的objness阈值换算到量化域，直接和int32原始数据比较
+    info->quanti_obj_thresh.resize(anchor_num);
+    for (int k = 0; k < anchor_num; k++) {
+      info->quanti_obj_thresh[k] = QuantiLogitThreshold(
+          post_info->score_threshold, dequantize_scale_ptr[info->num_pred * k + 4]);
+    }
+  }
+  return 0;
+}
 
-          // box参数即box的中心点坐标（x,y）和box的宽和高（w,h）
-          float center_x = cur_data[0];
-          float center_y = cur_data[1];
-          float scale_x = cur_data[2];
-          float scale_y = cur_data[3];
-
-          double box_center_x =
-              ((1.0 / (1.0 + std::exp(-center_x))) * 2 - 0.5 + w) * stride;
-          double box_center_y =
-              ((1.0 / (1.0 + std::exp(-center_y))) * 2 - 0.5 + h) * stride;
-
-          double box_scale_x =
-              std::pow((1.0 / (1.0 + std::exp(-scale_x))) * 2, 2) * anchor_x;
-          double box_scale_y =
-              std::pow((1.0 / (1.0 + std::exp(-scale_y))) * 2, 2) * anchor_y;
-
-          double xmin = (box_center_x - box_scale_x / 2.0);
-          double ymin = (box_center_y - box_scale_y / 2.0);
-          double xmax = (box_center_x + box_scale_x / 2.0);
-          double ymax = (box_center_y + box_scale_y / 2.0);
-
-          double w_padding =
-              (post_info->width - w_ratio * post_info->ori_width) / 2.0;
-          double h_padding =
-              (post_info->height - h_ratio * post_info->ori_height) / 2.0;
-
-          double xmin_org = (xmin - w_padding) / w_ratio;
-          double xmax_org = (xmax - w_padding) / w_ratio;
-          double ymin_org = (ymin - h_padding) / h_ratio;
-          double ymax_org = (ymax - h_padding) / h_ratio;
-
-          if (xmax_org <= 0 || ymax_org <= 0) {
-            continue;
-          }
+/**
+ * 解码一行网格的候选框，buf 中的 pos_buf/obj_buf/cls_buf/id_buf/box_buf 已经由调用者填好
+ * 第 i 个候选框对应网格 w = pos / anchor_num，anchor k = pos % anchor_num
+ * 通过阈值的候选框追加到 buf 的 cand_xxx 中
+ */
+static void Yolov5DecodeRow(Yolov5DecodeBuffer *buf,
+                            int num,
+                            int h,
+                            const Yolov5LayerInfo &layer,
+                            Yolov5PostProcessInfo_t *post_info) {
+  const std::vector<std::pair<double, double>> &anchors = *layer.anchors;
+  const Yolov5DecodeParam &param = layer.param;
+  int anchor_num = anchors.size();
+  float score_threshold = post_info->score_threshold;
+  float *conf = buf->conf_buf.data();
+  const float *box_raw = buf->box_buf.data();
+  const int32_t *ids = buf->id_buf.data();
+  const int32_t *pos = buf->pos_buf.data();
+
+  // 置信度 = sigmoid(objness) * sigmoid(class)
+  SigmoidProduct(buf->obj_buf.data(), buf->cls_buf.data(), conf, num);
+
+  for (int i = 0; i < num; i += 4) {
+    int lanes = std::min(4, num - i);
+    bool hit = false;
+    for (int j = 0; j < lanes; j++) {
+      hit |= (conf[i + j] >= score_threshold);
+    }
+    // 过滤执行度不足的检测框
+    if (!hit) {
+      continue;
+    }
 
-          if (xmin_org > xmax_org || ymin_org > ymax_org) {
-            continue;
-          }
+    float raw[16];
+    float grid[8];
+    float anchor[8];
+    float box[16];
+    for (int j = 0; j < 4; j++) {
+      // 行尾不足4个时重复最后一个，只是为了凑满4路，结果不使用
+      int index = i + std::min(j, lanes - 1);
+      raw[j] = box_raw[index * 4];
+      raw[4 + j] = box_raw[index * 4 + 1];
+      raw[8 + j] = box_raw[index * 4 + 2];
+      raw[12 + j] = box_raw[index * 4 + 3];
+      grid[j] = pos[index] / anchor_num;
+      grid[4 + j] = h;
+      anchor[j] = anchors[pos[index] % anchor_num].first;
+      anchor[4 + j] = anchors[pos[index] % anchor_num].second;
+    }
+    Yolov5DecodeBoxX4(raw, grid, anchor, param, box);
 
-          // 把box的坐标限制在图像大小范围内
-          xmin_org = std::max(xmin_org, 0.0);
-          xmax_org = std::min(xmax_org, post_info->ori_width - 1.0);
-          ymin_org = std::max(ymin_org, 0.0);
-          ymax_org = std::min(ymax_org, post_info->ori_height - 1.0);
+    for (int j = 0; j < lanes; j++) {
+      if (conf[i + j] < score_threshold) {
+        continue;
+      }
+      buf->cand_xmin.push_back(box[j]);
+      buf->cand_ymin.push_back(box[4 + j]);
+      buf->cand_xmax.push_back(box[8 + j]);
+      buf->cand_ymax.push_back(box[12 + j]);
+      buf->cand_score.push_back(conf[i + j]);
+      buf->cand_id.push_back(ids[i + j]);
+    }
+  }
+}
 
-          // 实际在原图上的box，添加到检测结果中
-          Bbox bbox(xmin_org, ymin_org, xmax_org, ymax_org);
-          dets.emplace_back((int)id,
-                    confidence,
-                    bbox,
-                    default_yolov5_config.class_names[(int)id].c_str());
+/**
+ * 把 buf 中的候选框一次性还原到原图坐标、裁剪到图像范围内，有效的追加到 dets
+ */
+static void Yolov5EmitDetections(const Yolov5LayerInfo &layer,
+                                 Yolov5DecodeBuffer *buf,
+                                 PostProcessArenaVector<Detection> *dets) {
+  int num = buf->cand_score.size();
+  buf->cand_valid.resize(num);
+  PostProcessProjectBoxes(layer.geometry, buf->cand_xmin.data(), buf->cand_ymin.data(),
+                          buf->cand_xmax.data(), buf->cand_ymax.data(), num,
+                          buf->cand_valid.data());
+  for (int i = 0; i < num; i++) {
+    if (!buf->cand_valid[i]) {
+      continue;
+    }
+    // 实际在原图上的box，添加到检测结果中
+    int id = buf->cand_id[i];
+    Bbox bbox(buf->cand_xmin[i], buf->cand_ymin[i], buf->cand_xmax[i], buf->cand_ymax[i]);
+    dets->emplace_back(id,
+                       buf->cand_score[i],
+                       bbox,
+                       default_yolov5_config.class_names[id].c_str());
+  }
+  buf->cand_xmin.clear();
+  buf->cand_ymin.clear();
+  buf->cand_xmax.clear();
+  buf->cand_ymax.clear();
+  buf->cand_score.clear();
+  buf->cand_id.clear();
+}
 
+/**
+ * 解码一层输出中 [h_begin, h_end) 行的候选框，不同行之间互不依赖，可以分给多个线程
+ * 布局、量化方式在编译期确定，kNumClasses/kAnchorNum 为0时使用 layer 中的值，
+ * 不为0时类别数和anchor数是常量，编译器可以展开求类别最大值的循环
+ * @param[in] buf: 行中间结果，每个线程使用各自的 buf
+ * @param[out] dets: 检测框按行的顺序追加到这里
+ */
+template <bool kQuanti, bool kNchw, int kNumClasses, int kAnchorNum>
+static void Yolov5DecodeRows(const Yolov5LayerInfo &layer,
+                             int h_begin,
+                             int h_end,
+                             Yolov5PostProcessInfo_t *post_info,
+                             Yolov5DecodeBuffer *buf,
+                             PostProcessArenaVector<Detection> *dets) {
+  typedef typename std::conditional<kQuanti, int32_t, float>::type T;
+  const int num_classes = kNumClasses > 0 ? kNumClasses : layer.num_classes;
+  const int anchor_num = kAnchorNum > 0 ? kAnchorNum : layer.anchors->size();
+  const int num_pred = num_classes + 4 + 1;
+  hbDNNTensor *tensor = layer.tensor;
+  int width = layer.width;
+  int height = layer.height;
+  // NHWC 时 c_stride 为1；NCHW 时相邻通道相差 c_stride，同一行的网格连续存放
+  const int c_stride = layer.c_stride;
+  const int w_stride = kNchw ? 1 : num_pred * anchor_num + (kQuanti ? 1 : 0);
+
+  buf->Reserve(width * anchor_num);
+  int32_t *pos = buf->pos_buf.data();
+  float *obj = buf->obj_buf.data();
+  float *cls = buf->cls_buf.data();
+  int32_t *ids = buf->id_buf.data();
+  float *box_raw = buf->box_buf.data();
+
+  auto *data = reinterpret_cast<T *>(tensor->sysMem[0].virAddr);
+  auto dequantize_scale_ptr = reinterpret_cast<float *>(tensor->properties.scale.scaleData);
+  for (int32_t h = h_begin; h < h_end; h++) {
+    T *row = data + static_cast<size_t>(h) * layer.row_stride;
+    int index = 0;
+    for (int32_t w = 0; w < width; w++) {
+      T *cell = row + w * w_stride;
+      for (int k = 0; k < anchor_num; k++) {
+        // 取出一个预测结果
+        T *cur_data = cell + k * num_pred * c_stride;
+        const float *cur_scale = kQuanti ? dequantize_scale_ptr + num_pred * k : nullptr;
+        if (kQuanti ? cur_data[4 * c_stride] < layer.quanti_obj_thresh[k]
+                    : cur_data[4 * c_stride] < layer.obj_thresh) {
+          continue;
         }
-        data = data + num_pred * anchors.size();
+        pos[index] = w * anchor_num + k;
+        // 置信度
+        obj[index] = kQuanti ? cur_data[4 * c_stride] * cur_scale[4] : cur_data[4 * c_stride];
+        // 获得概率值最大的分类对应的编号，作为id
+        if (kNchw) {
+          int id = 0;
+          float max_value = kQuanti ? cur_data[5 * c_stride] * cur_scale[5] : cur_data[5 * c_stride];
+          for (int c = 1; c < num_classes; c++) {
+            float value = kQuanti ? cur_data[(5 + c) * c_stride] * cur_scale[5 + c]
+                                  : cur_data[(5 + c) * c_stride];
+            if (value > max_value) {
+              max_value = value;
+              id = c;
+            }
+          }
+          ids[index] = id;
+          cls[index] = max_value;
+        } else if (kQuanti) {
+          ids[index] = ArgMaxDequanti(reinterpret_cast<const int32_t *>(cur_data) + 5,
+                                      cur_scale + 5, num_classes, &cls[index]);
+        } else {
+          ids[index] = ArgMaxFloat(reinterpret_cast<const float *>(cur_data) + 5,
+                                   num_classes, &cls[index]);
+        }
+        // box参数即box的中心点坐标（x,y）和box的宽和高（w,h）
+        for (int j = 0; j < 4; j++) {
+          box_raw[index * 4 + j] = kQuanti ? cur_data[j * c_stride] * cur_scale[j]
+                                           : cur_data[j * c_stride];
+        }
+        index++;
       }
-    }
-  }else if (quanti_type == hbDNNQuantiType::SCALE) {
-    auto *data = reinterpret_cast<int32_t *>(tensor->sysMem[0].virAddr);
-    auto dequantize_scale_ptr = reinterpret_cast<float *>(tensor->properties.scale.scaleData);
-    bool big_endian = false;
-    for (int32_t h = 0; h < height; h++) {
-      for (int32_t w = 0; w < width; w++) {
-        for (int k = 0; k < anchor_num; k++) {
-          double anchor_x = anchors[k].first;
-          double anchor_y = anchors[k].second;
-          int32_t *cur_data = data + k * num_pred;
-          int offset = num_pred * k;
-
-          float objness = DequantiScale(
-              cur_data[4], big_endian, *(dequantize_scale_ptr + offset + 4));
-
-          double max_cls_data = std::numeric_limits<double>::lowest();
-          int id{0};
-          float32x4_t max;
-          for (int cls = 0; cls < num_classes; cls += 4) {
-            for (int j = 0; j < 4; j++) {
-              float score = cur_data[cls + 5 + j] *
-                            dequantize_scale_ptr[offset + cls + 5 + j];
-              if (score > max_cls_data) {
-                max_cls_data = score;
-                id = cls + j;
+      /*
+      This is a temporary modification plan. The reason is that during debugging, it was discovered that tensor data
+      becomes zero in the last segment and causes access exceptions. This issue does not occur with TROS. Due to time
+      constraints and the inability to identify the root cause at the moment, this is a temporary commit. If a better
+      solution is found, it will need to be deleted and revised.
+      */
+      if (kQuanti && !kNchw && h == height - 1) {
+          bool all_zero = true;
+          for (int j = 0; j < num_pred; j++) {
+              if (cell[j] != 0) {
+                  all_zero = false;
               }
-            }
           }
+          if (all_zero) {
+              // std::cout << "All num_pred values are zero in the last row (h: " << h << ", w: " << w <<  ")" << std::endl;
+              break;
+          }
+      }
+    }
+    Yolov5DecodeRow(buf, index, h, layer, post_info);
+  }
+  Yolov5EmitDetections(layer, buf, dets);
+}
 
-          double x1 = 1 / (1 + std::exp(-objness)) * 1;
-          double x2 = 1 / (1 + std::exp(-max_cls_data));
-          double confidence = x1 * x2;
+/**
+ * 按布局、量化方式、类别数和anchor数选择解码函数，每层只选择一次
+ * 常用的 80类/3个anchor 使用常量实例，其他配置使用运行时参数的通用实例
+ */
+template <bool kQuanti, bool kNchw>
+static Yolov5DecodeFunc Yolov5SelectDecoder(int num_classes, int anchor_num) {
+  if (num_classes == 80 && anchor_num == 3) {
+    return Yolov5DecodeRows<kQuanti, kNchw, 80, 3>;
+  }
+  return Yolov5DecodeRows<kQuanti, kNchw, 0, 0>;
+}
 
-          if (confidence < post_info->score_threshold) {
-            continue;
-          }
+static Yolov5DecodeFunc Yolov5SelectDecoder(bool quanti, bool nchw, int num_classes, int anchor_num) {
+  if (quanti) {
+    return nchw ? Yolov5SelectDecoder<true, true>(num_classes, anchor_num)
+                : Yolov5SelectDecoder<true, false>(num_classes, anchor_num);
+  }
+  return nchw ? Yolov5SelectDecoder<false, true>(num_classes, anchor_num)
+              : Yolov5SelectDecoder<false, false>(num_classes, anchor_num);
+}
 
-          float center_x = DequantiScale(
-              cur_data[0], big_endian, *(dequantize_scale_ptr + offset));
-          float center_y = DequantiScale(
-              cur_data[1], big_endian, *(dequantize_scale_ptr + offset + 1));
-          float scale_x = DequantiScale(
-              cur_data[2], big_endian, *(dequantize_scale_ptr + offset + 2));
-          float scale_y = DequantiScale(
-              cur_data[3], big_endian, *(dequantize_scale_ptr + offset + 3));
-
-          double box_center_x =
-              ((1.0 / (1.0 + std::exp(-center_x))) * 2 - 0.5 + w) * stride;
-          double box_center_y =
-              ((1.0 / (1.0 + std::exp(-center_y))) * 2 - 0.5 + h) * stride;
-
-          double box_scale_x =
-              std::pow((1.0 / (1.0 + std::exp(-scale_x))) * 2, 2) * anchor_x;
-          double box_scale_y =
-              std::pow((1.0 / (1.0 + std::exp(-scale_y))) * 2, 2) * anchor_y;
-
-          double xmin = (box_center_x - box_scale_x / 2.0);
-          double ymin = (box_center_y - box_scale_y / 2.0);
-          double xmax = (box_center_x + box_scale_x / 2.0);
-          double ymax = (box_center_y + box_scale_y / 2.0);
-
-          double w_padding =
-              (post_info->width - w_ratio * post_info->ori_width) / 2.0;
-          double h_padding =
-              (post_info->height - h_ratio * post_info->ori_height) / 2.0;
-
-          double xmin_org = (xmin - w_padding) / w_ratio;
-          double xmax_org = (xmax - w_padding) / w_ratio;
-          double ymin_org = (ymin - h_padding) / h_ratio;
-          double ymax_org = (ymax - h_padding) / h_ratio;
-
-          if (xmax_org <= 0 || ymax_org <= 0) {
-            continue;
-          }
+void Yolov5doProcessWithContext(Yolov5PostProcessContext_t *ctx,
+                                hbDNNTensor *tensor,
+                                Yolov5PostProcessInfo_t *post_info,
+                                int layer) {
+  if (ctx == nullptr) {
+    printf("yolov5 post process context is null!\n");
+    return;
+  }
 
-          if (xmin_org > xmax_org || ymin_org > ymax_org) {
-            continue;
-          }
+  if (layer < 0 || layer >= static_cast<int>(default_yolov5_config.strides.size())) {
+    printf("yolov5 post process invalid output layer %d!\n", layer);
+    return;
+  }
+  if (static_cast<int>(ctx->layers.size()) <= layer) {
+    ctx->layers.resize(layer + 1);
+  }
+  Yolov5LayerInfo &layer_info = ctx->layers[layer];
+  if (Yolov5GetLayerInfo(tensor, post_info, layer, &layer_info) != 0) {
+    return;
+  }
+  // 按行解码，每行的中间结果保存在 ctx 中，帧间复用
+  layer_info.decode(layer_info, 0, layer_info.height, post_info, &ctx->decode_buf,
+                    &ctx->arena.dets);
+}
 
-          xmin_org = std::max(xmin_org, 0.0);
-          xmax_org = std::min(xmax_org, post_info->ori_width - 1.0);
-          ymin_org = std::max(ymin_org, 0.0);
-          ymax_org = std::min(ymax_org, post_info->ori_height - 1.0);
-          xmax_org = std::max(xmax_org, 0.0);
-          ymax_org = std::max(ymax_org, 0.0);
-
-          Bbox bbox(xmin_org, ymin_org, xmax_org, ymax_org);
-          dets.emplace_back((int)id,
-                            confidence,
-                            bbox,
-                            default_yolov5_config.class_names[(int)id].c_str());
-        }
-        /*
-        This is a temporary modification plan. The reason is that during debugging, it was discovered that tensor data
-        becomes zero in the last segment and causes access exceptions. This issue does not occur with TROS. Due to time
-        constraints and the inability to identify the root cause at the moment, this is a temporary commit. If a better
-        solution is found, it will need to be deleted and revised.
-        */
-        if (h == height - 1) {
-            bool all_zero = true;
-            for (int j = 0; j < num_pred; j++) {
-                if (data[j] != 0) {
-                    all_zero = false;
-                }
-            }
-            if (all_zero) {
-                // std::cout << "All num_pred values are zero in the last row (h: " << h << ", w: " << w <<  ")" << std::endl;
-                break;
-            }
-        }
-        data = data + num_pred * anchors.size() + 1;
-      }
-    }
-  } else {
-    printf("yolov5x unsupport shift dequantzie now!\n");
+void Yolov5doProcessAllWithContext(Yolov5PostProcessContext_t *ctx,
+                                   hbDNNTensor *tensors,
+                                   int layer_num,
+                                   Yolov5PostProcessInfo_t *post_info) {
+  if (ctx == nullptr) {
+    printf("yolov5 post process context is null!\n");
     return;
   }
+  if (tensors == nullptr || layer_num <= 0 ||
+      layer_num > static_cast<int>(default_yolov5_config.strides.size())) {
+    printf("yolov5 post process invalid output layer num %d!\n", layer_num);
+    return;
+  }
+
+  if (static_cast<int>(ctx->layers.size()) < layer_num) {
+    ctx->layers.resize(layer_num);
+  }
+  PostProcessArenaVector<Yolov5LayerInfo> &layers = ctx->layers;
+  size_t total_cells = 0;
+  for (int i = 0; i < layer_num; i++) {
+    if (Yolov5GetLayerInfo(&tensors[i], post_info, i, &layers[i]) != 0) {
+      return;
+    }
+    total_cells += static_cast<size_t>(layers[i].height) * layers[i].width;
+  }
+
+  // 按网格数把各层切成若干段连续的行，stride 8 的层网格最多，切得最细；
+  // 任务数取线程数的2倍，减少各线程之间的等待
+  PostProcessThreadPool *pool = PostProcessThreadPool::Instance();
+  int target_tasks = pool->ThreadNum() > 1 ? pool->ThreadNum() * 2 : 1;
+  PostProcessArenaVector<Yolov5DecodeTask> &tasks = ctx->tasks;
+  tasks.clear();
+  for (int i = 0; i < layer_num; i++) {
+    int height = layers[i].height;
+    size_t cells = static_cast<size_t>(height) * layers[i].width;
+    int chunks = total_cells > 0 ? static_cast<int>(
+        (cells * target_tasks + total_cells / 2) / total_cells) : 1;
+    chunks = std::max(1, std::min(chunks, height));
+    int rows = (height + chunks - 1) / chunks;
+    for (int h = 0; h < height; h += rows) {
+      tasks.push_back({i, h, std::min(h + rows, height)});
+    }
+  }
+
+  int task_num = tasks.size();
+  if (static_cast<int>(ctx->task_bufs.size()) < task_num) {
+    ctx->task_bufs.resize(task_num);
+  }
+  pool->ParallelFor(task_num, [&](int t) {
+    const Yolov5DecodeTask &task = tasks[t];
+    Yolov5DecodeBuffer *buf = &ctx->task_bufs[t];
+    buf->dets.clear();
+    const Yolov5LayerInfo &layer_info = layers[task.layer];
+    layer_info.decode(layer_info, task.h_begin, task.h_end, post_info, buf, &buf->dets);
+  });
+
+  // 按层、行的顺序合并，和逐层调用 Yolov5doProcess 得到的候选框顺序一致
+  for (int t = 0; t < task_num; t++) {
+    PostProcessArenaVector<Detection> &dets = ctx->task_bufs[t].dets;
+    ctx->arena.dets.insert(ctx->arena.dets.end(), dets.begin(), dets.end());
+    dets.clear();
+  }
 }
 
+void Yolov5doProcess(hbDNNTensor *tensor, Yolov5PostProcessInfo_t *post_info, int layer) {
+  Yolov5doProcessWithContext(&default_yolov5_context, tensor, post_info, layer);
+}
 
+void Yolov5doProcessAll(hbDNNTensor *tensors, int layer_num, Yolov5PostProcessInfo_t *post_info) {
+  Yolov5doProcessAllWithContext(&default_yolov5_context, tensors, layer_num, post_info);
+}
 
 // Yolov5 输出tensor格式
 // 3次下采样得到三组缩小后的gred，然后对每个gred进行三次预测，最后输出结果
-char* Yolov5PostProcess(Yolov5PostProcessInfo_t *post_info) {
+char* Yolov5PostProcessWithContext(Yolov5PostProcessContext_t *ctx,
+                                   Yolov5PostProcessInfo_t *post_info) {
 
-  int i = 0;
-  char *str_dets;
+  if (ctx == nullptr) {
+    printf("yolov5 post process context is null!\n");
+    return nullptr;
+  }
 
   // 计算交并比来合并检测框，传入交并比阈值(0.65)和返回box数量(5000)
-  yolov5_nms(dets, post_info->nms_threshold, post_info->nms_top_k, det_restuls, false);
-  std::stringstream out_string;
+  PostProcessDetectionArena<Detection> &arena = ctx->arena;
+  PostProcessNms(arena.dets, GetNmsParam(post_info, ResolveNmsMode(ctx->nms_mode)), arena.results,
+                 &arena.nms_ws);
 
   // 算法结果转换成json格式
-  int det_restuls_size = det_restuls.size();
-  out_string << "\"yolov5_result\": [";
-  for (i = 0; i < det_restuls_size; i++) {
-  	auto det_ret = det_restuls[i];
-  	out_string << det_ret;
-  	if (i < det_restuls_size - 1)
-		out_string << ",";
-  }
-  out_string << "]" << std::endl;
-
-  str_dets = (char *)malloc(out_string.str().length() + 1);
-  str_dets[out_string.str().length()] = '\0';
-  snprintf(str_dets, out_string.str().length(), "%s", out_string.str().c_str());
-  // printf("str_dets: %s\n", str_dets);
-  dets.clear();
-  det_restuls.clear();
-  return str_dets;
+  arena.out.resize(arena.results.size());
+  int num = CopyDetectionResult(arena.results, arena.out.data(), arena.out.size());
+  arena.Clear();
+  return DetectionResultToJson("yolov5_result", arena.out.data(), num, Yolov5GetClassName);
 }
 
+int Yolov5PostProcessWithContextToArray(Yolov5PostProcessContext_t *ctx,
+                                        Yolov5PostProcessInfo_t *post_info,
+                                        PostProcessDetection_t *dets,
+                                        int capacity) {
+  if (ctx == nullptr) {
+    printf("yolov5 post process context is null!\n");
+    return -1;
+  }
+  if (dets == nullptr || capacity < 0) {
+    printf("yolov5 post process invalid output array!\n");
+    ctx->arena.Clear();
+    return -1;
+  }
+
+  PostProcessDetectionArena<Detection> &arena = ctx->arena;
+  PostProcessNms(arena.dets, GetNmsParam(post_info, ResolveNmsMode(ctx->nms_mode)), arena.results,
+                 &arena.nms_ws);
+  int num = CopyDetectionResult(arena.results, dets, capacity);
+  arena.Clear();
+  return num;
+}
+
+char* Yolov5PostProcess(Yolov5PostProcessInfo_t *post_info) {
+  return Yolov5PostProcessWithContext(&default_yolov5_context, post_info);
+}
+
+int Yolov5PostProcessToArray(Yolov5PostProcessInfo_t *post_info,
+                             PostProcessDetection_t *dets,
+                             int capacity) {
+  return Yolov5PostProcessWithContextToArray(&default_yolov5_context, post_info, dets, capacity);
+}
+
+int Yolov5PostProcessBatchToArray(hbDNNTensor *tensors,
+                                  int layer_num,
+                                  Yolov5PostProcessInfo_t *post_info,
+                                  PostProcessDetection_t *dets,
+                                  int capacity,
+                                  int *counts,
+                                  int max_batch) {
+  return Yolov5PostProcessBatchWithContextToArray(&default_yolov5_context, tensors, layer_num,
+                                                  post_info, dets, capacity, counts, max_batch);
+}
+
+int Yolov5PostProcessBatchWithContextToArray(Yolov5PostProcessContext_t *ctx,
+                                             hbDNNTensor *tensors,
+                                             int layer_num,
+                                             Yolov5PostProcessInfo_t *post_info,
+                                             PostProcessDetection_t *dets,
+                                             int capacity,
+                                             int *counts,
+                                             int max_batch) {
+  if (ctx == nullptr || tensors == nullptr || layer_num <= 0 || dets == nullptr || capacity < 0 ||
+      counts == nullptr) {
+    printf("yolov5 post process invalid batch input or output array!\n");
+    return -1;
+  }
+
+  int batch_num = PostProcessGetBatchNum(&tensors[0]);
+  for (int i = 1; i < layer_num; i++) {
+    if (PostProcessGetBatchNum(&tensors[i]) != batch_num) {
+      printf("yolov5 post process output layers have different batch size!\n");
+      return -1;
+    }
+  }
+  if (batch_num > max_batch) {
+    printf("yolov5 post process batch %d exceeds output array size %d!\n", batch_num, max_batch);
+    return -1;
+  }
+
+  // 子上下文只在调用线程中增加，并行任务开始后不再改变
+  while (static_cast<int>(ctx->batch_contexts.size()) < batch_num) {
+    ctx->batch_contexts.emplace_back(new Yolov5PostProcessContext());
+  }
+  // 开始前确定NMS方式，同一批图片使用同一方式
+  int nms_mode = ResolveNmsMode(ctx->nms_mode);
+
+  // 每张图片使用自己的子上下文，图片之间并行，每张图片内部各层再按行并行解码
+  PostProcessThreadPool::Instance()->ParallelFor(batch_num, [&](int n) {
+    Yolov5PostProcessContext *item = ctx->batch_contexts[n].get();
+    item->nms_mode = nms_mode;
+    item->batch_tensors.resize(layer_num);
+    for (int i = 0; i < layer_num; i++) {
+      PostProcessGetBatchTensor(&tensors[i], batch_num, n, &item->batch_tensors[i]);
+    }
+    Yolov5doProcessAllWithContext(item, item->batch_tensors.data(), layer_num, post_info);
+    counts[n] = Yolov5PostProcessWithContextToArray(item, post_info,
+                                                    dets + static_cast<size_t>(n) * capacity,
+                                                    capacity);
+  });
+  return batch_num;
+}
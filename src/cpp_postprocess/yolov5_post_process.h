@@ -24,6 +24,7 @@
 #define _POST_PROCESS_YOLOV5_POST_PROCESS_H_
 
 #include "dnn/hb_dnn.h"
+#include "post_process_common.h"
 
 #ifdef __cplusplus
   extern "C"{
@@ -40,6 +41,32 @@ typedef struct {
 	int is_pad_resize;
 } Yolov5PostProcessInfo_t;
 
+  /**
+   * 后处理上下文，保存单路视频流的中间检测结果，不同上下文可以在不同线程中并行使用
+   * 同一个上下文同一时刻只能被一个线程使用
+   */
+  typedef struct Yolov5PostProcessContext Yolov5PostProcessContext_t;
+
+  /**
+   * Create post process context
+   * @return context handle, NULL if failed
+   */
+  Yolov5PostProcessContext_t *Yolov5CreateContext(void);
+
+  /**
+   * Destroy post process context
+   * @param[in] ctx: context created by Yolov5CreateContext
+   */
+  void Yolov5DestroyContext(Yolov5PostProcessContext_t *ctx);
+
+  /**
+   * 设置 ctx 使用的NMS方式，新建的上下文默认 NMS_MODE_HARD，不受 PostProcessSetNmsMode 影响
+   * 批量后处理时 ctx 的所有图片使用同一方式
+   * @param[in] nms_mode: PostProcessNmsMode_t
+   * @return 0 成功，ctx 为NULL或 nms_mode 不是 PostProcessNmsMode_t 中的值返回-1
+   */
+  int Yolov5SetNmsMode(Yolov5PostProcessContext_t *ctx, int nms_mode);
+
   /**
    * Post process
    * @param[in] tensor: Model output tensors
@@ -51,6 +78,83 @@ typedef struct {
 
   void Yolov5doProcess(hbDNNTensor *tensor, Yolov5PostProcessInfo_t *post_info, int layer);
 
+  /**
+   * 与 Yolov5PostProcess/Yolov5doProcess 相同，结果保存在 ctx 中而不是全局默认上下文
+   */
+  char* Yolov5PostProcessWithContext(Yolov5PostProcessContext_t *ctx,
+                                     Yolov5PostProcessInfo_t *post_info);
+
+  void Yolov5doProcessWithContext(Yolov5PostProcessContext_t *ctx,
+                                  hbDNNTensor *tensor,
+                                  Yolov5PostProcessInfo_t *post_info,
+                                  int layer);
+
+  /**
+   * 一次解码全部输出层，等价于依次调用 Yolov5doProcess(&tensors[i], post_info, i)
+   * 各层按行切分后在后处理线程池中并行解码，线程数见 PostProcessSetThreadNum
+   * @param[in] tensors: 模型输出tensor数组，按 stride 8/16/32 的顺序
+   * @param[in] layer_num: 输出层数
+   */
+  void Yolov5doProcessAll(hbDNNTensor *tensors, int layer_num, Yolov5PostProcessInfo_t *post_info);
+
+  void Yolov5doProcessAllWithContext(Yolov5PostProcessContext_t *ctx,
+                                     hbDNNTensor *tensors,
+                                     int layer_num,
+                                     Yolov5PostProcessInfo_t *post_info);
+
+  /**
+   * 与 Yolov5PostProcess 相同，但结果直接写入 dets 数组，不生成json字符串
+   * @param[out] dets: 调用者分配的结果数组，按score从大到小排列
+   * @param[in] capacity: dets 数组的长度，结果超过 capacity 时只保留前 capacity 个
+   * @return 写入的结果个数，参数错误返回-1
+   */
+  int Yolov5PostProcessToArray(Yolov5PostProcessInfo_t *post_info,
+                               PostProcessDetection_t *dets,
+                               int capacity);
+
+  int Yolov5PostProcessWithContextToArray(Yolov5PostProcessContext_t *ctx,
+                                          Yolov5PostProcessInfo_t *post_info,
+                                          PostProcessDetection_t *dets,
+                                          int capacity);
+
+  /**
+   * 批量(N>1)输出的后处理，每张图片单独解码和NMS，图片之间在后处理线程池中并行
+   * 内部使用全局默认上下文，不能在多个线程中同时调用；多路并行时使用 Yolov5PostProcessBatchWithContextToArray
+   * @param[in] tensors: 模型输出tensor数组，按 stride 8/16/32 的顺序，各层batch数相同
+   * @param[in] layer_num: 输出层数
+   * @param[out] dets: 调用者分配的结果数组，长度 max_batch * capacity，
+   *                   第 n 张图片的结果从 dets + n * capacity 开始，按score从大到小排列
+   * @param[in] capacity: 每张图片最多保留的结果个数
+   * @param[out] counts: 每张图片实际写入的结果个数，长度 max_batch
+   * @param[in] max_batch: dets/counts 能容纳的图片数，小于输出的batch数时返回-1
+   * @return 输出的batch数，参数错误返回-1
+   */
+  int Yolov5PostProcessBatchToArray(hbDNNTensor *tensors,
+                                    int layer_num,
+                                    Yolov5PostProcessInfo_t *post_info,
+                                    PostProcessDetection_t *dets,
+                                    int capacity,
+                                    int *counts,
+                                    int max_batch);
+
+  /**
+   * 与 Yolov5PostProcessBatchToArray 相同，每张图片的中间结果保存在 ctx 拥有的子上下文中
+   * 不同的 ctx 可以在不同线程中同时调用
+   */
+  int Yolov5PostProcessBatchWithContextToArray(Yolov5PostProcessContext_t *ctx,
+                                               hbDNNTensor *tensors,
+                                               int layer_num,
+                                               Yolov5PostProcessInfo_t *post_info,
+                                               PostProcessDetection_t *dets,
+                                               int capacity,
+                                               int *counts,
+                                               int max_batch);
+
+  /**
+   * 根据 PostProcessDetection_t.id 获取类别名，越界返回NULL
+   */
+  const char *Yolov5GetClassName(int id);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,378 @@
+// Copyright (c) 2024，D-Robotics.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "post_process_common.h"
+#include "post_process_geometry.h"
+#include "post_process_math.h"
+#include "post_process_nms.h"
+#include "yolov8_post_process.h"
+
+/**
+ * Config definition for Yolov8
+ */
+struct Yolov8Config {
+  std::vector<int> strides;
+  int class_num;
+  std::vector<std::string> class_names;
+};
+
+Yolov8Config default_yolov8_config = {
+    {8, 16, 32},
+    80,
+    {"person",        "bicycle",      "car",
+     "motorcycle",    "airplane",     "bus",
+     "train",         "truck",        "boat",
+     "traffic light", "fire hydrant", "stop sign",
+     "parking meter", "bench",        "bird",
+     "cat",           "dog",          "horse",
+     "sheep",         "cow",          "elephant",
+     "bear",          "zebra",        "giraffe",
+     "backpack",      "umbrella",     "handbag",
+     "tie",           "suitcase",     "frisbee",
+     "skis",          "snowboard",    "sports ball",
+     "kite",          "baseball bat", "baseball glove",
+     "skateboard",    "surfboard",    "tennis racket",
+     "bottle",        "wine glass",   "cup",
+     "fork",          "knife",        "spoon",
+     "bowl",          "banana",       "apple",
+     "sandwich",      "orange",       "broccoli",
+     "carrot",        "hot dog",      "pizza",
+     "donut",         "cake",         "chair",
+     "couch",         "potted plant", "bed",
+     "dining table",  "toilet",       "tv",
+     "laptop",        "mouse",        "remote",
+     "keyboard",      "cell phone",   "microwave",
+     "oven",          "toaster",      "sink",
+     "refrigerator",  "book",         "clock",
+     "vase",          "scissors",     "teddy bear",
+     "hair drier",    "toothbrush"}};
+
+typedef struct Bbox {
+  float xmin;
+  float ymin;
+  float xmax;
+  float ymax;
+
+  Bbox() {}
+
+  Bbox(float xmin, float ymin, float xmax, float ymax)
+      : xmin(xmin), ymin(ymin), xmax(xmax), ymax(ymax) {}
+} Bbox;
+
+typedef struct Detection {
+  int id;
+  float score;
+  Bbox bbox;
+  const char *class_name;
+  Detection() {}
+
+  Detection(int id, float score, Bbox bbox, const char *class_name)
+      : id(id), score(score), bbox(bbox), class_name(class_name) {}
+} Detection;
+
+/**
+ * NHWC输出tensor的尺寸和内存布局
+ */
+struct Yolov8TensorInfo {
+  int height;
+  int width;
+  int channel;
+  int cell_stride;  // 相邻网格之间的元素个数，按 alignedShape 计算
+  int row_stride;   // 相邻行之间的元素个数
+  bool quanti;
+};
+
+/**
+ * 一层解码的中间结果
+ */
+struct Yolov8LayerBuffer {
+  // 量化输出一个网格反量化后的 4 * reg_max 个分箱
+  PostProcessArenaVector<float> bins;
+  // 类别输出只有一个scale时展开成每个类别一个
+  PostProcessArenaVector<float> cls_scale;
+
+  // 通过阈值的候选框，坐标还在模型输入坐标系下，整层解码结束后统一还原到原图
+  PostProcessArenaVector<float> cand_xmin;
+  PostProcessArenaVector<float> cand_ymin;
+  PostProcessArenaVector<float> cand_xmax;
+  PostProcessArenaVector<float> cand_ymax;
+  PostProcessArenaVector<float> cand_score;
+  PostProcessArenaVector<int32_t> cand_id;
+  PostProcessArenaVector<uint8_t> cand_valid;
+
+  void Clear() {
+    cand_xmin.clear();
+    cand_ymin.clear();
+    cand_xmax.clear();
+    cand_ymax.clear();
+    cand_score.clear();
+    cand_id.clear();
+  }
+};
+
+/**
+ * 每路视频流独立的后处理上下文，不同上下文之间互不共享数据，可以在多个线程中并行调用
+ * 所有缓存帧间复用，稳定运行后不再有堆分配
+ */
+struct Yolov8PostProcessContext {
+  explicit Yolov8PostProcessContext(int mode = NMS_MODE_HARD) : nms_mode(mode) {}
+
+  // 候选框、NMS结果及NMS临时内存
+  PostProcessDetectionArena<Detection> arena;
+  // Yolov8SetNmsMode 设置，默认上下文为 NMS_MODE_PROCESS_DEFAULT
+  int nms_mode;
+  // 当前层的解码缓存
+  Yolov8LayerBuffer layer_buf;
+};
+
+// 兼容旧接口使用的默认上下文，NMS方式跟随 PostProcessSetNmsMode
+static Yolov8PostProcessContext default_yolov8_context(NMS_MODE_PROCESS_DEFAULT);
+
+Yolov8PostProcessContext_t *Yolov8CreateContext(void) {
+  return new (std::nothrow) Yolov8PostProcessContext();
+}
+
+void Yolov8DestroyContext(Yolov8PostProcessContext_t *ctx) {
+  delete ctx;
+}
+
+int Yolov8SetNmsMode(Yolov8PostProcessContext_t *ctx, int nms_mode) {
+  if (ctx == nullptr || !IsValidNmsMode(nms_mode)) {
+    printf("yolov8 invalid context or nms mode %d!\n", nms_mode);
+    return -1;
+  }
+  ctx->nms_mode = nms_mode;
+  return 0;
+}
+
+static int Yolov8GetTensorInfo(hbDNNTensor *tensor, Yolov8TensorInfo *info) {
+  if (tensor->properties.tensorLayout != HB_DNN_LAYOUT_NHWC) {
+    printf("yolov8 post process only support NHWC output!\n");
+    return -1;
+  }
+  auto quanti_type = tensor->properties.quantiType;
+  if (quanti_type != hbDNNQuantiType::NONE && quanti_type != hbDNNQuantiType::SCALE) {
+    printf("yolov8 unsupport shift dequantzie now!\n");
+    return -1;
+  }
+
+  int *valid = tensor->properties.validShape.dimensionSize;
+  int *aligned = tensor->properties.alignedShape.dimensionSize;
+  info->height = valid[1];
+  info->width = valid[2];
+  info->channel = valid[3];
+  info->cell_stride = aligned[3];
+  info->row_stride = aligned[2] * aligned[3];
+  info->quanti = quanti_type == hbDNNQuantiType::SCALE;
+  return 0;
+}
+
+/**
+ * 把一层的候选框一次性还原到原图坐标、裁剪到图像范围内，有效的追加到 ctx->arena.dets
+ */
+static void Yolov8EmitDetections(Yolov8PostProcessContext *ctx,
+                                 Yolov8PostProcessInfo_t *post_info) {
+  Yolov8LayerBuffer &buf = ctx->layer_buf;
+  int num = buf.cand_score.size();
+  buf.cand_valid.resize(num);
+  PostProcessProjectBoxes(GetGeometry(post_info), buf.cand_xmin.data(), buf.cand_ymin.data(),
+                          buf.cand_xmax.data(), buf.cand_ymax.data(), num,
+                          buf.cand_valid.data());
+  for (int i = 0; i < num; i++) {
+    if (!buf.cand_valid[i]) {
+      continue;
+    }
+    int id = buf.cand_id[i];
+    Bbox bbox(buf.cand_xmin[i], buf.cand_ymin[i], buf.cand_xmax[i], buf.cand_ymax[i]);
+    ctx->arena.dets.push_back(Detection(id, buf.cand_score[i], bbox, Yolov8GetClassName(id)));
+  }
+  buf.Clear();
+}
+
+void Yolov8doProcessWithContext(Yolov8PostProcessContext_t *ctx,
+                                hbDNNTensor *cls_tensor,
+                                hbDNNTensor *bbox_tensor,
+                                Yolov8PostProcessInfo_t *post_info,
+                                int layer) {
+  if (ctx == nullptr) {
+    printf("yolov8 post process context is null!\n");
+    return;
+  }
+  if (layer < 0 || layer >= static_cast<int>(default_yolov8_config.strides.size())) {
+    printf("yolov8 post process invalid output layer %d!\n", layer);
+    return;
+  }
+
+  Yolov8TensorInfo cls_info, bbox_info;
+  if (Yolov8GetTensorInfo(cls_tensor, &cls_info) != 0 ||
+      Yolov8GetTensorInfo(bbox_tensor, &bbox_info) != 0) {
+    return;
+  }
+  int reg_max = post_info->reg_max;
+  if (reg_max <= 0 || bbox_info.channel != 4 * reg_max ||
+      cls_info.height != bbox_info.height || cls_info.width != bbox_info.width) {
+    printf("yolov8 post process output shape mismatch, bbox channel %d, reg_max %d!\n",
+           bbox_info.channel, reg_max);
+    return;
+  }
+
+  // 量化输出至少要有一个scale，只有一个时所有通道共用
+  if ((cls_info.quanti && (cls_tensor->properties.scale.scaleLen <= 0 ||
+                           cls_tensor->properties.scale.scaleData == nullptr)) ||
+      (bbox_info.quanti && (bbox_tensor->properties.scale.scaleLen <= 0 ||
+                            bbox_tensor->properties.scale.scaleData == nullptr))) {
+    printf("yolov8 post process quantized output without scale!\n");
+    return;
+  }
+
+  Yolov8LayerBuffer &buf = ctx->layer_buf;
+  int num_classes = cls_info.channel;
+  float stride = default_yolov8_config.strides[layer];
+
+  const float *cls_scale = nullptr;
+  if (cls_info.quanti) {
+    cls_scale = cls_tensor->properties.scale.scaleData;
+    if (cls_tensor->properties.scale.scaleLen < num_classes) {
+      buf.cls_scale.assign(num_classes, cls_scale[0]);
+      cls_scale = buf.cls_scale.data();
+    }
+  }
+  const float *bbox_scale = bbox_tensor->properties.scale.scaleData;
+  int bbox_scale_len = bbox_tensor->properties.scale.scaleLen;
+  if (bbox_info.quanti) {
+    buf.bins.resize(4 * reg_max);
+  }
+
+  // sigmoid单调，类别logit的最大值小于 logit(score_threshold) 的网格直接跳过，
+  // 只有通过的网格才做DFL解码和sigmoid
+  float cls_thresh = LogitThreshold(post_info->score_threshold);
+
+  auto *cls_data = reinterpret_cast<uint8_t *>(cls_tensor->sysMem[0].virAddr);
+  auto *bbox_data = reinterpret_cast<uint8_t *>(bbox_tensor->sysMem[0].virAddr);
+  for (int h = 0; h < cls_info.height; h++) {
+    for (int w = 0; w < cls_info.width; w++) {
+      size_t cls_offset = static_cast<size_t>(h) * cls_info.row_stride + w * cls_info.cell_stride;
+      float max_logit;
+      int id;
+      if (cls_info.quanti) {
+        id = ArgMaxDequanti(reinterpret_cast<int32_t *>(cls_data) + cls_offset, cls_scale,
+                            num_classes, &max_logit);
+      } else {
+        id = ArgMaxFloat(reinterpret_cast<float *>(cls_data) + cls_offset, num_classes,
+                         &max_logit);
+      }
+      if (max_logit < cls_thresh) {
+        continue;
+      }
+
+      size_t bbox_offset =
+          static_cast<size_t>(h) * bbox_info.row_stride + w * bbox_info.cell_stride;
+      const float *bins;
+      if (bbox_info.quanti) {
+        DequantiArray(reinterpret_cast<int32_t *>(bbox_data) + bbox_offset, bbox_scale,
+                      bbox_scale_len, buf.bins.data(), 4 * reg_max);
+        bins = buf.bins.data();
+      } else {
+        bins = reinterpret_cast<float *>(bbox_data) + bbox_offset;
+      }
+
+      // ltrb 为网格中心到4条边的距离
+      float ltrb[4];
+      DflDecode(bins, reg_max, ltrb);
+      float center_x = (w + 0.5f) * stride;
+      float center_y = (h + 0.5f) * stride;
+      buf.cand_xmin.push_back(center_x - ltrb[0] * stride);
+      buf.cand_ymin.push_back(center_y - ltrb[1] * stride);
+      buf.cand_xmax.push_back(center_x + ltrb[2] * stride);
+      buf.cand_ymax.push_back(center_y + ltrb[3] * stride);
+      buf.cand_score.push_back(FastSigmoid(max_logit));
+      buf.cand_id.push_back(id);
+    }
+  }
+  Yolov8EmitDetections(ctx, post_info);
+}
+
+void Yolov8doProcess(hbDNNTensor *cls_tensor,
+                     hbDNNTensor *bbox_tensor,
+                     Yolov8PostProcessInfo_t *post_info,
+                     int layer) {
+  Yolov8doProcessWithContext(&default_yolov8_context, cls_tensor, bbox_tensor, post_info, layer);
+}
+
+char* Yolov8PostProcessWithContext(Yolov8PostProcessContext_t *ctx,
+                                   Yolov8PostProcessInfo_t *post_info) {
+  if (ctx == nullptr) {
+    printf("yolov8 post process context is null!\n");
+    return nullptr;
+  }
+
+  PostProcessDetectionArena<Detection> &arena = ctx->arena;
+
+  // 计算交并比来合并检测框
+  PostProcessNms(arena.dets, GetNmsParam(post_info, ResolveNmsMode(ctx->nms_mode)), arena.results,
+                 &arena.nms_ws);
+
+  // 算法结果转换成json格式
+  PostProcessArenaVector<PostProcessDetection_t> &dets = arena.out;
+  dets.resize(arena.results.size());
+  int num = CopyDetectionResult(arena.results, dets.data(), dets.size());
+  arena.Clear();
+  return DetectionResultToJson("yolov8_result", dets.data(), num, Yolov8GetClassName);
+}
+
+int Yolov8PostProcessWithContextToArray(Yolov8PostProcessContext_t *ctx,
+                                        Yolov8PostProcessInfo_t *post_info,
+                                        PostProcessDetection_t *dets,
+                                        int capacity) {
+  if (ctx == nullptr) {
+    printf("yolov8 post process context is null!\n");
+    return -1;
+  }
+  if (dets == nullptr || capacity < 0) {
+    printf("yolov8 post process invalid output array!\n");
+    ctx->arena.Clear();
+    return -1;
+  }
+
+  PostProcessDetectionArena<Detection> &arena = ctx->arena;
+  PostProcessNms(arena.dets, GetNmsParam(post_info, ResolveNmsMode(ctx->nms_mode)), arena.results,
+                 &arena.nms_ws);
+  int num = CopyDetectionResult(arena.results, dets, capacity);
+  arena.Clear();
+  return num;
+}
+
+char* Yolov8PostProcess(Yolov8PostProcessInfo_t *post_info) {
+  return Yolov8PostProcessWithContext(&default_yolov8_context, post_info);
+}
+
+int Yolov8PostProcessToArray(Yolov8PostProcessInfo_t *post_info,
+                             PostProcessDetection_t *dets,
+                             int capacity) {
+  return Yolov8PostProcessWithContextToArray(&default_yolov8_context, post_info, dets, capacity);
+}
+
+const char *Yolov8GetClassName(int id) {
+  if (id < 0 || id >= static_cast<int>(default_yolov8_config.class_names.size())) {
+    return nullptr;
+  }
+  return default_yolov8_config.class_names[id].c_str();
+}
@@ -0,0 +1,112 @@
+// Copyright (c) 2024，D-Robotics.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _POST_PROCESS_YOLOV8_POST_PROCESS_H_
+#define _POST_PROCESS_YOLOV8_POST_PROCESS_H_
+
+#include "dnn/hb_dnn.h"
+#include "post_process_common.h"
+
+#ifdef __cplusplus
+  extern "C"{
+#endif
+
+typedef struct {
+	int height;
+	int width;
+	int ori_height;
+	int ori_width;
+	float score_threshold; // 0.25
+	float nms_threshold; // 0.7
+	int nms_top_k; // 300
+	int is_pad_resize;
+	int reg_max; // 16, DFL每条边的分箱数
+} Yolov8PostProcessInfo_t;
+
+  /**
+   * 后处理上下文，保存单路视频流的中间检测结果，不同上下文可以在不同线程中并行使用
+   * 同一个上下文同一时刻只能被一个线程使用
+   */
+  typedef struct Yolov8PostProcessContext Yolov8PostProcessContext_t;
+
+  /**
+   * 创建上下文，失败返回NULL
+   */
+  Yolov8PostProcessContext_t *Yolov8CreateContext(void);
+
+  void Yolov8DestroyContext(Yolov8PostProcessContext_t *ctx);
+
+  /**
+   * 设置 ctx 使用的NMS方式，新建的上下文默认 NMS_MODE_HARD，不受 PostProcessSetNmsMode 影响
+   * @param[in] nms_mode: PostProcessNmsMode_t
+   * @return 0 成功，ctx 为NULL或 nms_mode 不是 PostProcessNmsMode_t 中的值返回-1
+   */
+  int Yolov8SetNmsMode(Yolov8PostProcessContext_t *ctx, int nms_mode);
+
+  /**
+   * 检测框做NMS后格式化成json字符串
+   * @return malloc分配的字符串，需要调用者free
+   */
+  char* Yolov8PostProcess(Yolov8PostProcessInfo_t *post_info);
+
+  /**
+   * 解码一层输出，anchor-free，每个网格一个候选框
+   * 只支持NHWC布局，数据可以是float或者int32量化(SCALE)，量化输出的 scaleLen 为0时不解码
+   * 内部使用全局默认上下文，不能在多个线程中同时调用；多路并行时使用 Yolov8doProcessWithContext
+   * @param[in] cls_tensor: 类别输出，(1, H, W, class_num)，sigmoid之前的logit
+   * @param[in] bbox_tensor: 边框输出，(1, H, W, 4 * reg_max)，left/top/right/bottom 各 reg_max 个分箱
+   * @param[in] layer: 输出层，0/1/2 对应 stride 8/16/32
+   */
+  void Yolov8doProcess(hbDNNTensor *cls_tensor,
+                       hbDNNTensor *bbox_tensor,
+                       Yolov8PostProcessInfo_t *post_info,
+                       int layer);
+
+  /**
+   * 与 Yolov8doProcess/Yolov8PostProcess/Yolov8PostProcessToArray 相同，结果保存在 ctx 中而不是全局默认上下文
+   */
+  void Yolov8doProcessWithContext(Yolov8PostProcessContext_t *ctx,
+                                  hbDNNTensor *cls_tensor,
+                                  hbDNNTensor *bbox_tensor,
+                                  Yolov8PostProcessInfo_t *post_info,
+                                  int layer);
+
+  char* Yolov8PostProcessWithContext(Yolov8PostProcessContext_t *ctx,
+                                     Yolov8PostProcessInfo_t *post_info);
+
+  int Yolov8PostProcessWithContextToArray(Yolov8PostProcessContext_t *ctx,
+                                          Yolov8PostProcessInfo_t *post_info,
+                                          PostProcessDetection_t *dets,
+                                          int capacity);
+
+  /**
+   * 与 Yolov8PostProcess 相同，但结果直接写入 dets 数组，不生成json字符串
+   * @param[out] dets: 调用者分配的结果数组，按score从大到小排列
+   * @param[in] capacity: dets 数组的长度，结果超过 capacity 时只保留前 capacity 个
+   * @return 写入的结果个数，参数错误返回-1
+   */
+  int Yolov8PostProcessToArray(Yolov8PostProcessInfo_t *post_info,
+                               PostProcessDetection_t *dets,
+                               int capacity);
+
+  /**
+   * 根据 PostProcessDetection_t.id 获取类别名，越界返回NULL
+   */
+  const char *Yolov8GetClassName(int id);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // _POST_PROCESS_YOLOV8_POST_PROCESS_H_
@@ -24,6 +24,7 @@
  */
 
 #include <atomic>
+#include <cmath>
 #include <cstdbool>
 #include <fstream>
 #include <iostream>
@@ -70,57 +71,72 @@ std::map<int, std::string> TensorLayout = {{0, "NHWC"}, {2, "NCHW"}, {255, "NONE
 
 /**
  * C++ => Python
- * Convert buffer to numpy array
+ * 用 BPU 的 tensor 内存构造 numpy 数组，不拷贝数据
+ * 形状取 validShape，各维的 stride 由 alignedShape 计算，对齐填充的部分不可见
+ * 数组的 base 为 owner(Model 对象)，数组存在期间模型不会被释放；
+ * 数据在同一组tensor下一次推理时会被覆盖，需要保留结果时使用 Model.outputs_copy()
  * @param arr
  * @param properties
+ * @param owner: 持有这块内存的 Python 对象
  * @return PyArrayObject*
  */
-PyObject* buffer_2_numpy(void *arr, hbDNNTensorProperties &properties, int npy_type, int32_t type_size) {
-    hbDNNTensorShape buffer_shape = properties.validShape;
-    int size = 1;
-    for (int i = 0; i < 4; i++) {
-        size *= buffer_shape.dimensionSize[i];
+PyObject* buffer_2_numpy(void *arr, hbDNNTensorProperties &properties, int npy_type, int32_t type_size, PyObject *owner) {
+    hbDNNTensorShape &valid_shape = properties.validShape;
+    hbDNNTensorShape &aligned_shape = properties.alignedShape;
+    int nd = valid_shape.numDimensions;
+    if (nd <= 0 || nd > NPY_MAXDIMS) {
+        PyErr_SetString(PyExc_RuntimeError, "Invalid tensor dimensions.");
+        return NULL;
     }
 
-    // 创建 numpy 数组对象
-    npy_intp dims[4];
-    for (int i = 0; i < 4; ++i) {
-        dims[i] = buffer_shape.dimensionSize[i];
+    npy_intp dims[NPY_MAXDIMS];
+    npy_intp strides[NPY_MAXDIMS];
+    // alignedShape 维数不同时按 validShape 连续存放处理
+    hbDNNTensorShape &layout_shape = aligned_shape.numDimensions == nd ? aligned_shape : valid_shape;
+    npy_intp stride = type_size;
+    for (int i = nd - 1; i >= 0; --i) {
+        dims[i] = valid_shape.dimensionSize[i];
+        strides[i] = stride;
+        stride *= layout_shape.dimensionSize[i];
     }
-    PyObject *array = PyArray_SimpleNew(4, dims, npy_type);
+
+    PyObject *array = PyArray_New(&PyArray_Type, nd, dims, npy_type, strides, arr, 0,
+                                  NPY_ARRAY_ALIGNED | NPY_ARRAY_WRITEABLE, NULL);
     if (!array) {
         PyErr_SetString(PyExc_RuntimeError, "Failed to create numpy array.");
         return NULL;
     }
 
-    // 从缓冲区复制数据到 numpy 数组中
-    void *data_ptr = PyArray_DATA((PyArrayObject*)array);
-    memcpy(data_ptr, arr, size * type_size);
-
+    // PyArray_SetBaseObject 无论成功与否都会接管 owner 的引用
+    Py_INCREF(owner);
+    if (PyArray_SetBaseObject((PyArrayObject *)array, owner) < 0) {
+        Py_DECREF(array);
+        return NULL;
+    }
     return array;
 }
 
-PyObject* buffer_2_pyarray(void *arr, hbDNNTensorProperties &properties) {
+PyObject* buffer_2_pyarray(void *arr, hbDNNTensorProperties &properties, PyObject *owner) {
     hbDNNDataType dataType = static_cast<hbDNNDataType>(properties.tensorType);
 
     // 检查输入指针是否有效
-    if (!arr) {
+    if (!arr || !owner) {
         PyErr_SetString(PyExc_ValueError, "Input buffer is NULL");
         return NULL;
     }
 
     switch (dataType) {
         case HB_DNN_TENSOR_TYPE_S8:
-            return buffer_2_numpy(reinterpret_cast<int8_t *>(arr), properties, NPY_INT8, sizeof(int8_t));
+            return buffer_2_numpy(arr, properties, NPY_INT8, sizeof(int8_t), owner);
         case HB_DNN_TENSOR_TYPE_S16:
-            return buffer_2_numpy(reinterpret_cast<int16_t *>(arr), properties, NPY_INT16, sizeof(int16_t));
+            return buffer_2_numpy(arr, properties, NPY_INT16, sizeof(int16_t), owner);
         case HB_DNN_TENSOR_TYPE_S32:
-            return buffer_2_numpy(reinterpret_cast<int32_t *>(arr), properties, NPY_INT32, sizeof(int32_t));
+            return buffer_2_numpy(arr, properties, NPY_INT32, sizeof(int32_t), owner);
         case HB_DNN_TENSOR_TYPE_F32:
-            return buffer_2_numpy(reinterpret_cast<float *>(arr), properties, NPY_FLOAT, sizeof(float));
+            return buffer_2_numpy(arr, properties, NPY_FLOAT, sizeof(float), owner);
         default:
             // Do not support data type, using default int8 for output.
-            return buffer_2_numpy(reinterpret_cast<int8_t *>(arr), properties, NPY_INT8, sizeof(int8_t));
+            return buffer_2_numpy(arr, properties, NPY_INT8, sizeof(int8_t), owner);
     }
 }
 
@@ -408,10 +424,12 @@ static PyObject *PyDNNTensor_new(PyTypeObject *type, PyObject *args, PyObject *k
 {
     PyDNNTensor *self = (PyDNNTensor *)type->tp_alloc(type, 0);
     self->buffer = nullptr;
+    self->owner = nullptr;
     return (PyObject *)self;
 }
 
 static void PyDNNTensor_dealloc(PyDNNTensor* self) {
+    Py_XDECREF(self->owner);
     self->ob_base.ob_type->tp_free(self);
 }
 
@@ -480,8 +498,8 @@ static PyObject* PyDNNTensor_get_properties(PyDNNTensor *self, void *closure) {
 
 // 获取 buffer 成员属性的 getter 函数
 static PyObject* PyDNNTensor_get_buffer(PyDNNTensor *self, void *closure) {
-    // 将 self->buffer 转换为 Python 对象并返回
-    return buffer_2_pyarray(self->buffer, self->properties);
+    // 将 self->buffer 包装成 numpy 数组返回，不拷贝数据
+    return buffer_2_pyarray(self->buffer, self->properties, self->owner);
 }
 
 static int32_t GetInputName(hbDNNHandle_t dnn_handle, int32_t input_index,
@@ -562,6 +580,86 @@ static PyTypeObject PyDNNTensorType = {
     0,                                             /* tp_free */
 };
 
+enum DnnInferSlotState {
+    DNN_SLOT_IDLE = 0,   // 没有请求，或者请求失败
+    DNN_SLOT_RUNNING,    // 已提交，还没有被 wait 取回
+    DNN_SLOT_DONE,       // 已完成，输出有效，可以被新的请求复用
+};
+
+struct DnnInferSlot {
+    hbDNNTensor *inputs = nullptr;   // DNN_SYNC_SLOT 指向 m_inputs
+    hbDNNTensor *outputs = nullptr;  // DNN_SYNC_SLOT 指向 m_outputs
+    hbDNNTaskHandle_t task_handle = nullptr;
+    int32_t state = DNN_SLOT_IDLE;
+    uint32_t generation = 0;
+    // 同一个请求同时只能有一个线程等待，等待期间不持有 m_forward_mutex
+    std::mutex wait_mutex;
+};
+
+static void free_tensor_array(hbDNNTensor *tensors, int32_t count)
+{
+    if (tensors == nullptr) {
+        return;
+    }
+    for (int32_t i = 0; i < count; ++i) {
+        for (int32_t j = 0; j < 2; ++j) {
+            if (tensors[i].sysMem[j].virAddr != nullptr) {
+                hbSysFreeMem(&tensors[i].sysMem[j]);
+            }
+        }
+    }
+    free(tensors);
+}
+
+// 按 src 的属性和内存大小分配一组新的tensor，失败返回 nullptr
+static hbDNNTensor *clone_tensor_array(const hbDNNTensor *src, int32_t count)
+{
+    hbDNNTensor *tensors = (hbDNNTensor *)calloc(count, sizeof(hbDNNTensor));
+    if (tensors == nullptr) {
+        return nullptr;
+    }
+    for (int32_t i = 0; i < count; ++i) {
+        tensors[i].properties = src[i].properties;
+        // NV12_SEPARATE 的输入 Y/UV 分别在 sysMem[0]/sysMem[1]
+        for (int32_t j = 0; j < 2; ++j) {
+            if (src[i].sysMem[j].virAddr == nullptr) {
+                continue;
+            }
+            if (hbSysAllocCachedMem(&tensors[i].sysMem[j], src[i].sysMem[j].memSize) != 0) {
+                free_tensor_array(tensors, count);
+                return nullptr;
+            }
+        }
+    }
+    return tensors;
+}
+
+// 给 forward_async 取下一组tensor，1 ~ DNN_INFER_SLOT_NUM 组按顺序轮流使用，同步 forward 不占用这些组：
+// 一个请求完成后，它的输出在之后 DNN_INFER_SLOT_NUM - 1 次 forward_async 内不会被覆盖，
+// 流水线中取回结果后先提交下一帧、再处理结果也不会读到被覆盖的数据
+// 调用者持有 m_forward_mutex，提交成功后再把 m_next_slot 后移
+// @return slot 下标，该组的请求还没有被 wait 取回返回 -1，分配tensor失败返回 -2
+static int32_t acquire_infer_slot(Model_Object *model_obj)
+{
+    int32_t slot_index = model_obj->m_next_slot;
+    DnnInferSlot &slot = model_obj->m_slots[slot_index];
+    if (slot.state == DNN_SLOT_RUNNING) {
+        return -1;
+    }
+    if (slot.inputs == nullptr) {
+        slot.inputs = clone_tensor_array(model_obj->m_inputs, model_obj->m_input_count);
+        slot.outputs = clone_tensor_array(model_obj->m_outputs, model_obj->m_output_count);
+        if (slot.inputs == nullptr || slot.outputs == nullptr) {
+            free_tensor_array(slot.inputs, model_obj->m_input_count);
+            free_tensor_array(slot.outputs, model_obj->m_output_count);
+            slot.inputs = nullptr;
+            slot.outputs = nullptr;
+            return -2;
+        }
+    }
+    return slot_index;
+}
+
 // 释放模型张量资源
 static void release_model_tensor(Model_Object *model_obj)
 {
@@ -603,6 +701,11 @@ static PyObject *Model_new(PyTypeObject *type, PyObject *args, PyObject *kwargs)
         self->m_outputs = nullptr;
 
         self->m_estimate_latency = 0;
+        self->m_forward_mutex = new std::mutex();
+        self->m_sync_mutex = new std::mutex();
+        self->m_slots = new DnnInferSlot[DNN_INFER_SLOT_NUM + 1];
+        self->m_next_slot = 1;
+        self->m_last_slot = DNN_SYNC_SLOT;
     }
 
     return (PyObject *)self;
@@ -610,7 +713,16 @@ static PyObject *Model_new(PyTypeObject *type, PyObject *args, PyObject *kwargs)
 
 static void Model_dealloc(Model_Object *self)
 {
+    // 每个 InferTask 都持有模型的引用，走到这里时已经没有在运行的请求
+    // DNN_SYNC_SLOT 的tensor 由 release_model_tensor 释放
+    for (int32_t i = 1; i <= DNN_INFER_SLOT_NUM; ++i) {
+        free_tensor_array(self->m_slots[i].inputs, self->m_input_count);
+        free_tensor_array(self->m_slots[i].outputs, self->m_output_count);
+    }
+    delete[] self->m_slots;
     release_model_tensor(self);
+    delete self->m_forward_mutex;
+    delete self->m_sync_mutex;
     self->ob_base.ob_type->tp_free(self);
 }
 
@@ -652,6 +764,8 @@ static PyObject* model_get_tensor_inputs(Model_Object *self, void *closure) {
         }
         dnn_tensor->properties = self->m_inputs[i].properties;
         dnn_tensor->buffer = self->m_inputs[i].sysMem[0].virAddr;
+        dnn_tensor->owner = (PyObject *)self;
+        Py_INCREF(self);
         GetInputName(self->m_dnn_handle, i, dnn_tensor->name);
 
         // 将张量对象添加到列表中
@@ -662,8 +776,8 @@ static PyObject* model_get_tensor_inputs(Model_Object *self, void *closure) {
     return inputs_list;
 }
 
-static PyObject* model_get_tensor_outputs(Model_Object *self, void *closure) {
-    // 获取模型的输出张量列表，这里假设 outputs 是一个列表，存储了 PyDNNTensor 对象的引用
+static PyObject* model_get_slot_outputs(Model_Object *self, hbDNNTensor *outputs) {
+    // 获取一组输出张量的列表，存储了 PyDNNTensor 对象的引用
     PyObject *outputs_list = PyList_New(0);
     if (!outputs_list) {
         PyErr_SetString(PyExc_RuntimeError, "Failed to create outputs list.");
@@ -680,8 +794,10 @@ static PyObject* model_get_tensor_outputs(Model_Object *self, void *closure) {
         }
 
         // 初始化 PyDNNTensor 对象的属性
-        dnn_tensor->properties = self->m_outputs[i].properties;
-        dnn_tensor->buffer = self->m_outputs[i].sysMem[0].virAddr;
+        dnn_tensor->properties = outputs[i].properties;
+        dnn_tensor->buffer = outputs[i].sysMem[0].virAddr;
+        dnn_tensor->owner = (PyObject *)self;
+        Py_INCREF(self);
         GetOutputName(self->m_dnn_handle, i, dnn_tensor->name);
 
         // 将张量对象添加到列表中
@@ -697,13 +813,21 @@ static PyObject* model_get_tensor_outputs(Model_Object *self, void *closure) {
     return outputs_list;
 }
 
+static PyObject* model_get_tensor_outputs(Model_Object *self, void *closure) {
+    // 返回最近一次完成的推理的输出
+    return model_get_slot_outputs(self, self->m_slots[self->m_last_slot].outputs);
+}
+
 static PyObject* model_get_estimate_latency(Model_Object *self, void *closure) {
     // 将延迟时间转换为 Python 整数对象并返回
     return PyLong_FromLong(self->m_estimate_latency);
 }
 
-static int32_t forward(
+// 拷贝输入到 slot 的输入tensor并提交推理，不等待完成
+// 调用者持有 m_forward_mutex，成功后 slot 进入 DNN_SLOT_RUNNING
+static int32_t forward_submit(
     Model_Object *model_obj,
+    int32_t slot_index,
     const std::vector<unsigned char *> &data_ptrs,  // 多个输入数据指针
     const std::vector<int32_t> &data_sizes,        // 每个输入数据的大小
     int32_t core_id,
@@ -717,6 +841,7 @@ static int32_t forward(
 
     int32_t ret = 0;
     uint32_t input_count = model_obj->m_input_count;
+    DnnInferSlot &slot = model_obj->m_slots[slot_index];
 
     // 确保数据大小和输入数量匹配
     if (data_ptrs.size() > input_count) {
@@ -744,7 +869,7 @@ static int32_t forward(
             std::cerr << "Error: Input tensor index out of bounds! Index: " << idx << ", input_count: " << input_count << std::endl;
             return -1;
         }
-        hbDNNTensor *input_tensor = &model_obj->m_inputs[idx];
+        hbDNNTensor *input_tensor = &slot.inputs[idx];
         if (!input_tensor || !input_tensor->sysMem[0].virAddr) {
             std::cerr << "Error: Invalid input tensor or system memory for input " << idx << std::endl;
             return -1;
@@ -790,58 +915,259 @@ static int32_t forward(
     ctrl_param.bpuCoreId = core_id; // 设置核心 ID
     ctrl_param.priority = priority; // 设置优先级
 
-    hbDNNTensor *output = model_obj->m_outputs;
+    hbDNNTensor *output = slot.outputs;
 
     // 执行推理
-    ret = hbDNNInfer(&task_handle, &output, model_obj->m_inputs, model_obj->m_dnn_handle, &ctrl_param);
+    ret = hbDNNInfer(&task_handle, &output, slot.inputs, model_obj->m_dnn_handle, &ctrl_param);
     if (ret) {
         std::cerr << "hbDNNInfer failed" << std::endl;
         return -1;
     }
 
-    // 等待任务完成
-    ret = hbDNNWaitTaskDone(task_handle, 0);
+    slot.task_handle = task_handle;
+    slot.state = DNN_SLOT_RUNNING;
+    slot.generation++;
+    return 0;
+}
+
+// 等待 slot 上 generation 对应的请求完成，timeout_ms 为0时一直等待
+// 完成后刷新输出cache、释放任务句柄，slot 进入 DNN_SLOT_DONE
+// @return 0 成功，1 超时(请求仍在运行)，-1 推理失败，-2 slot 已被之后的请求复用
+static int32_t forward_collect(Model_Object *model_obj, int32_t slot_index, uint32_t generation, int32_t timeout_ms)
+{
+    DnnInferSlot &slot = model_obj->m_slots[slot_index];
+    std::lock_guard<std::mutex> wait_lock(slot.wait_mutex);
+
+    hbDNNTaskHandle_t task_handle = NULL;
+    {
+        std::lock_guard<std::mutex> lock(*model_obj->m_forward_mutex);
+        if (slot.generation != generation) {
+            return -2;
+        }
+        if (slot.state == DNN_SLOT_DONE) {
+            return 0;
+        }
+        if (slot.state != DNN_SLOT_RUNNING) {
+            return -1;
+        }
+        task_handle = slot.task_handle;
+    }
+
+    // 等待任务完成，slot 处于 RUNNING 时不会被复用，不需要持有 m_forward_mutex
+    // 只有超时表示请求仍在运行，其他错误都按推理失败处理，释放任务并让出 slot
+    int32_t ret = hbDNNWaitTaskDone(task_handle, timeout_ms);
+    if (ret == HB_DNN_TIMEOUT) {
+        return 1;
+    }
+
+    int32_t result = 0;
     if (ret) {
-        std::cerr << "hbDNNWaitTaskDone failed" << std::endl;
-        return -1;
+        std::cerr << "hbDNNWaitTaskDone failed, error code: " << ret << std::endl;
+        result = -1;
     }
 
     // 确保 CPU 从 DDR 中读取数据之后再使用输出张量数据
-    for (int32_t i = 0; i < model_obj->m_output_count; i++) {
-        if (!output[i].sysMem[0].virAddr) {
+    for (int32_t i = 0; result == 0 && i < model_obj->m_output_count; i++) {
+        if (!slot.outputs[i].sysMem[0].virAddr) {
             std::cerr << "Error: Output tensor system memory is invalid for index " << i << std::endl;
-            return -1;
+            result = -1;
+            break;
         }
-        hbSysFlushMem(&output[i].sysMem[0], HB_SYS_MEM_CACHE_INVALIDATE);
+        hbSysFlushMem(&slot.outputs[i].sysMem[0], HB_SYS_MEM_CACHE_INVALIDATE);
     }
 
     // 释放任务句柄
-    ret = hbDNNReleaseTask(task_handle);
-    if (ret) {
+    if (hbDNNReleaseTask(task_handle)) {
         std::cerr << "hbDNNReleaseTask failed" << std::endl;
-        return -1;
+        result = -1;
     }
-    task_handle = NULL;
-    return 0;
+
+    std::lock_guard<std::mutex> lock(*model_obj->m_forward_mutex);
+    slot.task_handle = NULL;
+    if (result == 0) {
+        slot.state = DNN_SLOT_DONE;
+        model_obj->m_last_slot = slot_index;
+    } else {
+        slot.state = DNN_SLOT_IDLE;
+    }
+    return result;
+}
+
+// forward_async 返回的请求句柄
+static PyObject *PyInferTask_new(PyTypeObject *type, PyObject *args, PyObject *kwds) {
+    PyInferTask *self = (PyInferTask *)type->tp_alloc(type, 0);
+    if (self != nullptr) {
+        self->model = nullptr;
+        self->slot = 0;
+        self->generation = 0;
+    }
+    return (PyObject *)self;
 }
 
+static void PyInferTask_dealloc(PyInferTask *self) {
+    if (self->model != nullptr) {
+        // 没有 wait 的请求在这里等它结束，否则它占用的 slot 不能再被使用
+        Py_BEGIN_ALLOW_THREADS
+        forward_collect(self->model, self->slot, self->generation, 0);
+        Py_END_ALLOW_THREADS
+        Py_DECREF(self->model);
+    }
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
 
+// 等待请求完成并返回输出列表，timeout_ms 为0时一直等待
+static PyObject *infer_task_wait(PyInferTask *self, int32_t timeout_ms) {
+    int32_t result = 0;
+    Py_BEGIN_ALLOW_THREADS
+    result = forward_collect(self->model, self->slot, self->generation, timeout_ms);
+    Py_END_ALLOW_THREADS
 
-static PyObject *Model_forward(Model_Object *self, PyObject *args, PyObject *kwargs) {
-    PyObject *arg_obj = NULL;
+    if (result == 1) {
+        PyErr_SetString(PyExc_TimeoutError, "Inference is not finished.");
+        return NULL;
+    }
+    if (result == -2) {
+        PyErr_SetString(PyExc_RuntimeError, "Outputs were overwritten by a later forward_async.");
+        return NULL;
+    }
+    if (result != 0) {
+        PyErr_SetString(PyExc_RuntimeError, "forward execution failed.");
+        return NULL;
+    }
+    return model_get_slot_outputs(self->model, self->model->m_slots[self->slot].outputs);
+}
+
+// wait(timeout=None)，timeout 单位为秒，None 表示一直等待，超时抛出 TimeoutError
+static PyObject *PyInferTask_wait(PyInferTask *self, PyObject *args, PyObject *kwargs) {
+    PyObject *timeout_obj = Py_None;
+    static const char *keywords[] = {"timeout", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|O", const_cast<char **>(keywords), &timeout_obj)) {
+        return NULL;
+    }
+
+    int32_t timeout_ms = 0;
+    if (timeout_obj != Py_None) {
+        double timeout = PyFloat_AsDouble(timeout_obj);
+        if (timeout == -1.0 && PyErr_Occurred()) {
+            return NULL;
+        }
+        // hbDNNWaitTaskDone 的超时为0表示一直等待，最短按1ms等待
+        timeout_ms = std::max(1, static_cast<int32_t>(std::ceil(timeout * 1000)));
+    }
+    return infer_task_wait(self, timeout_ms);
+}
+
+static PyObject *PyInferTask_done(PyInferTask *self, PyObject *Py_UNUSED(args)) {
+    // m_forward_mutex 只在释放GIL后获取，持有GIL等锁会和释放GIL拷贝输入的 forward_async 互相等待
+    int32_t result = 0;
+    Py_BEGIN_ALLOW_THREADS
+    bool running = false;
+    {
+        std::lock_guard<std::mutex> lock(*self->model->m_forward_mutex);
+        DnnInferSlot &slot = self->model->m_slots[self->slot];
+        running = slot.generation == self->generation && slot.state == DNN_SLOT_RUNNING;
+    }
+    // 与 hb_bpu_try_poll 相同，用1ms的等待查询，完成时顺便取回结果
+    if (running) {
+        result = forward_collect(self->model, self->slot, self->generation, 1);
+    }
+    Py_END_ALLOW_THREADS
+    return PyBool_FromLong(result != 1);
+}
+
+static PyObject *infer_task_get_outputs(PyInferTask *self, void *closure) {
+    return infer_task_wait(self, 0);
+}
+
+static PyGetSetDef PyInferTaskGetSet[] = {
+    {"outputs", (getter)infer_task_get_outputs, NULL, "Output tensors, block until the inference finished", NULL},
+    {NULL} /* Sentinel */
+};
+
+static struct PyMethodDef PyInferTask_Methods[] = {
+    {"done", (PyCFunction)PyInferTask_done, METH_NOARGS, "Whether the inference finished"},
+    {"wait", (PyCFunction)PyInferTask_wait, METH_VARARGS | METH_KEYWORDS, "Wait for the inference and return output tensors"},
+    {NULL, NULL, 0, NULL},
+};
+
+static PyTypeObject PyInferTaskType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    "dnnpy.InferTask",                          /* tp_name */
+    sizeof(PyInferTask),                           /* tp_basicsize */
+    0,                                             /* tp_itemsize */
+    (destructor)PyInferTask_dealloc,               /* tp_dealloc */
+    0,                                             /* tp_print */
+    0,                                             /* tp_getattr */
+    0,                                             /* tp_setattr */
+    0,                                             /* tp_reserved */
+    0,                                             /* tp_repr */
+    0,                                             /* tp_as_number */
+    0,                                             /* tp_as_sequence */
+    0,                                             /* tp_as_mapping */
+    0,                                             /* tp_hash */
+    0,                                             /* tp_call */
+    0,                                             /* tp_str */
+    0,                                             /* tp_getattro */
+    0,                                             /* tp_setattro */
+    0,                                             /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT,                            /* tp_flags */
+    "InferTask object",                            /* tp_doc */
+    0,                                             /* tp_traverse */
+    0,                                             /* tp_clear */
+    0,                                             /* tp_richcompare */
+    0,                                             /* tp_weaklistoffset */
+    0,                                             /* tp_iter */
+    0,                                             /* tp_iternext */
+    PyInferTask_Methods,                           /* tp_methods */
+    0,                                             /* tp_members */
+    PyInferTaskGetSet,                             /* tp_getset */
+    0,                                             /* tp_base */
+    0,                                             /* tp_dict */
+    0,                                             /* tp_descr_get */
+    0,                                             /* tp_descr_set */
+    0,                                             /* tp_dictoffset */
+    0,                                             /* tp_init */
+    0,                                             /* tp_alloc */
+    0,                                             /* tp_new, 只能由 forward_async 创建 */
+    0,                                             /* tp_free */
+};
+
+// forward/forward_async 的参数
+struct ForwardArgs {
+    std::vector<unsigned char *> data_ptrs;  // 用于存储数据指针
+    std::vector<int32_t> data_sizes;         // 用于存储数据大小
+    // 类型转换得到的数组，输入拷贝完成前保持引用，保证 data_ptrs 在释放GIL期间有效
+    std::vector<PyObject *> arrays;
     int core_id = 0;
     int priority = 0;
+};
+
+// 输入拷贝完成后释放 ForwardArgs 持有的数组，需要持有GIL
+static void release_forward_args(ForwardArgs *forward_args) {
+    for (PyObject *array : forward_args->arrays) {
+        Py_DECREF(array);
+    }
+    forward_args->arrays.clear();
+}
+
+// 解析 forward/forward_async 的参数，失败时设置Python异常并返回-1
+static int32_t parse_forward_args(PyObject *args, PyObject *kwargs, ForwardArgs *forward_args) {
+    PyObject *arg_obj = NULL;
+    int &core_id = forward_args->core_id;
+    int &priority = forward_args->priority;
+    std::vector<unsigned char *> &data_ptrs = forward_args->data_ptrs;
+    std::vector<int32_t> &data_sizes = forward_args->data_sizes;
 
     // 定义参数的关键字
     static const char *keywords[] = {"arg", "core_id", "priority", NULL};
 
     // 初始化 NumPy API
-    import_array();
+    import_array1(-1);
 
     // 解析参数
     if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|ii", const_cast<char **>(keywords), &arg_obj, &core_id, &priority)) {
         PyErr_SetString(PyExc_TypeError, "Failed to parse arguments.");
-        Py_RETURN_NONE;
+        return -1;
     }
 
     // // 打印参数类型（调试用）
@@ -849,9 +1175,6 @@ static PyObject *Model_forward(Model_Object *self, PyObject *args, PyObject *kwa
     // PySys_WriteStdout("Type of arg_obj: %s\n", arg_obj->ob_type->tp_name);
     // PySys_WriteStdout("arg_obj type: %s\n", Py_TYPE(arg_obj)->tp_name);
 
-    std::vector<unsigned char *> data_ptrs;  // 用于存储数据指针
-    std::vector<int32_t> data_sizes;         // 用于存储数据大小
-
     // 检查 arg_obj 是否是 NumPy 数组
     if (PyArray_Check(arg_obj)) {
         // 如果 arg_obj 已经是 NumPy 数组，直接处理
@@ -882,14 +1205,14 @@ static PyObject *Model_forward(Model_Object *self, PyObject *args, PyObject *kwa
 
             if (!PyArray_Check(item)) {
                 PyErr_SetString(PyExc_TypeError, "Each element in arg_obj must be a NumPy array.");
-                Py_RETURN_NONE;
+                return -1;
             }
 
             // 如果是 NumPy 数组，转换并获取数据指针和大小
             PyArrayObject *arg_array = (PyArrayObject *)PyArray_FROM_OTF(item, NPY_UBYTE, NPY_ARRAY_ENSUREARRAY | NPY_ARRAY_FORCECAST);
             if (!arg_array) {
                 PyErr_SetString(PyExc_TypeError, "Failed to convert item to NumPy array.");
-                Py_RETURN_NONE;
+                return -1;
             }
 
             unsigned char *arg_data_ptr = (unsigned char *)PyArray_DATA(arg_array);
@@ -903,24 +1226,180 @@ static PyObject *Model_forward(Model_Object *self, PyObject *args, PyObject *kwa
             data_ptrs.push_back(arg_data_ptr);
             data_sizes.push_back(numpy_size);
 
-            // 释放引用，避免内存泄漏
-            Py_DECREF(arg_array);
+            // 转换时可能生成了新数组，推理完成后再释放引用
+            forward_args->arrays.push_back((PyObject *)arg_array);
         }
     } else {
         PySys_WriteStdout("arg_obj is NOT a container.\n");
     }
 
-    // 调用 forward 函数，并传递处理后的参数
-    int32_t result = forward(self, data_ptrs, data_sizes, core_id, priority);
+    return 0;
+}
+
+// 提交一次推理，返回 InferTask；输入数据在返回前已经拷贝，返回后可以修改
+// 各请求按顺序轮流使用 DNN_INFER_SLOT_NUM 组tensor，最多同时有 DNN_INFER_SLOT_NUM 个没有 wait 的请求；
+// 请求的输出在之后 DNN_INFER_SLOT_NUM - 1 次 forward_async 内保持有效，forward 不影响这些输出
+static PyObject *Model_forward_async(Model_Object *self, PyObject *args, PyObject *kwargs) {
+    if (!self->m_slots[DNN_SYNC_SLOT].inputs) {
+        PyErr_SetString(PyExc_RuntimeError, "Model is not loaded.");
+        return NULL;
+    }
+
+    ForwardArgs forward_args;
+    if (parse_forward_args(args, kwargs, &forward_args) != 0) {
+        release_forward_args(&forward_args);
+        return NULL;
+    }
+
+    PyInferTask *task = (PyInferTask *)PyInferTask_new(&PyInferTaskType, NULL, NULL);
+    if (task == NULL) {
+        release_forward_args(&forward_args);
+        return NULL;
+    }
+
+    // 输入拷贝和提交期间不访问Python对象，释放GIL让其他Python线程(取图、显示等)继续运行
+    int32_t slot_index = -1;
+    int32_t result = 0;
+    Py_BEGIN_ALLOW_THREADS
+    {
+        std::lock_guard<std::mutex> lock(*self->m_forward_mutex);
+        slot_index = acquire_infer_slot(self);
+        if (slot_index >= 0) {
+            result = forward_submit(self, slot_index, forward_args.data_ptrs, forward_args.data_sizes,
+                                    forward_args.core_id, forward_args.priority);
+            task->slot = slot_index;
+            task->generation = self->m_slots[slot_index].generation;
+            if (result == 0) {
+                self->m_next_slot = slot_index % DNN_INFER_SLOT_NUM + 1;
+            }
+        }
+    }
+    Py_END_ALLOW_THREADS
+    release_forward_args(&forward_args);
 
-    // 处理 forward 的返回值
+    if (slot_index == -1) {
+        PyErr_SetString(PyExc_RuntimeError,
+                        "Too many inferences in flight, wait the forward_async submitted DNN_INFER_SLOT_NUM calls ago first.");
+        Py_DECREF(task);
+        return NULL;
+    }
+    if (slot_index < 0) {
+        PyErr_SetString(PyExc_MemoryError, "Failed to allocate tensors for forward_async.");
+        Py_DECREF(task);
+        return NULL;
+    }
     if (result != 0) {
         PyErr_SetString(PyExc_RuntimeError, "forward execution failed.");
-        Py_RETURN_NONE;
+        Py_DECREF(task);
+        return NULL;
     }
 
-    // 返回 forward 函数执行成功的情况
-    return model_get_tensor_outputs(self, NULL);
+    task->model = self;
+    Py_INCREF(self);
+    return (PyObject *)task;
+}
+
+// 同步推理，使用单独的 DNN_SYNC_SLOT 组tensor(模型加载时分配的那组)，只用 forward 时不会分配 forward_async 的tensor
+// 返回的输出直接引用这组tensor，下一次 forward 时被覆盖，需要保留时使用 outputs_copy
+static PyObject *Model_forward(Model_Object *self, PyObject *args, PyObject *kwargs) {
+    if (!self->m_slots[DNN_SYNC_SLOT].inputs) {
+        PyErr_SetString(PyExc_RuntimeError, "Model is not loaded.");
+        return NULL;
+    }
+
+    ForwardArgs forward_args;
+    if (parse_forward_args(args, kwargs, &forward_args) != 0) {
+        release_forward_args(&forward_args);
+        return NULL;
+    }
+
+    // 提交和等待都不持有GIL；m_sync_mutex 只在释放GIL后获取，持有期间也不重新获取GIL
+    int32_t result = 0;
+    Py_BEGIN_ALLOW_THREADS
+    {
+        std::lock_guard<std::mutex> sync_lock(*self->m_sync_mutex);
+        uint32_t generation = 0;
+        {
+            std::lock_guard<std::mutex> lock(*self->m_forward_mutex);
+            result = forward_submit(self, DNN_SYNC_SLOT, forward_args.data_ptrs, forward_args.data_sizes,
+                                    forward_args.core_id, forward_args.priority);
+            generation = self->m_slots[DNN_SYNC_SLOT].generation;
+        }
+        if (result == 0) {
+            result = forward_collect(self, DNN_SYNC_SLOT, generation, 0);
+        }
+    }
+    Py_END_ALLOW_THREADS
+    release_forward_args(&forward_args);
+
+    if (result != 0) {
+        PyErr_SetString(PyExc_RuntimeError, "forward execution failed.");
+        return NULL;
+    }
+    return model_get_slot_outputs(self, self->m_slots[DNN_SYNC_SLOT].outputs);
+}
+
+// 拷贝当前的输出张量数据，返回各自拥有内存的 numpy 数组列表，不会被之后的推理覆盖
+static PyObject *Model_outputs_copy(Model_Object *self, PyObject *Py_UNUSED(args)) {
+    if (!self->m_outputs) {
+        PyErr_SetString(PyExc_RuntimeError, "Model outputs are not initialized.");
+        return NULL;
+    }
+
+    // 持有GIL时先分配暂存数组，再释放GIL、持有 m_forward_mutex 拷贝最近一次完成的推理的输出；
+    // 持有 m_forward_mutex 时不能重新获取GIL，否则会和持有GIL等锁的线程互相等待
+    std::vector<PyObject *> raws(self->m_output_count, nullptr);
+    std::vector<void *> raw_data(self->m_output_count, nullptr);
+    auto release_raws = [&raws]() {
+        for (PyObject *raw : raws) {
+            Py_XDECREF(raw);
+        }
+    };
+    for (int i = 0; i < self->m_output_count; i++) {
+        npy_intp size = self->m_outputs[i].sysMem[0].memSize;
+        raws[i] = PyArray_SimpleNew(1, &size, NPY_UINT8);
+        if (!raws[i]) {
+            release_raws();
+            return NULL;
+        }
+        raw_data[i] = PyArray_DATA((PyArrayObject *)raws[i]);
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    {
+        std::lock_guard<std::mutex> lock(*self->m_forward_mutex);
+        hbDNNTensor *outputs = self->m_slots[self->m_last_slot].outputs;
+        for (int i = 0; i < self->m_output_count; i++) {
+            memcpy(raw_data[i], outputs[i].sysMem[0].virAddr, outputs[i].sysMem[0].memSize);
+        }
+    }
+    Py_END_ALLOW_THREADS
+
+    // 按输出tensor的属性去掉对齐填充，得到连续的数组
+    PyObject *outputs_list = PyList_New(self->m_output_count);
+    if (!outputs_list) {
+        PyErr_SetString(PyExc_RuntimeError, "Failed to create outputs list.");
+        release_raws();
+        return NULL;
+    }
+    for (int i = 0; i < self->m_output_count; i++) {
+        PyObject *view = buffer_2_pyarray(raw_data[i], self->m_outputs[i].properties, raws[i]);
+        if (!view) {
+            Py_DECREF(outputs_list);
+            release_raws();
+            return NULL;
+        }
+        PyObject *copy = PyArray_NewCopy((PyArrayObject *)view, NPY_CORDER);
+        Py_DECREF(view);
+        if (!copy) {
+            Py_DECREF(outputs_list);
+            release_raws();
+            return NULL;
+        }
+        PyList_SET_ITEM(outputs_list, i, copy);  // 引用计数管理交给 outputs_list
+    }
+    release_raws();
+    return outputs_list;
 }
 
 // PyGetSetDef 定义成员属性，使用 getter 函数获取属性值
@@ -934,6 +1413,8 @@ static PyGetSetDef ModelGetSet[] = {
 
 static struct PyMethodDef Model_Methods[] = {
     {"forward", (PyCFunction)Model_forward, METH_VARARGS | METH_KEYWORDS, "Run Model"},
+    {"forward_async", (PyCFunction)Model_forward_async, METH_VARARGS | METH_KEYWORDS, "Submit Model inference, return an InferTask"},
+    {"outputs_copy", (PyCFunction)Model_outputs_copy, METH_NOARGS, "Copy output tensors into owned numpy arrays"},
     {NULL, NULL, 0, NULL},
 };
 
@@ -1115,6 +1596,8 @@ Model_Object* create_and_load_model(PyObject *self , const char* model_file) {
         Py_DECREF(model);
         return NULL;
     }
+    model->m_slots[DNN_SYNC_SLOT].inputs = model->m_inputs;
+    model->m_slots[DNN_SYNC_SLOT].outputs = model->m_outputs;
 
     return model;
 }
@@ -1213,6 +1696,7 @@ static PyObject* init_module(PyObject* m) {
     ModelType.ob_base = ob_base;
     PyDNNTensorType.ob_base = ob_base;
     TensorPropertiesType.ob_base = ob_base;
+    PyInferTaskType.ob_base = ob_base;
 
     if (PyType_Ready(&ModelType) < 0) {
         Py_INCREF(&ModelType);
@@ -1231,7 +1715,13 @@ static PyObject* init_module(PyObject* m) {
 
     PyModule_AddObject(m, "Model", (PyObject*)&ModelType);
     PyModule_AddObject(m, "pyDNNTensor", (PyObject*)&PyDNNTensorType);
+    if (PyType_Ready(&PyInferTaskType) < 0) {
+        Py_INCREF(&PyInferTaskType);
+        return NULL;
+    }
+
     PyModule_AddObject(m, "TensorProperties", (PyObject*)&TensorPropertiesType);
+    PyModule_AddObject(m, "InferTask", (PyObject*)&PyInferTaskType);
 
     return m;
 }
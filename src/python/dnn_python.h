@@ -19,6 +19,7 @@
 
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -81,8 +82,17 @@ typedef struct {
     hbDNNTensorProperties properties;
     void *buffer;
     char name[64];           // 名称
+    PyObject *owner;         // buffer 所属的 Model 对象，buffer 返回的numpy数组直接引用这块内存
 } PyDNNTensor;
 
+// 每个模型最多同时在推理的 forward_async 请求数，每个请求占用一组输入/输出tensor
+#define DNN_INFER_SLOT_NUM 4
+// 同步 forward 单独使用的一组tensor的下标，forward_async 使用 1 ~ DNN_INFER_SLOT_NUM
+#define DNN_SYNC_SLOT 0
+
+// forward_async 使用的一组输入/输出tensor，定义见 dnn_python.cpp
+struct DnnInferSlot;
+
 typedef struct {
     PyObject_HEAD;
     char name[128];
@@ -93,8 +103,27 @@ typedef struct {
     int32_t m_output_count;
     hbDNNTensor *m_outputs;
     int32_t m_estimate_latency;
+    // 释放GIL推理时，同一个模型的输入/输出tensor和 m_slots 的状态由该锁保护
+    std::mutex *m_forward_mutex;
+    // 多个线程同时调用 forward 时依次使用 DNN_SYNC_SLOT 组tensor
+    std::mutex *m_sync_mutex;
+    // DNN_INFER_SLOT_NUM + 1 组tensor，第 DNN_SYNC_SLOT 组就是 m_inputs/m_outputs，
+    // 其余给 forward_async 使用，第一次调用 forward_async 用到时才分配
+    DnnInferSlot *m_slots;
+    // 下一个 forward_async 请求使用的组，在 1 ~ DNN_INFER_SLOT_NUM 中按顺序轮流使用
+    int32_t m_next_slot;
+    // 最近一次完成的请求所在的组，outputs 返回这一组的输出
+    int32_t m_last_slot;
 } Model_Object;
 
+// forward_async 返回的请求句柄
+typedef struct {
+    PyObject_HEAD;
+    Model_Object *model;     // 持有模型的引用
+    int32_t slot;            // 使用的 m_slots 下标
+    uint32_t generation;     // 提交时 slot 的编号，slot 被之后的请求复用后句柄失效
+} PyInferTask;
+
 #ifdef __cplusplus
 }
 #endif /* extern "C" */
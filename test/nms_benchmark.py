@@ -0,0 +1,102 @@
+# Copyright (c) 2024，D-Robotics.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# 比较 libpostprocess.so 中几种NMS方式(hard / soft_gaussian / matrix / hard_int16)的耗时
+# 用法: python3 nms_benchmark.py [--lib /usr/lib/libpostprocess.so] [--boxes 4000]
+
+import argparse
+import ctypes
+import time
+
+import numpy as np
+
+NMS_MODES = {
+    "hard": 0,
+    "soft_gaussian": 1,
+    "matrix": 2,
+    "hard_int16": 3,
+}
+
+# 与 post_process_common.h 中的 PostProcessDetection_t 一致
+DETECTION_DTYPE = np.dtype([
+    ("xmin", np.float32),
+    ("ymin", np.float32),
+    ("xmax", np.float32),
+    ("ymax", np.float32),
+    ("score", np.float32),
+    ("id", np.int32),
+])
+
+def make_crowded_boxes(num, num_classes, width=1920, height=1080, seed=0):
+    # 模拟拥挤场景：候选框围绕少量目标聚集，相互之间IoU较大
+    rng = np.random.default_rng(seed)
+    num_objects = max(1, num // 40)
+    centers = rng.uniform([0, 0], [width, height], size=(num_objects, 2))
+    sizes = rng.uniform(20, 200, size=(num_objects, 2))
+    obj = rng.integers(0, num_objects, size=num)
+
+    dets = np.zeros(num, dtype=DETECTION_DTYPE)
+    wh = sizes[obj] * rng.uniform(0.8, 1.2, size=(num, 2))
+    xy = centers[obj] + rng.normal(0, 0.1, size=(num, 2)) * sizes[obj]
+    dets["xmin"] = xy[:, 0] - wh[:, 0] / 2
+    dets["ymin"] = xy[:, 1] - wh[:, 1] / 2
+    dets["xmax"] = xy[:, 0] + wh[:, 0] / 2
+    dets["ymax"] = xy[:, 1] + wh[:, 1] / 2
+    dets["score"] = rng.uniform(0.25, 1.0, size=num)
+    dets["id"] = obj % num_classes
+    return dets
+
+def run_nms(lib, dets, mode, iou_threshold, score_threshold, top_k):
+    out = np.zeros(top_k, dtype=DETECTION_DTYPE)
+    num = lib.PostProcessNmsDetections(
+        dets.ctypes.data_as(ctypes.c_void_p), len(dets), mode,
+        ctypes.c_float(iou_threshold), ctypes.c_float(score_threshold), top_k,
+        out.ctypes.data_as(ctypes.c_void_p), top_k)
+    return out[:max(num, 0)]
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--lib", default="/usr/lib/libpostprocess.so")
+    parser.add_argument("--boxes", type=int, nargs="+", default=[500, 2000, 5000])
+    parser.add_argument("--classes", type=int, default=3)
+    parser.add_argument("--iou-threshold", type=float, default=0.45)
+    parser.add_argument("--score-threshold", type=float, default=0.25)
+    parser.add_argument("--top-k", type=int, default=300)
+    parser.add_argument("--repeat", type=int, default=20)
+    args = parser.parse_args()
+
+    lib = ctypes.CDLL(args.lib)
+    lib.PostProcessNmsDetections.restype = ctypes.c_int
+    lib.PostProcessArenaAllocCount.restype = ctypes.c_uint64
+
+    print("%8s %15s %10s %8s" % ("boxes", "mode", "ms", "kept"))
+    for num in args.boxes:
+        dets = make_crowded_boxes(num, args.classes)
+        for name, mode in NMS_MODES.items():
+            # 预热一次，让内部临时内存分配完成
+            kept = run_nms(lib, dets, mode, args.iou_threshold,
+                           args.score_threshold, args.top_k)
+            alloc_count = lib.PostProcessArenaAllocCount()
+            start = time.perf_counter()
+            for _ in range(args.repeat):
+                run_nms(lib, dets, mode, args.iou_threshold,
+                        args.score_threshold, args.top_k)
+            cost = (time.perf_counter() - start) * 1000 / args.repeat
+            # 输入个数不变时稳定运行不应再有堆分配
+            assert lib.PostProcessArenaAllocCount() == alloc_count, \
+                "nms allocated memory after warm up"
+            print("%8d %15s %10.3f %8d" % (num, name, cost, len(kept)))
+
+if __name__ == "__main__":
+    main()
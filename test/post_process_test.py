@@ -0,0 +1,444 @@
+# Copyright (c) 2024，D-Robotics.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# libpostprocess.so 的功能检查，不需要模型和BPU：
+#   1. Yolov5/FCOS/SSD/EfficientDet 用构造的float输出走完整的 ToArray 流程，预热后再次运行不应有堆分配
+#   2. 分类后处理默认直接使用模型输出，ClassificationSetApplySoftmax 打开后先做softmax
+#   3. 各NMS方式在结果应当一致的输入上与 NMS_MODE_HARD 的结果相同
+#   4. Yolov5 上下文的NMS方式与 PostProcessSetNmsMode 设置的进程默认值互不影响
+#   5. Yolov8 上下文与默认上下文的结果相同，没有scale的量化输出不解码
+# 用法: python3 post_process_test.py [--lib /usr/lib/libpostprocess.so]
+
+import argparse
+import ctypes
+
+import numpy as np
+
+from nms_benchmark import DETECTION_DTYPE, NMS_MODES, make_crowded_boxes, run_nms
+
+# 与 dnn/hb_dnn.h 中的定义一致
+HB_DNN_LAYOUT_NHWC = 0
+HB_DNN_TENSOR_TYPE_F32 = 13
+HB_DNN_TENSOR_TYPE_S32 = 14
+QUANTI_TYPE_NONE = 0
+QUANTI_TYPE_SCALE = 2
+
+class hbSysMem(ctypes.Structure):
+    _fields_ = [
+        ("phyAddr", ctypes.c_uint64),
+        ("virAddr", ctypes.c_void_p),
+        ("memSize", ctypes.c_uint32),
+    ]
+
+class hbDNNTensorShape(ctypes.Structure):
+    _fields_ = [
+        ("dimensionSize", ctypes.c_int32 * 8),
+        ("numDimensions", ctypes.c_int32),
+    ]
+
+class hbDNNQuantiShift(ctypes.Structure):
+    _fields_ = [
+        ("shiftLen", ctypes.c_int32),
+        ("shiftData", ctypes.c_void_p),
+    ]
+
+class hbDNNQuantiScale(ctypes.Structure):
+    _fields_ = [
+        ("scaleLen", ctypes.c_int32),
+        ("scaleData", ctypes.c_void_p),
+        ("zeroPointLen", ctypes.c_int32),
+        ("zeroPointData", ctypes.c_void_p),
+    ]
+
+class hbDNNTensorProperties(ctypes.Structure):
+    _fields_ = [
+        ("validShape", hbDNNTensorShape),
+        ("alignedShape", hbDNNTensorShape),
+        ("tensorLayout", ctypes.c_int32),
+        ("tensorType", ctypes.c_int32),
+        ("shift", hbDNNQuantiShift),
+        ("scale", hbDNNQuantiScale),
+        ("quantiType", ctypes.c_int32),
+        ("quantizeAxis", ctypes.c_int32),
+        ("alignedByteSize", ctypes.c_int32),
+        ("stride", ctypes.c_int32 * 8),
+    ]
+
+class hbDNNTensor(ctypes.Structure):
+    _fields_ = [
+        ("sysMem", hbSysMem * 4),
+        ("properties", hbDNNTensorProperties),
+    ]
+
+# Yolov5PostProcessInfo_t、FcosPostProcessInfo_t 和 ClassificationPostProcessInfo_t 的布局相同
+class DetectPostProcessInfo(ctypes.Structure):
+    _fields_ = [
+        ("height", ctypes.c_int),
+        ("width", ctypes.c_int),
+        ("ori_height", ctypes.c_int),
+        ("ori_width", ctypes.c_int),
+        ("score_threshold", ctypes.c_float),
+        ("nms_threshold", ctypes.c_float),
+        ("nms_top_k", ctypes.c_int),
+        ("is_pad_resize", ctypes.c_int),
+    ]
+
+class Yolov8PostProcessInfo(ctypes.Structure):
+    _fields_ = DetectPostProcessInfo._fields_ + [("reg_max", ctypes.c_int)]
+
+def make_tensors(arrays):
+    # 用 NHWC 排布的float数组构造不量化的输出tensor，数组需要在tensor使用期间保持存活
+    tensors = (hbDNNTensor * len(arrays))()
+    for tensor, array in zip(tensors, arrays):
+        tensor.sysMem[0].virAddr = array.ctypes.data
+        tensor.sysMem[0].memSize = array.nbytes
+        props = tensor.properties
+        for shape in (props.validShape, props.alignedShape):
+            shape.numDimensions = array.ndim
+            for i, dim in enumerate(array.shape):
+                shape.dimensionSize[i] = dim
+        props.tensorLayout = HB_DNN_LAYOUT_NHWC
+        props.tensorType = HB_DNN_TENSOR_TYPE_F32
+        props.quantiType = QUANTI_TYPE_NONE
+        props.alignedByteSize = array.nbytes
+    return tensors
+
+def make_info(height, width):
+    return DetectPostProcessInfo(height, width, height, width, 0.3, 0.45, 100, 0)
+
+def check_steady_state(lib, name, run_once, repeat=3):
+    # 第一次运行完成内部内存的分配，之后同样的输入不应再向系统申请内存
+    first = run_once()
+    alloc_count = lib.PostProcessArenaAllocCount()
+    for _ in range(repeat):
+        dets = run_once()
+        assert np.array_equal(dets, first), "%s result changed between runs" % name
+    assert lib.PostProcessArenaAllocCount() == alloc_count, \
+        "%s allocated memory after warm up" % name
+    assert len(first) > 0, "%s produced no detections" % name
+    print("%-8s %4d dets, steady state allocation free" % (name, len(first)))
+
+def make_yolov5_outputs(rng, height=640, width=640):
+    num_pred = 3 * (80 + 4 + 1)
+    return [rng.normal(-4, 3, size=(1, height // s, width // s, num_pred)).astype(np.float32)
+            for s in (8, 16, 32)]
+
+def test_yolov5(lib, rng, top_k=100):
+    height = width = 640
+    arrays = make_yolov5_outputs(rng, height, width)
+    tensors = make_tensors(arrays)
+    info = make_info(height, width)
+
+    def run_once():
+        lib.Yolov5doProcessAll(tensors, len(arrays), ctypes.byref(info))
+        out = np.zeros(top_k, dtype=DETECTION_DTYPE)
+        num = lib.Yolov5PostProcessToArray(ctypes.byref(info),
+                                           out.ctypes.data_as(ctypes.c_void_p), top_k)
+        assert num >= 0, "Yolov5PostProcessToArray failed"
+        return out[:num]
+
+    check_steady_state(lib, "yolov5", run_once)
+
+def test_fcos(lib, rng, top_k=100):
+    height = width = 512
+    strides = (8, 16, 32, 64, 128)
+    cls = [rng.normal(-4, 3, size=(1, height // s, width // s, 80)).astype(np.float32)
+           for s in strides]
+    bbox = [rng.uniform(0, 4 * s, size=(1, height // s, width // s, 4)).astype(np.float32)
+            for s in strides]
+    ce = [rng.normal(-2, 3, size=(1, height // s, width // s, 1)).astype(np.float32)
+          for s in strides]
+    cls_tensors, bbox_tensors, ce_tensors = make_tensors(cls), make_tensors(bbox), make_tensors(ce)
+    info = make_info(height, width)
+
+    def run_once():
+        lib.FcosdoProcessAll(cls_tensors, bbox_tensors, ce_tensors, len(strides),
+                             ctypes.byref(info))
+        out = np.zeros(top_k, dtype=DETECTION_DTYPE)
+        num = lib.FcosPostProcessToArray(ctypes.byref(info),
+                                         out.ctypes.data_as(ctypes.c_void_p), top_k)
+        assert num >= 0, "FcosPostProcessToArray failed"
+        return out[:num]
+
+    check_steady_state(lib, "fcos", run_once)
+
+def test_ssd(lib, rng, top_k=100):
+    # ssd_mobilenetv1 300x300，每层每个位置 3/6 个先验框，20类加背景
+    height = width = 300
+    feature_sizes = (19, 10, 5, 3, 2, 1)
+    anchor_nums = (3, 6, 6, 6, 6, 6)
+    bbox = [rng.normal(0, 1, size=(1, f, f, a * 4)).astype(np.float32)
+            for f, a in zip(feature_sizes, anchor_nums)]
+    cls = [rng.normal(0, 3, size=(1, f, f, a * 21)).astype(np.float32)
+           for f, a in zip(feature_sizes, anchor_nums)]
+    bbox_tensors, cls_tensors = make_tensors(bbox), make_tensors(cls)
+    info = make_info(height, width)
+
+    def run_once():
+        for layer in range(len(feature_sizes)):
+            lib.SsddoProcess(ctypes.byref(bbox_tensors[layer]), ctypes.byref(cls_tensors[layer]),
+                             ctypes.byref(info), layer)
+        out = np.zeros(top_k, dtype=DETECTION_DTYPE)
+        num = lib.SsdPostProcessToArray(ctypes.byref(info),
+                                        out.ctypes.data_as(ctypes.c_void_p), top_k)
+        assert num >= 0, "SsdPostProcessToArray failed"
+        return out[:num]
+
+    check_steady_state(lib, "ssd", run_once)
+
+def test_efficientdet(lib, rng, top_k=100):
+    # EfficientDet-D0 512x512，每层每个位置 9 个先验框，80类
+    height = width = 512
+    strides = (8, 16, 32, 64, 128)
+    cls = [rng.normal(-4, 3, size=(1, height // s, width // s, 9 * 80)).astype(np.float32)
+           for s in strides]
+    bbox = [rng.normal(0, 1, size=(1, height // s, width // s, 9 * 4)).astype(np.float32)
+            for s in strides]
+    cls_tensors, bbox_tensors = make_tensors(cls), make_tensors(bbox)
+    info = make_info(height, width)
+
+    def run_once():
+        for layer in range(len(strides)):
+            lib.EfficientdetdoProcess(ctypes.byref(cls_tensors[layer]),
+                                      ctypes.byref(bbox_tensors[layer]),
+                                      ctypes.byref(info), layer)
+        out = np.zeros(top_k, dtype=DETECTION_DTYPE)
+        num = lib.EfficientdetPostProcessToArray(ctypes.byref(info),
+                                                 out.ctypes.data_as(ctypes.c_void_p), top_k)
+        assert num >= 0, "EfficientdetPostProcessToArray failed"
+        return out[:num]
+
+    check_steady_state(lib, "effdet", run_once)
+
+def test_yolov8_context(lib, rng, top_k=100):
+    # 默认上下文和新建上下文(都是 NMS_MODE_HARD)对同一输入的结果相同
+    height = width = 640
+    reg_max = 16
+    strides = (8, 16, 32)
+    cls = [rng.normal(-4, 3, size=(1, height // s, width // s, 80)).astype(np.float32)
+           for s in strides]
+    bbox = [rng.normal(0, 2, size=(1, height // s, width // s, 4 * reg_max)).astype(np.float32)
+            for s in strides]
+    cls_tensors, bbox_tensors = make_tensors(cls), make_tensors(bbox)
+    info = Yolov8PostProcessInfo(height, width, height, width, 0.3, 0.45, 100, 0, reg_max)
+
+    def run(ctx, cls_tensors, bbox_tensors):
+        for layer in range(len(strides)):
+            lib.Yolov8doProcessWithContext(ctx, ctypes.byref(cls_tensors[layer]),
+                                           ctypes.byref(bbox_tensors[layer]),
+                                           ctypes.byref(info), layer)
+        out = np.zeros(top_k, dtype=DETECTION_DTYPE)
+        num = lib.Yolov8PostProcessWithContextToArray(ctx, ctypes.byref(info),
+                                                      out.ctypes.data_as(ctypes.c_void_p), top_k)
+        assert num >= 0, "Yolov8PostProcessWithContextToArray failed"
+        return out[:num]
+
+    def run_default():
+        for layer in range(len(strides)):
+            lib.Yolov8doProcess(ctypes.byref(cls_tensors[layer]), ctypes.byref(bbox_tensors[layer]),
+                                ctypes.byref(info), layer)
+        out = np.zeros(top_k, dtype=DETECTION_DTYPE)
+        num = lib.Yolov8PostProcessToArray(ctypes.byref(info),
+                                           out.ctypes.data_as(ctypes.c_void_p), top_k)
+        return out[:num]
+
+    ctx = lib.Yolov8CreateContext()
+    assert ctx, "Yolov8CreateContext failed"
+    try:
+        expected = run_default()
+        assert len(expected) > 0, "yolov8 produced no detections"
+        assert np.array_equal(run(ctx, cls_tensors, bbox_tensors), expected), \
+            "yolov8 context result differs from default context"
+
+        # scaleLen 为0的量化输出不能读取 scaleData
+        quanti = [np.zeros(a.shape, dtype=np.int32) for a in cls + bbox]
+        quanti_tensors = make_tensors(quanti)
+        for tensor in quanti_tensors:
+            tensor.properties.tensorType = HB_DNN_TENSOR_TYPE_S32
+            tensor.properties.quantiType = QUANTI_TYPE_SCALE
+        num = len(strides)
+        assert len(run(ctx, quanti_tensors[:num], quanti_tensors[num:])) == 0, \
+            "yolov8 decoded quantized output without scale"
+    finally:
+        lib.Yolov8DestroyContext(ctx)
+    print("yolov8 context ok")
+
+def test_context_nms_mode(lib, rng, top_k=100):
+    # 上下文的NMS方式由 Yolov5SetNmsMode 设置，PostProcessSetNmsMode 只影响旧接口
+    # 所有候选框都是类别0，相邻网格的框互相重叠，不同NMS方式的结果不同
+    arrays = make_yolov5_outputs(rng)
+    for array in arrays:
+        pred = array.reshape(array.shape[:3] + (3, 85))
+        pred[..., :4] = rng.normal(0, 0.5, size=pred[..., :4].shape)
+        pred[..., 5:] = -8
+        pred[..., 5] = 8
+    tensors = make_tensors(arrays)
+    info = make_info(640, 640)
+
+    def run_default():
+        lib.Yolov5doProcessAll(tensors, len(arrays), ctypes.byref(info))
+        out = np.zeros(top_k, dtype=DETECTION_DTYPE)
+        num = lib.Yolov5PostProcessToArray(ctypes.byref(info),
+                                           out.ctypes.data_as(ctypes.c_void_p), top_k)
+        return out[:num]
+
+    def run_context(ctx):
+        lib.Yolov5doProcessAllWithContext(ctx, tensors, len(arrays), ctypes.byref(info))
+        out = np.zeros(top_k, dtype=DETECTION_DTYPE)
+        num = lib.Yolov5PostProcessWithContextToArray(ctx, ctypes.byref(info),
+                                                      out.ctypes.data_as(ctypes.c_void_p), top_k)
+        return out[:num]
+
+    ctx = lib.Yolov5CreateContext()
+    assert ctx, "Yolov5CreateContext failed"
+    try:
+        hard = run_default()
+        assert np.array_equal(run_context(ctx), hard), "new context should default to hard nms"
+
+        assert lib.PostProcessSetNmsMode(NMS_MODES["matrix"]) == 0
+        matrix = run_default()
+        assert not np.array_equal(matrix, hard), "process default nms mode not applied"
+        assert np.array_equal(run_context(ctx), hard), "process default changed a context's nms mode"
+
+        assert lib.PostProcessSetNmsMode(NMS_MODES["hard"]) == 0
+        assert lib.Yolov5SetNmsMode(ctx, NMS_MODES["matrix"]) == 0
+        assert np.array_equal(run_context(ctx), matrix), "context nms mode not applied"
+        assert np.array_equal(run_default(), hard), "context nms mode leaked to default context"
+        assert lib.Yolov5SetNmsMode(ctx, len(NMS_MODES)) == -1
+    finally:
+        lib.PostProcessSetNmsMode(NMS_MODES["hard"])
+        lib.Yolov5DestroyContext(ctx)
+    print("per context nms mode ok")
+
+CLASSIFICATION_DTYPE = np.dtype([("prob", np.float32), ("id", np.int32)])
+
+def test_classification(lib, rng, top_k=5):
+    logits = rng.normal(0, 2, size=(1, 1000)).astype(np.float32)
+    tensors = make_tensors([logits])
+    info = make_info(224, 224)
+    info.score_threshold = 0.0
+    info.nms_top_k = top_k
+
+    def run_once():
+        lib.ClassificationDoProcess(tensors, ctypes.byref(info))
+        out = np.zeros(top_k, dtype=CLASSIFICATION_DTYPE)
+        num = lib.ClassificationPostProcessToArray(ctypes.byref(info),
+                                                   out.ctypes.data_as(ctypes.c_void_p), top_k)
+        assert num >= 0, "ClassificationPostProcessToArray failed"
+        return out[:num]
+
+    expected_ids = np.argsort(-logits[0], kind="stable")[:top_k]
+    # 默认模型输出已经是概率，直接取top_k
+    result = run_once()
+    assert np.array_equal(result["id"], expected_ids), "classification top_k ids mismatch"
+    assert np.allclose(result["prob"], logits[0][expected_ids]), "classification probs changed"
+
+    # 模型输出为logits时先做softmax，只影响默认上下文
+    assert lib.ClassificationSetApplySoftmax(None, 1) == 0
+    exp = np.exp(logits[0].astype(np.float64) - logits[0].max())
+    softmax = exp / exp.sum()
+    result = run_once()
+    assert np.array_equal(result["id"], expected_ids), "softmax top_k ids mismatch"
+    assert np.allclose(result["prob"], softmax[expected_ids], rtol=1e-3), "softmax probs mismatch"
+    check_steady_state(lib, "cls", run_once)
+    lib.ClassificationSetApplySoftmax(None, 0)
+
+def same_result(a, b):
+    # 结果都按score从大到小排列，score相同的框顺序可能不同，按 (score, id, 坐标) 排序后比较
+    key = lambda d: np.sort(d, order=["score", "id", "xmin", "ymin", "xmax", "ymax"])
+    return len(a) == len(b) and np.array_equal(key(a), key(b))
+
+def test_nms_modes(lib, iou_threshold=0.45, score_threshold=0.25, top_k=300):
+    # 整数像素坐标在int16范围内，量化后没有误差，hard_int16 应与 hard 完全一致
+    dets = make_crowded_boxes(2000, 3, seed=1)
+    for field in ("xmin", "ymin", "xmax", "ymax"):
+        dets[field] = np.round(dets[field])
+    hard = run_nms(lib, dets, NMS_MODES["hard"], iou_threshold, score_threshold, top_k)
+    int16 = run_nms(lib, dets, NMS_MODES["hard_int16"], iou_threshold, score_threshold, top_k)
+    assert same_result(hard, int16), "hard_int16 differs from hard on integer boxes"
+
+    # 同类别的框互不重叠时没有框被抑制或衰减，所有方式都应与 hard 一致
+    num = 200
+    dets = np.zeros(num, dtype=DETECTION_DTYPE)
+    dets["xmin"] = (np.arange(num) % 20) * 50
+    dets["ymin"] = (np.arange(num) // 20) * 50
+    dets["xmax"] = dets["xmin"] + 40
+    dets["ymax"] = dets["ymin"] + 40
+    dets["score"] = np.linspace(0.3, 0.99, num)
+    dets["id"] = np.arange(num) % 3
+    hard = run_nms(lib, dets, NMS_MODES["hard"], iou_threshold, score_threshold, top_k)
+    assert len(hard) == num, "hard nms dropped non-overlapping boxes"
+    for name, mode in NMS_MODES.items():
+        result = run_nms(lib, dets, mode, iou_threshold, score_threshold, top_k)
+        assert same_result(hard, result), "%s differs from hard on disjoint boxes" % name
+
+    # 不同类别的框完全重合时互不抑制
+    dets = np.zeros(len(NMS_MODES), dtype=DETECTION_DTYPE)
+    dets["xmax"] = dets["ymax"] = 100
+    dets["score"] = 0.9
+    dets["id"] = np.arange(len(dets))
+    for name, mode in NMS_MODES.items():
+        result = run_nms(lib, dets, mode, iou_threshold, score_threshold, top_k)
+        assert len(result) == len(dets), "%s suppressed boxes across classes" % name
+
+    # 模型后处理使用的NMS方式：非法值不生效，默认是 hard
+    assert lib.PostProcessGetNmsMode() == NMS_MODES["hard"]
+    assert lib.PostProcessSetNmsMode(len(NMS_MODES)) == -1
+    assert lib.PostProcessGetNmsMode() == NMS_MODES["hard"]
+    for mode in NMS_MODES.values():
+        assert lib.PostProcessSetNmsMode(mode) == 0
+        assert lib.PostProcessGetNmsMode() == mode
+    lib.PostProcessSetNmsMode(NMS_MODES["hard"])
+    print("nms modes agree with hard")
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--lib", default="/usr/lib/libpostprocess.so")
+    args = parser.parse_args()
+
+    lib = ctypes.CDLL(args.lib)
+    lib.PostProcessArenaAllocCount.restype = ctypes.c_uint64
+    lib.PostProcessNmsDetections.restype = ctypes.c_int
+    lib.Yolov5PostProcessToArray.restype = ctypes.c_int
+    lib.Yolov5CreateContext.restype = ctypes.c_void_p
+    lib.Yolov5DestroyContext.argtypes = [ctypes.c_void_p]
+    lib.Yolov5SetNmsMode.argtypes = [ctypes.c_void_p, ctypes.c_int]
+    lib.Yolov5doProcessAllWithContext.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_int,
+                                                  ctypes.c_void_p]
+    lib.Yolov5PostProcessWithContextToArray.argtypes = [ctypes.c_void_p, ctypes.c_void_p,
+                                                        ctypes.c_void_p, ctypes.c_int]
+    lib.FcosPostProcessToArray.restype = ctypes.c_int
+    lib.ClassificationPostProcessToArray.restype = ctypes.c_int
+    lib.SsdPostProcessToArray.restype = ctypes.c_int
+    lib.Yolov8CreateContext.restype = ctypes.c_void_p
+    lib.Yolov8DestroyContext.argtypes = [ctypes.c_void_p]
+    lib.Yolov8doProcessWithContext.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_void_p,
+                                               ctypes.c_void_p, ctypes.c_int]
+    lib.Yolov8PostProcessWithContextToArray.argtypes = [ctypes.c_void_p, ctypes.c_void_p,
+                                                        ctypes.c_void_p, ctypes.c_int]
+    lib.EfficientdetPostProcessToArray.restype = ctypes.c_int
+
+    rng = np.random.default_rng(0)
+    test_nms_modes(lib)
+    test_yolov5(lib, rng)
+    test_fcos(lib, rng)
+    test_ssd(lib, rng)
+    test_efficientdet(lib, rng)
+    test_classification(lib, rng)
+    test_context_nms_mode(lib, rng)
+    test_yolov8_context(lib, rng)
+    print("all post process checks passed")
+
+if __name__ == "__main__":
+    main()